@@ -5,53 +5,485 @@ a copyright and/or license notice that predates the release of Sqliteman
 for which a new license (GPL+exception) is in place.
 */
 
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QMessageBox>
 #include <QSettings>
+#include <QSqlQuery>
 
 #include "analyzedialog.h"
 #include "database.h"
+#include "regexp.h"
 #include "utils.h"
 
-AnalyzeDialog::AnalyzeDialog(QWidget * parent)
-	: QDialog(parent)
+// statsTree columns
+#define COL_TABLE 0
+#define COL_ROWS 1
+#define COL_STAT_ROWS 2
+#define COL_DRIFT 3
+#define COL_ANALYZED 4
+#define COL_SAMPLES 5
+
+
+AnalyzeThread::AnalyzeThread(const QString & fileName, sqlite3 * connection,
+							 const QStringList & tables, bool analyze,
+							 int analysisLimit, QObject * parent)
+	: QThread(parent),
+	  m_fileName(fileName),
+	  m_connection(connection),
+	  m_tables(tables),
+	  m_analyze(analyze),
+	  m_analysisLimit(analysisLimit),
+	  m_cancelled(false)
+{
+}
+
+void AnalyzeThread::cancel()
+{
+	m_cancelled = true;
+}
+
+int AnalyzeThread::progressHandler(void * thread)
+{
+	// non-zero interrupts the statement
+	return static_cast<AnalyzeThread*>(thread)->m_cancelled ? 1 : 0;
+}
+
+void AnalyzeThread::run()
+{
+	sqlite3 * db = m_connection;
+	if (!db)
+	{
+		QByteArray name(QDir::toNativeSeparators(m_fileName).toUtf8());
+		int flags = m_analyze ? SQLITE_OPEN_READWRITE : SQLITE_OPEN_READONLY;
+		if (sqlite3_open_v2(name.constData(), &db, flags, 0) != SQLITE_OK)
+		{
+			m_error = QString::fromUtf8(sqlite3_errmsg(db));
+			sqlite3_close(db);
+			return;
+		}
+		sqlite3_busy_timeout(db, 5000);
+		// partial and expression indexes may use REGEXP
+		Regexp::install(db);
+	}
+
+	// older libraries ignore the unknown pragma
+	if (m_analyze && m_analysisLimit > 0)
+		sqlite3_exec(db, QString("PRAGMA analysis_limit = %1;")
+						 .arg(m_analysisLimit).toUtf8().constData(), 0, 0, 0);
+	sqlite3_progress_handler(db, 1000, AnalyzeThread::progressHandler, this);
+
+	foreach (QString table, m_tables)
+	{
+		if (m_cancelled || !process(db, table))
+			break;
+	}
+
+	sqlite3_progress_handler(db, 0, 0, 0);
+	if (db == m_connection)
+	{
+		if (m_analyze && m_analysisLimit > 0)
+			sqlite3_exec(db, "PRAGMA analysis_limit = 0;", 0, 0, 0);
+	}
+	else
+		sqlite3_close(db);
+}
+
+bool AnalyzeThread::process(sqlite3 * db, const QString & table)
+{
+	QString sql(m_analyze ? "ANALYZE main.%1;" : "SELECT count(*) FROM main.%1;");
+	QByteArray utf(sql.arg(Utils::quote(table)).toUtf8());
+	qlonglong rows = -1;
+
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(db, utf.constData(), -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		rc = sqlite3_step(stmt);
+		if (rc == SQLITE_ROW)
+		{
+			rows = sqlite3_column_int64(stmt, 0);
+			rc = SQLITE_DONE;
+		}
+	}
+	if (rc != SQLITE_DONE && !m_cancelled)
+		m_error = QString("%1: %2").arg(table)
+				  .arg(QString::fromUtf8(sqlite3_errmsg(db)));
+	sqlite3_finalize(stmt);
+	if (rc != SQLITE_DONE)
+		return false;
+
+	emit tableDone(table, rows);
+	return true;
+}
+
+
+AnalyzeDialog::AnalyzeDialog(const QString & fileName, QWidget * parent)
+	: QDialog(parent),
+	  m_fileName(fileName),
+	  m_thread(0),
+	  m_analyzing(false),
+	  m_tableCount(0),
+	  m_tablesDone(0)
 {
 	ui.setupUi(this);
 	QSettings settings("yarpen.cz", "sqliteman");
 	int hh = settings.value("analyze/height", QVariant(500)).toInt();
 	int ww = settings.value("analyze/width", QVariant(600)).toInt();
 	resize(ww, hh);
+	ui.limitSpinBox->setValue(settings.value("analyze/limit", QVariant(0)).toInt());
+	ui.thresholdSpinBox->setValue(settings.value("analyze/threshold",
+										QVariant(ui.thresholdSpinBox->value())).toInt());
+	ui.optimizeCheckBox->setChecked(settings.value("analyze/optimize",
+										QVariant(false)).toBool());
+
+	if (!hasAnalysisLimit())
+	{
+		ui.limitSpinBox->setEnabled(false);
+		ui.limitSpinBox->setToolTip(tr("PRAGMA analysis_limit needs sqlite 3.32 or newer"));
+	}
+	if (sqlite3_libversion_number() < 3018000)
+	{
+		ui.optimizeCheckBox->setEnabled(false);
+		ui.optimizeCheckBox->setToolTip(tr("PRAGMA optimize needs sqlite 3.18 or newer"));
+	}
 
-	ui.tableList->addItems(Database::getObjects("table").keys());
+	foreach (QString table, Database::getObjects("table").keys())
+	{
+		QTreeWidgetItem * item = new QTreeWidgetItem(ui.statsTree);
+		item->setText(COL_TABLE, table);
+	}
+	readStats();
+	ui.statsTree->sortItems(COL_TABLE, Qt::AscendingOrder);
+	for (int i = 0; i < ui.statsTree->columnCount(); ++i)
+		ui.statsTree->resizeColumnToContents(i);
+	setRunning(false);
 
 	connect(ui.dropButton, SIGNAL(clicked()), this, SLOT(dropButton_clicked()));
 	connect(ui.allButton, SIGNAL(clicked()), this, SLOT(allButton_clicked()));
 	connect(ui.tableButton, SIGNAL(clicked()), this, SLOT(tableButton_clicked()));
+	connect(ui.countButton, SIGNAL(clicked()), this, SLOT(countButton_clicked()));
+	connect(ui.staleButton, SIGNAL(clicked()), this, SLOT(staleButton_clicked()));
+	connect(ui.cancelButton, SIGNAL(clicked()), this, SLOT(cancelButton_clicked()));
 }
 
 AnalyzeDialog::~AnalyzeDialog()
 {
+	if (m_thread)
+	{
+		m_thread->cancel();
+		m_thread->wait();
+	}
 	QSettings settings("yarpen.cz", "sqliteman");
     settings.setValue("analyze/height", QVariant(height()));
     settings.setValue("analyze/width", QVariant(width()));
+	settings.setValue("analyze/limit", QVariant(ui.limitSpinBox->value()));
+	settings.setValue("analyze/threshold", QVariant(ui.thresholdSpinBox->value()));
+	settings.setValue("analyze/optimize", QVariant(ui.optimizeCheckBox->isChecked()));
+}
+
+void AnalyzeDialog::optimizeOnClose()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	if (!settings.value("analyze/optimize", QVariant(false)).toBool())
+		return;
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME, false));
+	if (!db.isOpen())
+		return;
+
+	QSqlQuery query(db);
+	// keep closing fast on huge tables
+	int limit = settings.value("analyze/limit", QVariant(0)).toInt();
+	if (limit > 0 && hasAnalysisLimit())
+		query.exec(QString("PRAGMA analysis_limit = %1;").arg(limit));
+	query.exec("PRAGMA optimize;");
+}
+
+bool AnalyzeDialog::hasAnalysisLimit()
+{
+	return sqlite3_libversion_number() >= 3032000;
+}
+
+QVariantMap AnalyzeDialog::analyzeTimes()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	QVariantMap files = settings.value("analyze/files").toMap();
+	return files.value(QFileInfo(m_fileName).absoluteFilePath()).toMap();
+}
+
+void AnalyzeDialog::setAnalyzeTimes(const QVariantMap & times)
+{
+	// nothing to remember for in-memory databases
+	if (!QFileInfo(m_fileName).isFile())
+		return;
+	QSettings settings("yarpen.cz", "sqliteman");
+	QVariantMap files = settings.value("analyze/files").toMap();
+	QString path(QFileInfo(m_fileName).absoluteFilePath());
+	if (times.isEmpty())
+		files.remove(path);
+	else
+		files[path] = times;
+	settings.setValue("analyze/files", files);
+}
+
+void AnalyzeDialog::readStats()
+{
+	QStringList statTables;
+	ForwardQuery query(
+			"select name from main.sqlite_master where type = 'table' "
+			"and name in ('sqlite_stat1', 'sqlite_stat4');");
+	while (query.next())
+		statTables.append(query.value(0).toString());
+
+	QMap<QString,qlonglong> statRows;
+	if (statTables.contains("sqlite_stat1"))
+	{
+		// stat starts with the row count of the table
+		ForwardQuery stat(
+				"select tbl, max(cast(stat as integer)) "
+				"from main.sqlite_stat1 group by tbl;");
+		while (stat.next())
+			statRows[stat.value(0).toString()] = stat.value(1).toLongLong();
+	}
+	QMap<QString,qlonglong> samples;
+	if (statTables.contains("sqlite_stat4"))
+	{
+		ForwardQuery stat(
+				"select tbl, count(*) from main.sqlite_stat4 group by tbl;");
+		while (stat.next())
+			samples[stat.value(0).toString()] = stat.value(1).toLongLong();
+	}
+	QVariantMap times(analyzeTimes());
+
+	for (int i = 0; i < ui.statsTree->topLevelItemCount(); ++i)
+	{
+		QTreeWidgetItem * item = ui.statsTree->topLevelItem(i);
+		QString table(item->text(COL_TABLE));
+		item->setData(COL_STAT_ROWS, Qt::DisplayRole,
+					  statRows.contains(table) ? QVariant(statRows[table]) : QVariant());
+		item->setData(COL_SAMPLES, Qt::DisplayRole,
+					  samples.contains(table) ? QVariant(samples[table]) : QVariant());
+		item->setData(COL_ANALYZED, Qt::DisplayRole,
+					  times.contains(table) ? QVariant(times[table].toDateTime()) : QVariant());
+		updateDrift(item);
+	}
+}
+
+void AnalyzeDialog::updateDrift(QTreeWidgetItem * item)
+{
+	QVariant rows(item->data(COL_ROWS, Qt::DisplayRole));
+	QVariant statRows(item->data(COL_STAT_ROWS, Qt::DisplayRole));
+	if (!rows.isValid() || !statRows.isValid())
+	{
+		item->setData(COL_DRIFT, Qt::DisplayRole, QVariant());
+		return;
+	}
+	qlonglong current = rows.toLongLong();
+	qlonglong analyzed = statRows.toLongLong();
+	double drift = 100.0 * qAbs(current - analyzed) / qMax(analyzed, (qlonglong)1);
+	item->setData(COL_DRIFT, Qt::DisplayRole, qRound(drift * 10) / 10.0);
+}
+
+QStringList AnalyzeDialog::selectedTables()
+{
+	QStringList tables;
+	foreach (QTreeWidgetItem * item, ui.statsTree->selectedItems())
+		tables.append(item->text(COL_TABLE));
+	return tables;
+}
+
+void AnalyzeDialog::setRunning(bool running)
+{
+	ui.statsTree->setEnabled(!running);
+	ui.countButton->setEnabled(!running);
+	ui.staleButton->setEnabled(!running);
+	ui.tableButton->setEnabled(!running);
+	ui.allButton->setEnabled(!running);
+	ui.dropButton->setEnabled(!running);
+	ui.optionsGroupBox->setEnabled(!running);
+	ui.cancelButton->setEnabled(running);
+}
+
+void AnalyzeDialog::start(const QStringList & tables, bool analyze)
+{
+	if (tables.isEmpty())
+		return;
+	// in-memory databases have no file for the own connection
+	sqlite3 * connection = 0;
+	if (!QFileInfo(m_fileName).isFile())
+	{
+		connection = Database::sqlite3handle();
+		if (!connection)
+			return;
+	}
+
+	if (analyze)
+		emit aboutToAnalyze();
+
+	m_analyzing = analyze;
+	m_tableCount = tables.count();
+	m_tablesDone = 0;
+	m_thread = new AnalyzeThread(m_fileName, connection, tables, analyze,
+								 hasAnalysisLimit() ? ui.limitSpinBox->value() : 0,
+								 this);
+	connect(m_thread, SIGNAL(tableDone(const QString &, qlonglong)),
+			this, SLOT(thread_tableDone(const QString &, qlonglong)));
+	connect(m_thread, SIGNAL(finished()),
+			this, SLOT(thread_finished()));
+
+	ui.progressBar->setMaximum(m_tableCount);
+	ui.progressBar->setValue(0);
+	ui.statusLabel->setText(analyze ? tr("Analyzing...") : tr("Counting rows..."));
+	setRunning(true);
+	m_time.start();
+	m_thread->start();
 }
 
 void AnalyzeDialog::dropButton_clicked()
 {
-	Database::execSql("delete from sqlite_stat1;");
+	QStringList statTables;
+	ForwardQuery query(
+			"select name from main.sqlite_master where type = 'table' "
+			"and name like 'sqlite@_stat%' escape '@';");
+	while (query.next())
+		statTables.append(query.value(0).toString());
+
+	foreach (QString table, statTables)
+	{
+		if (!Database::execSql(QString("delete from main.%1;").arg(table)))
+			return;
+	}
+	// the main connection forgets the dropped statistics
+	if (!statTables.isEmpty())
+		Database::execSql("analyze sqlite_master;");
+	setAnalyzeTimes(QVariantMap());
+	readStats();
 }
 
 void AnalyzeDialog::allButton_clicked()
 {
-	Database::execSql("analyze;");
+	QStringList tables;
+	for (int i = 0; i < ui.statsTree->topLevelItemCount(); ++i)
+		tables.append(ui.statsTree->topLevelItem(i)->text(COL_TABLE));
+	start(tables, true);
 }
 
 void AnalyzeDialog::tableButton_clicked()
 {
-	QList<QListWidgetItem *> list(ui.tableList->selectedItems());
-	for (int i = 0; i < list.size(); ++i)
+	start(selectedTables(), true);
+}
+
+void AnalyzeDialog::countButton_clicked()
+{
+	QStringList tables(selectedTables());
+	if (tables.isEmpty())
 	{
-		if (!Database::execSql(QString("analyze %1;")
-							   .arg(Utils::quote(list.at(i)->text()))))
-			break;
+		for (int i = 0; i < ui.statsTree->topLevelItemCount(); ++i)
+			tables.append(ui.statsTree->topLevelItem(i)->text(COL_TABLE));
+	}
+	start(tables, false);
+}
+
+void AnalyzeDialog::staleButton_clicked()
+{
+	double threshold = ui.thresholdSpinBox->value();
+	ui.statsTree->clearSelection();
+	for (int i = 0; i < ui.statsTree->topLevelItemCount(); ++i)
+	{
+		QTreeWidgetItem * item = ui.statsTree->topLevelItem(i);
+		QVariant drift(item->data(COL_DRIFT, Qt::DisplayRole));
+		if (!item->data(COL_STAT_ROWS, Qt::DisplayRole).isValid()
+			|| (drift.isValid() && drift.toDouble() >= threshold))
+			item->setSelected(true);
+	}
+}
+
+void AnalyzeDialog::cancelButton_clicked()
+{
+	if (m_thread)
+		m_thread->cancel();
+}
+
+void AnalyzeDialog::thread_tableDone(const QString & table, qlonglong rows)
+{
+	if (!m_thread)
+		return;
+	++m_tablesDone;
+	ui.progressBar->setValue(m_tablesDone);
+	ui.statusLabel->setText(tr("%1 of %2 tables, %3 s")
+							.arg(m_tablesDone).arg(m_tableCount)
+							.arg(m_time.elapsed() / 1000.0, 0, 'f', 1));
+
+	QDateTime now(QDateTime::currentDateTime());
+	if (m_analyzing)
+	{
+		QVariantMap times(analyzeTimes());
+		times[table] = now;
+		setAnalyzeTimes(times);
+	}
+	foreach (QTreeWidgetItem * item,
+			 ui.statsTree->findItems(table, Qt::MatchExactly, COL_TABLE))
+	{
+		if (m_analyzing)
+			item->setData(COL_ANALYZED, Qt::DisplayRole, now);
+		else
+		{
+			item->setData(COL_ROWS, Qt::DisplayRole, rows);
+			updateDrift(item);
+		}
 	}
 }
 
+void AnalyzeDialog::thread_finished()
+{
+	// already handled by reject()
+	if (!m_thread)
+		return;
+	QString error(m_thread->error());
+	bool cancelled = m_thread->isCancelled();
+	m_thread->deleteLater();
+	m_thread = 0;
+	setRunning(false);
+
+	if (m_analyzing && m_tablesDone > 0)
+	{
+		// the statistics were written by another connection
+		Database::execSql("analyze sqlite_master;");
+		readStats();
+	}
+
+	if (!error.isEmpty())
+	{
+		ui.statusLabel->setText(tr("Error while computing statistics")
+								+ ":<br/><span style=\" color:#ff0000;\">"
+								+ error + "<br/></span>");
+		return;
+	}
+	QString seconds(QString::number(m_time.elapsed() / 1000.0, 'f', 1));
+	if (cancelled)
+		ui.statusLabel->setText(tr("Stopped. %1 of %2 tables done.")
+								.arg(m_tablesDone).arg(m_tableCount));
+	else if (m_analyzing)
+		ui.statusLabel->setText(tr("%1 tables analyzed in %2 s.")
+								.arg(m_tablesDone).arg(seconds));
+	else
+		ui.statusLabel->setText(tr("Rows of %1 tables counted in %2 s.")
+								.arg(m_tablesDone).arg(seconds));
+}
+
+void AnalyzeDialog::reject()
+{
+	if (m_thread)
+	{
+		int ret = QMessageBox::question(this, windowTitle(),
+						tr("The statistics are still computed. Do you want to stop it?"),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+		m_thread->cancel();
+		m_thread->wait();
+		thread_finished();
+	}
+	QDialog::reject();
+}
@@ -9,12 +9,71 @@ for which a new license (GPL+exception) is in place.
 #define ANALYZEDIALOG_H
 
 #include <qdialog.h>
+#include <QStringList>
+#include <QThread>
+#include <QTime>
 
+#include "sqlite3.h"
 #include "ui_analyzedialog.h"
 
 
+/*! \brief ANALYZE or count rows of tables one by one out of the GUI thread.
+It uses its own connection to the database file so the statistics are
+computed while the main connection stays usable.
+*/
+class AnalyzeThread : public QThread
+{
+	Q_OBJECT
+
+	public:
+		/*!
+		\param fileName the main database file
+		\param connection an open connection to use when fileName
+		       is not a file (in-memory databases)
+		\param tables the tables to process
+		\param analyze true runs ANALYZE, false counts the rows
+		\param analysisLimit PRAGMA analysis_limit, 0 for no limit
+		\param parent standard Qt parent
+		*/
+		AnalyzeThread(const QString & fileName, sqlite3 * connection,
+					  const QStringList & tables, bool analyze,
+					  int analysisLimit, QObject * parent = 0);
+
+		//! \brief An error message, empty on success or when cancelled.
+		QString error() const { return m_error; };
+		bool isCancelled() const { return m_cancelled; };
+
+	public slots:
+		//! \brief Stop the current statement. Done tables are kept.
+		void cancel();
+
+	signals:
+		//! \brief rows is the row count, -1 when the table has been analyzed.
+		void tableDone(const QString & table, qlonglong rows);
+
+	protected:
+		void run();
+
+	private:
+		QString m_fileName;
+		sqlite3 * m_connection;
+		QStringList m_tables;
+		bool m_analyze;
+		int m_analysisLimit;
+		QString m_error;
+		volatile bool m_cancelled;
+
+		static int progressHandler(void * thread);
+		bool process(sqlite3 * db, const QString & table);
+};
+
+
 /*! \brief Handle DB statistics here.
 Sqlite3 offers simple statistics for its internal SQL optimizer.
+The dialog shows the rows counted by the last ANALYZE for every table
+(sqlite_stat1), the stat4 samples, and when Sqliteman analyzed it.
+Counting the rows of the tables again shows how stale the statistics
+are. ANALYZE and the counting run in an AnalyzeThread.
 \author Petr Vanek <petr@scribus.info>
  */
 class AnalyzeDialog : public QDialog
@@ -22,16 +81,54 @@ class AnalyzeDialog : public QDialog
 	Q_OBJECT
 
 	public:
-		AnalyzeDialog(QWidget * parent = 0);
+		/*!
+		\param fileName the main database file; the time of ANALYZE
+		       is remembered for it
+		\param parent standard Qt parent
+		*/
+		AnalyzeDialog(const QString & fileName, QWidget * parent = 0);
 		~AnalyzeDialog();
 
+		/*! \brief Run PRAGMA optimize if it is enabled in the dialog.
+		It is called before the main database is closed.
+		*/
+		static void optimizeOnClose();
+
+	signals:
+		//! \brief Emitted before ANALYZE. Open statements would block its commit.
+		void aboutToAnalyze();
+
 	private:
 		Ui::AnalyzeDialog ui;
+		QString m_fileName;
+		AnalyzeThread * m_thread;
+		bool m_analyzing;
+		int m_tableCount;
+		int m_tablesDone;
+		QTime m_time;
+
+		//! \brief PRAGMA analysis_limit needs sqlite 3.32
+		static bool hasAnalysisLimit();
+		//! \brief Table name -> time of its last ANALYZE by Sqliteman
+		QVariantMap analyzeTimes();
+		void setAnalyzeTimes(const QVariantMap & times);
+		//! \brief Fill the table statistics from sqlite_stat1 and sqlite_stat4.
+		void readStats();
+		void updateDrift(QTreeWidgetItem * item);
+		QStringList selectedTables();
+		void setRunning(bool running);
+		void start(const QStringList & tables, bool analyze);
 
     private slots:
 		void dropButton_clicked();
 		void allButton_clicked();
 		void tableButton_clicked();
+		void countButton_clicked();
+		void staleButton_clicked();
+		void cancelButton_clicked();
+		void thread_tableDone(const QString & table, qlonglong rows);
+		void thread_finished();
+		void reject();
 };
 
 #endif
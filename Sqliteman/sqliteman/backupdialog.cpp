@@ -0,0 +1,270 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QDir>
+#include <QFile>
+#include <QFileDialog>
+#include <QMessageBox>
+
+#include "backupdialog.h"
+#include "database.h"
+
+
+BackupThread::BackupThread(sqlite3 * connection, const QString & fileName,
+						   bool restore, int pagesPerStep, int pause,
+						   QObject * parent)
+	: QThread(parent),
+	  m_connection(connection),
+	  m_fileName(fileName),
+	  m_restore(restore),
+	  m_pagesPerStep(pagesPerStep),
+	  m_pause(pause),
+	  m_pageSize(0),
+	  m_cancelled(false)
+{
+}
+
+void BackupThread::cancel()
+{
+	m_cancelled = true;
+}
+
+void BackupThread::run()
+{
+	sqlite3 * file = 0;
+	QByteArray name(QDir::toNativeSeparators(m_fileName).toUtf8());
+	int flags = m_restore
+				? SQLITE_OPEN_READONLY
+				: (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+	if (sqlite3_open_v2(name.constData(), &file, flags, 0) != SQLITE_OK)
+	{
+		m_error = QString::fromUtf8(sqlite3_errmsg(file));
+		sqlite3_close(file);
+		return;
+	}
+	sqlite3 * source = m_restore ? file : m_connection;
+	sqlite3 * target = m_restore ? m_connection : file;
+
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(source, "PRAGMA main.page_size;", -1, &stmt, 0) == SQLITE_OK
+		&& sqlite3_step(stmt) == SQLITE_ROW)
+		m_pageSize = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+
+	sqlite3_backup * backup = sqlite3_backup_init(target, "main", source, "main");
+	if (!backup)
+	{
+		m_error = QString::fromUtf8(sqlite3_errmsg(target));
+		sqlite3_close(file);
+		return;
+	}
+
+	int rc;
+	do
+	{
+		rc = sqlite3_backup_step(backup, m_pagesPerStep);
+		emit progress(sqlite3_backup_remaining(backup),
+					  sqlite3_backup_pagecount(backup));
+		// let the writers in; a busy source is retried after the pause
+		if (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED)
+			msleep(m_pause);
+	}
+	while (!m_cancelled && (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED));
+
+	// stopped too late, the copy is complete
+	if (rc == SQLITE_DONE)
+		m_cancelled = false;
+	// an unfinished copy is rolled back here
+	sqlite3_backup_finish(backup);
+	if (!m_cancelled && rc != SQLITE_DONE)
+		m_error = QString::fromUtf8(sqlite3_errstr(rc));
+	sqlite3_close(file);
+}
+
+
+BackupDialog::BackupDialog(QWidget * parent)
+	: QDialog(parent),
+	  update(false),
+	  m_thread(0),
+	  m_targetExisted(false)
+{
+	setupUi(this);
+	setRunning(false);
+	startButton->setEnabled(false);
+
+	connect(browseButton, SIGNAL(clicked()),
+			this, SLOT(browseButton_clicked()));
+	connect(startButton, SIGNAL(clicked()),
+			this, SLOT(startButton_clicked()));
+	connect(cancelButton, SIGNAL(clicked()),
+			this, SLOT(cancelButton_clicked()));
+	connect(fileEdit, SIGNAL(textChanged(const QString &)),
+			this, SLOT(fileEdit_textChanged(const QString &)));
+}
+
+BackupDialog::~BackupDialog()
+{
+	if (m_thread)
+	{
+		m_thread->cancel();
+		m_thread->wait();
+	}
+}
+
+void BackupDialog::setRunning(bool running)
+{
+	operationGroupBox->setEnabled(!running);
+	fileEdit->setEnabled(!running);
+	browseButton->setEnabled(!running);
+	pagesSpinBox->setEnabled(!running);
+	pauseSpinBox->setEnabled(!running);
+	startButton->setEnabled(!running);
+	cancelButton->setEnabled(running);
+}
+
+void BackupDialog::browseButton_clicked()
+{
+	QString fileName;
+	if (restoreRadioButton->isChecked())
+		fileName = QFileDialog::getOpenFileName(this, tr("Restore from"),
+												QDir::currentPath(),
+												tr("SQLite database (*)"));
+	else
+		fileName = QFileDialog::getSaveFileName(this, tr("Back up into"),
+												QDir::currentPath(),
+												tr("SQLite database (*)"));
+	if (!fileName.isNull())
+		fileEdit->setText(fileName);
+}
+
+void BackupDialog::fileEdit_textChanged(const QString & text)
+{
+	startButton->setEnabled(!text.trimmed().isEmpty());
+}
+
+void BackupDialog::startButton_clicked()
+{
+	QString fileName(fileEdit->text().trimmed());
+	bool restore = restoreRadioButton->isChecked();
+	m_targetExisted = QFile::exists(fileName);
+
+	if (restore)
+	{
+		if (!m_targetExisted)
+		{
+			statusLabel->setText(tr("File %1 does not exist.").arg(fileName));
+			return;
+		}
+		int ret = QMessageBox::question(this, tr("Restore Database"),
+						tr("The content of the main database will be replaced "
+						   "by the content of %1.\n\nDo you want to continue?")
+						.arg(fileName),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+		emit aboutToRestore();
+	}
+	else if (m_targetExisted)
+	{
+		int ret = QMessageBox::question(this, tr("Back up Database"),
+						tr("File %1 will be overwritten.\n\nDo you want to continue?")
+						.arg(fileName),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+	}
+
+	sqlite3 * connection = Database::sqlite3handle();
+	if (!connection)
+		return;
+
+	m_thread = new BackupThread(connection, fileName, restore,
+								pagesSpinBox->value(), pauseSpinBox->value(),
+								this);
+	connect(m_thread, SIGNAL(progress(int, int)),
+			this, SLOT(thread_progress(int, int)));
+	connect(m_thread, SIGNAL(finished()),
+			this, SLOT(thread_finished()));
+
+	progressBar->setValue(0);
+	statusLabel->setText(restore ? tr("Restoring...") : tr("Backing up..."));
+	setRunning(true);
+	m_time.start();
+	m_thread->start();
+}
+
+void BackupDialog::cancelButton_clicked()
+{
+	if (m_thread)
+		m_thread->cancel();
+}
+
+void BackupDialog::thread_progress(int remaining, int pageCount)
+{
+	if (!m_thread)
+		return;
+	progressBar->setMaximum(qMax(pageCount, 1));
+	progressBar->setValue(pageCount - remaining);
+
+	double seconds = m_time.elapsed() / 1000.0;
+	double bytes = (double)(pageCount - remaining) * m_thread->pageSize();
+	QString speed;
+	if (seconds > 0)
+		speed = QString::number(bytes / seconds / (1024 * 1024), 'f', 1);
+	else
+		speed = "-";
+	statusLabel->setText(tr("%1 of %2 pages remaining, %3 MB/s")
+						 .arg(remaining).arg(pageCount).arg(speed));
+}
+
+void BackupDialog::thread_finished()
+{
+	// already handled by reject()
+	if (!m_thread)
+		return;
+	bool restore = restoreRadioButton->isChecked();
+	QString error(m_thread->error());
+	bool cancelled = m_thread->isCancelled();
+	m_thread->deleteLater();
+	m_thread = 0;
+	setRunning(false);
+
+	if (!error.isEmpty() || cancelled)
+	{
+		// the partial copy is rolled back; no empty file is left behind
+		if (!restore && !m_targetExisted)
+			QFile::remove(fileEdit->text().trimmed());
+		if (cancelled)
+			statusLabel->setText(tr("Cancelled. Nothing has been changed."));
+		else
+			statusLabel->setText(tr("Error while copying the database")
+								 + ":<br/><span style=\" color:#ff0000;\">"
+								 + error + "<br/></span>");
+		return;
+	}
+
+	statusLabel->setText((restore ? tr("Restored in %1 s.") : tr("Backed up in %1 s."))
+						 .arg(m_time.elapsed() / 1000.0, 0, 'f', 1));
+	if (restore)
+		update = true;
+}
+
+void BackupDialog::reject()
+{
+	if (m_thread)
+	{
+		int ret = QMessageBox::question(this, windowTitle(),
+						tr("The copy is still running. Do you want to stop it?"),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+		m_thread->cancel();
+		m_thread->wait();
+		thread_finished();
+	}
+	QDialog::reject();
+}
@@ -0,0 +1,109 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef BACKUPDIALOG_H
+#define BACKUPDIALOG_H
+
+#include <QDialog>
+#include <QThread>
+#include <QTime>
+
+#include "sqlite3.h"
+#include "ui_backupdialog.h"
+
+
+/*! \brief A sqlite3_backup copy running out of the GUI thread.
+The open connection is copied page by page into a file (backup) or
+a file is copied into the open connection (restore). After every step
+of pagesPerStep pages the thread sleeps for pause ms so other
+connections can take the locks in the meantime.
+*/
+class BackupThread : public QThread
+{
+	Q_OBJECT
+
+	public:
+		/*! \brief Prepare a copy. It is started by start().
+		\param connection the open connection ("main" is copied)
+		\param fileName the other database file
+		\param restore true copies fileName into the connection,
+		       false copies the connection into fileName
+		\param pagesPerStep pages copied in one sqlite3_backup_step()
+		\param pause ms to sleep between the steps
+		\param parent standard Qt parent
+		*/
+		BackupThread(sqlite3 * connection, const QString & fileName,
+					 bool restore, int pagesPerStep, int pause,
+					 QObject * parent = 0);
+
+		//! \brief An error message, empty on success or when cancelled.
+		QString error() const { return m_error; };
+		bool isCancelled() const { return m_cancelled; };
+		//! \brief Page size of the source database (valid after the first progress).
+		int pageSize() const { return m_pageSize; };
+
+	public slots:
+		//! \brief Stop after the current step. The target is left untouched.
+		void cancel();
+
+	signals:
+		void progress(int remaining, int pageCount);
+
+	protected:
+		void run();
+
+	private:
+		sqlite3 * m_connection;
+		QString m_fileName;
+		bool m_restore;
+		int m_pagesPerStep;
+		int m_pause;
+		int m_pageSize;
+		QString m_error;
+		volatile bool m_cancelled;
+};
+
+
+/*! \brief Binary backup and restore of the main database.
+It uses the sqlite3 online backup API in a BackupThread so the database
+stays usable while it is copied. Restore replaces the content of the
+main database of the open connection.
+*/
+class BackupDialog : public QDialog, public Ui::BackupDialog
+{
+	Q_OBJECT
+
+	public:
+		BackupDialog(QWidget * parent = 0);
+		~BackupDialog();
+
+		//! \brief True when the main database has been restored.
+		bool update;
+
+	signals:
+		//! \brief Emitted before a restore. Open statements would block it.
+		void aboutToRestore();
+
+	private:
+		BackupThread * m_thread;
+		QTime m_time;
+		//! \brief The backup target existed before.
+		bool m_targetExisted;
+
+		void setRunning(bool running);
+
+	private slots:
+		void browseButton_clicked();
+		void startButton_clicked();
+		void cancelButton_clicked();
+		void fileEdit_textChanged(const QString & text);
+		void thread_progress(int remaining, int pageCount);
+		void thread_finished();
+		void reject();
+};
+
+#endif
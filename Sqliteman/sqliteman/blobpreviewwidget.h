@@ -30,11 +30,6 @@ class BlobPreviewWidget : public QWidget, public Ui::BlobPreviewWidget
 
 		void resizeEvent(QResizeEvent * event);
 		void createPreview();
-
-		/*! \brief Format m_data size to the human readable form.
-		It's taken from FatRat http://fatrat.dolezel.info/. Cheers!
-		*/
-		QString formatSize(qulonglong size/*, bool persec*/);
 };
 
 #endif
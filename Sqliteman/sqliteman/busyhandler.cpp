@@ -0,0 +1,101 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QMap>
+#include <QMutex>
+#include <QSettings>
+
+#include "busyhandler.h"
+
+
+// the handler runs in the thread of the blocked statement
+static QMutex s_mutex;
+static BusyHandler::Policy s_policy = { 5000, 5, 250 };
+static BusyHandler::Stats s_stats = { 0, 0, 0, 0, 0 };
+//! \brief Connection -> ms waited in its current contention
+static QMap<void*,qlonglong> s_waited;
+
+
+void BusyHandler::install(sqlite3 * db)
+{
+	if (!db)
+		return;
+	Policy p(policy());
+	s_mutex.lock();
+	s_policy = p;
+	s_mutex.unlock();
+	sqlite3_busy_handler(db, BusyHandler::handler, db);
+}
+
+BusyHandler::Policy BusyHandler::policy()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	Policy p;
+	p.timeout = settings.value("busy/timeout", QVariant(5000)).toInt();
+	p.initialDelay = qMax(1, settings.value("busy/initialDelay", QVariant(5)).toInt());
+	p.maxDelay = qMax(p.initialDelay, settings.value("busy/maxDelay", QVariant(250)).toInt());
+	return p;
+}
+
+void BusyHandler::setPolicy(const Policy & policy)
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("busy/timeout", QVariant(policy.timeout));
+	settings.setValue("busy/initialDelay", QVariant(policy.initialDelay));
+	settings.setValue("busy/maxDelay", QVariant(policy.maxDelay));
+	QMutexLocker locker(&s_mutex);
+	s_policy = policy;
+}
+
+BusyHandler::Stats BusyHandler::stats()
+{
+	QMutexLocker locker(&s_mutex);
+	return s_stats;
+}
+
+void BusyHandler::resetStats()
+{
+	QMutexLocker locker(&s_mutex);
+	Stats empty = { 0, 0, 0, 0, 0 };
+	s_stats = empty;
+}
+
+int BusyHandler::handler(void * data, int count)
+{
+	QMutexLocker locker(&s_mutex);
+	if (count == 0)
+	{
+		++s_stats.contentions;
+		s_waited[data] = 0;
+	}
+	qlonglong & waited = s_waited[data];
+
+	// double the wait with every retry, then take a random part of its half
+	qlonglong delay = (qlonglong)s_policy.initialDelay << qMin(count, 20);
+	delay = qMin(delay, (qlonglong)s_policy.maxDelay);
+	// qrand() is per thread and unseeded; sqlite seeds its own generator
+	unsigned int r;
+	sqlite3_randomness(sizeof(r), &r);
+	delay = delay / 2 + r % (delay / 2 + 1);
+	delay = qMin(delay, s_policy.timeout - waited);
+	if (delay <= 0)
+	{
+		++s_stats.timeouts;
+		s_waited.remove(data);
+		// SQLITE_BUSY for the statement
+		return 0;
+	}
+
+	waited += delay;
+	++s_stats.waits;
+	s_stats.waitTime += delay;
+	s_stats.longestWait = qMax(s_stats.longestWait, waited);
+	locker.unlock();
+
+	sqlite3_sleep((int)delay);
+	return 1;
+}
@@ -0,0 +1,67 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef BUSYHANDLER_H
+#define BUSYHANDLER_H
+
+#include <QtGlobal>
+
+#include "sqlite3.h"
+
+
+/*! \brief Wait for locks of other connections with exponential backoff.
+It replaces the fixed sqlite3_busy_timeout() of the main connection.
+The first retry comes after initialDelay, every next one waits twice
+as long up to maxDelay. Every wait is shortened by a random part
+(jitter) so connections blocked by the same writer do not retry
+in lockstep. The statement fails with SQLITE_BUSY after timeout.
+The waits are counted for the lock monitor.
+*/
+class BusyHandler
+{
+	public:
+		struct Policy
+		{
+			//! \brief Give up after this many ms of waiting
+			int timeout;
+			//! \brief The first wait in ms
+			int initialDelay;
+			//! \brief The longest single wait in ms
+			int maxDelay;
+		};
+
+		struct Stats
+		{
+			//! \brief Statements which found the database locked
+			qlonglong contentions;
+			//! \brief Waits (handler calls) of all contentions
+			qlonglong waits;
+			//! \brief Contentions which ended with SQLITE_BUSY
+			qlonglong timeouts;
+			//! \brief Time spent waiting in ms
+			qlonglong waitTime;
+			//! \brief The longest contention in ms
+			qlonglong longestWait;
+		};
+
+		//! \brief Use the handler for db with the policy from settings.
+		static void install(sqlite3 * db);
+
+		//! \brief The policy stored in settings.
+		static Policy policy();
+		//! \brief Store the policy. It is used by the next wait.
+		static void setPolicy(const Policy & policy);
+
+		static Stats stats();
+		static void resetStats();
+
+	private:
+		//! \brief The sqlite3_busy_handler() callback.
+		static int handler(void * data, int count);
+};
+
+#endif
@@ -0,0 +1,728 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <stdlib.h>
+#include <zlib.h>
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMessageBox>
+#include <QMutexLocker>
+#include <QSettings>
+#include <QSqlError>
+#include <QSqlQuery>
+
+#include "compresscolumndialog.h"
+#include "database.h"
+#include "regexp.h"
+#include "utils.h"
+
+// resultTree columns
+#define COL_ROWIDS 0
+#define COL_ROWS 1
+#define COL_BYTES 2
+#define COL_COMPRESSED 3
+#define COL_RATIO 4
+
+#define MIN_ROWID (-Q_INT64_C(9223372036854775807) - 1)
+#define MAX_ROWID Q_INT64_C(9223372036854775807)
+
+
+CompressTask::CompressTask(QByteArray * values, int count, int level,
+						   const QByteArray & dictionary)
+	: m_values(values),
+	  m_count(count),
+	  m_level(level),
+	  m_dictionary(dictionary)
+{
+}
+
+void CompressTask::run()
+{
+	const unsigned char * dict = m_dictionary.isEmpty()
+								 ? 0 : (const unsigned char *)m_dictionary.constData();
+	for (int i = 0; i < m_count; ++i)
+	{
+		unsigned char * out = 0;
+		int size = 0;
+		int rc = sqlite3CompressData((const unsigned char *)m_values[i].constData(),
+									 m_values[i].size(), m_level, dict,
+									 m_dictionary.size(), &out, &size);
+		m_values[i] = (rc == Z_OK) ? QByteArray((const char *)out, size) : QByteArray();
+		free(out);
+	}
+}
+
+
+CompressThread::CompressThread(const QString & database, const QString & fileName,
+							   sqlite3 * connection, const QString & table,
+							   const QString & column, int level, int trainSize,
+							   int threads, int chunkRows, QObject * parent)
+	: QThread(parent),
+	  m_database(database),
+	  m_fileName(fileName),
+	  m_table(table),
+	  m_column(column),
+	  m_level(level),
+	  m_trainSize(trainSize),
+	  m_chunkRows(chunkRows),
+	  m_db(connection),
+	  m_own(false),
+	  m_readStmt(0),
+	  m_updateStmt(0),
+	  m_jobStmt(0),
+	  m_cancelled(false),
+	  m_resumed(false),
+	  m_rows(0),
+	  m_bytesIn(0),
+	  m_bytesOut(0)
+{
+	m_pool.setMaxThreadCount(threads);
+}
+
+CompressThread::~CompressThread()
+{
+	m_pool.waitForDone();
+	sqlite3_finalize(m_readStmt);
+	sqlite3_finalize(m_updateStmt);
+	sqlite3_finalize(m_jobStmt);
+	if (m_own)
+		sqlite3_close(m_db);
+}
+
+QList<CompressChunkStats> CompressThread::takeChunks()
+{
+	QMutexLocker locker(&m_mutex);
+	QList<CompressChunkStats> chunks(m_chunks);
+	m_chunks.clear();
+	return chunks;
+}
+
+void CompressThread::cancel()
+{
+	// the chunk being written is committed, so the job can be resumed
+	m_cancelled = true;
+}
+
+QString CompressThread::source(const QString & table) const
+{
+	// an own connection has the database as main
+	if (m_own)
+		return Utils::quote(table);
+	return Utils::quote(m_database) + "." + Utils::quote(table);
+}
+
+bool CompressThread::prepare(const QString & sql, sqlite3_stmt ** stmt)
+{
+	QByteArray utf(sql.toUtf8());
+	if (sqlite3_prepare_v2(m_db, utf.constData(), -1, stmt, 0) == SQLITE_OK)
+		return true;
+	m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+	return false;
+}
+
+bool CompressThread::exec(const QString & sql)
+{
+	QByteArray utf(sql.toUtf8());
+	if (sqlite3_exec(m_db, utf.constData(), 0, 0, 0) == SQLITE_OK)
+		return true;
+	m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+	return false;
+}
+
+bool CompressThread::open()
+{
+	if (QFileInfo(m_fileName).isFile())
+	{
+		QByteArray name(QDir::toNativeSeparators(m_fileName).toUtf8());
+		sqlite3 * db = 0;
+		if (sqlite3_open_v2(name.constData(), &db, SQLITE_OPEN_READWRITE, 0) != SQLITE_OK)
+		{
+			m_error = QString::fromUtf8(sqlite3_errmsg(db));
+			sqlite3_close(db);
+			return false;
+		}
+		m_db = db;
+		m_own = true;
+		sqlite3_busy_timeout(m_db, 5000);
+		// compress_dictionary() for the training
+		sqlite3CompressInit(m_db);
+		// the UPDATE runs the CHECK constraints and triggers of the table
+		Regexp::install(m_db);
+	}
+	if (!m_db)
+	{
+		m_error = tr("The database has no connection.");
+		return false;
+	}
+	return true;
+}
+
+bool CompressThread::startJob(qint64 & from, bool & done)
+{
+	QString job(source(COMPRESS_JOB_TABLE));
+	if (!exec(QString("CREATE TABLE IF NOT EXISTS %1 (tbl TEXT, col TEXT, "
+					  "level INTEGER, dictionary BLOB, last_rowid INTEGER, "
+					  "finished INTEGER, compressed_rows INTEGER, "
+					  "bytes_in INTEGER, bytes_out INTEGER, "
+					  "PRIMARY KEY (tbl, col));").arg(job)))
+		return false;
+
+	QByteArray table(m_table.toUtf8());
+	QByteArray column(m_column.toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (!prepare(QString("SELECT level, dictionary, last_rowid, finished, "
+						 "compressed_rows, bytes_in, bytes_out "
+						 "FROM %1 WHERE tbl = ?1 AND col = ?2;").arg(job), &stmt))
+		return false;
+	sqlite3_bind_text(stmt, 1, table.constData(), -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 2, column.constData(), -1, SQLITE_STATIC);
+	from = MIN_ROWID;
+	done = false;
+	int rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW)
+	{
+		if (sqlite3_column_int(stmt, 3))
+		{
+			sqlite3_finalize(stmt);
+			m_error = tr("The column is compressed already.");
+			return false;
+		}
+		// the recorded settings, the values written so far use them
+		m_resumed = true;
+		m_level = sqlite3_column_int(stmt, 0);
+		m_dictionary = QByteArray((const char *)sqlite3_column_blob(stmt, 1),
+								  sqlite3_column_bytes(stmt, 1));
+		if (sqlite3_column_type(stmt, 2) != SQLITE_NULL)
+		{
+			qint64 last = sqlite3_column_int64(stmt, 2);
+			done = last == MAX_ROWID;
+			from = done ? last : last + 1;
+		}
+		m_rows = sqlite3_column_int64(stmt, 4);
+		m_bytesIn = sqlite3_column_int64(stmt, 5);
+		m_bytesOut = sqlite3_column_int64(stmt, 6);
+		rc = SQLITE_DONE;
+	}
+	if (rc != SQLITE_DONE)
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+	sqlite3_finalize(stmt);
+	if (rc != SQLITE_DONE)
+		return false;
+
+	QString quoted(Utils::quote(m_column));
+	QString data(source(m_table));
+	if (!m_resumed)
+	{
+		if (m_trainSize > 0)
+		{
+			emit training();
+			if (!prepare(QString("SELECT compress_dictionary(%1, %2) FROM (SELECT %1 FROM %3 "
+								 "WHERE typeof(%1) IN ('text', 'blob') "
+								 "ORDER BY random() LIMIT %4);")
+						 .arg(quoted).arg(m_trainSize).arg(data).arg(DictionarySamples), &stmt))
+				return false;
+			rc = sqlite3_step(stmt);
+			if (rc == SQLITE_ROW)
+				m_dictionary = QByteArray((const char *)sqlite3_column_blob(stmt, 0),
+										  sqlite3_column_bytes(stmt, 0));
+			else
+				m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+			sqlite3_finalize(stmt);
+			if (rc != SQLITE_ROW)
+				return false;
+		}
+
+		if (!prepare(QString("INSERT INTO %1 VALUES (?1, ?2, ?3, ?4, NULL, 0, 0, 0, 0);")
+					 .arg(job), &stmt))
+			return false;
+		sqlite3_bind_text(stmt, 1, table.constData(), -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 2, column.constData(), -1, SQLITE_STATIC);
+		sqlite3_bind_int(stmt, 3, m_level);
+		if (!m_dictionary.isEmpty())
+			sqlite3_bind_blob(stmt, 4, m_dictionary.constData(), m_dictionary.size(),
+							  SQLITE_STATIC);
+		rc = sqlite3_step(stmt);
+		if (rc != SQLITE_DONE)
+			m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+		sqlite3_finalize(stmt);
+		if (rc != SQLITE_DONE)
+			return false;
+	}
+
+	return prepare(QString("SELECT rowid, %1 FROM %2 WHERE rowid >= ?1 "
+						   "ORDER BY rowid LIMIT ?2;").arg(quoted).arg(data), &m_readStmt)
+		   && prepare(QString("UPDATE %1 SET %2 = ?1 WHERE rowid = ?2;")
+					  .arg(data).arg(quoted), &m_updateStmt)
+		   && prepare(QString("UPDATE %1 SET last_rowid = ?1, "
+							  "compressed_rows = compressed_rows + ?2, "
+							  "bytes_in = bytes_in + ?3, bytes_out = bytes_out + ?4 "
+							  "WHERE tbl = ?5 AND col = ?6;").arg(job), &m_jobStmt);
+}
+
+bool CompressThread::read(qint64 from, CompressChunk & chunk, int & rowsRead)
+{
+	chunk.rowids.clear();
+	chunk.values.clear();
+	chunk.first = from;
+	chunk.last = from;
+	chunk.bytesIn = 0;
+	chunk.bytesOut = 0;
+	rowsRead = 0;
+	sqlite3_bind_int64(m_readStmt, 1, from);
+	sqlite3_bind_int(m_readStmt, 2, m_chunkRows);
+	int rc;
+	while ((rc = sqlite3_step(m_readStmt)) == SQLITE_ROW)
+	{
+		qint64 rowid = sqlite3_column_int64(m_readStmt, 0);
+		if (rowsRead == 0)
+			chunk.first = rowid;
+		chunk.last = rowid;
+		++rowsRead;
+		// NULLs and numbers are kept as they are
+		int type = sqlite3_column_type(m_readStmt, 1);
+		if (type != SQLITE_TEXT && type != SQLITE_BLOB)
+			continue;
+		const char * data = (const char *)sqlite3_column_blob(m_readStmt, 1);
+		int size = sqlite3_column_bytes(m_readStmt, 1);
+		chunk.rowids.append(rowid);
+		chunk.values.append(QByteArray(data, size));
+		chunk.bytesIn += size;
+	}
+	// the read ends here, the writes of the chunks do not wait for it
+	sqlite3_reset(m_readStmt);
+	if (rc != SQLITE_DONE)
+	{
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+		return false;
+	}
+	return true;
+}
+
+void CompressThread::compress(CompressChunk & chunk)
+{
+	QByteArray * values = chunk.values.data();
+	for (int i = 0; i < chunk.values.count(); i += TaskValues)
+		m_pool.start(new CompressTask(values + i, qMin((int)TaskValues, chunk.values.count() - i),
+									  m_level, m_dictionary));
+}
+
+bool CompressThread::write(CompressChunk & chunk)
+{
+	for (int i = 0; i < chunk.values.count(); ++i)
+	{
+		if (chunk.values.at(i).isNull())
+		{
+			m_error = tr("Cannot compress the value of rowid %1.").arg(chunk.rowids.at(i));
+			return false;
+		}
+		chunk.bytesOut += chunk.values.at(i).size();
+	}
+
+	if (!exec("BEGIN;"))
+		return false;
+	int rc = SQLITE_DONE;
+	for (int i = 0; i < chunk.values.count() && rc == SQLITE_DONE; ++i)
+	{
+		sqlite3_bind_blob(m_updateStmt, 1, chunk.values.at(i).constData(),
+						  chunk.values.at(i).size(), SQLITE_STATIC);
+		sqlite3_bind_int64(m_updateStmt, 2, chunk.rowids.at(i));
+		rc = sqlite3_step(m_updateStmt);
+		sqlite3_reset(m_updateStmt);
+	}
+	// the job record is written with the values, it is exact after a crash
+	if (rc == SQLITE_DONE)
+	{
+		QByteArray table(m_table.toUtf8());
+		QByteArray column(m_column.toUtf8());
+		sqlite3_bind_int64(m_jobStmt, 1, chunk.last);
+		sqlite3_bind_int(m_jobStmt, 2, chunk.rowids.count());
+		sqlite3_bind_int64(m_jobStmt, 3, chunk.bytesIn);
+		sqlite3_bind_int64(m_jobStmt, 4, chunk.bytesOut);
+		sqlite3_bind_text(m_jobStmt, 5, table.constData(), -1, SQLITE_STATIC);
+		sqlite3_bind_text(m_jobStmt, 6, column.constData(), -1, SQLITE_STATIC);
+		rc = sqlite3_step(m_jobStmt);
+		sqlite3_reset(m_jobStmt);
+	}
+	if (rc != SQLITE_DONE || !exec("COMMIT;"))
+	{
+		if (rc != SQLITE_DONE)
+			m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+		sqlite3_exec(m_db, "ROLLBACK;", 0, 0, 0);
+		return false;
+	}
+
+	CompressChunkStats stats;
+	stats.first = chunk.first;
+	stats.last = chunk.last;
+	stats.rows = chunk.rowids.count();
+	stats.bytesIn = chunk.bytesIn;
+	stats.bytesOut = chunk.bytesOut;
+	m_rows += stats.rows;
+	m_bytesIn += stats.bytesIn;
+	m_bytesOut += stats.bytesOut;
+	m_mutex.lock();
+	m_chunks.append(stats);
+	m_mutex.unlock();
+	emit chunkDone();
+	return true;
+}
+
+void CompressThread::run()
+{
+	qint64 from;
+	bool done;
+	if (!open() || !startJob(from, done))
+		return;
+
+	// while the pool compresses a chunk, the previous one is written
+	// and the next one is read
+	CompressChunk previous;
+	CompressChunk current;
+	CompressChunk next;
+	bool pending = false;
+	int rowsRead = 0;
+	bool ok = done || read(from, current, rowsRead);
+	while (ok && rowsRead > 0)
+	{
+		compress(current);
+		if (pending)
+			ok = write(previous);
+		if (ok && !m_cancelled && current.last < MAX_ROWID)
+			ok = read(current.last + 1, next, rowsRead);
+		else
+			rowsRead = 0;
+		m_pool.waitForDone();
+		previous = current;
+		pending = true;
+		current = next;
+		next = CompressChunk();
+	}
+	// the last chunk is compressed already, even when cancelled
+	if (ok && pending)
+		ok = write(previous);
+	if (!ok || m_cancelled)
+		return;
+
+	QByteArray table(m_table.toUtf8());
+	QByteArray column(m_column.toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (!prepare(QString("UPDATE %1 SET finished = 1 WHERE tbl = ?1 AND col = ?2;")
+				 .arg(source(COMPRESS_JOB_TABLE)), &stmt))
+		return;
+	sqlite3_bind_text(stmt, 1, table.constData(), -1, SQLITE_STATIC);
+	sqlite3_bind_text(stmt, 2, column.constData(), -1, SQLITE_STATIC);
+	if (sqlite3_step(stmt) != SQLITE_DONE)
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+	sqlite3_finalize(stmt);
+}
+
+
+CompressColumnDialog::CompressColumnDialog(QWidget * parent)
+	: QDialog(parent),
+	  update(false),
+	  m_thread(0)
+{
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("compresscolumn/height", QVariant(460)).toInt();
+	int ww = settings.value("compresscolumn/width", QVariant(640)).toInt();
+	resize(ww, hh);
+	ui.levelSpinBox->setValue(settings.value("compresscolumn/level",
+							  QVariant(ui.levelSpinBox->value())).toInt());
+	ui.dictionaryCheckBox->setChecked(settings.value("compresscolumn/dictionary",
+									  QVariant(true)).toBool());
+	ui.dictionarySpinBox->setValue(settings.value("compresscolumn/dictionarySize",
+								   QVariant(ui.dictionarySpinBox->value())).toInt());
+	ui.threadsSpinBox->setValue(settings.value("compresscolumn/threads",
+								QVariant(qMax(1, QThread::idealThreadCount()))).toInt());
+	ui.chunkSpinBox->setValue(settings.value("compresscolumn/chunk",
+							  QVariant(ui.chunkSpinBox->value())).toInt());
+
+	QStringList databases(Database::getDatabases().keys());
+	ui.databaseComboBox->addItems(databases);
+	ui.databaseComboBox->setCurrentIndex(databases.indexOf("main"));
+	databaseComboBox_activated(ui.databaseComboBox->currentText());
+	setRunning(false);
+
+	connect(ui.databaseComboBox, SIGNAL(activated(const QString &)),
+			this, SLOT(databaseComboBox_activated(const QString &)));
+	connect(ui.tableComboBox, SIGNAL(activated(const QString &)),
+			this, SLOT(tableComboBox_activated(const QString &)));
+	connect(ui.columnComboBox, SIGNAL(activated(const QString &)),
+			this, SLOT(columnComboBox_activated(const QString &)));
+	connect(ui.dictionaryCheckBox, SIGNAL(toggled(bool)),
+			ui.dictionarySpinBox, SLOT(setEnabled(bool)));
+	connect(ui.compressButton, SIGNAL(clicked()), this, SLOT(compressButton_clicked()));
+	connect(ui.cancelButton, SIGNAL(clicked()), this, SLOT(cancelButton_clicked()));
+}
+
+CompressColumnDialog::~CompressColumnDialog()
+{
+	if (m_thread)
+	{
+		m_thread->cancel();
+		m_thread->wait();
+		delete m_thread;
+	}
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("compresscolumn/height", QVariant(height()));
+	settings.setValue("compresscolumn/width", QVariant(width()));
+	settings.setValue("compresscolumn/level", QVariant(ui.levelSpinBox->value()));
+	settings.setValue("compresscolumn/dictionary", QVariant(ui.dictionaryCheckBox->isChecked()));
+	settings.setValue("compresscolumn/dictionarySize", QVariant(ui.dictionarySpinBox->value()));
+	settings.setValue("compresscolumn/threads", QVariant(ui.threadsSpinBox->value()));
+	settings.setValue("compresscolumn/chunk", QVariant(ui.chunkSpinBox->value()));
+}
+
+QString CompressColumnDialog::ratio(qint64 in, qint64 out)
+{
+	if (out == 0)
+		return QString();
+	return QString("1 : %1").arg(double(in) / double(out), 0, 'f', 2);
+}
+
+void CompressColumnDialog::setRunning(bool running)
+{
+	ui.databaseComboBox->setEnabled(!running);
+	ui.tableComboBox->setEnabled(!running);
+	ui.columnComboBox->setEnabled(!running);
+	ui.threadsSpinBox->setEnabled(!running);
+	ui.chunkSpinBox->setEnabled(!running);
+	ui.cancelButton->setEnabled(running);
+	if (running)
+	{
+		ui.levelSpinBox->setEnabled(false);
+		ui.dictionaryCheckBox->setEnabled(false);
+		ui.dictionarySpinBox->setEnabled(false);
+		ui.compressButton->setEnabled(false);
+	}
+	else
+		columnComboBox_activated(ui.columnComboBox->currentText());
+}
+
+void CompressColumnDialog::databaseComboBox_activated(const QString & schema)
+{
+	QString current(ui.tableComboBox->currentText());
+	QStringList tables(Database::getObjects("table", schema).keys());
+	tables.removeAll(COMPRESS_JOB_TABLE);
+	tables.sort();
+	ui.tableComboBox->clear();
+	ui.tableComboBox->addItems(tables);
+	if (tables.contains(current))
+		ui.tableComboBox->setCurrentIndex(tables.indexOf(current));
+	tableComboBox_activated(ui.tableComboBox->currentText());
+}
+
+void CompressColumnDialog::tableComboBox_activated(const QString & table)
+{
+	QString current(ui.columnComboBox->currentText());
+	QStringList columns;
+	if (!table.isEmpty())
+	{
+		foreach (FieldInfo field, Database::tableFields(table, ui.databaseComboBox->currentText()))
+			columns.append(field.name);
+	}
+	ui.columnComboBox->clear();
+	ui.columnComboBox->addItems(columns);
+	if (columns.contains(current))
+		ui.columnComboBox->setCurrentIndex(columns.indexOf(current));
+	columnComboBox_activated(ui.columnComboBox->currentText());
+}
+
+void CompressColumnDialog::columnComboBox_activated(const QString & column)
+{
+	QString table(ui.tableComboBox->currentText());
+	bool fresh = true;
+	ui.compressButton->setText(tr("&Compress"));
+	ui.compressButton->setEnabled(!column.isEmpty());
+	ui.statusLabel->clear();
+	if (!column.isEmpty())
+	{
+		// a recorded job of the column, the table may not exist yet
+		ForwardQuery query(
+					QString("SELECT level, length(dictionary), last_rowid, finished "
+							"FROM %1.%2 WHERE tbl = %3 AND col = %4;")
+					.arg(Utils::quote(ui.databaseComboBox->currentText()))
+					.arg(COMPRESS_JOB_TABLE)
+					.arg(Utils::literal(table))
+					.arg(Utils::literal(column)));
+		if (query.next())
+		{
+			fresh = false;
+			QString dictionary(query.value(1).isNull()
+							   ? tr("no dictionary")
+							   : tr("a dictionary of %1 bytes").arg(query.value(1).toInt()));
+			if (query.value(3).toInt())
+			{
+				ui.compressButton->setEnabled(false);
+				ui.statusLabel->setText(
+					tr("The column is compressed already, at level %1 with %2. "
+					   "Read it with uncompress(%3, (SELECT dictionary FROM %4 "
+					   "WHERE tbl = %5 AND col = %6)).")
+					.arg(query.value(0).toInt()).arg(dictionary)
+					.arg(Utils::quote(column)).arg(COMPRESS_JOB_TABLE)
+					.arg(Utils::literal(table)).arg(Utils::literal(column)));
+			}
+			else
+			{
+				ui.compressButton->setText(tr("&Resume"));
+				ui.statusLabel->setText(
+					tr("The compression of the column was interrupted. It is resumed "
+					   "after rowid %1 at level %2 with %3.")
+					.arg(query.value(2).isNull() ? tr("none") : query.value(2).toString())
+					.arg(query.value(0).toInt()).arg(dictionary));
+			}
+		}
+	}
+	// a resumed job keeps its settings
+	ui.levelSpinBox->setEnabled(fresh);
+	ui.dictionaryCheckBox->setEnabled(fresh);
+	ui.dictionarySpinBox->setEnabled(fresh && ui.dictionaryCheckBox->isChecked());
+}
+
+void CompressColumnDialog::compressButton_clicked()
+{
+	QString schema(ui.databaseComboBox->currentText());
+	QString table(ui.tableComboBox->currentText());
+	QString column(ui.columnComboBox->currentText());
+	if (table.isEmpty() || column.isEmpty())
+		return;
+	if (!Database::isAutoCommit())
+	{
+		ui.statusLabel->setText(tr("Commit or roll back the pending transaction first."));
+		return;
+	}
+	ForwardQuery query(QString("SELECT rowid FROM %1.%2 LIMIT 0;")
+					   .arg(Utils::quote(schema))
+					   .arg(Utils::quote(table)));
+	if (query.lastError().isValid())
+	{
+		ui.statusLabel->setText(tr("Tables without rowid cannot be compressed."));
+		return;
+	}
+	query.finish();
+
+	// the shown table would block the writes
+	emit aboutToCompress();
+	QString fileName(Database::getDatabases().value(schema));
+	sqlite3 * connection = 0;
+	if (!QFileInfo(fileName).isFile())
+	{
+		connection = Database::sqlite3handle();
+		if (!connection)
+			return;
+	}
+	m_thread = new CompressThread(schema, fileName, connection, table, column,
+								  ui.levelSpinBox->value(),
+								  ui.dictionaryCheckBox->isChecked()
+								  ? ui.dictionarySpinBox->value() * 1024 : 0,
+								  ui.threadsSpinBox->value(),
+								  ui.chunkSpinBox->value(), this);
+	connect(m_thread, SIGNAL(training()), this, SLOT(thread_training()));
+	connect(m_thread, SIGNAL(chunkDone()), this, SLOT(thread_chunkDone()));
+	connect(m_thread, SIGNAL(finished()), this, SLOT(thread_finished()));
+
+	// the job table is created in the database
+	update = true;
+	ui.resultTree->clear();
+	ui.statusLabel->setText(tr("Compressing..."));
+	setRunning(true);
+	m_time.start();
+	m_thread->start();
+}
+
+void CompressColumnDialog::cancelButton_clicked()
+{
+	if (m_thread)
+	{
+		ui.statusLabel->setText(tr("Stopping after the current chunk..."));
+		m_thread->cancel();
+	}
+}
+
+void CompressColumnDialog::thread_training()
+{
+	ui.statusLabel->setText(tr("Training the dictionary on %1 values...")
+							.arg(CompressThread::DictionarySamples));
+}
+
+void CompressColumnDialog::thread_chunkDone()
+{
+	if (!m_thread)
+		return;
+	QTreeWidgetItem * item = 0;
+	foreach (CompressChunkStats chunk, m_thread->takeChunks())
+	{
+		item = new QTreeWidgetItem(ui.resultTree);
+		item->setText(COL_ROWIDS, QString("%1 - %2").arg(chunk.first).arg(chunk.last));
+		item->setData(COL_ROWS, Qt::DisplayRole, chunk.rows);
+		item->setText(COL_BYTES, Utils::formatSize(chunk.bytesIn));
+		item->setText(COL_COMPRESSED, Utils::formatSize(chunk.bytesOut));
+		item->setText(COL_RATIO, ratio(chunk.bytesIn, chunk.bytesOut));
+	}
+	if (item)
+		ui.resultTree->scrollToItem(item);
+	ui.statusLabel->setText(tr("%1 values compressed, %2 to %3 (%4).")
+							.arg(m_thread->rows())
+							.arg(Utils::formatSize(m_thread->bytesIn()))
+							.arg(Utils::formatSize(m_thread->bytesOut()))
+							.arg(ratio(m_thread->bytesIn(), m_thread->bytesOut())));
+}
+
+void CompressColumnDialog::thread_finished()
+{
+	if (!m_thread)
+		return;
+	// the chunks reported after the last queued signal
+	thread_chunkDone();
+	for (int i = 0; i < ui.resultTree->columnCount(); ++i)
+		ui.resultTree->resizeColumnToContents(i);
+
+	QString totals(tr("%1 values compressed at level %2, %3 to %4 (%5), in %6 s.")
+				   .arg(m_thread->rows()).arg(m_thread->level())
+				   .arg(Utils::formatSize(m_thread->bytesIn()))
+				   .arg(Utils::formatSize(m_thread->bytesOut()))
+				   .arg(ratio(m_thread->bytesIn(), m_thread->bytesOut()))
+				   .arg(m_time.elapsed() / 1000.0, 0, 'f', 1));
+	if (!m_thread->error().isEmpty())
+		ui.statusLabel->setText(tr("Error while compressing")
+								+ ":<br/><span style=\" color:#ff0000;\">"
+								+ m_thread->error() + "</span><br/>"
+								+ tr("The written chunks are kept, the job can be resumed."));
+	else if (m_thread->isCancelled())
+		ui.statusLabel->setText(tr("Stopped. The job can be resumed.") + " " + totals);
+	else
+		ui.statusLabel->setText((m_thread->isResumed() ? tr("Resumed job finished.")
+														: tr("Finished."))
+								+ " " + totals);
+	QString status(ui.statusLabel->text());
+
+	m_thread->deleteLater();
+	m_thread = 0;
+	setRunning(false);
+	// setRunning() shows the state of the column, the result is more important
+	ui.statusLabel->setText(status);
+}
+
+void CompressColumnDialog::reject()
+{
+	if (m_thread)
+	{
+		int ret = QMessageBox::question(this, windowTitle(),
+						tr("The column is still compressed. Do you want to stop it? "
+						   "It can be resumed later."),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+		m_thread->cancel();
+		m_thread->wait();
+		delete m_thread;
+		m_thread = 0;
+	}
+	QDialog::reject();
+}
@@ -0,0 +1,229 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef COMPRESSCOLUMNDIALOG_H
+#define COMPRESSCOLUMNDIALOG_H
+
+#include <qdialog.h>
+#include <QMutex>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <QTime>
+#include <QVector>
+
+#include "sqlite3.h"
+#include "ui_compresscolumndialog.h"
+
+//! \brief Compress a value with zlib, see extensions/compress.c.
+extern "C" int sqlite3CompressData(const unsigned char * in, int nIn, int level,
+								   const unsigned char * dict, int nDict,
+								   unsigned char ** out, int * nOut);
+
+// the job table in the compressed database
+#define COMPRESS_JOB_TABLE "sqliteman_compression"
+
+
+//! \brief Rows of the column read at once and written in one transaction.
+struct CompressChunk
+{
+	//! \brief The rowids read, the first and the last one
+	qint64 first;
+	qint64 last;
+	//! \brief Rows of texts and blobs, the other values are kept
+	QVector<qint64> rowids;
+	//! \brief Their values, replaced by the compressed ones by the pool
+	QVector<QByteArray> values;
+	qint64 bytesIn;
+	qint64 bytesOut;
+};
+
+//! \brief A written chunk, reported to the dialog.
+struct CompressChunkStats
+{
+	qint64 first;
+	qint64 last;
+	int rows;
+	qint64 bytesIn;
+	qint64 bytesOut;
+};
+
+
+/*! \brief Compress a part of the values of a chunk in the thread pool.
+A failed value is replaced by a null QByteArray.
+*/
+class CompressTask : public QRunnable
+{
+	public:
+		CompressTask(QByteArray * values, int count, int level,
+					 const QByteArray & dictionary);
+
+		void run();
+
+	private:
+		QByteArray * m_values;
+		int m_count;
+		int m_level;
+		QByteArray m_dictionary;
+};
+
+
+/*! \brief Compress a column of a table in place.
+The thread is the only writer. It reads the table in chunks of rows in
+rowid order, has the values of a chunk compressed by a thread pool and
+writes them back in one transaction per chunk. Reading and writing of
+the neighbouring chunks overlaps the compression of a chunk.
+The job is recorded in the COMPRESS_JOB_TABLE table of the database: its
+level, the preset dictionary and the last rowid written, which is updated
+in the transaction of every chunk. An interrupted job is resumed after the
+last written chunk with the recorded settings, so no value is compressed
+twice. The table keeps the dictionary needed by uncompress() later.
+Databases without a file (in-memory and temp) are written on the
+connection of the application.
+*/
+class CompressThread : public QThread
+{
+	Q_OBJECT
+
+	public:
+		/*!
+		\param database the schema name in the application
+		\param fileName its file to open
+		\param connection the connection of the application, used when
+		       fileName is not a file
+		\param table the table with the column
+		\param column the compressed column
+		\param level zlib level of a new job, 1 to 9
+		\param trainSize bytes of a preset dictionary trained for a new
+		       job, 0 for none; a smaller one is faster to set up per value
+		\param threads the size of the thread pool
+		\param chunkRows rows in one transaction
+		\param parent standard Qt parent
+		*/
+		CompressThread(const QString & database, const QString & fileName,
+					   sqlite3 * connection, const QString & table,
+					   const QString & column, int level, int trainSize,
+					   int threads, int chunkRows, QObject * parent = 0);
+		~CompressThread();
+
+		QString error() const { return m_error; };
+		bool isCancelled() const { return m_cancelled; };
+		//! \brief The job was an interrupted one.
+		bool isResumed() const { return m_resumed; };
+		//! \brief The level of the job, recorded one when resumed.
+		int level() const { return m_level; };
+		int dictionarySize() const { return m_dictionary.size(); };
+		//! \brief Totals of the whole job, resumed parts included.
+		qint64 rows() const { return m_rows; };
+		qint64 bytesIn() const { return m_bytesIn; };
+		qint64 bytesOut() const { return m_bytesOut; };
+		//! \brief The chunks written since the last call.
+		QList<CompressChunkStats> takeChunks();
+
+		enum
+		{
+			//! \brief Values sampled to train the dictionary
+			DictionarySamples = 1000,
+			//! \brief Values compressed by one task
+			TaskValues = 64
+		};
+
+	public slots:
+		//! \brief Stop after the current chunk, the job can be resumed.
+		void cancel();
+
+	signals:
+		//! \brief The dictionary is trained from the samples.
+		void training();
+		//! \brief A chunk is written, see takeChunks().
+		void chunkDone();
+
+	protected:
+		void run();
+
+	private:
+		QString m_database;
+		QString m_fileName;
+		QString m_table;
+		QString m_column;
+		int m_level;
+		int m_trainSize;
+		int m_chunkRows;
+		sqlite3 * m_db;
+		bool m_own;
+		sqlite3_stmt * m_readStmt;
+		sqlite3_stmt * m_updateStmt;
+		sqlite3_stmt * m_jobStmt;
+		QByteArray m_dictionary;
+		QThreadPool m_pool;
+		QString m_error;
+		volatile bool m_cancelled;
+		bool m_resumed;
+		qint64 m_rows;
+		qint64 m_bytesIn;
+		qint64 m_bytesOut;
+		QMutex m_mutex;
+		QList<CompressChunkStats> m_chunks;
+
+		//! \brief The name of a table of the database on the connection.
+		QString source(const QString & table) const;
+		bool prepare(const QString & sql, sqlite3_stmt ** stmt);
+		bool exec(const QString & sql);
+		bool open();
+		//! \brief Read the recorded job or record a new one.
+		bool startJob(qint64 & from, bool & done);
+		//! \brief Read the rows from rowid from, chunk.rowids is empty at the end.
+		bool read(qint64 from, CompressChunk & chunk, int & rowsRead);
+		//! \brief Compress the values of chunk in the pool, does not wait.
+		void compress(CompressChunk & chunk);
+		//! \brief Write the chunk and the job record in one transaction.
+		bool write(CompressChunk & chunk);
+};
+
+
+/*! \brief Compress a column of a table with zlib in the background.
+The work is done by CompressThread. The values are readable with
+uncompress() of the compress extension, built into Sqliteman, and the
+dictionary recorded for the column.
+*/
+class CompressColumnDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		CompressColumnDialog(QWidget * parent = 0);
+		~CompressColumnDialog();
+
+		//! \brief The schema has changed, the job table is created.
+		bool update;
+
+	signals:
+		//! \brief The data view has to release the table before it is written.
+		void aboutToCompress();
+
+	private:
+		Ui::CompressColumnDialog ui;
+		CompressThread * m_thread;
+		QTime m_time;
+
+		void setRunning(bool running);
+		//! \brief "1 : 3.25", the ratio of in to out.
+		static QString ratio(qint64 in, qint64 out);
+
+	private slots:
+		void databaseComboBox_activated(const QString & schema);
+		void tableComboBox_activated(const QString & table);
+		void columnComboBox_activated(const QString & column);
+		void compressButton_clicked();
+		void cancelButton_clicked();
+		void thread_training();
+		void thread_chunkDone();
+		void thread_finished();
+		void reject();
+};
+
+#endif
@@ -0,0 +1,173 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QFileInfo>
+#include <QSettings>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QUrl>
+#include <QVariant>
+
+#include "connectionprofile.h"
+#include "utils.h"
+
+
+ConnectionProfile::ConnectionProfile()
+	: m_name("default"),
+	  m_readOnly(false),
+	  m_immutable(false),
+	  m_nolock(false)
+{
+	m_title = tr("Default");
+	m_description = tr("SQLite defaults, nothing is changed.");
+}
+
+QStringList ConnectionProfile::names()
+{
+	return QStringList() << "default" << "interactive" << "bulkload" << "analytics";
+}
+
+ConnectionProfile ConnectionProfile::profile(const QString & name)
+{
+	ConnectionProfile p;
+	if (name == "interactive")
+	{
+		p.m_name = name;
+		p.m_title = tr("Interactive");
+		p.m_description = tr("Browsing and editing: a bigger page cache, "
+							 "memory mapped I/O and temporary tables in memory.");
+		p.m_mmapSize = "268435456";
+		p.m_cacheSize = "-16384";
+		p.m_tempStore = "MEMORY";
+	}
+	else if (name == "bulkload")
+	{
+		p.m_name = name;
+		p.m_title = tr("Bulk load");
+		p.m_description = tr("Imports and mass changes: the rollback journal is kept "
+							 "in memory (WAL databases stay in WAL mode) and nothing "
+							 "is synced to disk. A crash or a power loss can corrupt "
+							 "the database.");
+		p.m_cacheSize = "-262144";
+		p.m_journalMode = "MEMORY";
+		p.m_synchronous = "OFF";
+		p.m_tempStore = "MEMORY";
+		p.m_threads = "4";
+		// apply() keeps WAL databases in WAL mode: fewer, bigger checkpoints
+		p.m_walAutocheckpoint = "10000";
+	}
+	else if (name == "analytics")
+	{
+		p.m_name = name;
+		p.m_title = tr("Read-only analytics");
+		p.m_description = tr("Big read-only queries: the file is opened read-only and "
+							 "immutable (no locking at all) with a large memory map. "
+							 "It must not be changed by anything else while it is open.");
+		p.m_readOnly = true;
+		p.m_immutable = true;
+		p.m_mmapSize = "1073741824";
+		p.m_cacheSize = "-65536";
+		p.m_tempStore = "MEMORY";
+		p.m_threads = "4";
+	}
+	return p;
+}
+
+QString ConnectionProfile::profileName(const QString & fileName)
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	QVariantMap files = settings.value("connectionProfiles/files").toMap();
+	QString name = files.value(QFileInfo(fileName).absoluteFilePath()).toString();
+	return names().contains(name) ? name : names().first();
+}
+
+void ConnectionProfile::setProfileName(const QString & fileName, const QString & name)
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	QVariantMap files = settings.value("connectionProfiles/files").toMap();
+	QString path(QFileInfo(fileName).absoluteFilePath());
+	if (name == names().first())
+		files.remove(path);
+	else
+		files[path] = name;
+	settings.setValue("connectionProfiles/files", files);
+}
+
+QString ConnectionProfile::connectOptions() const
+{
+	// URI file names are always allowed so ATTACH can use attachName()
+	QStringList opts("QSQLITE_OPEN_URI");
+	if (m_readOnly)
+		opts.append("QSQLITE_OPEN_READONLY");
+	if (m_immutable)
+		opts.append("QSQLITE_IMMUTABLE");
+	if (m_nolock)
+		opts.append("QSQLITE_NOLOCK");
+	return opts.join(";");
+}
+
+QString ConnectionProfile::attachName(const QString & fileName) const
+{
+#ifdef INTERNAL_SQLDRIVER
+	QStringList params;
+	if (m_readOnly)
+		params.append("mode=ro");
+	if (m_immutable)
+		params.append("immutable=1");
+	if (m_nolock)
+		params.append("nolock=1");
+	if (params.isEmpty())
+		return fileName;
+	return QString::fromLatin1(QUrl::fromLocalFile(fileName).toEncoded())
+		   + "?" + params.join("&");
+#else
+	// QSQLITE of Qt does not open URI file names, ATTACH would take it as a path
+	return fileName;
+#endif
+}
+
+bool ConnectionProfile::isWal(QSqlDatabase db, const QString & schema)
+{
+	QSqlQuery query(QString("PRAGMA %1.journal_mode;").arg(Utils::quote(schema)), db);
+	return query.next() && query.value(0).toString().toLower() == "wal";
+}
+
+QString ConnectionProfile::apply(QSqlDatabase db, const QString & schema) const
+{
+	QStringList pragmas;
+	if (!m_mmapSize.isEmpty())
+		pragmas.append(QString("mmap_size = %1").arg(m_mmapSize));
+	if (!m_cacheSize.isEmpty())
+		pragmas.append(QString("cache_size = %1").arg(m_cacheSize));
+	// read-only files cannot switch their journal. journal_mode of a WAL
+	// database is persistent, it would be changed for all its users
+	if (!m_journalMode.isEmpty() && !m_readOnly && !isWal(db, schema))
+		pragmas.append(QString("journal_mode = %1").arg(m_journalMode));
+	if (!m_synchronous.isEmpty())
+		pragmas.append(QString("synchronous = %1").arg(m_synchronous));
+	for (int i = 0; i < pragmas.count(); ++i)
+		pragmas[i] = Utils::quote(schema) + "." + pragmas.at(i);
+
+	if (schema == "main")
+	{
+		if (!m_tempStore.isEmpty())
+			pragmas.append(QString("temp_store = %1").arg(m_tempStore));
+		if (!m_threads.isEmpty())
+			pragmas.append(QString("threads = %1").arg(m_threads));
+		if (!m_walAutocheckpoint.isEmpty())
+			pragmas.append(QString("wal_autocheckpoint = %1").arg(m_walAutocheckpoint));
+	}
+
+	QStringList errors;
+	foreach (QString pragma, pragmas)
+	{
+		QSqlQuery query(QString("PRAGMA %1;").arg(pragma), db);
+		if (query.lastError().isValid())
+			errors.append(QString("PRAGMA %1: %2").arg(pragma).arg(query.lastError().text()));
+	}
+	return errors.join("<br/>");
+}
@@ -0,0 +1,98 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef CONNECTIONPROFILE_H
+#define CONNECTIONPROFILE_H
+
+#include <QCoreApplication>
+#include <QSqlDatabase>
+#include <QStringList>
+
+
+/*! \brief A named set of connection settings.
+A profile is applied to the main connection when a database is opened
+and to every database attached to it. Empty values are not set at all
+so sqlite (or the database file) defaults are used.
+The profile used for a database file is remembered with the recent
+databases.
+*/
+class ConnectionProfile
+{
+		Q_DECLARE_TR_FUNCTIONS(ConnectionProfile)
+
+	public:
+		ConnectionProfile();
+
+		//! \brief Names of the known profiles. The first one is the default.
+		static QStringList names();
+
+		/*! \brief Get a profile by its name.
+		\param name a name from names(). Unknown names give the default profile.
+		*/
+		static ConnectionProfile profile(const QString & name);
+
+		/*! \brief The profile remembered for a database file.
+		\param fileName a database file
+		\retval QString a profile name, the default one if nothing is stored.
+		*/
+		static QString profileName(const QString & fileName);
+
+		//! \brief Remember the profile for a database file.
+		static void setProfileName(const QString & fileName, const QString & name);
+
+		//! \brief The name stored in settings.
+		QString name() const { return m_name; };
+		//! \brief The translated name for the GUI.
+		QString title() const { return m_title; };
+		QString description() const { return m_description; };
+		bool isReadOnly() const { return m_readOnly; };
+
+		//! \brief Options for QSqlDatabase::setConnectOptions().
+		QString connectOptions() const;
+
+		/*! \brief A file name for ATTACH DATABASE.
+		\param fileName a database file
+		\retval QString a file: URI when the profile needs URI parameters
+		        and the internal driver is used, fileName otherwise.
+		*/
+		QString attachName(const QString & fileName) const;
+
+		/*! \brief Set the profile pragmas.
+		Connection wide pragmas are set only for the "main" schema; for
+		an attached schema only its own per-database pragmas are set.
+		The journal mode of a database in WAL mode is not changed.
+		\param db an open connection
+		\param schema a schema to set the per-database pragmas for
+		\retval QString error messages, empty on success.
+		*/
+		QString apply(QSqlDatabase db, const QString & schema = "main") const;
+
+	private:
+		//! \brief True if schema of db is in WAL journal mode.
+		static bool isWal(QSqlDatabase db, const QString & schema);
+
+		QString m_name;
+		QString m_title;
+		QString m_description;
+
+		// URI parameters and open flags
+		bool m_readOnly;
+		bool m_immutable;
+		bool m_nolock;
+
+		// per-database pragmas
+		QString m_mmapSize;
+		QString m_cacheSize;
+		QString m_journalMode;
+		QString m_synchronous;
+		// connection wide pragmas
+		QString m_tempStore;
+		QString m_threads;
+		QString m_walAutocheckpoint;
+};
+
+#endif
@@ -28,10 +28,31 @@ CreateIndexDialog::CreateIndexDialog(const QString & tabName,
 	ui.tableNameLabel->setText(tabName);
 	ui.schemaLabel->setText(m_schema);
 
-	QList<FieldInfo> columns = Database::tableFields(tabName, schema);
-	ui.tableColumns->setRowCount(columns.size());
+	setColumns(Database::tableFields(tabName, schema));
 	ui.createButton->setDisabled(true);
 
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("createindex/height", QVariant(500)).toInt();
+	resize(width(), hh);
+
+	connect(ui.tableColumns, SIGNAL(itemChanged(QTableWidgetItem*)),
+			this, SLOT(tableColumns_itemChanged(QTableWidgetItem*)));
+	connect(ui.indexNameEdit, SIGNAL(textChanged(const QString&)),
+			this, SLOT(indexNameEdit_textChanged(const QString&)));
+	connect(ui.createButton, SIGNAL(clicked()), this, SLOT(createButton_clicked()));
+}
+
+CreateIndexDialog::~CreateIndexDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+    settings.setValue("createindex/height", QVariant(height()));
+}
+
+void CreateIndexDialog::setColumns(const QList<FieldInfo> & columns)
+{
+	ui.tableColumns->setRowCount(0);
+	ui.tableColumns->setRowCount(columns.size());
+
 	for(int i = 0; i < columns.size(); i++)
 	{
 		QTableWidgetItem * nameItem = new QTableWidgetItem(columns[i].name);
@@ -49,21 +70,29 @@ CreateIndexDialog::CreateIndexDialog(const QString & tabName,
 		asc->setEnabled(false);
 		ui.tableColumns->setCellWidget(i, 2, asc);
 	}
-	QSettings settings("yarpen.cz", "sqliteman");
-	int hh = settings.value("createindex/height", QVariant(500)).toInt();
-	resize(width(), hh);
-
-	connect(ui.tableColumns, SIGNAL(itemChanged(QTableWidgetItem*)),
-			this, SLOT(tableColumns_itemChanged(QTableWidgetItem*)));
-	connect(ui.indexNameEdit, SIGNAL(textChanged(const QString&)),
-			this, SLOT(indexNameEdit_textChanged(const QString&)));
-	connect(ui.createButton, SIGNAL(clicked()), this, SLOT(createButton_clicked()));
 }
 
-CreateIndexDialog::~CreateIndexDialog()
+void CreateIndexDialog::suggest(const QString & indexName, const QStringList & columns)
 {
-	QSettings settings("yarpen.cz", "sqliteman");
-    settings.setValue("createindex/height", QVariant(height()));
+	QList<FieldInfo> fields = Database::tableFields(ui.tableNameLabel->text(), m_schema);
+	// the index columns go first, in the index order
+	QList<FieldInfo> ordered;
+	foreach (QString column, columns)
+	{
+		for (int i = 0; i < fields.size(); ++i)
+		{
+			if (fields[i].name.compare(column, Qt::CaseInsensitive) == 0)
+			{
+				ordered.append(fields.takeAt(i));
+				break;
+			}
+		}
+	}
+	int used = ordered.size();
+	setColumns(ordered + fields);
+	for (int i = 0; i < used; ++i)
+		ui.tableColumns->item(i, 1)->setCheckState(Qt::Checked);
+	ui.indexNameEdit->setText(indexName);
 }
 
 void CreateIndexDialog::createButton_clicked()
@@ -10,6 +10,7 @@ for which a new license (GPL+exception) is in place.
 
 #include <qwidget.h>
 
+#include "database.h"
 #include "litemanwindow.h"
 #include "ui_createindexdialog.h"
 
@@ -31,12 +32,21 @@ class CreateIndexDialog : public QDialog
 						  LiteManWindow * parent = 0);
 		~CreateIndexDialog();
 
+		/*! \brief Prefill the dialog with an index definition.
+		The columns are moved to the top of the list in the given order
+		and checked.
+		\param indexName a name for the new index
+		\param columns the index columns
+		*/
+		void suggest(const QString & indexName, const QStringList & columns);
+
 		bool update;
 
 	private:
 		Ui::CreateIndexDialog ui;
 		QString m_schema;
 
+		void setColumns(const QList<FieldInfo> & columns);
 		void checkToEnable();
 		void resultAppend(QString text);
 
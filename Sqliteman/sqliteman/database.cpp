@@ -7,6 +7,7 @@ for which a new license (GPL+exception) is in place.
 
 #include <QSqlDriver>
 #include <QSqlQuery>
+#include <QSqlResult>
 #include <QSqlError>
 #include <QTextStream>
 #include <QVariant>
@@ -15,9 +16,12 @@ for which a new license (GPL+exception) is in place.
 
 #include "database.h"
 #include "preferences.h"
-#include "shell.h"
+#include "regexp.h"
 #include "utils.h"
 #include "sqlparser.h"
+#ifdef INTERNAL_SQLDRIVER
+#include "driver/qsql_sqlite.h"
+#endif
 
 void Database::exception(const QString & message)
 {
@@ -43,7 +47,7 @@ QString Database::sessionName(const QString & schema)
 DbAttach Database::getDatabases()
 {
 	DbAttach ret;
-	QSqlQuery query("PRAGMA database_list;", QSqlDatabase::database(SESSION_NAME));
+	ForwardQuery query("PRAGMA database_list;");
 
 	if (query.lastError().isValid())
 	{
@@ -121,7 +125,7 @@ QStringList Database::indexFields(const QString & index, const QString &schema)
 				  + ".INDEX_INFO("
 				  + Utils::quote(index)
 				  + ");";
-	QSqlQuery query(sql, QSqlDatabase::database(SESSION_NAME));
+	ForwardQuery query(sql);
 	QStringList fields;
 
 	if (query.lastError().isValid())
@@ -159,7 +163,7 @@ DbObjects Database::getObjects(const QString type, const QString schema)
 			  + " and name not like 'sqlite_%';";
 	}
 
-	QSqlQuery query(sql, QSqlDatabase::database(SESSION_NAME));
+	ForwardQuery query(sql);
 	while(query.next())
 		objs.insertMulti(query.value(1).toString(), query.value(0).toString());
 
@@ -177,11 +181,11 @@ QStringList Database::getSysIndexes(const QString & table, const QString & schem
 	QStringList orig = Database::getObjects("index", schema).values(table);
 	// really all indexes
 	QStringList sysIx;
-	QSqlQuery query(QString("PRAGMA ")
-					+ Utils::quote(schema)
-					+ ".index_list("
-					+ Utils::quote(table)
-					+ ");", QSqlDatabase::database(SESSION_NAME));
+	ForwardQuery query(QString("PRAGMA ")
+					   + Utils::quote(schema)
+					   + ".index_list("
+					   + Utils::quote(table)
+					   + ");");
 
 	QString curr;
 	while(query.next())
@@ -202,10 +206,9 @@ DbObjects Database::getSysObjects(const QString & schema)
 {
 	DbObjects objs;
 
-    QSqlQuery query(QString("SELECT name, tbl_name FROM %1 "
-							"WHERE type = 'table' and name like 'sqlite_%';")
-					.arg(getMaster(schema)),
-					QSqlDatabase::database(SESSION_NAME));
+    ForwardQuery query(QString("SELECT name, tbl_name FROM %1 "
+							   "WHERE type = 'table' and name like 'sqlite_%';")
+					   .arg(getMaster(schema)));
 
 	if (schema.compare("temp", Qt::CaseInsensitive))
 	{
@@ -278,7 +281,7 @@ bool Database::exportSql(const QString & fileName)
 	
 	// Run query for tables
 	QString sql = "SELECT sql FROM sqlite_master;";
-	QSqlQuery query(sql, QSqlDatabase::database(SESSION_NAME));
+	ForwardQuery query(sql);
 	
 	if (query.lastError().isValid())
 	{
@@ -294,42 +297,6 @@ bool Database::exportSql(const QString & fileName)
 	return true;
 }
 
-// TODO/FIXME: it definitely requires worker thread - to unfreeze GUI
-bool Database::dumpDatabase(const QString & fileName)
-{
-	char * fname = fileName.toUtf8().data();
-	FILE * f = fopen(fname, "w");
-	
-	if (f == NULL)
-	{
-		exception(tr("Unable to open file %1 for writing.").arg(fileName));
-		return false;
-	}
-
-	sqlite3 * h = Database::sqlite3handle();
-	Q_ASSERT_X(h!=0, "Database::dumpDatabase", "sqlite3handle is missing");
-	ShellState sh;
-	sh.db = h;
-	sh.out = f;
-	sh.nErr = 0;
-	sh.writableSchema = 0;
-
-	sqlite3_exec(sh.db, "PRAGMA writable_schema=ON", 0, 0, 0);
-	fprintf(sh.out, "BEGIN TRANSACTION;\n");
-	run_schema_dump_query(&sh,
-        "SELECT name, type, sql FROM sqlite_master "
-        "WHERE sql NOT NULL AND type=='table'");
-	run_table_dump_query(&sh,
-		"SELECT sql FROM sqlite_master "
-        "WHERE sql NOT NULL AND type IN ('index','trigger','view')",
-		(const char *)0);
-	fprintf(sh.out, "COMMIT;\n");
-	sqlite3_exec(sh.db, "PRAGMA writable_schema=OFF", 0, 0, 0);
-
-	fclose(f);
-	return true;
-}
-
 QString Database::describeObject(const QString & name,
 								 const QString & schema,
 								 const QString & type)
@@ -341,7 +308,7 @@ QString Database::describeObject(const QString & name,
     			  + " and type = \""
 				  + type
 				  + "\";";
-	QSqlQuery query(sql, QSqlDatabase::database(SESSION_NAME));
+	ForwardQuery query(sql);
 	
 	if (query.lastError().isValid())
 	{
@@ -396,7 +363,7 @@ QString Database::hex(const QByteArray & val)
 QString Database::pragma(const QString & name)
 {
 	QString statement("PRAGMA main.%1;");
-	QSqlQuery query(statement.arg(name), QSqlDatabase::database(SESSION_NAME));
+	ForwardQuery query(statement.arg(name));
 	if (query.lastError().isValid())
 	{
 		exception(tr("Error executing: %1.").arg(query.lastError().text()));
@@ -532,7 +499,48 @@ extern "C" void do_exec(sqlite3_context* context, int n, sqlite3_value** value)
 
 int Database::makeUserFunctions()
 {
-	return sqlite3_create_function(
+	int rc = sqlite3_create_function(
 		sqlite3handle(), "exec", 1, SQLITE_UTF8, NULL, do_exec, NULL, NULL);
+	// REGEXP without the ICU extension
+	if (rc == SQLITE_OK)
+		rc = Regexp::install(sqlite3handle());
+	// xxh64(), row_hash(), table_hash() for the table checksums
+	if (rc == SQLITE_OK)
+		rc = sqlite3XxhashInit(sqlite3handle());
+	// compress(), uncompress() for the columns compressed by Sqliteman
+	if (rc == SQLITE_OK)
+		rc = sqlite3CompressInit(sqlite3handle());
+	return rc;
 }
 
+
+bool Database::hasResultColumns(const QSqlQuery & query)
+{
+	QVariant v = query.result() ? query.result()->handle() : QVariant();
+	if (!v.isValid() || qstrcmp(v.typeName(), "sqlite3_stmt*") != 0)
+		return true;
+
+	sqlite3_stmt * stmt = *static_cast<sqlite3_stmt **>(v.data());
+	return stmt && sqlite3_column_count(stmt) > 0;
+}
+
+
+// the result of a ForwardQuery, owned by the query
+static QSqlResult * forwardResult()
+{
+	QSqlDatabase db(QSqlDatabase::database(SESSION_NAME));
+#ifdef INTERNAL_SQLDRIVER
+	QSQLiteDriver * drv = qobject_cast<QSQLiteDriver*>(db.driver());
+	if (drv)
+		return drv->createForwardOnlyResult();
+#endif
+	return db.driver()->createResult();
+}
+
+ForwardQuery::ForwardQuery(const QString & sql)
+	: QSqlQuery(forwardResult())
+{
+	setForwardOnly(true);
+	if (!sql.isEmpty())
+		exec(sql);
+}
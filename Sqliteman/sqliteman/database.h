@@ -10,6 +10,7 @@ for which a new license (GPL+exception) is in place.
 
 #include <QCoreApplication>
 #include <QSqlDatabase>
+#include <QSqlQuery>
 #include <QStringList>
 
 #include "sqlite3.h"
@@ -18,6 +19,11 @@ for which a new license (GPL+exception) is in place.
 
 #define SESSION_NAME "sqliteman-db"
 
+//! \brief Create the functions of extensions/xxhash.c, compiled into sqlite_lib.
+extern "C" int sqlite3XxhashInit(sqlite3 * db);
+//! \brief Create the functions of extensions/compress.c, compiled into sqlite_lib.
+extern "C" int sqlite3CompressInit(sqlite3 * db);
+
 /*! \brief This struct is a sqlite3 table column representation.
 Something like a system catalogue item */
 typedef struct
@@ -155,8 +161,6 @@ class Database
 		*/
 		static bool exportSql(const QString & fileName);
 
-		static bool dumpDatabase(const QString & fileName);
-
 		static QString describeObject(const QString & name,
 									  const QString & schema,
 									  const QString & type);
@@ -197,9 +201,31 @@ class Database
 
 		static int makeUserFunctions();
 
+		/*! \brief Check if the prepared statement returns any columns.
+		\param query a prepared (or executed) query.
+		\retval bool false for statements like INSERT/CREATE; true when
+		             it cannot be decided (an unknown driver).
+		*/
+		static bool hasResultColumns(const QSqlQuery & query);
+
 	private:
 		//! \brief Error feedback to the user.
 		static void exception(const QString & message);
 };
 
+/*! \brief A forward-only query on the main connection.
+Rows are streamed from the statement instead of being cached in memory
+so it is the right choice for single-pass loops. Construct it where it
+is used and do not copy it around - QSqlQuery recreates a shared result
+as a default (cached) one.
+*/
+class ForwardQuery : public QSqlQuery
+{
+	public:
+		/*! \param sql a statement to execute. Nothing is executed if it's
+		empty so the query can be prepared later. Check lastError() as usual.
+		*/
+		explicit ForwardQuery(const QString & sql = QString());
+};
+
 #endif
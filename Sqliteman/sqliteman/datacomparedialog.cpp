@@ -0,0 +1,857 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QDir>
+#include <QFile>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QMessageBox>
+#include <QSettings>
+#include <QSqlError>
+#include <QSqlQuery>
+
+#include "datacomparedialog.h"
+#include "database.h"
+#include "regexp.h"
+#include "dumpdialog.h"
+#include "utils.h"
+
+// resultTree columns
+#define COL_ROWID 0
+#define COL_KIND 1
+#define COL_COLUMNS 2
+#define COL_FIRST 3
+#define COL_SECOND 4
+
+// the longest value shown in resultTree
+#define MAX_SHOWN 200
+
+
+quint64 DataCompareTask::width() const
+{
+	// unsigned, the span of all 64 bit rowids does not fit into qint64
+	quint64 span = (quint64)to - (quint64)from;
+	return span / buckets + 1;
+}
+
+DataCompareTask DataCompareTask::bucket(int index, int buckets) const
+{
+	quint64 w = width();
+	quint64 start = (quint64)index * w;
+	quint64 span = (quint64)to - (quint64)from;
+	DataCompareTask task;
+	task.from = (qint64)((quint64)from + start);
+	task.to = (span - start < w) ? to : (qint64)((quint64)from + start + w - 1);
+	task.buckets = buckets;
+	return task;
+}
+
+
+DataCompareSide::DataCompareSide(const QString & database, const QString & fileName,
+								 sqlite3 * connection, const QString & table,
+								 const QStringList & columns)
+	: m_database(database),
+	  m_fileName(fileName),
+	  m_table(table),
+	  m_columns(columns),
+	  m_db(connection),
+	  m_own(false),
+	  m_hashStmt(0),
+	  m_valuesStmt(0),
+	  m_rowsRead(0),
+	  m_interrupted(false)
+{
+}
+
+DataCompareSide::~DataCompareSide()
+{
+	sqlite3_finalize(m_hashStmt);
+	sqlite3_finalize(m_valuesStmt);
+	// the read transaction is rolled back
+	if (m_own)
+		sqlite3_close(m_db);
+}
+
+bool DataCompareSide::prepare(const QString & sql, sqlite3_stmt ** stmt)
+{
+	QByteArray utf(sql.toUtf8());
+	if (sqlite3_prepare_v2(m_db, utf.constData(), -1, stmt, 0) == SQLITE_OK)
+		return true;
+	m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+	return false;
+}
+
+bool DataCompareSide::open()
+{
+	if (QFileInfo(m_fileName).isFile())
+	{
+		QByteArray name(QDir::toNativeSeparators(m_fileName).toUtf8());
+		sqlite3 * db = 0;
+		if (sqlite3_open_v2(name.constData(), &db, SQLITE_OPEN_READONLY, 0) != SQLITE_OK)
+		{
+			m_error = QString::fromUtf8(sqlite3_errmsg(db));
+			sqlite3_close(db);
+			return false;
+		}
+		m_db = db;
+		m_own = true;
+		sqlite3_busy_timeout(m_db, 5000);
+		sqlite3XxhashInit(m_db);
+		// generated columns may use REGEXP
+		Regexp::install(m_db);
+		// all levels read one snapshot
+		if (sqlite3_exec(m_db, "BEGIN;", 0, 0, 0) != SQLITE_OK)
+		{
+			m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+			return false;
+		}
+	}
+	if (!m_db)
+	{
+		m_error = QObject::tr("The database has no connection.");
+		return false;
+	}
+
+	// an own connection has the database as main
+	QString source(Utils::quote(m_table));
+	if (!m_own)
+		source = Utils::quote(m_database) + "." + source;
+	QString columns(m_columns.join(", "));
+	// the rowid is hashed too: a bucket sum must see rows which only
+	// swapped their values, as the row by row comparison does
+	return prepare(QString("SELECT rowid, row_hash(rowid, %1) FROM %2 "
+						   "WHERE rowid BETWEEN ?1 AND ?2 ORDER BY rowid;")
+				   .arg(columns).arg(source), &m_hashStmt)
+		   && prepare(QString("SELECT %1 FROM %2 WHERE rowid = ?1;")
+					  .arg(columns).arg(source), &m_valuesStmt);
+}
+
+bool DataCompareSide::sharesConnection(const DataCompareSide & other) const
+{
+	return m_db == other.m_db;
+}
+
+void DataCompareSide::interrupt()
+{
+	m_interrupted = true;
+	if (m_own)
+		sqlite3_interrupt(m_db);
+}
+
+bool DataCompareSide::bounds(qint64 & min, qint64 & max, bool & empty)
+{
+	// each of min() and max() alone is read from the b-tree
+	sqlite3_stmt * stmt = 0;
+	QString source(Utils::quote(m_table));
+	if (!m_own)
+		source = Utils::quote(m_database) + "." + source;
+	if (!prepare(QString("SELECT (SELECT min(rowid) FROM %1), (SELECT max(rowid) FROM %1);")
+				 .arg(source), &stmt))
+		return false;
+	int rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW)
+	{
+		empty = sqlite3_column_type(stmt, 0) == SQLITE_NULL;
+		min = sqlite3_column_int64(stmt, 0);
+		max = sqlite3_column_int64(stmt, 1);
+	}
+	else
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+	sqlite3_finalize(stmt);
+	return rc == SQLITE_ROW;
+}
+
+bool DataCompareSide::process(const QList<DataCompareTask> & tasks,
+							  QList<DataCompareResult> & results)
+{
+	results.clear();
+	foreach (DataCompareTask task, tasks)
+	{
+		DataCompareResult result;
+		quint64 width = 1;
+		if (task.buckets > 0)
+		{
+			width = task.width();
+			result.counts.fill(0, task.buckets);
+			result.sums.fill(0, task.buckets);
+			result.mins.fill(0, task.buckets);
+			result.maxs.fill(0, task.buckets);
+		}
+		sqlite3_bind_int64(m_hashStmt, 1, task.from);
+		sqlite3_bind_int64(m_hashStmt, 2, task.to);
+		int rc = SQLITE_DONE;
+		while (!m_interrupted && (rc = sqlite3_step(m_hashStmt)) == SQLITE_ROW)
+		{
+			qint64 rowid = sqlite3_column_int64(m_hashStmt, 0);
+			quint64 hash = (quint64)sqlite3_column_int64(m_hashStmt, 1);
+			++m_rowsRead;
+			if (task.buckets == 0)
+			{
+				result.rows.insert(rowid, hash);
+				continue;
+			}
+			int i = (int)(((quint64)rowid - (quint64)task.from) / width);
+			// rows come in rowid order
+			if (result.counts.at(i) == 0)
+				result.mins[i] = rowid;
+			result.maxs[i] = rowid;
+			++result.counts[i];
+			// the sum does not depend on the order of the rows
+			result.sums[i] += hash;
+		}
+		sqlite3_reset(m_hashStmt);
+		if (m_interrupted)
+			return false;
+		if (rc != SQLITE_DONE)
+		{
+			m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+			return false;
+		}
+		results.append(result);
+	}
+	return true;
+}
+
+bool DataCompareSide::values(qint64 rowid, QList<QByteArray> & values)
+{
+	values.clear();
+	sqlite3_bind_int64(m_valuesStmt, 1, rowid);
+	int rc = sqlite3_step(m_valuesStmt);
+	if (rc == SQLITE_ROW)
+	{
+		for (int i = 0; i < m_columns.count(); ++i)
+		{
+			QByteArray value;
+			DumpThread::appendValue(value, m_valuesStmt, i);
+			values.append(value);
+		}
+		rc = SQLITE_DONE;
+	}
+	if (rc != SQLITE_DONE)
+		m_error = QString::fromUtf8(sqlite3_errmsg(m_db));
+	sqlite3_reset(m_valuesStmt);
+	return rc == SQLITE_DONE;
+}
+
+
+DataCompareJob::DataCompareJob(DataCompareSide * side, const QList<DataCompareTask> & tasks,
+							   QObject * parent)
+	: QThread(parent),
+	  ok(false),
+	  m_side(side),
+	  m_tasks(tasks)
+{
+}
+
+void DataCompareJob::run()
+{
+	ok = m_side->process(m_tasks, results);
+}
+
+
+DataCompareThread::DataCompareThread(DataCompareSide * first, DataCompareSide * second,
+									 int maxDifferences, QObject * parent)
+	: QThread(parent),
+	  m_first(first),
+	  m_second(second),
+	  m_maxDifferences(maxDifferences),
+	  m_cancelled(false),
+	  m_truncated(false),
+	  m_levels(0)
+{
+}
+
+DataCompareThread::~DataCompareThread()
+{
+	delete m_first;
+	delete m_second;
+}
+
+qint64 DataCompareThread::rowsRead() const
+{
+	return m_first->rowsRead() + m_second->rowsRead();
+}
+
+void DataCompareThread::cancel()
+{
+	m_cancelled = true;
+	m_first->interrupt();
+	m_second->interrupt();
+}
+
+bool DataCompareThread::process(const QList<DataCompareTask> & tasks,
+								QList<DataCompareResult> & first,
+								QList<DataCompareResult> & second)
+{
+	bool ok;
+	bool otherOk;
+	if (m_first->sharesConnection(*m_second))
+	{
+		ok = m_first->process(tasks, first);
+		otherOk = ok && m_second->process(tasks, second);
+	}
+	else
+	{
+		DataCompareJob job(m_second, tasks);
+		job.start();
+		ok = m_first->process(tasks, first);
+		job.wait();
+		otherOk = job.ok;
+		second = job.results;
+	}
+	if (!m_cancelled && !ok)
+		m_error = QString("%1: %2").arg(m_first->database()).arg(m_first->error());
+	else if (!m_cancelled && !otherOk)
+		m_error = QString("%1: %2").arg(m_second->database()).arg(m_second->error());
+	return ok && otherOk;
+}
+
+void DataCompareThread::compareRows(const QMap<qint64,quint64> & first,
+									const QMap<qint64,quint64> & second)
+{
+	// both are ordered by rowid
+	QMap<qint64,quint64>::const_iterator a = first.constBegin();
+	QMap<qint64,quint64>::const_iterator b = second.constBegin();
+	while (a != first.constEnd() || b != second.constEnd())
+	{
+		Difference difference;
+		if (b == second.constEnd() || (a != first.constEnd() && a.key() < b.key()))
+		{
+			difference.kind = OnlyFirst;
+			difference.rowid = a.key();
+			++a;
+		}
+		else if (a == first.constEnd() || b.key() < a.key())
+		{
+			difference.kind = OnlySecond;
+			difference.rowid = b.key();
+			++b;
+		}
+		else
+		{
+			bool equal = a.value() == b.value();
+			difference.kind = Changed;
+			difference.rowid = a.key();
+			++a;
+			++b;
+			if (equal)
+				continue;
+		}
+		if (m_differences.count() >= m_maxDifferences)
+		{
+			m_truncated = true;
+			return;
+		}
+		m_differences.append(difference);
+	}
+}
+
+bool DataCompareThread::readValues()
+{
+	for (int i = 0; i < m_differences.count() && !m_cancelled; ++i)
+	{
+		Difference & difference = m_differences[i];
+		if (difference.kind != OnlySecond
+			&& !m_first->values(difference.rowid, difference.first))
+		{
+			m_error = QString("%1: %2").arg(m_first->database()).arg(m_first->error());
+			return false;
+		}
+		if (difference.kind != OnlyFirst
+			&& !m_second->values(difference.rowid, difference.second))
+		{
+			m_error = QString("%1: %2").arg(m_second->database()).arg(m_second->error());
+			return false;
+		}
+	}
+	return true;
+}
+
+void DataCompareThread::run()
+{
+	if (!m_first->open())
+	{
+		m_error = QString("%1: %2").arg(m_first->database()).arg(m_first->error());
+		return;
+	}
+	if (!m_second->open())
+	{
+		m_error = QString("%1: %2").arg(m_second->database()).arg(m_second->error());
+		return;
+	}
+
+	qint64 min;
+	qint64 max;
+	qint64 otherMin;
+	qint64 otherMax;
+	bool empty;
+	bool otherEmpty;
+	if (!m_first->bounds(min, max, empty))
+	{
+		m_error = QString("%1: %2").arg(m_first->database()).arg(m_first->error());
+		return;
+	}
+	if (!m_second->bounds(otherMin, otherMax, otherEmpty))
+	{
+		m_error = QString("%1: %2").arg(m_second->database()).arg(m_second->error());
+		return;
+	}
+	if (empty && otherEmpty)
+		return;
+
+	// the rowids of both tables
+	DataCompareTask all;
+	all.from = empty ? otherMin : (otherEmpty ? min : qMin(min, otherMin));
+	all.to = empty ? otherMax : (otherEmpty ? max : qMax(max, otherMax));
+	all.buckets = ((quint64)all.to - (quint64)all.from < (quint64)Fanout) ? 0 : (int)Fanout;
+
+	QList<DataCompareTask> tasks;
+	tasks.append(all);
+	while (!tasks.isEmpty() && !m_cancelled && !m_truncated)
+	{
+		++m_levels;
+		emit progress(m_levels, tasks.count());
+		QList<DataCompareResult> first;
+		QList<DataCompareResult> second;
+		if (!process(tasks, first, second))
+			return;
+
+		// only the buckets which differ are split again
+		QList<DataCompareTask> next;
+		for (int i = 0; i < tasks.count() && !m_truncated; ++i)
+		{
+			const DataCompareTask & task = tasks.at(i);
+			if (task.buckets == 0)
+			{
+				compareRows(first.at(i).rows, second.at(i).rows);
+				continue;
+			}
+			for (int j = 0; j < task.buckets; ++j)
+			{
+				qint64 count = first.at(i).counts.at(j);
+				qint64 otherCount = second.at(i).counts.at(j);
+				if (count == otherCount && first.at(i).sums.at(j) == second.at(i).sums.at(j))
+					continue;
+				// only the rowids present in either table, sparse rowids
+				// would need many levels of nearly empty buckets otherwise
+				DataCompareTask bucket(task.bucket(j, Fanout));
+				if (count == 0)
+				{
+					bucket.from = second.at(i).mins.at(j);
+					bucket.to = second.at(i).maxs.at(j);
+				}
+				else if (otherCount == 0)
+				{
+					bucket.from = first.at(i).mins.at(j);
+					bucket.to = first.at(i).maxs.at(j);
+				}
+				else
+				{
+					bucket.from = qMin(first.at(i).mins.at(j), second.at(i).mins.at(j));
+					bucket.to = qMax(first.at(i).maxs.at(j), second.at(i).maxs.at(j));
+				}
+				if (qMax(count, otherCount) <= LeafRows
+					|| (quint64)bucket.to - (quint64)bucket.from < (quint64)Fanout)
+					bucket.buckets = 0;
+				next.append(bucket);
+			}
+		}
+		tasks = next;
+	}
+	if (!m_cancelled)
+		readValues();
+}
+
+
+DataCompareDialog::DataCompareDialog(QWidget * parent)
+	: QDialog(parent),
+	  m_thread(0)
+{
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("datacompare/height", QVariant(500)).toInt();
+	int ww = settings.value("datacompare/width", QVariant(700)).toInt();
+	resize(ww, hh);
+	ui.maxSpinBox->setValue(settings.value("datacompare/maxDifferences",
+								QVariant(ui.maxSpinBox->value())).toInt());
+
+	QStringList databases(Database::getDatabases().keys());
+	ui.databaseComboBox->addItems(databases);
+	ui.otherComboBox->addItems(databases);
+	ui.databaseComboBox->setCurrentIndex(databases.indexOf("main"));
+	// the first attached database is the most likely copy
+	foreach (QString schema, databases)
+	{
+		if (schema != "main" && schema != "temp")
+		{
+			ui.otherComboBox->setCurrentIndex(databases.indexOf(schema));
+			break;
+		}
+	}
+	databaseComboBox_activated(ui.databaseComboBox->currentText());
+	setRunning(false);
+
+	if (databases.count() < 2)
+		ui.statusLabel->setText(tr("Attach the database with the copy of the table first."));
+
+	connect(ui.databaseComboBox, SIGNAL(activated(const QString &)),
+			this, SLOT(databaseComboBox_activated(const QString &)));
+	connect(ui.compareButton, SIGNAL(clicked()), this, SLOT(compareButton_clicked()));
+	connect(ui.cancelButton, SIGNAL(clicked()), this, SLOT(cancelButton_clicked()));
+	connect(ui.scriptButton, SIGNAL(clicked()), this, SLOT(scriptButton_clicked()));
+}
+
+DataCompareDialog::~DataCompareDialog()
+{
+	if (m_thread)
+	{
+		m_thread->cancel();
+		m_thread->wait();
+		delete m_thread;
+	}
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("datacompare/height", QVariant(height()));
+	settings.setValue("datacompare/width", QVariant(width()));
+	settings.setValue("datacompare/maxDifferences", QVariant(ui.maxSpinBox->value()));
+}
+
+bool DataCompareDialog::commonColumns(const QString & schema, const QString & otherSchema,
+									  const QString & table, QStringList & columns,
+									  bool & integerKey, QString & error)
+{
+	QList<QStringList> names;
+	QStringList primaryKey;
+	QString type;
+	QStringList schemas;
+	schemas << schema << otherSchema;
+	foreach (QString current, schemas)
+	{
+		QStringList list;
+		ForwardQuery query(QString("PRAGMA %1.table_info(%2);")
+						   .arg(Utils::quote(current))
+						   .arg(Utils::quote(table)));
+		while (query.next())
+		{
+			list.append(query.value(1).toString());
+			if (current != schema || query.value(5).toInt() == 0)
+				continue;
+			primaryKey.append(query.value(1).toString());
+			type = query.value(2).toString();
+		}
+		if (list.isEmpty())
+		{
+			error = tr("There is no table %1 in %2.").arg(table).arg(current);
+			return false;
+		}
+		names.append(list);
+	}
+	// an INTEGER PRIMARY KEY is the rowid
+	integerKey = primaryKey.count() == 1 && type.toUpper() == "INTEGER";
+
+	// the columns are matched by name, in the order of the first table
+	QStringList reasons;
+	for (int side = 0; side < 2; ++side)
+	{
+		QStringList missing;
+		foreach (QString name, names.at(side))
+		{
+			bool found = false;
+			for (int i = 0; i < names.at(1 - side).count() && !found; ++i)
+				found = names.at(1 - side).at(i).compare(name, Qt::CaseInsensitive) == 0;
+			if (!found)
+				missing.append(name);
+		}
+		if (!missing.isEmpty())
+			reasons.append(tr("%1 has no column %2")
+						   .arg(schemas.at(1 - side)).arg(missing.join(", ")));
+	}
+	if (!reasons.isEmpty())
+	{
+		error = tr("The tables differ in their columns: %1.").arg(reasons.join("; "));
+		return false;
+	}
+	columns = names.at(0);
+	return true;
+}
+
+void DataCompareDialog::setRunning(bool running)
+{
+	ui.databaseComboBox->setEnabled(!running);
+	ui.tableComboBox->setEnabled(!running);
+	ui.otherComboBox->setEnabled(!running);
+	ui.maxSpinBox->setEnabled(!running);
+	ui.compareButton->setEnabled(!running);
+	ui.cancelButton->setEnabled(running);
+	ui.scriptButton->setEnabled(!running && ui.resultTree->topLevelItemCount() > 0);
+}
+
+void DataCompareDialog::databaseComboBox_activated(const QString & schema)
+{
+	QString current(ui.tableComboBox->currentText());
+	QStringList tables(Database::getObjects("table", schema).keys());
+	tables.sort();
+	ui.tableComboBox->clear();
+	ui.tableComboBox->addItems(tables);
+	if (tables.contains(current))
+		ui.tableComboBox->setCurrentIndex(tables.indexOf(current));
+}
+
+void DataCompareDialog::compareButton_clicked()
+{
+	QString table(ui.tableComboBox->currentText());
+	QString schema(ui.databaseComboBox->currentText());
+	QString otherSchema(ui.otherComboBox->currentText());
+	ui.resultTree->clear();
+	ui.scriptButton->setEnabled(false);
+	if (table.isEmpty())
+		return;
+	if (schema == otherSchema)
+	{
+		ui.statusLabel->setText(tr("Choose two different databases."));
+		return;
+	}
+
+	QString error;
+	bool integerKey;
+	if (!commonColumns(schema, otherSchema, table, m_columns, integerKey, error))
+	{
+		ui.statusLabel->setText(error);
+		return;
+	}
+	// other rowids are not stable, VACUUM renumbers them
+	if (!integerKey)
+	{
+		ui.statusLabel->setText(tr("Only tables with an INTEGER PRIMARY KEY can be compared."));
+		return;
+	}
+	// the rows are matched by rowid
+	ForwardQuery query(QString("SELECT rowid FROM %1.%2 LIMIT 0;")
+					   .arg(Utils::quote(schema))
+					   .arg(Utils::quote(table)));
+	if (query.lastError().isValid())
+	{
+		ui.statusLabel->setText(tr("Tables without rowid cannot be compared."));
+		return;
+	}
+
+	DbAttach files(Database::getDatabases());
+	sqlite3 * connection = 0;
+	if (!QFileInfo(files.value(schema)).isFile() || !QFileInfo(files.value(otherSchema)).isFile())
+	{
+		connection = Database::sqlite3handle();
+		if (!connection)
+			return;
+	}
+	QStringList columns;
+	foreach (QString column, m_columns)
+		columns.append(Utils::quote(column));
+	m_table = table;
+	m_thread = new DataCompareThread(
+		new DataCompareSide(schema, files.value(schema), connection, table, columns),
+		new DataCompareSide(otherSchema, files.value(otherSchema), connection, table, columns),
+		ui.maxSpinBox->value(), this);
+	connect(m_thread, SIGNAL(progress(int, int)), this, SLOT(thread_progress(int, int)));
+	connect(m_thread, SIGNAL(finished()), this, SLOT(thread_finished()));
+
+	ui.resultTree->headerItem()->setText(COL_FIRST, schema);
+	ui.resultTree->headerItem()->setText(COL_SECOND, otherSchema);
+	ui.statusLabel->setText(tr("Comparing..."));
+	setRunning(true);
+	m_time.start();
+	m_thread->start();
+}
+
+void DataCompareDialog::cancelButton_clicked()
+{
+	if (m_thread)
+		m_thread->cancel();
+}
+
+void DataCompareDialog::thread_progress(int level, int ranges)
+{
+	if (level == 1)
+		ui.statusLabel->setText(tr("Hashing the tables..."));
+	else
+		ui.statusLabel->setText(tr("Level %1: hashing %2 ranges which differ...")
+								.arg(level).arg(ranges));
+}
+
+//! \brief "column = value" of the given columns, shortened for the tree.
+static QString shownValues(const QStringList & columns, const QList<QByteArray> & values,
+						   const QList<int> & indexes)
+{
+	QStringList shown;
+	foreach (int i, indexes)
+	{
+		QString value(QString::fromUtf8(values.at(i)));
+		if (value.length() > MAX_SHOWN)
+			value = value.left(MAX_SHOWN) + "...";
+		shown.append(QString("%1 = %2").arg(columns.at(i)).arg(value));
+	}
+	return shown.join(", ");
+}
+
+void DataCompareDialog::thread_finished()
+{
+	if (!m_thread)
+		return;
+	m_differences = m_thread->differences();
+	QList<int> all;
+	for (int i = 0; i < m_columns.count(); ++i)
+		all.append(i);
+	int counts[3] = { 0, 0, 0 };
+	foreach (DataCompareThread::Difference difference, m_differences)
+	{
+		QTreeWidgetItem * item = new QTreeWidgetItem(ui.resultTree);
+		item->setData(COL_ROWID, Qt::DisplayRole, difference.rowid);
+		++counts[difference.kind];
+		switch (difference.kind)
+		{
+			case DataCompareThread::OnlyFirst:
+				item->setText(COL_KIND, tr("missing in %1").arg(ui.otherComboBox->currentText()));
+				item->setText(COL_FIRST, shownValues(m_columns, difference.first, all));
+				break;
+			case DataCompareThread::OnlySecond:
+				item->setText(COL_KIND, tr("only in %1").arg(ui.otherComboBox->currentText()));
+				item->setText(COL_SECOND, shownValues(m_columns, difference.second, all));
+				break;
+			case DataCompareThread::Changed:
+			{
+				QList<int> changed;
+				QStringList names;
+				for (int i = 0; i < m_columns.count(); ++i)
+				{
+					if (difference.first.value(i) == difference.second.value(i))
+						continue;
+					changed.append(i);
+					names.append(m_columns.at(i));
+				}
+				item->setText(COL_KIND, tr("changed"));
+				item->setText(COL_COLUMNS, names.join(", "));
+				if (difference.first.count() == m_columns.count()
+					&& difference.second.count() == m_columns.count())
+				{
+					item->setText(COL_FIRST, shownValues(m_columns, difference.first, changed));
+					item->setText(COL_SECOND, shownValues(m_columns, difference.second, changed));
+				}
+				break;
+			}
+		}
+		item->setToolTip(COL_FIRST, item->text(COL_FIRST));
+		item->setToolTip(COL_SECOND, item->text(COL_SECOND));
+	}
+	for (int i = 0; i < COL_FIRST; ++i)
+		ui.resultTree->resizeColumnToContents(i);
+
+	QString seconds(QString::number(m_time.elapsed() / 1000.0, 'f', 1));
+	QString stats(tr("%1 rows read in %2 levels, %3 s.")
+				  .arg(m_thread->rowsRead()).arg(m_thread->levels()).arg(seconds));
+	int found = m_differences.count();
+	if (!m_thread->error().isEmpty())
+		ui.statusLabel->setText(tr("Error while comparing")
+								+ ":<br/><span style=\" color:#ff0000;\">"
+								+ m_thread->error() + "</span>");
+	else if (m_thread->isCancelled())
+		ui.statusLabel->setText(tr("Stopped. %1 differences found.").arg(found));
+	else if (found == 0)
+		ui.statusLabel->setText(tr("The tables are equal.") + " " + stats);
+	else
+		ui.statusLabel->setText(tr("%1 rows missing in %2, %3 rows only in %2, %4 rows changed%5.")
+								.arg(counts[DataCompareThread::OnlyFirst])
+								.arg(ui.otherComboBox->currentText())
+								.arg(counts[DataCompareThread::OnlySecond])
+								.arg(counts[DataCompareThread::Changed])
+								.arg(m_thread->isTruncated()
+									 ? tr(", more differences were not listed") : QString())
+								+ " " + stats);
+
+	m_thread->deleteLater();
+	m_thread = 0;
+	setRunning(false);
+}
+
+QByteArray DataCompareDialog::script()
+{
+	QByteArray target((Utils::quote(ui.otherComboBox->currentText()) + "."
+					   + Utils::quote(m_table)).toUtf8());
+	QList<QByteArray> columns;
+	foreach (QString column, m_columns)
+		columns.append(Utils::quote(column).toUtf8());
+	QByteArray deletes;
+	QByteArray updates;
+	QByteArray inserts;
+	foreach (DataCompareThread::Difference difference, m_differences)
+	{
+		QByteArray rowid(QByteArray::number(difference.rowid));
+		if (difference.kind == DataCompareThread::OnlySecond)
+		{
+			deletes += "DELETE FROM " + target + " WHERE rowid = " + rowid + ";\n";
+			continue;
+		}
+		// the values of the first table, they are SQL literals already
+		QByteArray names;
+		QByteArray values;
+		QByteArray sets;
+		for (int i = 0; i < columns.count(); ++i)
+		{
+			QByteArray separator(i ? ", " : "");
+			names += separator + columns.at(i);
+			values += separator + difference.first.value(i);
+			if (difference.first.value(i) != difference.second.value(i))
+				sets += (sets.isEmpty() ? "" : ", ") + columns.at(i) + " = "
+						+ difference.first.value(i);
+		}
+		if (difference.kind == DataCompareThread::Changed)
+			updates += "UPDATE " + target + " SET " + sets + " WHERE rowid = " + rowid + ";\n";
+		// the INTEGER PRIMARY KEY is among the columns already
+		else
+			inserts += "INSERT INTO " + target + " (" + names + ") VALUES ("
+					   + values + ");\n";
+	}
+
+	// deleted rows first so inserted rows do not collide with them
+	QByteArray source((Utils::quote(ui.databaseComboBox->currentText()) + "."
+					   + Utils::quote(m_table)).toUtf8());
+	return "-- Makes " + target + " equal to " + source + "\n"
+		   + "BEGIN;\n" + deletes + updates + inserts + "COMMIT;\n";
+}
+
+void DataCompareDialog::scriptButton_clicked()
+{
+	QString fileName = QFileDialog::getSaveFileName(this, tr("Save Sync Script"),
+													QDir::currentPath(),
+													tr("SQL script (*.sql);;All Files (*)"));
+	if (fileName.isEmpty())
+		return;
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		QMessageBox::warning(this, windowTitle(),
+							 tr("Cannot write %1: %2").arg(fileName).arg(file.errorString()));
+		return;
+	}
+	file.write(script());
+	file.close();
+	ui.statusLabel->setText(tr("The sync script is saved as %1.").arg(fileName));
+}
+
+void DataCompareDialog::reject()
+{
+	if (m_thread)
+	{
+		int ret = QMessageBox::question(this, windowTitle(),
+						tr("The tables are still compared. Do you want to stop it?"),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+		m_thread->cancel();
+		m_thread->wait();
+		delete m_thread;
+		m_thread = 0;
+	}
+	QDialog::reject();
+}
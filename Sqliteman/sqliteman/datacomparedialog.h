@@ -0,0 +1,264 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef DATACOMPAREDIALOG_H
+#define DATACOMPAREDIALOG_H
+
+#include <qdialog.h>
+#include <QMap>
+#include <QStringList>
+#include <QThread>
+#include <QTime>
+#include <QVector>
+
+#include "sqlite3.h"
+#include "ui_datacomparedialog.h"
+
+
+//! \brief A rowid range to hash, split into buckets or row by row.
+struct DataCompareTask
+{
+	qint64 from;
+	qint64 to;
+	//! \brief Count of equal sized buckets, 0 for the rows themselves
+	int buckets;
+
+	//! \brief Rowids in one bucket; the last bucket may be shorter.
+	quint64 width() const;
+	//! \brief The range of the bucket.
+	DataCompareTask bucket(int index, int buckets) const;
+};
+
+//! \brief The hashes of a DataCompareTask on one side.
+struct DataCompareResult
+{
+	//! \brief Rows and the sum of their row_hash() in every bucket
+	QVector<qint64> counts;
+	QVector<quint64> sums;
+	//! \brief The smallest and the largest rowid in every bucket
+	QVector<qint64> mins;
+	QVector<qint64> maxs;
+	//! \brief rowid -> row_hash() when the task is not split
+	QMap<qint64,quint64> rows;
+};
+
+
+/*! \brief A table in one database for a data compare.
+The table is read on its own read-only connection in one read
+transaction, so the hashes of all levels see the same data. Databases
+without a file (in-memory and temp) are read on the connection of the
+application. The row_hash() function of the xxhash extension hashes the
+compared columns, in the same order on both sides.
+*/
+class DataCompareSide
+{
+	public:
+		/*!
+		\param database the schema name in the application
+		\param fileName its file to open read-only
+		\param connection the connection of the application, used when
+		       fileName is not a file; the table is addressed by database then
+		\param table the compared table
+		\param columns the compared columns, already quoted
+		*/
+		DataCompareSide(const QString & database, const QString & fileName,
+						sqlite3 * connection, const QString & table,
+						const QStringList & columns);
+		~DataCompareSide();
+
+		bool open();
+		QString error() const { return m_error; };
+		QString database() const { return m_database; };
+		//! \brief Both sides use one connection, they cannot read at once.
+		bool sharesConnection(const DataCompareSide & other) const;
+		//! \brief Stop reading; called from other threads.
+		void interrupt();
+
+		//! \brief The smallest and the largest rowid, false on an error.
+		bool bounds(qint64 & min, qint64 & max, bool & empty);
+		//! \brief Hash the tasks in one pass over each of their ranges.
+		bool process(const QList<DataCompareTask> & tasks,
+					 QList<DataCompareResult> & results);
+		/*! \brief The compared columns of a row as SQL literals.
+		\retval false on an error; values is empty when there is no such row
+		*/
+		bool values(qint64 rowid, QList<QByteArray> & values);
+		//! \brief Rows read by process() so far.
+		qint64 rowsRead() const { return m_rowsRead; };
+
+	private:
+		QString m_database;
+		QString m_fileName;
+		QString m_table;
+		QStringList m_columns;
+		sqlite3 * m_db;
+		bool m_own;
+		sqlite3_stmt * m_hashStmt;
+		sqlite3_stmt * m_valuesStmt;
+		QString m_error;
+		qint64 m_rowsRead;
+		volatile bool m_interrupted;
+
+		bool prepare(const QString & sql, sqlite3_stmt ** stmt);
+};
+
+
+/*! \brief Hash the tasks of one side in a thread.
+The other side is hashed meanwhile by DataCompareThread itself.
+*/
+class DataCompareJob : public QThread
+{
+	public:
+		DataCompareJob(DataCompareSide * side, const QList<DataCompareTask> & tasks,
+					   QObject * parent = 0);
+
+		bool ok;
+		QList<DataCompareResult> results;
+
+	protected:
+		void run();
+
+	private:
+		DataCompareSide * m_side;
+		QList<DataCompareTask> m_tasks;
+};
+
+
+/*! \brief Find the rows which differ between two copies of a table.
+The rows are matched by rowid, which must be an INTEGER PRIMARY KEY.
+The whole rowid range of both tables is split into buckets, and the
+counts and sums of row hashes of the buckets are compared. Only the buckets which differ are split again in
+the next level, until they are small enough to compare row by row. Each
+level reads both tables at once on their own connections.
+Without stored hashes the first level reads both tables once; the next
+levels read only the ranges around the differences, so the rest of the
+time depends on the number of differences, not on the size of the table.
+*/
+class DataCompareThread : public QThread
+{
+	Q_OBJECT
+
+	public:
+		enum Kind
+		{
+			OnlyFirst,
+			OnlySecond,
+			Changed
+		};
+
+		struct Difference
+		{
+			Kind kind;
+			qint64 rowid;
+			//! \brief SQL literals of the compared columns, empty when missing
+			QList<QByteArray> first;
+			QList<QByteArray> second;
+		};
+
+		/*!
+		\param first the reference
+		\param second the copy
+		\param maxDifferences stop after this many differing rows
+		\param parent standard Qt parent
+		The sides are owned by the thread.
+		*/
+		DataCompareThread(DataCompareSide * first, DataCompareSide * second,
+						  int maxDifferences, QObject * parent = 0);
+		~DataCompareThread();
+
+		QString error() const { return m_error; };
+		bool isCancelled() const { return m_cancelled; };
+		//! \brief More differences were found than reported.
+		bool isTruncated() const { return m_truncated; };
+		QList<Difference> differences() const { return m_differences; };
+		//! \brief The rows read on both sides.
+		qint64 rowsRead() const;
+		int levels() const { return m_levels; };
+
+		enum
+		{
+			//! \brief Buckets of a split range
+			Fanout = 256,
+			//! \brief Ranges with at most this many rows are compared row by row
+			LeafRows = 64
+		};
+
+	public slots:
+		void cancel();
+
+	signals:
+		//! \brief Level has ranges to hash.
+		void progress(int level, int ranges);
+
+	protected:
+		void run();
+
+	private:
+		DataCompareSide * m_first;
+		DataCompareSide * m_second;
+		int m_maxDifferences;
+		QList<Difference> m_differences;
+		QString m_error;
+		volatile bool m_cancelled;
+		bool m_truncated;
+		int m_levels;
+
+		//! \brief Hash the tasks on both sides, at once when possible.
+		bool process(const QList<DataCompareTask> & tasks,
+					 QList<DataCompareResult> & first,
+					 QList<DataCompareResult> & second);
+		void compareRows(const QMap<qint64,quint64> & first,
+						 const QMap<qint64,quint64> & second);
+		bool readValues();
+};
+
+
+/*! \brief Compare the data of a table in two attached databases.
+The differences are found by DataCompareThread. A script of INSERT,
+UPDATE and DELETE statements which makes the second table equal to the
+first one can be saved.
+*/
+class DataCompareDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		DataCompareDialog(QWidget * parent = 0);
+		~DataCompareDialog();
+
+		/*! \brief Columns of table present in both databases.
+		\param columns the names in the order of the first database
+		\param integerKey the table has an INTEGER PRIMARY KEY, the rowid is a column
+		\retval false when the tables differ in their columns; the reason is in error
+		*/
+		static bool commonColumns(const QString & schema, const QString & otherSchema,
+								  const QString & table, QStringList & columns,
+								  bool & integerKey, QString & error);
+
+	private:
+		Ui::DataCompareDialog ui;
+		DataCompareThread * m_thread;
+		QString m_table;
+		QStringList m_columns;
+		QList<DataCompareThread::Difference> m_differences;
+		QTime m_time;
+
+		void setRunning(bool running);
+		//! \brief The statements making the second table equal to the first one.
+		QByteArray script();
+
+	private slots:
+		void databaseComboBox_activated(const QString & schema);
+		void compareButton_clicked();
+		void cancelButton_clicked();
+		void scriptButton_clicked();
+		void thread_progress(int level, int ranges);
+		void thread_finished();
+		void reject();
+};
+
+#endif
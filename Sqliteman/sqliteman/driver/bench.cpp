@@ -0,0 +1,201 @@
+/*
+Times the SQLite driver of Sqliteman, see bench.pro.
+
+Fetch: text columns are read through a forward only QSqlQuery from a
+UTF-8 and from a UTF-16 database. On the UTF-8 one the old UTF-16 path
+(sqlite3_column_text16(), transcoded by SQLite) is timed against the
+UTF-8 one the driver uses now, on the same statement.
+
+Batch: the rows are inserted again with one QSqlQuery::exec() per row,
+in autocommit mode (only a few of them) and inside a transaction, and
+with one QSqlQuery::execBatch() of QVariantList columns.
+*/
+
+#include <QtDebug>
+#include <QCoreApplication>
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlDriver>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTime>
+#include <QVariant>
+
+#include <sqlite3.h>
+
+#include "qsql_sqlite.h"
+
+
+static const int rows = 100000;
+
+
+static QSqlDatabase open(const QString & name, const QString & file)
+{
+	QSqlDatabase db = QSqlDatabase::addDatabase(new QSQLiteDriver(), name);
+	db.setDatabaseName(file);
+	if (!db.open())
+		qDebug() << "open:" << db.lastError().text();
+	return db;
+}
+
+static sqlite3 * handle(const QSqlDatabase & db)
+{
+	QVariant v = db.driver()->handle();
+	return *static_cast<sqlite3 * const *>(v.constData());
+}
+
+static QString perSecond(int count, int ms)
+{
+	return QString("%1 rows/s (%2 ms)")
+			.arg(ms ? qint64(count) * 1000 / ms : 0).arg(ms);
+}
+
+//! \brief A new database file in encoding with rows of text.
+static void fill(const QString & file, const QString & encoding)
+{
+	QFile::remove(file);
+	{
+		QSqlDatabase db = open("fill", file);
+		QSqlQuery query(db);
+		query.exec("PRAGMA encoding = '" + encoding + "'");
+		query.exec("CREATE TABLE t (a TEXT, b TEXT)");
+		db.transaction();
+		query.prepare("INSERT INTO t VALUES (?, ?)");
+		for (int i = 0; i < rows; ++i)
+		{
+			query.addBindValue(QString("customer %1, some street %2").arg(i).arg(i % 97));
+			query.addBindValue(QString::fromUtf8("Příliš žluťoučký kůň %1").arg(i));
+			query.exec();
+		}
+		db.commit();
+	}
+	QSqlDatabase::removeDatabase("fill");
+}
+
+static void fetch(const QString & file, const QString & label)
+{
+	{
+		QSqlDatabase db = open("fetch", file);
+		QSqlQuery query(db);
+		query.setForwardOnly(true);
+		QTime time;
+		time.start();
+		query.exec("SELECT a, b FROM t");
+		int count = 0;
+		while (query.next())
+		{
+			query.value(0).toString();
+			query.value(1).toString();
+			++count;
+		}
+		qDebug() << "fetch" << label << perSecond(count, time.elapsed());
+	}
+	QSqlDatabase::removeDatabase("fetch");
+}
+
+//! \brief The UTF-16 and the UTF-8 API on the statement of a UTF-8 database.
+static void fetchApi(const QString & file)
+{
+	{
+		QSqlDatabase db = open("api", file);
+		sqlite3 * access = handle(db);
+		sqlite3_stmt * stmt = 0;
+		sqlite3_prepare_v2(access, "SELECT a, b FROM t", -1, &stmt, 0);
+		for (int utf8 = 0; utf8 < 2; ++utf8)
+		{
+			QTime time;
+			time.start();
+			int count = 0;
+			while (sqlite3_step(stmt) == SQLITE_ROW)
+			{
+				for (int i = 0; i < 2; ++i)
+				{
+					if (utf8)
+						QString::fromUtf8((const char *)sqlite3_column_text(stmt, i),
+										  sqlite3_column_bytes(stmt, i));
+					else
+						QString((const QChar *)sqlite3_column_text16(stmt, i),
+								sqlite3_column_bytes16(stmt, i) / sizeof(QChar));
+				}
+				++count;
+			}
+			sqlite3_reset(stmt);
+			qDebug() << (utf8 ? "column_text  " : "column_text16")
+					 << perSecond(count, time.elapsed());
+		}
+		sqlite3_finalize(stmt);
+	}
+	QSqlDatabase::removeDatabase("api");
+}
+
+static void insertRows(const QString & label, int count, bool transaction)
+{
+	QFile::remove("bench-insert.db");
+	{
+		QSqlDatabase db = open("insert", "bench-insert.db");
+		QSqlQuery query(db);
+		query.exec("CREATE TABLE t (a TEXT, b TEXT)");
+		query.prepare("INSERT INTO t VALUES (?, ?)");
+		QTime time;
+		time.start();
+		if (transaction)
+			db.transaction();
+		for (int i = 0; i < count; ++i)
+		{
+			query.addBindValue(QString("customer %1, some street %2").arg(i).arg(i % 97));
+			query.addBindValue(QString::fromUtf8("Příliš žluťoučký kůň %1").arg(i));
+			if (!query.exec())
+				qDebug() << "exec:" << query.lastError().text();
+		}
+		if (transaction)
+			db.commit();
+		qDebug() << "exec     " << label << perSecond(count, time.elapsed());
+	}
+	QSqlDatabase::removeDatabase("insert");
+}
+
+static void insertBatch()
+{
+	QFile::remove("bench-insert.db");
+	{
+		QSqlDatabase db = open("batch", "bench-insert.db");
+		QSqlQuery query(db);
+		query.exec("CREATE TABLE t (a TEXT, b TEXT)");
+		query.prepare("INSERT INTO t VALUES (?, ?)");
+		QTime time;
+		time.start();
+		QVariantList a;
+		QVariantList b;
+		for (int i = 0; i < rows; ++i)
+		{
+			a << QString("customer %1, some street %2").arg(i).arg(i % 97);
+			b << QString::fromUtf8("Příliš žluťoučký kůň %1").arg(i);
+		}
+		query.addBindValue(a);
+		query.addBindValue(b);
+		if (!query.execBatch())
+			qDebug() << "execBatch:" << query.lastError().text();
+		qDebug() << "execBatch" << perSecond(rows, time.elapsed());
+	}
+	QSqlDatabase::removeDatabase("batch");
+}
+
+
+int main(int argc, char ** argv)
+{
+	QCoreApplication app(argc, argv);
+
+	fill("bench-utf8.db", "UTF-8");
+	fill("bench-utf16.db", "UTF-16le");
+	fetch("bench-utf8.db", "UTF-8 ");
+	fetch("bench-utf16.db", "UTF-16");
+	fetchApi("bench-utf8.db");
+	insertRows("autocommit ", rows / 100, false);
+	insertRows("transaction", rows, true);
+	insertBatch();
+
+	QFile::remove("bench-utf8.db");
+	QFile::remove("bench-utf16.db");
+	QFile::remove("bench-insert.db");
+	return 0;
+}
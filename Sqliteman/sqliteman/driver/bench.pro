@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = bench
+DEPENDPATH += .
+INCLUDEPATH += . ../sqlite
+QT += sql
+QT -= gui
+LIBS += -lsqlite3
+unix:!macx:LIBS += -lrt
+
+win32:CONFIG += console
+
+# Input
+HEADERS += qsql_sqlite.h qsqlcachedresult_p.h
+SOURCES += bench.cpp qsql_sqlite.cpp
@@ -48,16 +48,23 @@
 #include <qsqlindex.h>
 #include <qsqlquery.h>
 #include <qstringlist.h>
+#include <qurl.h>
 #include <qvector.h>
+#include <qhash.h>
 #include <qdebug.h>
 
 #if defined Q_OS_WIN
 # include <qt_windows.h>
+#elif defined Q_OS_MAC
+# include <unistd.h>
+# include <mach/mach_time.h>
 #else
 # include <unistd.h>
+# include <time.h>
 #endif
 
 #include <sqlite3.h>
+#include <string.h>
 
 Q_DECLARE_METATYPE(sqlite3*)
 Q_DECLARE_METATYPE(sqlite3_stmt*)
@@ -99,13 +106,437 @@ static QSqlError qMakeError(sqlite3 *access, const QString &descr, QSqlError::Er
                      type, errorCode);
 }
 
+/*
+   The error of a failed step. A lock held by another connection is named
+   so, the generic text hides why the busy handler gave up.
+*/
+static QSqlError qStepError(sqlite3 *access, int errorCode)
+{
+    if ((errorCode & 0xff) == SQLITE_BUSY || (errorCode & 0xff) == SQLITE_LOCKED)
+        return qMakeError(access, QCoreApplication::translate("QSQLiteResult",
+                          "The database is locked by another connection"),
+                          QSqlError::ConnectionError, errorCode);
+    return qMakeError(access, QCoreApplication::translate("QSQLiteResult",
+                      "Unable to fetch row"), QSqlError::ConnectionError, errorCode);
+}
+
+/*
+   Convert the UTF-8 text handed out by sqlite3_column_text() into a QString.
+   Most text in a typical database is plain ASCII, which can be widened with
+   fromLatin1() after checking the bytes one machine word at a time; anything
+   else goes through the full UTF-8 decoder.
+*/
+static inline QString qFromUtf8(const char *str, int size)
+{
+    const uchar *p = reinterpret_cast<const uchar *>(str);
+    const uchar *end = p + size;
+    while (end - p >= 8) {
+        quint64 word;
+        memcpy(&word, p, sizeof(word));
+        if (word & Q_UINT64_C(0x8080808080808080))
+            return QString::fromUtf8(str, size);
+        p += 8;
+    }
+    for (; p < end; ++p) {
+        if (*p & 0x80)
+            return QString::fromUtf8(str, size);
+    }
+    return QString::fromLatin1(str, size);
+}
+
+/*
+   SQLite stores the text of a database in one encoding only. When that is
+   UTF-8 (the default) we talk UTF-8 to it as well, otherwise every string
+   would be transcoded twice - once by SQLite and once by QString.
+*/
+static bool qIsUtf8Database(sqlite3 *access)
+{
+    sqlite3_stmt *stmt = 0;
+    bool utf8 = true;
+    if (sqlite3_prepare_v2(access, "PRAGMA encoding", -1, &stmt, 0) == SQLITE_OK
+        && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *enc = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+        utf8 = enc && qstrcmp(enc, "UTF-8") == 0;
+    }
+    sqlite3_finalize(stmt);
+    return utf8;
+}
+
+// describes column i of a prepared statement
+static QSqlField qColumnField(sqlite3_stmt *stmt, int i, bool utf8, bool emptyResultset)
+{
+    QString colName;
+    QString typeName;
+    if (utf8) {
+        colName = QString::fromUtf8(sqlite3_column_name(stmt, i)).remove(QLatin1Char('"'));
+        // must use typeName for resolving the type to match QSqliteDriver::record
+        typeName = QString::fromUtf8(sqlite3_column_decltype(stmt, i));
+    } else {
+        colName = QString(reinterpret_cast<const char *>(
+                    sqlite3_column_name16(stmt, i))
+                    ).remove(QLatin1Char('"'));
+        typeName = QString(reinterpret_cast<const char *>(
+                    sqlite3_column_decltype16(stmt, i)));
+    }
+
+    int dotIdx = colName.lastIndexOf(QLatin1Char('.'));
+    QSqlField fld(colName.mid(dotIdx == -1 ? 0 : dotIdx + 1), qGetColumnType(typeName));
+
+    // sqlite3_column_type is documented to have undefined behavior if the result set is empty
+    int stp = emptyResultset ? -1 : sqlite3_column_type(stmt, i);
+    fld.setSqlType(stp);
+    return fld;
+}
+
+// reads column i of the current row of stmt
+static QVariant qColumnValue(sqlite3_stmt *stmt, int i,
+                             QSql::NumericalPrecisionPolicy precision, bool utf8)
+{
+    switch (sqlite3_column_type(stmt, i)) {
+    case SQLITE_BLOB:
+        return QByteArray(static_cast<const char *>(
+                    sqlite3_column_blob(stmt, i)),
+                    sqlite3_column_bytes(stmt, i));
+    case SQLITE_INTEGER:
+        return sqlite3_column_int64(stmt, i);
+    case SQLITE_FLOAT:
+        switch(precision) {
+            case QSql::LowPrecisionInt32:
+                return sqlite3_column_int(stmt, i);
+            case QSql::LowPrecisionInt64:
+                return sqlite3_column_int64(stmt, i);
+            case QSql::LowPrecisionDouble:
+            case QSql::HighPrecision:
+            default:
+                return sqlite3_column_double(stmt, i);
+        };
+    case SQLITE_NULL:
+        return QVariant(QVariant::String);
+    default:
+        if (utf8) {
+            // sqlite3_column_bytes() must follow sqlite3_column_text()
+            const char *text = reinterpret_cast<const char *>(
+                        sqlite3_column_text(stmt, i));
+            return qFromUtf8(text, sqlite3_column_bytes(stmt, i));
+        }
+        return QString(reinterpret_cast<const QChar *>(
+                    sqlite3_column_text16(stmt, i)),
+                    sqlite3_column_bytes16(stmt, i) / sizeof(QChar));
+    }
+}
+
+// binds a single value to the parameter idx (1-based)
+static int qBindValue(sqlite3_stmt *stmt, int idx, const QVariant &value,
+                      bool utf8, QVector<QByteArray> &boundText)
+{
+    if (value.isNull())
+        return sqlite3_bind_null(stmt, idx);
+
+    switch (value.type()) {
+    case QVariant::ByteArray: {
+        const QByteArray *ba = static_cast<const QByteArray*>(value.constData());
+        return sqlite3_bind_blob(stmt, idx, ba->constData(),
+                                 ba->size(), SQLITE_STATIC); }
+    case QVariant::Int:
+        return sqlite3_bind_int(stmt, idx, value.toInt());
+    case QVariant::Double:
+        return sqlite3_bind_double(stmt, idx, value.toDouble());
+    case QVariant::UInt:
+    case QVariant::LongLong:
+        return sqlite3_bind_int64(stmt, idx, value.toLongLong());
+    case QVariant::String: {
+        const QString *str = static_cast<const QString*>(value.constData());
+        if (utf8) {
+            // lifetime of the UTF-8 copy == until the next exec()
+            boundText.append(str->toUtf8());
+            const QByteArray &text = boundText.last();
+            return sqlite3_bind_text(stmt, idx, text.constData(),
+                                     text.size(), SQLITE_STATIC);
+        }
+        // lifetime of string == lifetime of its qvariant
+        return sqlite3_bind_text16(stmt, idx, str->utf16(),
+                                   (str->size()) * sizeof(QChar), SQLITE_STATIC); }
+    default: {
+        QString str = value.toString();
+        // SQLITE_TRANSIENT makes sure that sqlite buffers the data
+        if (utf8) {
+            const QByteArray text = str.toUtf8();
+            return sqlite3_bind_text(stmt, idx, text.constData(),
+                                     text.size(), SQLITE_TRANSIENT);
+        }
+        return sqlite3_bind_text16(stmt, idx, str.utf16(),
+                                   (str.size()) * sizeof(QChar), SQLITE_TRANSIENT); }
+    }
+}
+
+/*
+   Binds values to the positional parameters of stmt. UTF-8 copies of
+   strings are kept in boundText, which must stay untouched until the
+   statement is stepped. Returns an sqlite result code.
+*/
+static int qBindValues(sqlite3_stmt *stmt, const QVector<QVariant> &values,
+                       bool utf8, QVector<QByteArray> &boundText)
+{
+    int res = SQLITE_OK;
+    boundText.clear();
+    if (utf8)
+        boundText.reserve(values.count());
+    for (int i = 0; i < values.count() && res == SQLITE_OK; ++i)
+        res = qBindValue(stmt, i + 1, values.at(i), utf8, boundText);
+    return res;
+}
+
+/*
+   The values of the parameters of stmt in their order. Named values are
+   looked up by the name of every parameter, which covers :name, @name and
+   $name alike. A parameter used more than once in the statement is a
+   single parameter for sqlite, so it is bound once.
+*/
+static QVector<QVariant> qParameterValues(sqlite3_stmt *stmt, bool positional,
+                                          const QVector<QVariant> &positionalValues,
+                                          const QHash<QString, QVariant> &namedValues)
+{
+    if (positional)
+        return positionalValues;
+
+    int paramCount = sqlite3_bind_parameter_count(stmt);
+    QVector<QVariant> values(paramCount);
+    for (int i = 0; i < paramCount; ++i) {
+        const char *name = sqlite3_bind_parameter_name(stmt, i + 1);
+        if (name)
+            values[i] = namedValues.value(QString::fromUtf8(name));
+    }
+    return values;
+}
+
+/*
+   Executes stmt once per row of the column-wise bound values. A value
+   which is not a QVariantList is used for every row. All rows run inside
+   one savepoint, so either all of them are stored or none.
+*/
+static bool qExecBatch(sqlite3 *access, sqlite3_stmt *stmt, const QVector<QVariant> &values,
+                       bool utf8, QVector<QByteArray> &boundText, QSqlError &error)
+{
+    const int nParams = values.count();
+    if (sqlite3_bind_parameter_count(stmt) != nParams) {
+        error = QSqlError(QCoreApplication::translate("QSQLiteResult",
+                          "Parameter count mismatch"), QString(), QSqlError::StatementError);
+        return false;
+    }
+
+    // the lists are implicitly shared, nothing is copied here
+    QVector<QVariantList> columns(nParams);
+    QVector<bool> isList(nParams);
+    int nRows = -1;
+    for (int j = 0; j < nParams; ++j) {
+        isList[j] = values.at(j).type() == QVariant::List;
+        if (!isList[j])
+            continue;
+        columns[j] = values.at(j).toList();
+        if (nRows == -1) {
+            nRows = columns.at(j).count();
+        } else if (nRows != columns.at(j).count()) {
+            error = QSqlError(QCoreApplication::translate("QSQLiteResult",
+                              "Batch lists have different sizes"), QString(), QSqlError::StatementError);
+            return false;
+        }
+    }
+    if (nRows == -1)
+        nRows = 1;
+
+    if (sqlite3_exec(access, "SAVEPOINT qsqlite_batch", 0, 0, 0) != SQLITE_OK) {
+        error = qMakeError(access, QCoreApplication::translate("QSQLiteResult",
+                           "Unable to begin transaction"), QSqlError::TransactionError);
+        return false;
+    }
+
+    int res = SQLITE_OK;
+    for (int i = 0; i < nRows && res == SQLITE_OK; ++i) {
+        sqlite3_reset(stmt);
+        boundText.clear();
+        for (int j = 0; j < nParams && res == SQLITE_OK; ++j)
+            res = qBindValue(stmt, j + 1, isList.at(j) ? columns.at(j).at(i) : values.at(j),
+                             utf8, boundText);
+        if (res != SQLITE_OK) {
+            error = qMakeError(access, QCoreApplication::translate("QSQLiteResult",
+                               "Unable to bind parameters"), QSqlError::StatementError, res);
+            break;
+        }
+        res = sqlite3_step(stmt);
+        // a returned row is fine, its data is not interesting here
+        if (res == SQLITE_ROW || res == SQLITE_DONE) {
+            res = SQLITE_OK;
+        } else {
+            res = sqlite3_reset(stmt);
+            error = qMakeError(access, QCoreApplication::translate("QSQLiteResult",
+                               "Unable to execute batch row %1").arg(i + 1),
+                               QSqlError::StatementError, res);
+            if (res == SQLITE_OK)
+                res = SQLITE_ERROR;
+        }
+    }
+    sqlite3_reset(stmt);
+
+    if (res != SQLITE_OK) {
+        sqlite3_exec(access, "ROLLBACK TO qsqlite_batch", 0, 0, 0);
+        sqlite3_exec(access, "RELEASE qsqlite_batch", 0, 0, 0);
+        return false;
+    }
+    if (sqlite3_exec(access, "RELEASE qsqlite_batch", 0, 0, 0) != SQLITE_OK) {
+        error = qMakeError(access, QCoreApplication::translate("QSQLiteResult",
+                           "Unable to commit transaction"), QSqlError::TransactionError);
+        return false;
+    }
+    return true;
+}
+
+// prepares query in the encoding of the database
+static int qPrepare(sqlite3 *access, const QString &query, bool utf8, sqlite3_stmt **stmt)
+{
+    if (utf8) {
+        const QByteArray sql = query.toUtf8();
+#if (SQLITE_VERSION_NUMBER >= 3003011)
+        return sqlite3_prepare_v2(access, sql.constData(), sql.size() + 1, stmt, 0);
+#else
+        return sqlite3_prepare(access, sql.constData(), sql.size() + 1, stmt, 0);
+#endif
+    }
+#if (SQLITE_VERSION_NUMBER >= 3003011)
+    return sqlite3_prepare16_v2(access, query.constData(), (query.size() + 1) * sizeof(QChar),
+                                stmt, 0);
+#else
+    return sqlite3_prepare16(access, query.constData(), (query.size() + 1) * sizeof(QChar),
+                             stmt, 0);
+#endif
+}
+
 class QSQLiteDriverPrivate
 {
 public:
-    inline QSQLiteDriverPrivate() : access(0) {}
+    inline QSQLiteDriverPrivate() : access(0), utf8(true), profiling(false) {}
     sqlite3 *access;
+    // database text encoding is UTF-8, use the UTF-8 API
+    bool utf8;
+    // report every statement with statementProfiled()
+    bool profiling;
+};
+
+
+// microseconds from an arbitrary point in time, for the statement profiler
+static qint64 qProfileClock()
+{
+#if defined Q_OS_WIN
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (count.QuadPart / freq.QuadPart) * 1000000
+           + (count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+#elif defined Q_OS_MAC
+    static mach_timebase_info_data_t info = { 0, 0 };
+    if (info.denom == 0)
+        mach_timebase_info(&info);
+    return qint64(double(mach_absolute_time()) * info.numer / info.denom / 1000);
+#else
+    // monotonic, a clock step must not show up as a slow statement
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+/*
+   Collects QSQLiteStatementProfile data for one statement execution of a
+   result and hands it to the driver when the statement is done (finished,
+   reset or finalized). Does nothing while the driver is not profiling.
+*/
+class QSQLiteProfileState
+{
+public:
+    QSQLiteProfileState() : driver(0), active(false), pendingPrepareTime(0),
+        cacheHit(0), cacheMiss(0) {}
+
+    void prepared(const QString &sql, qint64 usecs);
+    void begin(const QSqlDriver *drv, sqlite3 *access, sqlite3_stmt *stmt);
+    int step(sqlite3 *access, sqlite3_stmt *stmt);
+    void end(sqlite3 *access, sqlite3_stmt *stmt);
+
+private:
+    const QSQLiteDriver *driver;
+    bool active;
+    qint64 pendingPrepareTime;
+    int cacheHit;
+    int cacheMiss;
+    QSQLiteStatementProfile profile;
 };
 
+void QSQLiteProfileState::prepared(const QString &sql, qint64 usecs)
+{
+    profile.sql = sql;
+    pendingPrepareTime = usecs;
+}
+
+void QSQLiteProfileState::begin(const QSqlDriver *drv, sqlite3 *access, sqlite3_stmt *stmt)
+{
+    driver = static_cast<const QSQLiteDriver*>(drv);
+    active = stmt && driver && driver->d->profiling;
+    if (!active)
+        return;
+
+    // the prepare time belongs to the first execution only
+    profile.prepareTime = pendingPrepareTime;
+    pendingPrepareTime = 0;
+    profile.firstRowTime = -1;
+    profile.stepTime = 0;
+    profile.rows = 0;
+
+    // drop the counters of previous executions
+    sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+    sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+    sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+    sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+    int highwater;
+    sqlite3_db_status(access, SQLITE_DBSTATUS_CACHE_HIT, &cacheHit, &highwater, 0);
+    sqlite3_db_status(access, SQLITE_DBSTATUS_CACHE_MISS, &cacheMiss, &highwater, 0);
+}
+
+int QSQLiteProfileState::step(sqlite3 *access, sqlite3_stmt *stmt)
+{
+    if (!active)
+        return sqlite3_step(stmt);
+
+    qint64 start = qProfileClock();
+    int res = sqlite3_step(stmt);
+    profile.stepTime += qProfileClock() - start;
+    if (res == SQLITE_ROW) {
+        if (profile.rows == 0)
+            profile.firstRowTime = profile.stepTime;
+        ++profile.rows;
+    } else {
+        end(access, stmt);
+    }
+    return res;
+}
+
+void QSQLiteProfileState::end(sqlite3 *access, sqlite3_stmt *stmt)
+{
+    if (!active)
+        return;
+    active = false;
+    if (!stmt)
+        return;
+
+    profile.fullscanSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 0);
+    profile.sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 0);
+    profile.autoindexes = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 0);
+    profile.vmSteps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 0);
+    int current, highwater;
+    sqlite3_db_status(access, SQLITE_DBSTATUS_CACHE_HIT, &current, &highwater, 0);
+    profile.cacheHits = current - cacheHit;
+    sqlite3_db_status(access, SQLITE_DBSTATUS_CACHE_MISS, &current, &highwater, 0);
+    profile.cacheMisses = current - cacheMiss;
+
+    emit const_cast<QSQLiteDriver*>(driver)->statementProfiled(profile);
+}
 
 class QSQLiteResultPrivate
 {
@@ -119,8 +550,14 @@ public:
 
     QSQLiteResult* q;
     sqlite3 *access;
+    bool utf8;
 
     sqlite3_stmt *stmt;
+    // UTF-8 copies of the bound strings, alive until the next exec()
+    QVector<QByteArray> boundText;
+    // values bound by name; QSqlResult only knows :name placeholders
+    QHash<QString, QVariant> namedValues;
+    QSQLiteProfileState profile;
 
     bool skippedStatus; // the status of the fetchNext() that's skipped
     bool skipRow; // skip the next fetchNext()?
@@ -129,7 +566,7 @@ public:
 };
 
 QSQLiteResultPrivate::QSQLiteResultPrivate(QSQLiteResult* res) : q(res), access(0),
-    stmt(0), skippedStatus(false), skipRow(false)
+    utf8(true), stmt(0), skippedStatus(false), skipRow(false)
 {
 }
 
@@ -137,6 +574,7 @@ void QSQLiteResultPrivate::cleanup()
 {
     finalize();
     rInf.clear();
+    namedValues.clear();
     skippedStatus = false;
     skipRow = false;
     q->setAt(QSql::BeforeFirstRow);
@@ -149,8 +587,10 @@ void QSQLiteResultPrivate::finalize()
     if (!stmt)
         return;
 
+    profile.end(access, stmt);
     sqlite3_finalize(stmt);
     stmt = 0;
+    boundText.clear();
 }
 
 void QSQLiteResultPrivate::initColumns(bool emptyResultset)
@@ -161,23 +601,8 @@ void QSQLiteResultPrivate::initColumns(bool emptyResultset)
 
     q->init(nCols);
 
-    for (int i = 0; i < nCols; ++i) {
-        QString colName = QString(reinterpret_cast<const char *>(
-                    sqlite3_column_name16(stmt, i))
-                    ).remove(QLatin1Char('"'));
-
-        // must use typeName for resolving the type to match QSqliteDriver::record
-        QString typeName = QString(reinterpret_cast<const char *>(
-                    sqlite3_column_decltype16(stmt, i)));
-
-        int dotIdx = colName.lastIndexOf(QLatin1Char('.'));
-        QSqlField fld(colName.mid(dotIdx == -1 ? 0 : dotIdx + 1), qGetColumnType(typeName));
-
-        // sqlite3_column_type is documented to have undefined behavior if the result set is empty
-        int stp = emptyResultset ? -1 : sqlite3_column_type(stmt, i);
-        fld.setSqlType(stp);
-        rInf.append(fld);
-    }
+    for (int i = 0; i < nCols; ++i)
+        rInf.append(qColumnField(stmt, i, utf8, emptyResultset));
 }
 
 bool QSQLiteResultPrivate::fetchNext(QSqlCachedResult::ValueCache &values, int idx, bool initialFetch)
@@ -206,7 +631,7 @@ bool QSQLiteResultPrivate::fetchNext(QSqlCachedResult::ValueCache &values, int i
         q->setAt(QSql::AfterLastRow);
         return false;
     }
-    res = sqlite3_step(stmt);
+    res = profile.step(access, stmt);
 
     switch(res) {
     case SQLITE_ROW:
@@ -216,41 +641,8 @@ bool QSQLiteResultPrivate::fetchNext(QSqlCachedResult::ValueCache &values, int i
             initColumns(false);
         if (idx < 0 && !initialFetch)
             return true;
-        for (i = 0; i < rInf.count(); ++i) {
-            switch (sqlite3_column_type(stmt, i)) {
-            case SQLITE_BLOB:
-                values[i + idx] = QByteArray(static_cast<const char *>(
-                            sqlite3_column_blob(stmt, i)),
-                            sqlite3_column_bytes(stmt, i));
-                break;
-            case SQLITE_INTEGER:
-                values[i + idx] = sqlite3_column_int64(stmt, i);
-                break;
-            case SQLITE_FLOAT:
-                switch(q->numericalPrecisionPolicy()) {
-                    case QSql::LowPrecisionInt32:
-                        values[i + idx] = sqlite3_column_int(stmt, i);
-                        break;
-                    case QSql::LowPrecisionInt64:
-                        values[i + idx] = sqlite3_column_int64(stmt, i);
-                        break;
-                    case QSql::LowPrecisionDouble:
-                    case QSql::HighPrecision:
-                    default:
-                        values[i + idx] = sqlite3_column_double(stmt, i);
-                        break;
-                };
-                break;
-            case SQLITE_NULL:
-                values[i + idx] = QVariant(QVariant::String);
-                break;
-            default:
-                values[i + idx] = QString(reinterpret_cast<const QChar *>(
-                            sqlite3_column_text16(stmt, i)),
-                            sqlite3_column_bytes16(stmt, i) / sizeof(QChar));
-                break;
-            }
-        }
+        for (i = 0; i < rInf.count(); ++i)
+            values[i + idx] = qColumnValue(stmt, i, q->numericalPrecisionPolicy(), utf8);
         return true;
     case SQLITE_DONE:
         if (rInf.isEmpty())
@@ -272,8 +664,7 @@ bool QSQLiteResultPrivate::fetchNext(QSqlCachedResult::ValueCache &values, int i
     case SQLITE_BUSY:
     default:
         // something wrong, don't get col info, but still return false
-        q->setLastError(qMakeError(access, QCoreApplication::translate("QSQLiteResult",
-                        "Unable to fetch row"), QSqlError::ConnectionError, res));
+        q->setLastError(qStepError(access, res));
         sqlite3_reset(stmt);
         q->setAt(QSql::AfterLastRow);
         return false;
@@ -286,6 +677,7 @@ QSQLiteResult::QSQLiteResult(const QSQLiteDriver* db)
 {
     d = new QSQLiteResultPrivate(this);
     d->access = db->d->access;
+    d->utf8 = db->d->utf8;
 }
 
 QSQLiteResult::~QSQLiteResult()
@@ -298,8 +690,13 @@ void QSQLiteResult::virtual_hook(int id, void *data)
 {
     switch (id) {
     case QSqlResult::DetachFromResultSet:
-        if (d->stmt)
+        if (d->stmt) {
+            d->profile.end(d->access, d->stmt);
             sqlite3_reset(d->stmt);
+        }
+        break;
+    case QSqlResult::BatchOperation:
+        execBatch(*reinterpret_cast<bool *>(data));
         break;
     default:
         QSqlCachedResult::virtual_hook(id, data);
@@ -322,13 +719,9 @@ bool QSQLiteResult::prepare(const QString &query)
 
     setSelect(false);
 
-#if (SQLITE_VERSION_NUMBER >= 3003011)
-    int res = sqlite3_prepare16_v2(d->access, query.constData(), (query.size() + 1) * sizeof(QChar),
-                                   &d->stmt, 0);
-#else
-    int res = sqlite3_prepare16(d->access, query.constData(), (query.size() + 1) * sizeof(QChar),
-                                &d->stmt, 0);
-#endif
+    qint64 start = qProfileClock();
+    int res = qPrepare(d->access, query, d->utf8, &d->stmt);
+    d->profile.prepared(query, qProfileClock() - start);
 
     if (res != SQLITE_OK) {
         setLastError(qMakeError(d->access, QCoreApplication::translate("QSQLiteResult",
@@ -341,7 +734,8 @@ bool QSQLiteResult::prepare(const QString &query)
 
 bool QSQLiteResult::exec()
 {
-    const QVector<QVariant> values = boundValues();
+    const QVector<QVariant> values = qParameterValues(d->stmt, bindingSyntax() == PositionalBinding,
+                                                      boundValues(), d->namedValues);
 
     d->skippedStatus = false;
     d->skipRow = false;
@@ -349,6 +743,7 @@ bool QSQLiteResult::exec()
     clearValues();
     setLastError(QSqlError());
 
+    d->profile.end(d->access, d->stmt);
     int res = sqlite3_reset(d->stmt);
     if (res != SQLITE_OK) {
         setLastError(qMakeError(d->access, QCoreApplication::translate("QSQLiteResult",
@@ -358,55 +753,19 @@ bool QSQLiteResult::exec()
     }
     int paramCount = sqlite3_bind_parameter_count(d->stmt);
     if (paramCount == values.count()) {
-        for (int i = 0; i < paramCount; ++i) {
-            res = SQLITE_OK;
-            const QVariant value = values.at(i);
-
-            if (value.isNull()) {
-                res = sqlite3_bind_null(d->stmt, i + 1);
-            } else {
-                switch (value.type()) {
-                case QVariant::ByteArray: {
-                    const QByteArray *ba = static_cast<const QByteArray*>(value.constData());
-                    res = sqlite3_bind_blob(d->stmt, i + 1, ba->constData(),
-                                            ba->size(), SQLITE_STATIC);
-                    break; }
-                case QVariant::Int:
-                    res = sqlite3_bind_int(d->stmt, i + 1, value.toInt());
-                    break;
-                case QVariant::Double:
-                    res = sqlite3_bind_double(d->stmt, i + 1, value.toDouble());
-                    break;
-                case QVariant::UInt:
-                case QVariant::LongLong:
-                    res = sqlite3_bind_int64(d->stmt, i + 1, value.toLongLong());
-                    break;
-                case QVariant::String: {
-                    // lifetime of string == lifetime of its qvariant
-                    const QString *str = static_cast<const QString*>(value.constData());
-                    res = sqlite3_bind_text16(d->stmt, i + 1, str->utf16(),
-                                              (str->size()) * sizeof(QChar), SQLITE_STATIC);
-                    break; }
-                default: {
-                    QString str = value.toString();
-                    // SQLITE_TRANSIENT makes sure that sqlite buffers the data
-                    res = sqlite3_bind_text16(d->stmt, i + 1, str.utf16(),
-                                              (str.size()) * sizeof(QChar), SQLITE_TRANSIENT);
-                    break; }
-                }
-            }
-            if (res != SQLITE_OK) {
-                setLastError(qMakeError(d->access, QCoreApplication::translate("QSQLiteResult",
-                             "Unable to bind parameters"), QSqlError::StatementError, res));
-                d->finalize();
-                return false;
-            }
+        res = qBindValues(d->stmt, values, d->utf8, d->boundText);
+        if (res != SQLITE_OK) {
+            setLastError(qMakeError(d->access, QCoreApplication::translate("QSQLiteResult",
+                         "Unable to bind parameters"), QSqlError::StatementError, res));
+            d->finalize();
+            return false;
         }
     } else {
         setLastError(QSqlError(QCoreApplication::translate("QSQLiteResult",
                         "Parameter count mismatch"), QString(), QSqlError::StatementError));
         return false;
     }
+    d->profile.begin(driver(), d->access, d->stmt);
     d->skippedStatus = d->fetchNext(d->firstRow, 0, true);
     if (lastError().isValid()) {
         setSelect(false);
@@ -418,6 +777,40 @@ bool QSQLiteResult::exec()
     return true;
 }
 
+void QSQLiteResult::bindValue(const QString &placeholder, const QVariant &val, QSql::ParamType type)
+{
+    d->namedValues.insert(placeholder, val);
+    QSqlCachedResult::bindValue(placeholder, val, type);
+}
+
+bool QSQLiteResult::execBatch(bool arrayBind)
+{
+    Q_UNUSED(arrayBind);
+
+    d->skippedStatus = false;
+    d->skipRow = false;
+    d->rInf.clear();
+    clearValues();
+    setSelect(false);
+    setActive(false);
+
+    if (!d->stmt) {
+        setLastError(QSqlError(QCoreApplication::translate("QSQLiteResult", "Unable to execute batch"),
+                               QCoreApplication::translate("QSQLiteResult", "No query"), QSqlError::StatementError));
+        return false;
+    }
+    const QVector<QVariant> values = qParameterValues(d->stmt, bindingSyntax() == PositionalBinding,
+                                                      boundValues(), d->namedValues);
+    QSqlError error;
+    if (!qExecBatch(d->access, d->stmt, values, d->utf8, d->boundText, error)) {
+        setLastError(error);
+        return false;
+    }
+    setLastError(QSqlError());
+    setActive(true);
+    return true;
+}
+
 bool QSQLiteResult::gotoNext(QSqlCachedResult::ValueCache& row, int idx)
 {
     return d->fetchNext(row, idx, false);
@@ -457,6 +850,376 @@ QVariant QSQLiteResult::handle() const
 
 /////////////////////////////////////////////////////////
 
+class QSQLiteForwardResultPrivate
+{
+public:
+    QSQLiteForwardResultPrivate(QSQLiteForwardResult *res);
+    void cleanup();
+    void finalize();
+    // steps the statement and handles errors; true if a row is available
+    bool step();
+    void initColumns(bool emptyResultset);
+    // copies the current row into lastRow
+    void keepRow();
+
+    QSQLiteForwardResult* q;
+    sqlite3 *access;
+    bool utf8;
+
+    sqlite3_stmt *stmt;
+    QVector<QByteArray> boundText;
+    QHash<QString, QVariant> namedValues;
+    QSQLiteProfileState profile;
+
+    bool rowPending; // exec() already stepped onto the first row
+    bool useLastRow; // fetchLast() ran off the end, values are in lastRow
+    QSqlRecord rInf;
+    QVector<QVariant> lastRow;
+};
+
+QSQLiteForwardResultPrivate::QSQLiteForwardResultPrivate(QSQLiteForwardResult* res)
+    : q(res), access(0), utf8(true), stmt(0), rowPending(false), useLastRow(false)
+{
+}
+
+void QSQLiteForwardResultPrivate::cleanup()
+{
+    finalize();
+    rInf.clear();
+    lastRow.clear();
+    namedValues.clear();
+    rowPending = false;
+    useLastRow = false;
+    q->setAt(QSql::BeforeFirstRow);
+    q->setActive(false);
+}
+
+void QSQLiteForwardResultPrivate::finalize()
+{
+    if (!stmt)
+        return;
+
+    profile.end(access, stmt);
+    sqlite3_finalize(stmt);
+    stmt = 0;
+    boundText.clear();
+}
+
+void QSQLiteForwardResultPrivate::initColumns(bool emptyResultset)
+{
+    int nCols = sqlite3_column_count(stmt);
+    for (int i = 0; i < nCols; ++i)
+        rInf.append(qColumnField(stmt, i, utf8, emptyResultset));
+}
+
+void QSQLiteForwardResultPrivate::keepRow()
+{
+    lastRow.resize(rInf.count());
+    for (int i = 0; i < rInf.count(); ++i)
+        lastRow[i] = qColumnValue(stmt, i, q->numericalPrecisionPolicy(), utf8);
+}
+
+bool QSQLiteForwardResultPrivate::step()
+{
+    if (!stmt) {
+        q->setLastError(QSqlError(QCoreApplication::translate("QSQLiteResult", "Unable to fetch row"),
+                                  QCoreApplication::translate("QSQLiteResult", "No query"), QSqlError::ConnectionError));
+        q->setAt(QSql::AfterLastRow);
+        return false;
+    }
+
+    int res = profile.step(access, stmt);
+    switch (res) {
+    case SQLITE_ROW:
+        if (rInf.isEmpty())
+            initColumns(false);
+        return true;
+    case SQLITE_DONE:
+        if (rInf.isEmpty())
+            initColumns(true);
+        sqlite3_reset(stmt);
+        return false;
+    case SQLITE_CONSTRAINT:
+    case SQLITE_ERROR:
+        // SQLITE_ERROR is a generic error code and we must call sqlite3_reset()
+        // to get the specific error message.
+        res = sqlite3_reset(stmt);
+        q->setLastError(qMakeError(access, QCoreApplication::translate("QSQLiteResult",
+                        "Unable to fetch row"), QSqlError::ConnectionError, res));
+        return false;
+    default:
+        q->setLastError(qStepError(access, res));
+        sqlite3_reset(stmt);
+        return false;
+    }
+}
+
+QSQLiteForwardResult::QSQLiteForwardResult(const QSQLiteDriver* db)
+    : QSqlResult(db)
+{
+    d = new QSQLiteForwardResultPrivate(this);
+    d->access = db->d->access;
+    d->utf8 = db->d->utf8;
+    QSqlResult::setForwardOnly(true);
+}
+
+QSQLiteForwardResult::~QSQLiteForwardResult()
+{
+    d->cleanup();
+    delete d;
+}
+
+void QSQLiteForwardResult::setForwardOnly(bool)
+{
+    // rows are never kept, there is no way back
+    QSqlResult::setForwardOnly(true);
+}
+
+void QSQLiteForwardResult::virtual_hook(int id, void *data)
+{
+    switch (id) {
+    case QSqlResult::DetachFromResultSet:
+        if (d->stmt) {
+            d->profile.end(d->access, d->stmt);
+            sqlite3_reset(d->stmt);
+        }
+        break;
+    case QSqlResult::BatchOperation:
+        execBatch(*reinterpret_cast<bool *>(data));
+        break;
+    default:
+        QSqlResult::virtual_hook(id, data);
+    }
+}
+
+bool QSQLiteForwardResult::reset(const QString &query)
+{
+    if (!prepare(query))
+        return false;
+    return exec();
+}
+
+bool QSQLiteForwardResult::prepare(const QString &query)
+{
+    if (!driver() || !driver()->isOpen() || driver()->isOpenError())
+        return false;
+
+    d->cleanup();
+
+    setSelect(false);
+
+    qint64 start = qProfileClock();
+    int res = qPrepare(d->access, query, d->utf8, &d->stmt);
+    d->profile.prepared(query, qProfileClock() - start);
+
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, QCoreApplication::translate("QSQLiteResult",
+                     "Unable to execute statement"), QSqlError::StatementError, res));
+        d->finalize();
+        return false;
+    }
+    return true;
+}
+
+bool QSQLiteForwardResult::exec()
+{
+    const QVector<QVariant> values = qParameterValues(d->stmt, bindingSyntax() == PositionalBinding,
+                                                      boundValues(), d->namedValues);
+
+    d->rowPending = false;
+    d->useLastRow = false;
+    d->rInf.clear();
+    d->lastRow.clear();
+    setAt(QSql::BeforeFirstRow);
+    setLastError(QSqlError());
+
+    d->profile.end(d->access, d->stmt);
+    int res = sqlite3_reset(d->stmt);
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, QCoreApplication::translate("QSQLiteResult",
+                     "Unable to reset statement"), QSqlError::StatementError, res));
+        d->finalize();
+        return false;
+    }
+    if (sqlite3_bind_parameter_count(d->stmt) != values.count()) {
+        setLastError(QSqlError(QCoreApplication::translate("QSQLiteResult",
+                        "Parameter count mismatch"), QString(), QSqlError::StatementError));
+        return false;
+    }
+    res = qBindValues(d->stmt, values, d->utf8, d->boundText);
+    if (res != SQLITE_OK) {
+        setLastError(qMakeError(d->access, QCoreApplication::translate("QSQLiteResult",
+                     "Unable to bind parameters"), QSqlError::StatementError, res));
+        d->finalize();
+        return false;
+    }
+
+    // step once so that statements without a result set are executed
+    // and errors are reported here, like QSQLiteResult does
+    d->profile.begin(driver(), d->access, d->stmt);
+    d->rowPending = d->step();
+    if (lastError().isValid()) {
+        setSelect(false);
+        setActive(false);
+        return false;
+    }
+    if (!d->rowPending)
+        setAt(QSql::AfterLastRow);
+    setSelect(!d->rInf.isEmpty());
+    setActive(true);
+    return true;
+}
+
+void QSQLiteForwardResult::bindValue(const QString &placeholder, const QVariant &val, QSql::ParamType type)
+{
+    d->namedValues.insert(placeholder, val);
+    QSqlResult::bindValue(placeholder, val, type);
+}
+
+bool QSQLiteForwardResult::execBatch(bool arrayBind)
+{
+    Q_UNUSED(arrayBind);
+
+    d->rowPending = false;
+    d->useLastRow = false;
+    d->rInf.clear();
+    d->lastRow.clear();
+    setAt(QSql::BeforeFirstRow);
+    setSelect(false);
+    setActive(false);
+
+    if (!d->stmt) {
+        setLastError(QSqlError(QCoreApplication::translate("QSQLiteResult", "Unable to execute batch"),
+                               QCoreApplication::translate("QSQLiteResult", "No query"), QSqlError::StatementError));
+        return false;
+    }
+    const QVector<QVariant> values = qParameterValues(d->stmt, bindingSyntax() == PositionalBinding,
+                                                      boundValues(), d->namedValues);
+    QSqlError error;
+    if (!qExecBatch(d->access, d->stmt, values, d->utf8, d->boundText, error)) {
+        setLastError(error);
+        return false;
+    }
+    setLastError(QSqlError());
+    setActive(true);
+    return true;
+}
+
+bool QSQLiteForwardResult::fetchNext()
+{
+    if (at() == QSql::AfterLastRow || d->useLastRow)
+        return false;
+
+    if (d->rowPending) {
+        d->rowPending = false;
+        setAt(0);
+        return true;
+    }
+    if (!d->step()) {
+        setAt(QSql::AfterLastRow);
+        return false;
+    }
+    setAt(at() + 1);
+    return true;
+}
+
+bool QSQLiteForwardResult::fetch(int i)
+{
+    if (i == at())
+        return at() >= 0;
+    if (i < at())
+        return false;
+    while (at() < i) {
+        if (!fetchNext())
+            return false;
+    }
+    return true;
+}
+
+bool QSQLiteForwardResult::fetchFirst()
+{
+    if (at() != QSql::BeforeFirstRow)
+        return at() == 0;
+    return fetchNext();
+}
+
+bool QSQLiteForwardResult::fetchPrevious()
+{
+    return false;
+}
+
+bool QSQLiteForwardResult::fetchLast()
+{
+    if (at() == QSql::AfterLastRow)
+        return false;
+
+    // keep only the most recent row; its columns go away with the next step
+    int i = at();
+    if (i >= 0)
+        d->keepRow();
+    while (fetchNext()) {
+        d->keepRow();
+        i = at();
+    }
+    if (i < 0)
+        return false;
+    d->useLastRow = true;
+    setAt(i);
+    return true;
+}
+
+QVariant QSQLiteForwardResult::data(int i)
+{
+    if (d->useLastRow)
+        return d->lastRow.value(i);
+    if (!d->stmt || at() < 0 || i < 0 || i >= d->rInf.count())
+        return QVariant();
+    return qColumnValue(d->stmt, i, numericalPrecisionPolicy(), d->utf8);
+}
+
+bool QSQLiteForwardResult::isNull(int i)
+{
+    if (d->useLastRow)
+        return d->lastRow.value(i).isNull();
+    if (!d->stmt || at() < 0 || i < 0 || i >= d->rInf.count())
+        return true;
+    return sqlite3_column_type(d->stmt, i) == SQLITE_NULL;
+}
+
+int QSQLiteForwardResult::size()
+{
+    return -1;
+}
+
+int QSQLiteForwardResult::numRowsAffected()
+{
+    return sqlite3_changes(d->access);
+}
+
+QVariant QSQLiteForwardResult::lastInsertId() const
+{
+    if (isActive()) {
+        qint64 id = sqlite3_last_insert_rowid(d->access);
+        if (id)
+            return id;
+    }
+    return QVariant();
+}
+
+QSqlRecord QSQLiteForwardResult::record() const
+{
+    if (!isActive() || !isSelect())
+        return QSqlRecord();
+    return d->rInf;
+}
+
+QVariant QSQLiteForwardResult::handle() const
+{
+    return qVariantFromValue(d->stmt);
+}
+
+/////////////////////////////////////////////////////////
+
 QSQLiteDriver::QSQLiteDriver(QObject * parent)
     : QSqlDriver(parent)
 {
@@ -468,6 +1231,7 @@ QSQLiteDriver::QSQLiteDriver(sqlite3 *connection, QObject *parent)
 {
     d = new QSQLiteDriverPrivate();
     d->access = connection;
+    d->utf8 = qIsUtf8Database(connection);
     setOpen(true);
     setOpenError(false);
 }
@@ -487,13 +1251,13 @@ bool QSQLiteDriver::hasFeature(DriverFeature f) const
     case LastInsertId:
     case PreparedQueries:
     case PositionalPlaceholders:
+    case NamedPlaceholders:
+    case BatchOperations:
     case SimpleLocking:
     case FinishQuery:
     case LowPrecisionNumbers:
         return true;
     case QuerySize:
-    case NamedPlaceholders:
-    case BatchOperations:
     case EventNotifications:
     case MultipleResultSets:
         return false;
@@ -513,6 +1277,9 @@ bool QSQLiteDriver::open(const QString & db, const QString &, const QString &, c
     if (db.isEmpty())
         return false;
     bool sharedCache = false;
+    bool immutable = false;
+    bool nolock = false;
+    bool uri = false;
     int openMode = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, timeOut=5000;
     QStringList opts=QString(conOpts).remove(QLatin1Char(' ')).split(QLatin1Char(';'));
     foreach(const QString &option, opts) {
@@ -526,12 +1293,35 @@ bool QSQLiteDriver::open(const QString & db, const QString &, const QString &, c
             openMode = SQLITE_OPEN_READONLY;
         if (option == QLatin1String("QSQLITE_ENABLE_SHARED_CACHE"))
             sharedCache = true;
+        // URI file names are also needed to ATTACH with URI parameters
+        if (option == QLatin1String("QSQLITE_OPEN_URI"))
+            uri = true;
+        if (option == QLatin1String("QSQLITE_IMMUTABLE"))
+            immutable = true;
+        if (option == QLatin1String("QSQLITE_NOLOCK"))
+            nolock = true;
     }
 
+    // after the loop, QSQLITE_OPEN_READONLY replaces the whole mode
+    if (uri)
+        openMode |= SQLITE_OPEN_URI;
+
     sqlite3_enable_shared_cache(sharedCache);
 
-    if (sqlite3_open_v2(db.toUtf8().constData(), &d->access, openMode, NULL) == SQLITE_OK) {
+    QByteArray fileName = db.toUtf8();
+    if (immutable || nolock) {
+        QStringList params;
+        if (immutable)
+            params << QLatin1String("immutable=1");
+        if (nolock)
+            params << QLatin1String("nolock=1");
+        fileName = QUrl::fromLocalFile(db).toEncoded() + '?' + params.join(QLatin1String("&")).toLatin1();
+        openMode |= SQLITE_OPEN_URI;
+    }
+
+    if (sqlite3_open_v2(fileName.constData(), &d->access, openMode, NULL) == SQLITE_OK) {
         sqlite3_busy_timeout(d->access, timeOut);
+        d->utf8 = qIsUtf8Database(d->access);
         setOpen(true);
         setOpenError(false);
         return true;
@@ -560,6 +1350,21 @@ QSqlResult *QSQLiteDriver::createResult() const
     return new QSQLiteResult(this);
 }
 
+QSqlResult *QSQLiteDriver::createForwardOnlyResult() const
+{
+    return new QSQLiteForwardResult(this);
+}
+
+void QSQLiteDriver::setProfiling(bool enable)
+{
+    d->profiling = enable;
+}
+
+bool QSQLiteDriver::isProfiling() const
+{
+    return d->profiling;
+}
+
 bool QSQLiteDriver::beginTransaction()
 {
     if (!isOpen() || isOpenError())
@@ -59,7 +59,28 @@ QT_BEGIN_HEADER
 QT_BEGIN_NAMESPACE
 class QSQLiteDriverPrivate;
 class QSQLiteResultPrivate;
+class QSQLiteForwardResultPrivate;
 class QSQLiteDriver;
+class QSQLiteProfileState;
+
+/*
+   Timings and counters of one execution of a statement, see
+   QSQLiteDriver::setProfiling(). Times are in microseconds.
+*/
+struct QSQLiteStatementProfile
+{
+    QString sql;
+    qint64 prepareTime;  // only for the first execution after prepare
+    qint64 firstRowTime; // step time until the first row, -1 without rows
+    qint64 stepTime;     // all the steps together
+    qint64 rows;
+    int fullscanSteps;   // SQLITE_STMTSTATUS_FULLSCAN_STEP
+    int sorts;           // SQLITE_STMTSTATUS_SORT
+    int autoindexes;     // SQLITE_STMTSTATUS_AUTOINDEX
+    int vmSteps;         // SQLITE_STMTSTATUS_VM_STEP
+    int cacheHits;       // SQLITE_DBSTATUS_CACHE_HIT delta
+    int cacheMisses;     // SQLITE_DBSTATUS_CACHE_MISS delta
+};
 
 class QSQLiteResult : public QSqlCachedResult
 {
@@ -75,6 +96,8 @@ protected:
     bool reset(const QString &query);
     bool prepare(const QString &query);
     bool exec();
+    bool execBatch(bool arrayBind = false);
+    void bindValue(const QString &placeholder, const QVariant &val, QSql::ParamType type);
     int size();
     int numRowsAffected();
     QVariant lastInsertId() const;
@@ -85,10 +108,50 @@ private:
     QSQLiteResultPrivate* d;
 };
 
+/*
+   A result for single pass consumers. Unlike QSQLiteResult it never caches
+   rows: values are read straight from the statement, so memory use does not
+   depend on the number of rows. It is always forward only.
+*/
+class QSQLiteForwardResult : public QSqlResult
+{
+    friend class QSQLiteDriver;
+    friend class QSQLiteForwardResultPrivate;
+public:
+    explicit QSQLiteForwardResult(const QSQLiteDriver* db);
+    ~QSQLiteForwardResult();
+    QVariant handle() const;
+    void setForwardOnly(bool forward);
+
+protected:
+    QVariant data(int i);
+    bool isNull(int i);
+    bool reset(const QString &query);
+    bool prepare(const QString &query);
+    bool exec();
+    bool execBatch(bool arrayBind = false);
+    void bindValue(const QString &placeholder, const QVariant &val, QSql::ParamType type);
+    bool fetch(int i);
+    bool fetchNext();
+    bool fetchPrevious();
+    bool fetchFirst();
+    bool fetchLast();
+    int size();
+    int numRowsAffected();
+    QVariant lastInsertId() const;
+    QSqlRecord record() const;
+    void virtual_hook(int id, void *data);
+
+private:
+    QSQLiteForwardResultPrivate* d;
+};
+
 class Q_EXPORT_SQLDRIVER_SQLITE QSQLiteDriver : public QSqlDriver
 {
     Q_OBJECT
     friend class QSQLiteResult;
+    friend class QSQLiteForwardResult;
+    friend class QSQLiteProfileState;
 public:
     explicit QSQLiteDriver(QObject *parent = 0);
     explicit QSQLiteDriver(sqlite3 *connection, QObject *parent = 0);
@@ -102,6 +165,8 @@ public:
                    const QString & connOpts);
     void close();
     QSqlResult *createResult() const;
+    // a result which streams rows instead of caching them
+    QSqlResult *createForwardOnlyResult() const;
     bool beginTransaction();
     bool commitTransaction();
     bool rollbackTransaction();
@@ -112,6 +177,13 @@ public:
     QVariant handle() const;
     QString escapeIdentifier(const QString &identifier, IdentifierType) const;
 
+    // emit statementProfiled() for every executed statement
+    void setProfiling(bool enable);
+    bool isProfiling() const;
+
+Q_SIGNALS:
+    void statementProfiled(const QSQLiteStatementProfile &profile);
+
 private:
     QSQLiteDriverPrivate* d;
 };
@@ -0,0 +1,734 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <float.h>
+
+#include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QMessageBox>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QTemporaryFile>
+
+#include "dumpdialog.h"
+#include "database.h"
+#include "regexp.h"
+#include "utils.h"
+
+// the data is written to the files in chunks of this size
+#define DUMP_BUFFER_SIZE (1024 * 1024)
+
+
+DumpQueue::DumpQueue(const QStringList & tables, const QMap<QString,QString> & outputs)
+	: m_tables(tables),
+	  m_outputs(outputs),
+	  m_cancelled(false)
+{
+}
+
+bool DumpQueue::next(QString & table, QString & output)
+{
+	QMutexLocker locker(&m_mutex);
+	if (m_cancelled || m_tables.isEmpty())
+		return false;
+	table = m_tables.takeFirst();
+	output = m_outputs.value(table);
+	return true;
+}
+
+void DumpQueue::setError(const QString & error)
+{
+	QMutexLocker locker(&m_mutex);
+	if (m_error.isEmpty())
+		m_error = error;
+	m_cancelled = true;
+}
+
+QString DumpQueue::error()
+{
+	QMutexLocker locker(&m_mutex);
+	return m_error;
+}
+
+void DumpQueue::cancel()
+{
+	m_cancelled = true;
+}
+
+
+void DumpThread::appendValue(QByteArray & buf, sqlite3_stmt * stmt, int i)
+{
+	switch (sqlite3_column_type(stmt, i))
+	{
+		case SQLITE_INTEGER:
+			buf += QByteArray::number((qlonglong)sqlite3_column_int64(stmt, i));
+			break;
+		case SQLITE_FLOAT:
+		{
+			double d = sqlite3_column_double(stmt, i);
+			if (d != d)
+				buf += "NULL";
+			else if (d > DBL_MAX)
+				buf += "9.0e999";
+			else if (d < -DBL_MAX)
+				buf += "-9.0e999";
+			else
+			{
+				QByteArray number(QByteArray::number(d, 'g', 17));
+				if (!number.contains('.') && !number.contains('e'))
+					number += ".0";
+				buf += number;
+			}
+			break;
+		}
+		case SQLITE_TEXT:
+		{
+			QByteArray text((const char*)sqlite3_column_text(stmt, i),
+							sqlite3_column_bytes(stmt, i));
+			buf += '\'';
+			buf += text.replace('\'', "''");
+			buf += '\'';
+			break;
+		}
+		case SQLITE_BLOB:
+		{
+			QByteArray blob((const char*)sqlite3_column_blob(stmt, i),
+							sqlite3_column_bytes(stmt, i));
+			buf += "X'";
+			buf += blob.toHex();
+			buf += '\'';
+			break;
+		}
+		default:
+			buf += "NULL";
+	}
+}
+
+static bool selectRows(sqlite3 * db, const char * sql, int columns,
+					   QList<QStringList> & rows, QString & error)
+{
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+	{
+		error = QString::fromUtf8(sqlite3_errmsg(db));
+		sqlite3_finalize(stmt);
+		return false;
+	}
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		QStringList row;
+		for (int i = 0; i < columns; ++i)
+			row.append(QString::fromUtf8((const char*)sqlite3_column_text(stmt, i)));
+		rows.append(row);
+	}
+	if (sqlite3_finalize(stmt) != SQLITE_OK)
+	{
+		error = QString::fromUtf8(sqlite3_errmsg(db));
+		return false;
+	}
+	return true;
+}
+
+static bool appendFile(QFile & out, const QString & fileName)
+{
+	QFile in(fileName);
+	if (!in.open(QIODevice::ReadOnly))
+		return false;
+	while (!in.atEnd())
+	{
+		if (out.write(in.read(DUMP_BUFFER_SIZE)) == -1)
+			return false;
+		qApp->processEvents();
+	}
+	return true;
+}
+
+
+DumpThread::DumpThread(DumpQueue * queue, const QString & fileName,
+					   sqlite3 * connection, int rowsPerInsert,
+					   QObject * parent)
+	: QThread(parent),
+	  m_queue(queue),
+	  m_fileName(fileName),
+	  m_connection(connection),
+	  m_rowsPerInsert(rowsPerInsert)
+{
+}
+
+void DumpThread::run()
+{
+	sqlite3 * db = m_connection;
+	if (!db)
+	{
+		QByteArray name(QDir::toNativeSeparators(m_fileName).toUtf8());
+		if (sqlite3_open_v2(name.constData(), &db, SQLITE_OPEN_READONLY, 0) != SQLITE_OK)
+		{
+			m_queue->setError(QString::fromUtf8(sqlite3_errmsg(db)));
+			sqlite3_close(db);
+			m_queue->started.release();
+			return;
+		}
+		Regexp::install(db);
+	}
+
+	// reading sqlite_master really starts the read transaction
+	bool transaction = sqlite3_get_autocommit(db);
+	char * err = 0;
+	if (transaction
+		&& sqlite3_exec(db, "BEGIN; SELECT count(*) FROM sqlite_master;", 0, 0, &err) != SQLITE_OK)
+	{
+		m_queue->setError(QString::fromUtf8(err));
+		sqlite3_free(err);
+		transaction = false;
+	}
+	m_queue->started.release();
+
+	QString table;
+	QString output;
+	while (m_queue->next(table, output))
+	{
+		qlonglong rows = 0;
+		if (!dumpTable(db, table, output, rows))
+			break;
+		emit tableDumped(table, rows);
+	}
+
+	if (transaction)
+		sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	if (!m_connection)
+		sqlite3_close(db);
+}
+
+bool DumpThread::dumpTable(sqlite3 * db, const QString & table,
+						   const QString & output, qlonglong & rows)
+{
+	QFile file(output);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+	{
+		m_queue->setError(tr("Unable to open file %1 for writing.").arg(output));
+		return false;
+	}
+
+	QByteArray sql(QString("SELECT * FROM %1;").arg(Utils::quote(table)).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(db, sql.constData(), -1, &stmt, 0) != SQLITE_OK)
+	{
+		m_queue->setError(QString::fromUtf8(sqlite3_errmsg(db)));
+		sqlite3_finalize(stmt);
+		return false;
+	}
+
+	QByteArray insert(QString("INSERT INTO %1 VALUES").arg(Utils::quote(table)).toUtf8());
+	int columns = sqlite3_column_count(stmt);
+	QByteArray buf;
+	int inStatement = 0;
+	int rc;
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		buf += (inStatement == 0) ? insert : QByteArray(",");
+		buf += "\n(";
+		for (int i = 0; i < columns; ++i)
+		{
+			if (i)
+				buf += ',';
+			appendValue(buf, stmt, i);
+		}
+		buf += ')';
+		if (++inStatement == m_rowsPerInsert)
+		{
+			buf += ";\n";
+			inStatement = 0;
+		}
+		++rows;
+
+		if (buf.size() >= DUMP_BUFFER_SIZE)
+		{
+			if (file.write(buf) == -1)
+				break;
+			buf.clear();
+			if (m_queue->isCancelled())
+				break;
+		}
+	}
+	if (inStatement)
+		buf += ";\n";
+	bool written = (file.write(buf) != -1);
+
+	QString error(QString::fromUtf8(sqlite3_errmsg(db)));
+	sqlite3_finalize(stmt);
+	if (m_queue->isCancelled())
+		return false;
+	if (!written || file.error() != QFile::NoError)
+	{
+		m_queue->setError(file.errorString());
+		return false;
+	}
+	if (rc != SQLITE_DONE)
+	{
+		m_queue->setError(error);
+		return false;
+	}
+	return true;
+}
+
+
+DumpDialog::DumpDialog(const QString & fileName, QWidget * parent)
+	: QDialog(parent),
+	  m_fileName(fileName),
+	  m_queue(0),
+	  m_running(0),
+	  m_tableCount(0),
+	  m_tablesDone(0),
+	  m_rows(0)
+{
+	setupUi(this);
+	threadsSpinBox->setValue(qMax(QThread::idealThreadCount(), 1));
+	setRunning(false);
+	startButton->setEnabled(false);
+
+	connect(browseButton, SIGNAL(clicked()),
+			this, SLOT(browseButton_clicked()));
+	connect(startButton, SIGNAL(clicked()),
+			this, SLOT(startButton_clicked()));
+	connect(cancelButton, SIGNAL(clicked()),
+			this, SLOT(cancelButton_clicked()));
+	connect(fileEdit, SIGNAL(textChanged(const QString &)),
+			this, SLOT(fileEdit_textChanged(const QString &)));
+}
+
+DumpDialog::~DumpDialog()
+{
+	if (m_queue)
+	{
+		m_queue->cancel();
+		foreach (DumpThread * thread, m_threads)
+			thread->wait();
+		cleanup(true);
+	}
+}
+
+bool DumpDialog::isDirectoryDump()
+{
+	return directoryRadioButton->isChecked();
+}
+
+void DumpDialog::setRunning(bool running)
+{
+	outputGroupBox->setEnabled(!running);
+	fileEdit->setEnabled(!running);
+	browseButton->setEnabled(!running);
+	threadsSpinBox->setEnabled(!running);
+	rowsSpinBox->setEnabled(!running);
+	startButton->setEnabled(!running);
+	cancelButton->setEnabled(running);
+}
+
+void DumpDialog::showError(const QString & error)
+{
+	statusLabel->setText(tr("Error while dumping the database")
+						 + ":<br/><span style=\" color:#ff0000;\">"
+						 + error + "<br/></span>");
+}
+
+void DumpDialog::browseButton_clicked()
+{
+	QString fileName;
+	if (isDirectoryDump())
+		fileName = QFileDialog::getExistingDirectory(this, tr("Dump into Directory"),
+													 QDir::currentPath());
+	else
+		fileName = QFileDialog::getSaveFileName(this, tr("Export Database"),
+												QDir::currentPath(),
+												tr("SQL File (*.sql)"));
+	if (!fileName.isNull())
+		fileEdit->setText(fileName);
+}
+
+void DumpDialog::fileEdit_textChanged(const QString & text)
+{
+	startButton->setEnabled(!text.trimmed().isEmpty());
+}
+
+bool DumpDialog::readSchema(sqlite3 * db, QString & error)
+{
+	m_tables.clear();
+	m_otherSql.clear();
+
+	// the same objects in the same order as the sqlite3 shell .dump
+	if (!selectRows(db, "SELECT name, sql FROM sqlite_master "
+						"WHERE sql NOT NULL AND type == 'table';",
+					2, m_tables, error))
+		return false;
+	QList<QStringList> other;
+	if (!selectRows(db, "SELECT sql FROM sqlite_master "
+						"WHERE sql NOT NULL AND type IN ('index', 'trigger', 'view');",
+					1, other, error))
+		return false;
+	foreach (QStringList row, other)
+		m_otherSql.append(row.at(0));
+	return true;
+}
+
+QByteArray DumpDialog::tableHeader(const QStringList & table, bool & dataFollows,
+								   bool & writableSchema)
+{
+	QString name(table.at(0));
+	QString sql(table.at(1));
+	QByteArray header;
+	dataFollows = true;
+
+	if (name == "sqlite_sequence")
+		header = "DELETE FROM sqlite_sequence;\n";
+	else if (QRegExp("sqlite_stat\\d").exactMatch(name))
+		header = "ANALYZE sqlite_master;\n";
+	else if (name.startsWith("sqlite_"))
+		dataFollows = false;
+	else if (sql.startsWith("CREATE VIRTUAL TABLE", Qt::CaseInsensitive))
+	{
+		// its shadow tables are dumped as ordinary tables
+		if (!writableSchema)
+		{
+			header = "PRAGMA writable_schema=ON;\n";
+			writableSchema = true;
+		}
+		header += QString("INSERT INTO sqlite_master(type,name,tbl_name,rootpage,sql) "
+						  "VALUES('table',%1,%1,0,%2);\n")
+				  .arg(Utils::literal(name)).arg(Utils::literal(sql)).toUtf8();
+		dataFollows = false;
+	}
+	else
+		header = (sql + ";\n").toUtf8();
+	return header;
+}
+
+bool DumpDialog::prepareOutputs(QString & error)
+{
+	m_outputs.clear();
+	m_created.clear();
+	QString target(fileEdit->text().trimmed());
+
+	QStringList usedNames;
+	bool writableSchema = false;
+	foreach (QStringList table, m_tables)
+	{
+		bool dataFollows;
+		QByteArray header(tableHeader(table, dataFollows, writableSchema));
+		if (!dataFollows)
+			continue;
+
+		QString fileName;
+		if (isDirectoryDump())
+		{
+			QString base(table.at(0));
+			base.replace(QRegExp("[^A-Za-z0-9_.-]"), "_");
+			QString name(base);
+			for (int i = 2; usedNames.contains(name, Qt::CaseInsensitive)
+							|| name.compare("schema", Qt::CaseInsensitive) == 0; ++i)
+				name = QString("%1_%2").arg(base).arg(i);
+			usedNames.append(name);
+			fileName = QDir(target).filePath(name + ".sql");
+
+			// the table file is complete in itself
+			QFile file(fileName);
+			if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+			{
+				error = tr("Unable to open file %1 for writing.").arg(fileName);
+				return false;
+			}
+			file.write("PRAGMA foreign_keys=OFF;\n");
+			file.write("BEGIN TRANSACTION;\n");
+			file.write(header);
+		}
+		else
+		{
+			// the data is stitched into the output in the schema order
+			QTemporaryFile tmp(QDir::temp().filePath("sqliteman_dump"));
+			tmp.setAutoRemove(false);
+			if (!tmp.open())
+			{
+				error = tmp.errorString();
+				return false;
+			}
+			fileName = tmp.fileName();
+		}
+		m_created.append(fileName);
+		m_outputs[table.at(0)] = fileName;
+	}
+	return true;
+}
+
+bool DumpDialog::finishOutput(QString & error)
+{
+	QString target(fileEdit->text().trimmed());
+	bool writableSchema = false;
+
+	if (isDirectoryDump())
+	{
+		foreach (QString fileName, m_outputs.values())
+		{
+			QFile file(fileName);
+			if (!file.open(QIODevice::WriteOnly | QIODevice::Append)
+				|| file.write("COMMIT;\n") == -1)
+			{
+				error = file.errorString();
+				return false;
+			}
+		}
+		target = QDir(target).filePath("schema.sql");
+	}
+
+	QFile out(target);
+	if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		error = tr("Unable to open file %1 for writing.").arg(target);
+		return false;
+	}
+	m_created.append(target);
+
+	out.write("PRAGMA foreign_keys=OFF;\n");
+	out.write("BEGIN TRANSACTION;\n");
+	foreach (QStringList table, m_tables)
+	{
+		bool dataFollows;
+		QByteArray header(tableHeader(table, dataFollows, writableSchema));
+		// the table files have their own headers
+		if (dataFollows && isDirectoryDump())
+			continue;
+		out.write(header);
+		if (dataFollows && !appendFile(out, m_outputs.value(table.at(0))))
+		{
+			error = out.errorString();
+			return false;
+		}
+	}
+	foreach (QString sql, m_otherSql)
+		out.write((sql + ";\n").toUtf8());
+	if (writableSchema)
+		out.write("PRAGMA writable_schema=OFF;\n");
+	out.write("COMMIT;\n");
+	if (out.error() != QFile::NoError)
+	{
+		error = out.errorString();
+		return false;
+	}
+	return true;
+}
+
+void DumpDialog::cleanup(bool removeAll)
+{
+	if (removeAll)
+	{
+		foreach (QString fileName, m_created)
+			QFile::remove(fileName);
+	}
+	else if (!isDirectoryDump())
+	{
+		// the temporary data files
+		foreach (QString fileName, m_outputs.values())
+			QFile::remove(fileName);
+	}
+	// cleanup() can be called from a slot of their finished() signal
+	foreach (DumpThread * thread, m_threads)
+		thread->deleteLater();
+	m_threads.clear();
+	delete m_queue;
+	m_queue = 0;
+	m_outputs.clear();
+	m_created.clear();
+}
+
+void DumpDialog::startButton_clicked()
+{
+	QString target(fileEdit->text().trimmed());
+	if (isDirectoryDump())
+	{
+		if (!QDir().mkpath(target))
+		{
+			showError(tr("Cannot create directory %1.").arg(target));
+			return;
+		}
+	}
+	else if (QFile::exists(target))
+	{
+		int ret = QMessageBox::question(this, windowTitle(),
+						tr("File %1 will be overwritten.\n\nDo you want to continue?")
+						.arg(target),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+	}
+
+	// other connections are possible for a real file only
+	sqlite3 * connection = 0;
+	sqlite3 * lock = 0;
+	QString error;
+	bool consistent = true;
+	if (QFileInfo(m_fileName).isFile())
+	{
+		QByteArray name(QDir::toNativeSeparators(m_fileName).toUtf8());
+		if (sqlite3_open_v2(name.constData(), &lock, SQLITE_OPEN_READWRITE, 0) != SQLITE_OK)
+		{
+			sqlite3_close(lock);
+			lock = 0;
+			sqlite3_open_v2(name.constData(), &lock, SQLITE_OPEN_READONLY, 0);
+		}
+		sqlite3_busy_timeout(lock, 5000);
+		// no commit is possible until every thread has its read transaction
+		if (sqlite3_exec(lock, "BEGIN IMMEDIATE;", 0, 0, 0) != SQLITE_OK)
+		{
+			consistent = false;
+			sqlite3_exec(lock, "BEGIN;", 0, 0, 0);
+		}
+		if (!readSchema(lock, error))
+		{
+			sqlite3_close(lock);
+			showError(error);
+			return;
+		}
+	}
+	else
+	{
+		connection = Database::sqlite3handle();
+		if (!connection)
+			return;
+		if (!readSchema(connection, error))
+		{
+			showError(error);
+			return;
+		}
+	}
+
+	if (!prepareOutputs(error))
+	{
+		if (lock)
+			sqlite3_close(lock);
+		cleanup(true);
+		showError(error);
+		return;
+	}
+
+	// the biggest tables first so they do not finish last alone
+	QStringList tables(m_outputs.keys());
+	QList<QStringList> sizes;
+	QMap<QString,qlonglong> rowCounts;
+	if (selectRows(lock ? lock : connection,
+				   "SELECT tbl, max(CAST(stat AS INTEGER)) FROM sqlite_stat1 GROUP BY tbl;",
+				   2, sizes, error))
+	{
+		foreach (QStringList row, sizes)
+			rowCounts[row.at(0)] = row.at(1).toLongLong();
+		QMultiMap<qlonglong,QString> bySize;
+		foreach (QString table, tables)
+			bySize.insert(-rowCounts.value(table), table);
+		tables = bySize.values();
+	}
+
+	m_queue = new DumpQueue(tables, m_outputs);
+	int count = connection ? 1 : qMin(threadsSpinBox->value(), qMax(tables.count(), 1));
+	for (int i = 0; i < count; ++i)
+	{
+		DumpThread * thread = new DumpThread(m_queue, m_fileName, connection,
+											 rowsSpinBox->value());
+		connect(thread, SIGNAL(tableDumped(const QString &, qlonglong)),
+				this, SLOT(thread_tableDumped(const QString &, qlonglong)));
+		connect(thread, SIGNAL(finished()),
+				this, SLOT(thread_finished()));
+		m_threads.append(thread);
+	}
+
+	m_running = count;
+	m_tableCount = tables.count();
+	m_tablesDone = 0;
+	m_rows = 0;
+	progressBar->setMaximum(qMax(m_tableCount, 1));
+	progressBar->setValue(0);
+	setRunning(true);
+	m_time.start();
+	foreach (DumpThread * thread, m_threads)
+		thread->start();
+
+	if (lock)
+	{
+		// the snapshot is shared now, the writers can go on
+		m_queue->started.acquire(count);
+		sqlite3_exec(lock, "COMMIT;", 0, 0, 0);
+		sqlite3_close(lock);
+	}
+	statusLabel->setText(consistent
+						 ? tr("Dumping...")
+						 : tr("Dumping... The database could not be locked, "
+							  "the tables may be dumped from different commits."));
+}
+
+void DumpDialog::cancelButton_clicked()
+{
+	if (m_queue)
+		m_queue->cancel();
+}
+
+void DumpDialog::thread_tableDumped(const QString & table, qlonglong rows)
+{
+	Q_UNUSED(table);
+	++m_tablesDone;
+	m_rows += rows;
+	progressBar->setValue(m_tablesDone);
+	statusLabel->setText(tr("%1 of %2 tables, %3 rows, %4 s")
+						 .arg(m_tablesDone).arg(m_tableCount).arg(m_rows)
+						 .arg(m_time.elapsed() / 1000.0, 0, 'f', 1));
+}
+
+void DumpDialog::thread_finished()
+{
+	if (!m_queue || --m_running > 0)
+		return;
+
+	QString error(m_queue->error());
+	bool cancelled = m_queue->isCancelled();
+	setRunning(false);
+	if (cancelled || !error.isEmpty())
+	{
+		cleanup(true);
+		if (error.isEmpty())
+			statusLabel->setText(tr("Cancelled."));
+		else
+			showError(error);
+		return;
+	}
+
+	statusLabel->setText(tr("Writing the output..."));
+	if (!finishOutput(error))
+	{
+		cleanup(true);
+		showError(error);
+		return;
+	}
+	cleanup(false);
+	statusLabel->setText(tr("Dump written into: %1 (%2 rows in %3 s)")
+						 .arg(fileEdit->text().trimmed()).arg(m_rows)
+						 .arg(m_time.elapsed() / 1000.0, 0, 'f', 1));
+}
+
+void DumpDialog::reject()
+{
+	if (m_queue)
+	{
+		int ret = QMessageBox::question(this, windowTitle(),
+						tr("The dump is still running. Do you want to stop it?"),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+		m_queue->cancel();
+		foreach (DumpThread * thread, m_threads)
+			thread->wait();
+		cleanup(true);
+		setRunning(false);
+	}
+	QDialog::reject();
+}
@@ -0,0 +1,164 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef DUMPDIALOG_H
+#define DUMPDIALOG_H
+
+#include <QDialog>
+#include <QMap>
+#include <QMutex>
+#include <QSemaphore>
+#include <QStringList>
+#include <QThread>
+#include <QTime>
+
+#include "sqlite3.h"
+#include "ui_dumpdialog.h"
+
+
+/*! \brief Tables waiting for a DumpThread.
+It is shared by all threads of one dump. The first error stops the
+whole dump.
+*/
+class DumpQueue
+{
+	public:
+		/*! \param tables tables in the order they should be taken
+		\param outputs table name -> a file its data is appended to
+		*/
+		DumpQueue(const QStringList & tables, const QMap<QString,QString> & outputs);
+
+		/*! \brief Take the next table.
+		\retval bool false when there is nothing left or the dump is stopped.
+		*/
+		bool next(QString & table, QString & output);
+		//! \brief Stop the dump with an error. Only the first error is kept.
+		void setError(const QString & error);
+		QString error();
+		void cancel();
+		bool isCancelled() const { return m_cancelled; };
+
+		//! \brief Released by every thread when its read transaction is open.
+		QSemaphore started;
+
+	private:
+		QMutex m_mutex;
+		QStringList m_tables;
+		QMap<QString,QString> m_outputs;
+		QString m_error;
+		volatile bool m_cancelled;
+};
+
+
+/*! \brief Dump table data as INSERT statements in its own connection.
+Every thread reads the database in one read transaction and takes
+tables from the shared DumpQueue until it is empty.
+*/
+class DumpThread : public QThread
+{
+	Q_OBJECT
+
+	public:
+		/*!
+		\param queue the shared queue
+		\param fileName the database file to open read-only
+		\param connection an open connection to use instead of fileName
+		       (in-memory databases), 0 to open fileName
+		\param rowsPerInsert rows in one multi-row INSERT statement
+		\param parent standard Qt parent
+		*/
+		DumpThread(DumpQueue * queue, const QString & fileName,
+				   sqlite3 * connection, int rowsPerInsert,
+				   QObject * parent = 0);
+
+		/*! \brief Append column i of stmt to buf as a SQL literal.
+		The same as quote() of sqlite, but a real stays real with all its digits.
+		*/
+		static void appendValue(QByteArray & buf, sqlite3_stmt * stmt, int i);
+
+	signals:
+		void tableDumped(const QString & table, qlonglong rows);
+
+	protected:
+		void run();
+
+	private:
+		DumpQueue * m_queue;
+		QString m_fileName;
+		sqlite3 * m_connection;
+		int m_rowsPerInsert;
+
+		bool dumpTable(sqlite3 * db, const QString & table,
+					   const QString & output, qlonglong & rows);
+};
+
+
+/*! \brief Dump the main database as SQL statements.
+Tables are dumped in parallel by DumpThreads, each with its own
+read-only connection. The threads start their read transactions while
+this dialog holds a write lock (BEGIN IMMEDIATE) so no one can commit
+in between and all of them see the same data. In WAL mode the writers
+can continue once the threads are started.
+The result is one file in the schema order or a directory with a file
+per table plus schema.sql with the views, indexes and triggers.
+*/
+class DumpDialog : public QDialog, public Ui::DumpDialog
+{
+	Q_OBJECT
+
+	public:
+		/*!
+		\param fileName the main database file; when it is not a file
+		       the open connection is dumped by one thread
+		\param parent standard Qt parent
+		*/
+		DumpDialog(const QString & fileName, QWidget * parent = 0);
+		~DumpDialog();
+
+	private:
+		QString m_fileName;
+		DumpQueue * m_queue;
+		QList<DumpThread*> m_threads;
+		int m_running;
+		int m_tableCount;
+		int m_tablesDone;
+		qlonglong m_rows;
+		QTime m_time;
+
+		// the schema read in the snapshot: (name, sql) of tables, then the rest
+		QList<QStringList> m_tables;
+		QStringList m_otherSql;
+		//! \brief Table name -> its data file
+		QMap<QString,QString> m_outputs;
+		//! \brief Every file created by the dump, removed when it fails
+		QStringList m_created;
+
+		bool isDirectoryDump();
+		void setRunning(bool running);
+		void showError(const QString & error);
+		bool readSchema(sqlite3 * db, QString & error);
+		/*! \brief The statements restoring a table before its data.
+		\param dataFollows set to false for tables without dumped data
+		\param writableSchema the state of PRAGMA writable_schema in the output
+		*/
+		QByteArray tableHeader(const QStringList & table, bool & dataFollows,
+							   bool & writableSchema);
+		bool prepareOutputs(QString & error);
+		bool finishOutput(QString & error);
+		void cleanup(bool removeAll);
+
+	private slots:
+		void browseButton_clicked();
+		void startButton_clicked();
+		void cancelButton_clicked();
+		void fileEdit_textChanged(const QString & text);
+		void thread_tableDumped(const QString & table, qlonglong rows);
+		void thread_finished();
+		void reject();
+};
+
+#endif
@@ -0,0 +1,1092 @@
+/*
+This library provides approximate aggregates for large tables. They use
+a fixed amount of memory per group and their states can be serialized,
+so partial results of partitions or attached databases can be combined.
+
+Aggregates:
+	approx_count_distinct(x)
+		number of distinct values, HyperLogLog with 2^14 registers
+		(16 kB per group, standard error about 0.8 %)
+	approx_percentile(x, p)
+		the p-quantile of numeric values, 0 <= p <= 1 (0.5 is the median).
+		Merging t-digest with compression 100; the error is smallest
+		near the tails, typically below 0.1 % of the rank
+	reservoir_sample(x, k)
+		uniform random sample of k values (at most 100000) as a JSON array.
+		Blobs are written as hex strings.
+
+Partial states:
+	approx_count_distinct_state(x)
+	approx_percentile_state(x)
+	reservoir_sample_state(x, k)
+		return the state of the aggregate as a blob
+	approx_merge(state)
+		aggregate combining states of the same kind into one
+	approx_result(state)
+	approx_result(state, p)
+		the result of a state; p is required for approx_percentile states
+
+For example:
+	SELECT approx_result(approx_merge(s), 0.99) FROM (
+		SELECT approx_percentile_state(duration) AS s FROM main.requests
+		UNION ALL
+		SELECT approx_percentile_state(duration) FROM shard2.requests
+	);
+
+NULL values are skipped. approx_percentile skips values which are not
+numbers. 1 and 1.0 are one value for approx_count_distinct, as for
+count(DISTINCT).
+
+Compile with
+	gcc -lm -fPIC -shared approx.c -o libsqliteapprox.so
+*/
+
+#if !defined(SQLITE_CORE) || defined(SQLITE_ENABLE_APPROX)
+
+#ifndef SQLITE_CORE
+  #include "sqlite3ext.h"
+  SQLITE_EXTENSION_INIT1
+#else
+  #include "sqlite3.h"
+#endif
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int64_t i64;
+
+/* first byte of a serialized state */
+#define APPROX_HLL       'H'
+#define APPROX_DIGEST    'T'
+#define APPROX_RESERVOIR 'R'
+/* second byte */
+#define APPROX_VERSION   1
+
+#define HLL_PRECISION 14
+#define HLL_REGISTERS (1<<HLL_PRECISION)
+
+#define DIGEST_COMPRESSION 100
+/* the k1 scale function never makes more centroids than the compression */
+#define DIGEST_CENTROIDS DIGEST_COMPRESSION
+#define DIGEST_BUFFER (5*DIGEST_COMPRESSION)
+
+#define RESERVOIR_MAX 100000
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+
+/*
+** Serialization helpers. Numbers are stored big endian, so states can
+** be moved between machines.
+*/
+static void putU32(u8 *p, u32 v){
+  p[0] = (u8)(v>>24);
+  p[1] = (u8)(v>>16);
+  p[2] = (u8)(v>>8);
+  p[3] = (u8)v;
+}
+
+static u32 getU32(const u8 *p){
+  return ((u32)p[0]<<24) | ((u32)p[1]<<16) | ((u32)p[2]<<8) | (u32)p[3];
+}
+
+static void putU64(u8 *p, u64 v){
+  putU32(p, (u32)(v>>32));
+  putU32(p+4, (u32)v);
+}
+
+static u64 getU64(const u8 *p){
+  return ((u64)getU32(p)<<32) | getU32(p+4);
+}
+
+static void putDouble(u8 *p, double d){
+  u64 v;
+  memcpy(&v, &d, 8);
+  putU64(p, v);
+}
+
+static double getDouble(const u8 *p){
+  u64 v = getU64(p);
+  double d;
+  memcpy(&d, &v, 8);
+  return d;
+}
+
+/*
+** 64 bit finalizer of MurmurHash3
+*/
+static u64 approxMix(u64 h){
+  h ^= h>>33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h>>33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h>>33;
+  return h;
+}
+
+/*
+** Hashes n bytes eight at a time
+*/
+static u64 approxHashBytes(const u8 *p, int n, u64 seed){
+  u64 h = seed ^ ((u64)n * 0x9e3779b97f4a7c15ULL);
+  u64 k;
+  int i;
+  while( n>=8 ){
+    k = (u64)p[0] | ((u64)p[1]<<8) | ((u64)p[2]<<16) | ((u64)p[3]<<24)
+      | ((u64)p[4]<<32) | ((u64)p[5]<<40) | ((u64)p[6]<<48) | ((u64)p[7]<<56);
+    h = (h ^ approxMix(k)) * 0x9e3779b97f4a7c15ULL;
+    h ^= h>>29;
+    p += 8;
+    n -= 8;
+  }
+  k = 0;
+  for(i=0; i<n; ++i){
+    k |= (u64)p[i]<<(8*i);
+  }
+  h ^= approxMix(k ^ 0x27d4eb2f165667c5ULL);
+  return approxMix(h);
+}
+
+/*
+** Hash of an SQL value. Integral reals hash as integers.
+*/
+static u64 approxHashValue(sqlite3_value *v){
+  double d;
+  i64 i;
+  switch( sqlite3_value_type(v) ){
+    case SQLITE_INTEGER:
+      return approxMix((u64)sqlite3_value_int64(v) ^ 0x5bd1e9955bd1e995ULL);
+    case SQLITE_FLOAT:
+      d = sqlite3_value_double(v);
+      i = (i64)d;
+      if( d>=-9.2e18 && d<=9.2e18 && (double)i==d )
+        return approxMix((u64)i ^ 0x5bd1e9955bd1e995ULL);
+      {
+        u64 bits;
+        memcpy(&bits, &d, 8);
+        return approxMix(approxMix(bits) ^ 0x94d049bb133111ebULL);
+      }
+    case SQLITE_BLOB:
+      return approxHashBytes((const u8*)sqlite3_value_blob(v),
+                             sqlite3_value_bytes(v), 0x42);
+    default:
+      return approxHashBytes(sqlite3_value_text(v),
+                             sqlite3_value_bytes(v), 0x54);
+  }
+}
+
+/*
+** Number of leading zero bits
+*/
+static int approxClz(u64 x){
+#if defined(__GNUC__)
+  return x ? __builtin_clzll(x) : 64;
+#else
+  int n = 0;
+  if( x==0 )
+    return 64;
+  while( !(x & 0x8000000000000000ULL) ){
+    x <<= 1;
+    ++n;
+  }
+  return n;
+#endif
+}
+
+
+/*
+** HyperLogLog
+** The first HLL_PRECISION bits of the hash select a register, the
+** register keeps the longest run of leading zeros of the rest.
+*/
+typedef struct HllCtx HllCtx;
+struct HllCtx {
+  u8 reg[HLL_REGISTERS];
+};
+
+static void hllAdd(HllCtx *p, u64 h){
+  u32 idx = (u32)(h>>(64-HLL_PRECISION));
+  /* a guard bit keeps the rank below 64-HLL_PRECISION+2 */
+  u64 w = (h<<HLL_PRECISION) | ((u64)1<<(HLL_PRECISION-1));
+  u8 rank = (u8)(approxClz(w) + 1);
+  if( rank>p->reg[idx] )
+    p->reg[idx] = rank;
+}
+
+static i64 hllEstimate(const u8 *reg){
+  double m = HLL_REGISTERS;
+  double alpha = 0.7213/(1.0 + 1.079/m);
+  double sum = 0.0;
+  double e;
+  int zeros = 0;
+  int i;
+  for(i=0; i<HLL_REGISTERS; ++i){
+    sum += ldexp(1.0, -reg[i]);
+    if( reg[i]==0 )
+      ++zeros;
+  }
+  e = alpha*m*m/sum;
+  /* linear counting for small cardinalities; 64 bit hashes need
+  ** no correction for large ones */
+  if( e<=2.5*m && zeros>0 )
+    e = m*log(m/zeros);
+  return (i64)(e + 0.5);
+}
+
+static void hllMerge(HllCtx *p, const u8 *reg){
+  int i;
+  for(i=0; i<HLL_REGISTERS; ++i){
+    if( reg[i]>p->reg[i] )
+      p->reg[i] = reg[i];
+  }
+}
+
+static void hllStep(sqlite3_context *context, int argc, sqlite3_value **argv){
+  HllCtx *p;
+  assert( argc==1 );
+  if( sqlite3_value_type(argv[0])==SQLITE_NULL )
+    return;
+  p = (HllCtx*)sqlite3_aggregate_context(context, sizeof(*p));
+  if( p )
+    hllAdd(p, approxHashValue(argv[0]));
+}
+
+static void hllFinalize(sqlite3_context *context){
+  HllCtx *p = (HllCtx*)sqlite3_aggregate_context(context, 0);
+  sqlite3_result_int64(context, p ? hllEstimate(p->reg) : 0);
+}
+
+static void hllSerialize(sqlite3_context *context, const HllCtx *p){
+  u8 *out = (u8*)sqlite3_malloc(3 + HLL_REGISTERS);
+  if( out==0 ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  out[0] = APPROX_HLL;
+  out[1] = APPROX_VERSION;
+  out[2] = HLL_PRECISION;
+  if( p )
+    memcpy(out+3, p->reg, HLL_REGISTERS);
+  else
+    memset(out+3, 0, HLL_REGISTERS);
+  sqlite3_result_blob(context, out, 3 + HLL_REGISTERS, sqlite3_free);
+}
+
+static void hllStateFinalize(sqlite3_context *context){
+  hllSerialize(context, (HllCtx*)sqlite3_aggregate_context(context, 0));
+}
+
+
+/*
+** Merging t-digest (Dunning, "Computing extremely accurate quantiles
+** using t-digests"). Values are collected in a buffer; a full buffer
+** is sorted and merged with the centroids so that a centroid never
+** spans more than one unit of the k1 scale function. Centroids near
+** the tails stay small, hence the accuracy there.
+*/
+typedef struct Centroid Centroid;
+struct Centroid {
+  double mean;
+  double weight;
+};
+
+typedef struct DigestCtx DigestCtx;
+struct DigestCtx {
+  int used;             /* min and max are set */
+  int nCentroid;
+  int nBuffer;
+  double min;
+  double max;
+  double p;             /* the percentile of approx_percentile() */
+  int hasP;
+  Centroid c[DIGEST_CENTROIDS];
+  Centroid buf[DIGEST_BUFFER];
+  Centroid work[DIGEST_CENTROIDS + DIGEST_BUFFER];
+};
+
+static int centroidCmp(const void *a, const void *b){
+  double x = ((const Centroid*)a)->mean;
+  double y = ((const Centroid*)b)->mean;
+  return x<y ? -1 : (x>y ? 1 : 0);
+}
+
+static double digestK(double q){
+  return DIGEST_COMPRESSION/(2.0*M_PI) * asin(2.0*q - 1.0);
+}
+
+static double digestQ(double k){
+  double a = k*2.0*M_PI/DIGEST_COMPRESSION;
+  if( a>=M_PI/2.0 )
+    return 1.0;
+  return (sin(a) + 1.0)/2.0;
+}
+
+static void digestCompress(DigestCtx *p){
+  int n, i, out;
+  double total = 0.0;
+  double done = 0.0;
+  double limit;
+  Centroid cur;
+
+  if( p->nBuffer==0 )
+    return;
+  /* the centroids are sorted already, only the buffer needs sorting */
+  qsort(p->buf, p->nBuffer, sizeof(Centroid), centroidCmp);
+  n = 0;
+  i = 0;
+  out = 0;
+  while( i<p->nCentroid || out<p->nBuffer ){
+    if( out==p->nBuffer || (i<p->nCentroid && p->c[i].mean<=p->buf[out].mean) )
+      p->work[n] = p->c[i++];
+    else
+      p->work[n] = p->buf[out++];
+    total += p->work[n++].weight;
+  }
+  p->nBuffer = 0;
+
+  out = 0;
+  cur = p->work[0];
+  limit = total*digestQ(digestK(0.0) + 1.0);
+  for(i=1; i<n; ++i){
+    Centroid *x = &p->work[i];
+    if( done + cur.weight + x->weight <= limit || out==DIGEST_CENTROIDS-1 ){
+      cur.weight += x->weight;
+      cur.mean += (x->mean - cur.mean)*x->weight/cur.weight;
+    }else{
+      p->c[out++] = cur;
+      done += cur.weight;
+      limit = total*digestQ(digestK(done/total) + 1.0);
+      cur = *x;
+    }
+  }
+  p->c[out++] = cur;
+  p->nCentroid = out;
+}
+
+static void digestRange(DigestCtx *p, double min, double max){
+  if( !p->used || min<p->min )
+    p->min = min;
+  if( !p->used || max>p->max )
+    p->max = max;
+  p->used = 1;
+}
+
+static void digestAdd(DigestCtx *p, double mean, double weight){
+  digestRange(p, mean, mean);
+  if( p->nBuffer==DIGEST_BUFFER )
+    digestCompress(p);
+  p->buf[p->nBuffer].mean = mean;
+  p->buf[p->nBuffer].weight = weight;
+  ++p->nBuffer;
+}
+
+/*
+** Interpolates between the centers of the centroids; the tails go
+** to the exact minimum and maximum.
+*/
+static double digestQuantile(DigestCtx *p, double q){
+  double total = 0.0;
+  double index, cum, dw;
+  int i, n;
+
+  digestCompress(p);
+  n = p->nCentroid;
+  if( q<=0.0 )
+    return p->min;
+  if( q>=1.0 )
+    return p->max;
+  for(i=0; i<n; ++i){
+    total += p->c[i].weight;
+  }
+  index = q*total;
+  cum = p->c[0].weight/2.0;
+  if( index<cum )
+    return p->min + (index/cum)*(p->c[0].mean - p->min);
+  for(i=0; i<n-1; ++i){
+    dw = (p->c[i].weight + p->c[i+1].weight)/2.0;
+    if( index<cum+dw )
+      return p->c[i].mean + (index-cum)/dw*(p->c[i+1].mean - p->c[i].mean);
+    cum += dw;
+  }
+  dw = total - cum;
+  if( dw<=0.0 )
+    return p->max;
+  return p->c[n-1].mean + (index-cum)/dw*(p->max - p->c[n-1].mean);
+}
+
+static int digestValue(sqlite3_value *v, double *x){
+  int type = sqlite3_value_numeric_type(v);
+  if( type!=SQLITE_INTEGER && type!=SQLITE_FLOAT )
+    return 0;
+  *x = sqlite3_value_double(v);
+  return *x==*x;    /* not NaN */
+}
+
+static void digestStep(sqlite3_context *context, int argc, sqlite3_value **argv){
+  DigestCtx *p;
+  double x;
+  p = (DigestCtx*)sqlite3_aggregate_context(context, sizeof(*p));
+  if( p==0 )
+    return;
+  if( argc==2 ){
+    /* the percentile of the first row is used for the whole group */
+    double q = sqlite3_value_double(argv[1]);
+    int type = sqlite3_value_numeric_type(argv[1]);
+    if( (type!=SQLITE_INTEGER && type!=SQLITE_FLOAT) || q<0.0 || q>1.0 ){
+      sqlite3_result_error(context,
+          "the percentile of approx_percentile() must be between 0 and 1", -1);
+      return;
+    }
+    if( !p->hasP ){
+      p->p = q;
+      p->hasP = 1;
+    }
+  }
+  if( digestValue(argv[0], &x) )
+    digestAdd(p, x, 1.0);
+}
+
+static void digestFinalize(sqlite3_context *context){
+  DigestCtx *p = (DigestCtx*)sqlite3_aggregate_context(context, 0);
+  if( p && (p->nCentroid || p->nBuffer) )
+    sqlite3_result_double(context, digestQuantile(p, p->p));
+}
+
+static void digestSerialize(sqlite3_context *context, DigestCtx *p){
+  int n = 0;
+  int size, i;
+  u8 *out;
+  if( p ){
+    digestCompress(p);
+    n = p->nCentroid;
+  }
+  size = 2 + 4 + 16 + 16*n;
+  out = (u8*)sqlite3_malloc(size);
+  if( out==0 ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  out[0] = APPROX_DIGEST;
+  out[1] = APPROX_VERSION;
+  putU32(out+2, (u32)n);
+  putDouble(out+6, p ? p->min : 0.0);
+  putDouble(out+14, p ? p->max : 0.0);
+  for(i=0; i<n; ++i){
+    putDouble(out+22+16*i, p->c[i].mean);
+    putDouble(out+30+16*i, p->c[i].weight);
+  }
+  sqlite3_result_blob(context, out, size, sqlite3_free);
+}
+
+static void digestStateFinalize(sqlite3_context *context){
+  digestSerialize(context, (DigestCtx*)sqlite3_aggregate_context(context, 0));
+}
+
+/*
+** Adds the centroids of a serialized digest
+*/
+static int digestMerge(DigestCtx *p, const u8 *z, int n){
+  u32 cnt, i;
+  if( n<22 )
+    return 0;
+  cnt = getU32(z+2);
+  if( cnt>DIGEST_CENTROIDS || (u32)n!=22+16*cnt )
+    return 0;
+  if( cnt==0 )
+    return 1;
+  digestRange(p, getDouble(z+6), getDouble(z+14));
+  for(i=0; i<cnt; ++i){
+    digestAdd(p, getDouble(z+22+16*i), getDouble(z+30+16*i));
+  }
+  return 1;
+}
+
+
+/*
+** Reservoir sampling with Li's Algorithm L: after the reservoir is full
+** the number of values to skip is drawn directly, so the random number
+** generator runs O(k log(n/k)) times instead of once per row.
+*/
+typedef struct ApproxValue ApproxValue;
+struct ApproxValue {
+  int type;
+  i64 i;
+  double d;
+  int n;
+  u8 *z;
+};
+
+typedef struct ReservoirCtx ReservoirCtx;
+struct ReservoirCtx {
+  int k;                /* size of the reservoir */
+  int n;                /* values in it */
+  i64 seen;             /* values of the group */
+  i64 next;             /* the next value to take (Algorithm L) */
+  double w;
+  u64 rng;              /* xorshift64* state */
+  ApproxValue *a;
+};
+
+static u64 reservoirRandom(ReservoirCtx *p){
+  if( p->rng==0 ){
+    sqlite3_randomness(sizeof(p->rng), &p->rng);
+    p->rng |= 1;
+  }
+  p->rng ^= p->rng>>12;
+  p->rng ^= p->rng<<25;
+  p->rng ^= p->rng>>27;
+  return p->rng * 0x2545f4914f6cdd1dULL;
+}
+
+/*
+** uniform in (0,1)
+*/
+static double reservoirUniform(ReservoirCtx *p){
+  return ((reservoirRandom(p)>>11) + 0.5)/9007199254740992.0;
+}
+
+static void reservoirSkip(ReservoirCtx *p){
+  p->w *= exp(log(reservoirUniform(p))/p->k);
+  p->next += (i64)floor(log(reservoirUniform(p))/log(1.0 - p->w)) + 1;
+}
+
+static void valueFree(ApproxValue *v){
+  sqlite3_free(v->z);
+  v->z = 0;
+}
+
+static int valueCopy(ApproxValue *v, sqlite3_value *x){
+  const void *z = 0;
+  v->type = sqlite3_value_type(x);
+  v->z = 0;
+  v->n = 0;
+  switch( v->type ){
+    case SQLITE_INTEGER: v->i = sqlite3_value_int64(x); return 1;
+    case SQLITE_FLOAT:   v->d = sqlite3_value_double(x); return 1;
+    case SQLITE_NULL:    return 1;
+    case SQLITE_BLOB:    z = sqlite3_value_blob(x); break;
+    default:             z = sqlite3_value_text(x); break;
+  }
+  v->n = sqlite3_value_bytes(x);
+  v->z = (u8*)sqlite3_malloc(v->n + 1);
+  if( v->z==0 )
+    return 0;
+  if( v->n )
+    memcpy(v->z, z, v->n);
+  return 1;
+}
+
+static void reservoirFree(ReservoirCtx *p){
+  int i;
+  for(i=0; i<p->n; ++i){
+    valueFree(&p->a[i]);
+  }
+  sqlite3_free(p->a);
+  p->a = 0;
+  p->n = 0;
+}
+
+static int reservoirInit(sqlite3_context *context, ReservoirCtx *p, i64 k){
+  if( k<1 || k>RESERVOIR_MAX ){
+    sqlite3_result_error(context,
+        "the size of reservoir_sample() must be between 1 and 100000", -1);
+    return 0;
+  }
+  if( p->a )
+    return 1;
+  p->a = (ApproxValue*)sqlite3_malloc((int)(k*sizeof(ApproxValue)));
+  if( p->a==0 ){
+    sqlite3_result_error_nomem(context);
+    return 0;
+  }
+  p->k = (int)k;
+  return 1;
+}
+
+static void reservoirStep(sqlite3_context *context, int argc, sqlite3_value **argv){
+  ReservoirCtx *p;
+  ApproxValue v;
+  assert( argc==2 );
+  if( sqlite3_value_type(argv[0])==SQLITE_NULL )
+    return;
+  p = (ReservoirCtx*)sqlite3_aggregate_context(context, sizeof(*p));
+  if( p==0 || !reservoirInit(context, p, sqlite3_value_int64(argv[1])) )
+    return;
+  ++p->seen;
+  if( p->n<p->k ){
+    if( !valueCopy(&p->a[p->n], argv[0]) ){
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    if( ++p->n==p->k ){
+      p->w = 1.0;
+      p->next = p->seen;
+      reservoirSkip(p);
+    }
+  }else if( p->seen==p->next ){
+    if( !valueCopy(&v, argv[0]) ){
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    {
+      int j = (int)(reservoirRandom(p) % (u64)p->k);
+      valueFree(&p->a[j]);
+      p->a[j] = v;
+    }
+    reservoirSkip(p);
+  }
+}
+
+/*
+** Appends to a growable string
+*/
+typedef struct ApproxStr ApproxStr;
+struct ApproxStr {
+  char *z;
+  int n;
+  int alloc;
+  int oom;
+};
+
+static void strAppend(ApproxStr *s, const char *z, int n){
+  if( s->oom )
+    return;
+  if( s->n + n + 1 > s->alloc ){
+    int size = 2*(s->n + n + 1) + 64;
+    char *t = (char*)sqlite3_realloc(s->z, size);
+    if( t==0 ){
+      s->oom = 1;
+      return;
+    }
+    s->z = t;
+    s->alloc = size;
+  }
+  memcpy(s->z + s->n, z, n);
+  s->n += n;
+  s->z[s->n] = 0;
+}
+
+static void strAppendJson(ApproxStr *s, const ApproxValue *v){
+  static const char hex[] = "0123456789abcdef";
+  char buf[32];
+  int i;
+  switch( v->type ){
+    case SQLITE_INTEGER:
+      sqlite3_snprintf(sizeof(buf), buf, "%lld", (long long)v->i);
+      strAppend(s, buf, (int)strlen(buf));
+      return;
+    case SQLITE_FLOAT:
+      if( v->d!=v->d || v->d>1.7976931348623157e308 || v->d<-1.7976931348623157e308 ){
+        strAppend(s, "null", 4);
+        return;
+      }
+      sqlite3_snprintf(sizeof(buf), buf, "%!.17g", v->d);
+      strAppend(s, buf, (int)strlen(buf));
+      return;
+    case SQLITE_NULL:
+      strAppend(s, "null", 4);
+      return;
+    case SQLITE_BLOB:
+      strAppend(s, "\"", 1);
+      for(i=0; i<v->n; ++i){
+        buf[0] = hex[v->z[i]>>4];
+        buf[1] = hex[v->z[i]&0xf];
+        strAppend(s, buf, 2);
+      }
+      strAppend(s, "\"", 1);
+      return;
+  }
+  strAppend(s, "\"", 1);
+  for(i=0; i<v->n; ++i){
+    u8 c = v->z[i];
+    if( c=='"' || c=='\\' ){
+      buf[0] = '\\';
+      buf[1] = (char)c;
+      strAppend(s, buf, 2);
+    }else if( c<0x20 ){
+      sqlite3_snprintf(sizeof(buf), buf, "\\u%04x", c);
+      strAppend(s, buf, 6);
+    }else{
+      strAppend(s, (const char*)&v->z[i], 1);
+    }
+  }
+  strAppend(s, "\"", 1);
+}
+
+static void reservoirResult(sqlite3_context *context, ReservoirCtx *p){
+  ApproxStr s = { 0, 0, 0, 0 };
+  int i;
+  strAppend(&s, "[", 1);
+  for(i=0; p && i<p->n; ++i){
+    if( i )
+      strAppend(&s, ",", 1);
+    strAppendJson(&s, &p->a[i]);
+  }
+  strAppend(&s, "]", 1);
+  if( s.oom ){
+    sqlite3_free(s.z);
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  sqlite3_result_text(context, s.z, s.n, sqlite3_free);
+}
+
+static void reservoirFinalize(sqlite3_context *context){
+  ReservoirCtx *p = (ReservoirCtx*)sqlite3_aggregate_context(context, 0);
+  reservoirResult(context, p);
+  if( p )
+    reservoirFree(p);
+}
+
+static void reservoirSerialize(sqlite3_context *context, ReservoirCtx *p){
+  i64 size = 2 + 4 + 8 + 4;
+  int i, n = p ? p->n : 0;
+  u8 *out, *z;
+  for(i=0; i<n; ++i){
+    size += 1 + (p->a[i].type==SQLITE_NULL ? 0
+                 : (p->a[i].type==SQLITE_INTEGER || p->a[i].type==SQLITE_FLOAT ? 8 : 4 + p->a[i].n));
+  }
+  if( size>0x7fffffff ){
+    sqlite3_result_error_toobig(context);
+    return;
+  }
+  out = (u8*)sqlite3_malloc((int)size);
+  if( out==0 ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  out[0] = APPROX_RESERVOIR;
+  out[1] = APPROX_VERSION;
+  putU32(out+2, p ? (u32)p->k : 0);
+  putU64(out+6, p ? (u64)p->seen : 0);
+  putU32(out+14, (u32)n);
+  z = out+18;
+  for(i=0; i<n; ++i){
+    ApproxValue *v = &p->a[i];
+    *z++ = (u8)v->type;
+    switch( v->type ){
+      case SQLITE_INTEGER: putU64(z, (u64)v->i); z += 8; break;
+      case SQLITE_FLOAT:   putDouble(z, v->d); z += 8; break;
+      case SQLITE_NULL:    break;
+      default:
+        putU32(z, (u32)v->n);
+        memcpy(z+4, v->z, v->n);
+        z += 4 + v->n;
+        break;
+    }
+  }
+  sqlite3_result_blob(context, out, (int)size, sqlite3_free);
+}
+
+static void reservoirStateFinalize(sqlite3_context *context){
+  ReservoirCtx *p = (ReservoirCtx*)sqlite3_aggregate_context(context, 0);
+  reservoirSerialize(context, p);
+  if( p )
+    reservoirFree(p);
+}
+
+/*
+** Reads a serialized reservoir into p, which must be empty
+*/
+static int reservoirRead(ReservoirCtx *p, const u8 *z, int n){
+  const u8 *end = z + n;
+  u32 k, cnt, i;
+  if( n<18 )
+    return 0;
+  k = getU32(z+2);
+  cnt = getU32(z+14);
+  if( k<1 || k>RESERVOIR_MAX || cnt>k )
+    return 0;
+  p->a = (ApproxValue*)sqlite3_malloc((int)(k*sizeof(ApproxValue)));
+  if( p->a==0 )
+    return 0;
+  p->k = (int)k;
+  p->seen = (i64)getU64(z+6);
+  z += 18;
+  for(i=0; i<cnt; ++i){
+    ApproxValue *v = &p->a[i];
+    if( z>=end )
+      return 0;
+    v->type = *z++;
+    v->z = 0;
+    v->n = 0;
+    if( v->type==SQLITE_INTEGER || v->type==SQLITE_FLOAT ){
+      if( end-z<8 )
+        return 0;
+      if( v->type==SQLITE_INTEGER )
+        v->i = (i64)getU64(z);
+      else
+        v->d = getDouble(z);
+      z += 8;
+    }else if( v->type==SQLITE_TEXT || v->type==SQLITE_BLOB ){
+      if( end-z<4 || (u32)(end-z-4)<getU32(z) )
+        return 0;
+      v->n = (int)getU32(z);
+      v->z = (u8*)sqlite3_malloc(v->n + 1);
+      if( v->z==0 )
+        return 0;
+      memcpy(v->z, z+4, v->n);
+      z += 4 + v->n;
+    }else if( v->type!=SQLITE_NULL ){
+      return 0;
+    }
+    p->n = (int)i + 1;
+  }
+  return z==end && (i64)p->n<=p->seen;
+}
+
+/*
+** Combines the samples of two disjoint populations: every value of the
+** result comes from a population with probability proportional to its
+** not yet sampled size, so the result is a uniform sample of the union.
+*/
+static int reservoirMerge(ReservoirCtx *p, ReservoirCtx *q){
+  ApproxValue *a;
+  i64 restP = p->seen;
+  i64 restQ = q->seen;
+  int size = p->k<q->k ? p->k : q->k;
+  int k = size;
+  int n = 0;
+  if( (i64)k>restP+restQ )
+    k = (int)(restP+restQ);
+  a = (ApproxValue*)sqlite3_malloc(size*(int)sizeof(ApproxValue));
+  if( a==0 )
+    return 0;
+  while( n<k ){
+    ReservoirCtx *from;
+    int j;
+    if( q->n==0 || (p->n>0 && (double)restP/(restP+restQ) > reservoirUniform(p)) ){
+      from = p;
+      --restP;
+    }else{
+      from = q;
+      --restQ;
+    }
+    j = (int)(reservoirRandom(p) % (u64)from->n);
+    a[n++] = from->a[j];
+    from->a[j] = from->a[--from->n];
+  }
+  reservoirFree(q);
+  reservoirFree(p);
+  p->a = a;
+  p->n = n;
+  p->k = size;
+  p->seen += q->seen;
+  return 1;
+}
+
+
+/*
+** approx_merge(state)
+** The context holds one of the three states, chosen by the first blob.
+*/
+typedef struct MergeCtx MergeCtx;
+struct MergeCtx {
+  int kind;
+  HllCtx *hll;
+  DigestCtx *digest;
+  ReservoirCtx res;
+};
+
+static void mergeError(sqlite3_context *context){
+  sqlite3_result_error(context, "approx_merge(): not a state of an approximate aggregate"
+                                " or states of different kinds", -1);
+}
+
+static void mergeStep(sqlite3_context *context, int argc, sqlite3_value **argv){
+  MergeCtx *p;
+  const u8 *z;
+  int n;
+  assert( argc==1 );
+  if( sqlite3_value_type(argv[0])==SQLITE_NULL )
+    return;
+  z = (const u8*)sqlite3_value_blob(argv[0]);
+  n = sqlite3_value_bytes(argv[0]);
+  p = (MergeCtx*)sqlite3_aggregate_context(context, sizeof(*p));
+  if( p==0 )
+    return;
+  if( n<2 || z[1]!=APPROX_VERSION || (p->kind && p->kind!=z[0]) ){
+    mergeError(context);
+    return;
+  }
+
+  switch( z[0] ){
+    case APPROX_HLL:
+      if( n!=3+HLL_REGISTERS || z[2]!=HLL_PRECISION ){
+        mergeError(context);
+        return;
+      }
+      if( p->hll==0 ){
+        p->hll = (HllCtx*)sqlite3_malloc(sizeof(HllCtx));
+        if( p->hll==0 ){
+          sqlite3_result_error_nomem(context);
+          return;
+        }
+        memset(p->hll, 0, sizeof(HllCtx));
+      }
+      hllMerge(p->hll, z+3);
+      break;
+    case APPROX_DIGEST:
+      if( p->digest==0 ){
+        p->digest = (DigestCtx*)sqlite3_malloc(sizeof(DigestCtx));
+        if( p->digest==0 ){
+          sqlite3_result_error_nomem(context);
+          return;
+        }
+        memset(p->digest, 0, sizeof(DigestCtx));
+      }
+      if( !digestMerge(p->digest, z, n) ){
+        mergeError(context);
+        return;
+      }
+      break;
+    case APPROX_RESERVOIR:
+      {
+        ReservoirCtx q;
+        memset(&q, 0, sizeof(q));
+        if( !reservoirRead(&q, z, n) ){
+          reservoirFree(&q);
+          mergeError(context);
+          return;
+        }
+        if( p->kind==0 ){
+          p->res = q;
+        }else if( !reservoirMerge(&p->res, &q) ){
+          reservoirFree(&q);
+          sqlite3_result_error_nomem(context);
+          return;
+        }
+      }
+      break;
+    default:
+      mergeError(context);
+      return;
+  }
+  p->kind = z[0];
+}
+
+static void mergeFinalize(sqlite3_context *context){
+  MergeCtx *p = (MergeCtx*)sqlite3_aggregate_context(context, 0);
+  if( p==0 || p->kind==0 )
+    return;
+  switch( p->kind ){
+    case APPROX_HLL:
+      hllSerialize(context, p->hll);
+      break;
+    case APPROX_DIGEST:
+      digestSerialize(context, p->digest);
+      break;
+    case APPROX_RESERVOIR:
+      reservoirSerialize(context, &p->res);
+      break;
+  }
+  sqlite3_free(p->hll);
+  sqlite3_free(p->digest);
+  reservoirFree(&p->res);
+}
+
+/*
+** approx_result(state [, p])
+*/
+static void resultFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  const u8 *z;
+  int n;
+  if( sqlite3_value_type(argv[0])==SQLITE_NULL )
+    return;
+  z = (const u8*)sqlite3_value_blob(argv[0]);
+  n = sqlite3_value_bytes(argv[0]);
+  if( n<2 || z[1]!=APPROX_VERSION ){
+    sqlite3_result_error(context, "approx_result(): not a state of an approximate aggregate", -1);
+    return;
+  }
+
+  if( z[0]==APPROX_HLL && n==3+HLL_REGISTERS && z[2]==HLL_PRECISION ){
+    sqlite3_result_int64(context, hllEstimate(z+3));
+  }else if( z[0]==APPROX_DIGEST ){
+    DigestCtx *d;
+    double q = argc>1 ? sqlite3_value_double(argv[1]) : -1.0;
+    if( argc<2 || q<0.0 || q>1.0 ){
+      sqlite3_result_error(context,
+          "approx_result() of approx_percentile needs a percentile between 0 and 1", -1);
+      return;
+    }
+    d = (DigestCtx*)sqlite3_malloc(sizeof(DigestCtx));
+    if( d==0 ){
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    memset(d, 0, sizeof(DigestCtx));
+    if( !digestMerge(d, z, n) )
+      sqlite3_result_error(context, "approx_result(): damaged approx_percentile state", -1);
+    else if( d->nBuffer || d->nCentroid )
+      sqlite3_result_double(context, digestQuantile(d, q));
+    sqlite3_free(d);
+  }else if( z[0]==APPROX_RESERVOIR ){
+    ReservoirCtx r;
+    memset(&r, 0, sizeof(r));
+    if( reservoirRead(&r, z, n) )
+      reservoirResult(context, &r);
+    else
+      sqlite3_result_error(context, "approx_result(): damaged reservoir_sample state", -1);
+    reservoirFree(&r);
+  }else{
+    sqlite3_result_error(context, "approx_result(): not a state of an approximate aggregate", -1);
+  }
+}
+
+
+/* SQLite invokes this routine once when it loads the extension.
+** Create new functions, collating sequences, and virtual table
+** modules here.  This is usually the only exported symbol in
+** the shared library.
+*/
+
+int sqlite3ApproxInit(sqlite3 *db){
+  static const struct {
+    const char *zName;
+    int nArg;
+    void (*xStep)(sqlite3_context*,int,sqlite3_value**);
+    void (*xFinalize)(sqlite3_context*);
+  } aAggs[] = {
+    { "approx_count_distinct",       1, hllStep,       hllFinalize },
+    { "approx_count_distinct_state", 1, hllStep,       hllStateFinalize },
+    { "approx_percentile",           2, digestStep,    digestFinalize },
+    { "approx_percentile_state",     1, digestStep,    digestStateFinalize },
+    { "reservoir_sample",            2, reservoirStep, reservoirFinalize },
+    { "reservoir_sample_state",      2, reservoirStep, reservoirStateFinalize },
+    { "approx_merge",                1, mergeStep,     mergeFinalize },
+  };
+  int i;
+  int rc = SQLITE_OK;
+  for(i=0; rc==SQLITE_OK && i<(int)(sizeof(aAggs)/sizeof(aAggs[0])); i++){
+    rc = sqlite3_create_function(db, aAggs[i].zName, aAggs[i].nArg, SQLITE_UTF8,
+                                 0, 0, aAggs[i].xStep, aAggs[i].xFinalize);
+  }
+  if( rc==SQLITE_OK )
+    rc = sqlite3_create_function(db, "approx_result", 1, SQLITE_UTF8, 0, resultFunc, 0, 0);
+  if( rc==SQLITE_OK )
+    rc = sqlite3_create_function(db, "approx_result", 2, SQLITE_UTF8, 0, resultFunc, 0, 0);
+  return rc;
+}
+
+#if !SQLITE_CORE
+int sqlite3_extension_init(
+  sqlite3 *db,
+  char **pzErrMsg,
+  const sqlite3_api_routines *pApi
+){
+  SQLITE_EXTENSION_INIT2(pApi)
+  return sqlite3ApproxInit(db);
+}
+#endif
+
+#endif
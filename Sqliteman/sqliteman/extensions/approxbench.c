@@ -0,0 +1,116 @@
+/*
+Accuracy and time of the approximate aggregates of approx.c against
+the exact queries, see approxbench.pro. The extension is compiled in.
+
+	approxbench [rows]
+
+A table of random integers (1M rows by default, about 63 % of them
+distinct) is summarized by
+	count(DISTINCT x)                   and approx_count_distinct(x)
+	ORDER BY x LIMIT 1 OFFSET n*p       and approx_percentile(x, p)
+	ORDER BY random() LIMIT k           and reservoir_sample(x, k)
+The error of approx_count_distinct is relative to the exact count, the
+one of approx_percentile is the distance of the rank of its result
+from p. The mean of the sample is compared with the mean of the table.
+*/
+
+#include <sqlite3.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int sqlite3ApproxInit(sqlite3 *db);
+
+
+static double now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec/1e9;
+}
+
+/* the first column of the first row of zSql, timed in *pSeconds */
+static double queryDouble(sqlite3 *db, const char *zSql, double *pSeconds){
+  sqlite3_stmt *pStmt = 0;
+  double r = 0.0;
+  double start = now();
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)!=SQLITE_OK
+   || sqlite3_step(pStmt)!=SQLITE_ROW ){
+    fprintf(stderr, "%s\n%s\n", zSql, sqlite3_errmsg(db));
+    exit(1);
+  }
+  r = sqlite3_column_double(pStmt, 0);
+  sqlite3_finalize(pStmt);
+  if( pSeconds )
+    *pSeconds = now() - start;
+  return r;
+}
+
+static void report(const char *zName, double exact, double exactTime,
+                   double approx, double approxTime, double error){
+  printf("%-22s %14.1f %8.3f s  %14.1f %8.3f s  %7.3f %%\n",
+         zName, exact, exactTime, approx, approxTime, 100.0*error);
+}
+
+static void percentile(sqlite3 *db, int nRow, double p){
+  char zName[32];
+  char *zSql;
+  double exact, approx, exactTime, approxTime, below;
+
+  zSql = sqlite3_mprintf("SELECT x FROM t ORDER BY x LIMIT 1 OFFSET %d",
+                         (int)((nRow - 1)*p));
+  exact = queryDouble(db, zSql, &exactTime);
+  sqlite3_free(zSql);
+  zSql = sqlite3_mprintf("SELECT approx_percentile(x, %.2f) FROM t", p);
+  approx = queryDouble(db, zSql, &approxTime);
+  sqlite3_free(zSql);
+  zSql = sqlite3_mprintf("SELECT count(*) FROM t WHERE x <= %.17g", approx);
+  below = queryDouble(db, zSql, 0);
+  sqlite3_free(zSql);
+
+  sqlite3_snprintf(sizeof(zName), zName, "percentile %.2f", p);
+  report(zName, exact, exactTime, approx, approxTime, fabs(below/nRow - p));
+}
+
+int main(int argc, char **argv){
+  sqlite3 *db;
+  char *zSql;
+  int nRow = argc>1 ? atoi(argv[1]) : 1000000;
+  double exact, approx, exactTime, approxTime;
+
+  if( nRow<1 ){
+    fprintf(stderr, "usage: %s [rows]\n", argv[0]);
+    return 1;
+  }
+  sqlite3_open(":memory:", &db);
+  sqlite3ApproxInit(db);
+  zSql = sqlite3_mprintf(
+      "CREATE TABLE t(x INTEGER);"
+      "WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM c WHERE i<%d)"
+      " INSERT INTO t SELECT abs(random() %% %d) FROM c;", nRow, nRow);
+  if( sqlite3_exec(db, zSql, 0, 0, 0)!=SQLITE_OK ){
+    fprintf(stderr, "%s\n", sqlite3_errmsg(db));
+    return 1;
+  }
+  sqlite3_free(zSql);
+
+  printf("%d rows\n%-22s %25s  %25s  %9s\n", nRow, "", "exact", "approximate", "error");
+
+  exact = queryDouble(db, "SELECT count(DISTINCT x) FROM t", &exactTime);
+  approx = queryDouble(db, "SELECT approx_count_distinct(x) FROM t", &approxTime);
+  report("count distinct", exact, exactTime, approx, approxTime, fabs(approx - exact)/exact);
+
+  percentile(db, nRow, 0.5);
+  percentile(db, nRow, 0.99);
+
+  exact = queryDouble(db, "SELECT avg(x) FROM t", 0);
+  queryDouble(db, "SELECT avg(x) FROM (SELECT x FROM t ORDER BY random() LIMIT 1000)",
+              &exactTime);
+  approx = queryDouble(db, "SELECT avg(value) FROM json_each("
+                           "(SELECT reservoir_sample(x, 1000) FROM t))", &approxTime);
+  report("sample mean, k=1000", exact, exactTime, approx, approxTime, fabs(approx - exact)/exact);
+
+  sqlite3_close(db);
+  return 0;
+}
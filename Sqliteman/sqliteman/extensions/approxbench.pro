@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = approxbench
+DEPENDPATH += .
+INCLUDEPATH += .
+CONFIG -= qt
+DEFINES += SQLITE_CORE SQLITE_ENABLE_APPROX
+LIBS += -lsqlite3 -lm
+
+CONFIG += console
+
+# Input
+SOURCES += approxbench.c approx.c
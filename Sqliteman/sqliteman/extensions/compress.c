@@ -1,4 +1,34 @@
 /*
+** zlib compression of values.
+**
+**   compress(X)                 compress X at the default level of zlib
+**   compress(X, LEVEL)          compress X at LEVEL, 0 (store) to 9 (best)
+**   compress(X, LEVEL, DICT)    compress X with DICT as the preset dictionary
+**   uncompress(X)               restore a compressed value as a blob
+**   uncompress(X, DICT)         restore a value compressed with DICT
+**   compress_dictionary(X)      aggregate: train a dictionary on the values X
+**   compress_dictionary(X, N)   the same with at most N bytes, 32768 at most
+**
+** A compressed value is a blob of the uncompressed size in 4 bytes, big
+** endian, followed by the zlib stream, which is the format of the original
+** extension and of qCompress(). Compressing short values, rows of a
+** column for example, gains little on its own because the values are too
+** short to repeat themselves; a preset dictionary with the strings they
+** share helps. A value compressed with a dictionary needs the same
+** dictionary to be restored; uncompress() returns NULL without it.
+**
+**   SELECT compress_dictionary(body)
+**     FROM (SELECT body FROM mail ORDER BY random() LIMIT 1000);
+**
+** The trainer picks the segments of the samples whose 8 byte strings are
+** the most frequent over all samples, greedily, and counts every string
+** only once. The best segments are placed at the end of the dictionary,
+** where zlib reaches them with the shortest distances.
+**
+** Sqliteman compresses columns with it in bulk, see the Compress Column
+** dialog; the compressed blobs are readable by other programs loading
+** this extension.
+
 gcc -lz -lm -fPIC -shared compress.c -o libsqlitecompress.so
 */
 
@@ -18,6 +48,127 @@ gcc -lz -lm -fPIC -shared compress.c -o libsqlitecompress.so
   #include "sqlite3.h"
 #endif
 
+/* The largest useful dictionary, the window of zlib */
+#define MAX_DICTIONARY 32768
+/* Sample bytes the trainer keeps, the rest of the values is ignored */
+#define MAX_SAMPLES (8*1024*1024)
+/* Length of the counted strings and of the dictionary segments */
+#define GRAM 8
+#define SEGMENT 32
+/* Buckets of the string counts, 2^GRAM_BITS */
+#define GRAM_BITS 18
+
+/*
+** Compress nIn bytes of in at level (Z_DEFAULT_COMPRESSION for the default)
+** with an optional preset dictionary. On success *out is a malloc()ed
+** buffer of *nOut bytes in the format described above. Returns a zlib
+** status code. Thread safe, Sqliteman calls it from its worker threads.
+*/
+int sqlite3CompressData(
+  const unsigned char *in, int nIn,
+  int level,
+  const unsigned char *dict, int nDict,
+  unsigned char **out, int *nOut
+){
+  z_stream z;
+  uLong nBound;
+  unsigned char *buf;
+  int rc;
+
+  *out = 0;
+  *nOut = 0;
+  memset(&z, 0, sizeof(z));
+  rc = deflateInit(&z, level);
+  if( rc!=Z_OK ) return rc;
+  if( dict && nDict>0 ){
+    rc = deflateSetDictionary(&z, dict, (uInt)nDict);
+    if( rc!=Z_OK ){
+      deflateEnd(&z);
+      return rc;
+    }
+  }
+  nBound = deflateBound(&z, (uLong)nIn);
+  buf = malloc(nBound + 4);
+  if( buf==0 ){
+    deflateEnd(&z);
+    return Z_MEM_ERROR;
+  }
+  buf[0] = nIn>>24 & 0xff;
+  buf[1] = nIn>>16 & 0xff;
+  buf[2] = nIn>>8 & 0xff;
+  buf[3] = nIn & 0xff;
+  z.next_in = (Bytef*)in;
+  z.avail_in = (uInt)nIn;
+  z.next_out = &buf[4];
+  z.avail_out = (uInt)nBound;
+  rc = deflate(&z, Z_FINISH);
+  deflateEnd(&z);
+  if( rc!=Z_STREAM_END ){
+    free(buf);
+    return rc==Z_OK ? Z_BUF_ERROR : rc;
+  }
+  *out = buf;
+  *nOut = (int)z.total_out + 4;
+  return Z_OK;
+}
+
+/*
+** Restore a value of sqlite3CompressData(). A stream compressed with a
+** dictionary fails with Z_NEED_DICT when dict is missing, and with
+** Z_DATA_ERROR when it is another one.
+*/
+int sqlite3UncompressData(
+  const unsigned char *in, int nIn,
+  const unsigned char *dict, int nDict,
+  unsigned char **out, int *nOut
+){
+  z_stream z;
+  unsigned char *buf;
+  uLong nSize;
+  int rc;
+
+  *out = 0;
+  *nOut = 0;
+  if( nIn<=4 ) return Z_DATA_ERROR;
+  nSize = ((uLong)in[0]<<24) + (in[1]<<16) + (in[2]<<8) + in[3];
+  /* deflate does not compress more than about 1:1032, not a compressed value */
+  if( nSize>(uLong)(nIn-4)*1032 + 1024 ) return Z_DATA_ERROR;
+  /* one more byte, malloc(0) may return NULL */
+  buf = malloc(nSize + 1);
+  if( buf==0 ) return Z_MEM_ERROR;
+  memset(&z, 0, sizeof(z));
+  rc = inflateInit(&z);
+  if( rc!=Z_OK ){
+    free(buf);
+    return rc;
+  }
+  z.next_in = (Bytef*)&in[4];
+  z.avail_in = (uInt)(nIn - 4);
+  z.next_out = buf;
+  z.avail_out = (uInt)nSize;
+  rc = inflate(&z, Z_FINISH);
+  if( rc==Z_NEED_DICT && dict && nDict>0 ){
+    rc = inflateSetDictionary(&z, dict, (uInt)nDict);
+    if( rc==Z_OK ) rc = inflate(&z, Z_FINISH);
+  }
+  inflateEnd(&z);
+  if( rc!=Z_STREAM_END || z.total_out!=nSize ){
+    free(buf);
+    return rc==Z_STREAM_END || rc==Z_OK ? Z_DATA_ERROR : rc;
+  }
+  *out = buf;
+  *nOut = (int)nSize;
+  return Z_OK;
+}
+
+static void zlibError(sqlite3_context *context, int rc){
+  if( rc==Z_MEM_ERROR ){
+    sqlite3_result_error_nomem(context);
+  }else{
+    sqlite3_result_error(context, zError(rc), -1);
+  }
+}
+
 // see http://www.mail-archive.com/sqlite-users%40sqlite.org/msg17018.html
 /*
 ** SQL function to compress content into a blob using libz
@@ -27,22 +178,33 @@ static void compressFunc(
   int argc,
   sqlite3_value **argv
 ){
-  int nIn, nOut;
-  long int nOut2;
   const unsigned char *inBuf;
+  const unsigned char *dict = 0;
   unsigned char *outBuf;
-  assert( argc==1 );
-  nIn = sqlite3_value_bytes(argv[0]);
+  int nIn, nOut, nDict = 0, rc;
+  int level = Z_DEFAULT_COMPRESSION;
+
+  assert( argc>=1 && argc<=3 );
+  if( sqlite3_value_type(argv[0])==SQLITE_NULL ) return;
+  if( argc>1 && sqlite3_value_type(argv[1])!=SQLITE_NULL ){
+    level = sqlite3_value_int(argv[1]);
+    if( level<0 || level>9 ){
+      sqlite3_result_error(context, "compress() level must be 0 to 9", -1);
+      return;
+    }
+  }
+  if( argc>2 ){
+    dict = sqlite3_value_blob(argv[2]);
+    nDict = sqlite3_value_bytes(argv[2]);
+  }
   inBuf = sqlite3_value_blob(argv[0]);
-  nOut = 13 + nIn + (nIn+999)/1000;
-  outBuf = malloc( nOut+4 );
-  outBuf[0] = nIn>>24 & 0xff;
-  outBuf[1] = nIn>>16 & 0xff;
-  outBuf[2] = nIn>>8 & 0xff;
-  outBuf[3] = nIn & 0xff;
-  nOut2 = (long int)nOut;
-  compress(&outBuf[4], &nOut2, inBuf, nIn);
-  sqlite3_result_blob(context, outBuf, nOut2+4, free);
+  nIn = sqlite3_value_bytes(argv[0]);
+  rc = sqlite3CompressData(inBuf, nIn, level, dict, nDict, &outBuf, &nOut);
+  if( rc!=Z_OK ){
+    zlibError(context, rc);
+    return;
+  }
+  sqlite3_result_blob(context, outBuf, nOut, free);
 }
 
 /*
@@ -53,26 +215,238 @@ static void uncompressFunc(
   int argc,
   sqlite3_value **argv
 ){
-  unsigned int nIn, nOut, rc;
   const unsigned char *inBuf;
+  const unsigned char *dict = 0;
   unsigned char *outBuf;
-  long int nOut2;
+  int nIn, nOut, nDict = 0, rc;
 
-  assert( argc==1 );
+  assert( argc==1 || argc==2 );
   nIn = sqlite3_value_bytes(argv[0]);
   if( nIn<=4 ){
     return;
   }
   inBuf = sqlite3_value_blob(argv[0]);
-  nOut = (inBuf[0]<<24) + (inBuf[1]<<16) + (inBuf[2]<<8) + inBuf[3];
-  outBuf = malloc( nOut );
-  nOut2 = (long int)nOut;
-  rc = uncompress(outBuf, &nOut2, &inBuf[4], nIn);
-  if( rc!=Z_OK ){
-    free(outBuf);
-  }else{
-    sqlite3_result_blob(context, outBuf, nOut2, free);
+  if( argc>1 ){
+    dict = sqlite3_value_blob(argv[1]);
+    nDict = sqlite3_value_bytes(argv[1]);
+  }
+  rc = sqlite3UncompressData(inBuf, nIn, dict, nDict, &outBuf, &nOut);
+  if( rc==Z_MEM_ERROR ){
+    sqlite3_result_error_nomem(context);
+  }else if( rc==Z_OK ){
+    sqlite3_result_blob(context, outBuf, nOut, free);
   }
+  /* not compressed, or by another dictionary: NULL */
+}
+
+
+/*
+** The samples of compress_dictionary(), all values in one buffer.
+*/
+typedef struct DictSamples DictSamples;
+struct DictSamples {
+  unsigned char *aBuf;      /* the values one after another */
+  int nBuf;                 /* bytes used in aBuf */
+  int nAlloc;               /* bytes allocated for aBuf */
+  int *aEnd;                /* aEnd[i] is the end of the value i in aBuf */
+  int nValue;
+  int nValueAlloc;
+  int nDict;                /* the requested size of the dictionary */
+};
+
+/* A segment candidate: its start in aBuf and its score when computed */
+typedef struct DictSegment DictSegment;
+struct DictSegment {
+  int iStart;
+  unsigned int score;
+};
+
+static unsigned int gramHash(const unsigned char *p){
+  sqlite3_uint64 x;
+  memcpy(&x, p, GRAM);
+  return (unsigned int)((x * 0x9E3779B185EBCA87ULL) >> (64 - GRAM_BITS));
+}
+
+/* The counts of the strings starting in the segment which are not used yet */
+static unsigned int segmentScore(
+  const unsigned char *aBuf, int iStart, int iEnd,
+  const unsigned int *aCount
+){
+  unsigned int score = 0;
+  int i;
+  for(i=iStart; i+GRAM<=iEnd && i<iStart+SEGMENT-GRAM+1; i++){
+    score += aCount[gramHash(&aBuf[i])];
+  }
+  return score;
+}
+
+/* Restore the heap property of a max heap of segments from i down */
+static void heapDown(DictSegment *aHeap, int nHeap, int i){
+  for(;;){
+    int iLeft = 2*i + 1;
+    int iMax = i;
+    DictSegment tmp;
+    if( iLeft<nHeap && aHeap[iLeft].score>aHeap[iMax].score ) iMax = iLeft;
+    if( iLeft+1<nHeap && aHeap[iLeft+1].score>aHeap[iMax].score ) iMax = iLeft+1;
+    if( iMax==i ) return;
+    tmp = aHeap[i];
+    aHeap[i] = aHeap[iMax];
+    aHeap[iMax] = tmp;
+    i = iMax;
+  }
+}
+
+static void dictionaryStep(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+){
+  DictSamples *p;
+  const unsigned char *z;
+  int n;
+
+  assert( argc==1 || argc==2 );
+  p = sqlite3_aggregate_context(context, sizeof(*p));
+  if( p==0 ) return;
+  if( p->nDict==0 ){
+    p->nDict = MAX_DICTIONARY;
+    if( argc>1 && sqlite3_value_int(argv[1])>0
+     && sqlite3_value_int(argv[1])<MAX_DICTIONARY ){
+      p->nDict = sqlite3_value_int(argv[1]);
+    }
+  }
+  if( sqlite3_value_type(argv[0])==SQLITE_NULL ) return;
+  z = sqlite3_value_blob(argv[0]);
+  n = sqlite3_value_bytes(argv[0]);
+  if( n<GRAM || p->nBuf+n>MAX_SAMPLES ) return;
+
+  if( p->nBuf+n>p->nAlloc ){
+    int nNew = p->nAlloc ? p->nAlloc*2 : 65536;
+    unsigned char *aNew;
+    while( nNew<p->nBuf+n ) nNew *= 2;
+    aNew = sqlite3_realloc(p->aBuf, nNew);
+    if( aNew==0 ){
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    p->aBuf = aNew;
+    p->nAlloc = nNew;
+  }
+  if( p->nValue==p->nValueAlloc ){
+    int nNew = p->nValueAlloc ? p->nValueAlloc*2 : 1024;
+    int *aNew = sqlite3_realloc(p->aEnd, nNew*sizeof(int));
+    if( aNew==0 ){
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    p->aEnd = aNew;
+    p->nValueAlloc = nNew;
+  }
+  memcpy(&p->aBuf[p->nBuf], z, n);
+  p->nBuf += n;
+  p->aEnd[p->nValue++] = p->nBuf;
+}
+
+static void dictionaryFinal(sqlite3_context *context){
+  DictSamples *p;
+  unsigned int *aCount = 0;
+  DictSegment *aHeap = 0;
+  unsigned char *aDict = 0;
+  int nHeap = 0;
+  int nDict;
+  int i, iValue, iStart;
+
+  p = sqlite3_aggregate_context(context, 0);
+  if( p==0 || p->nValue==0 ) return;
+
+  aCount = sqlite3_malloc(sizeof(unsigned int) << GRAM_BITS);
+  /* segments start every SEGMENT/2 bytes of each value */
+  aHeap = sqlite3_malloc(sizeof(DictSegment) * (p->nBuf/(SEGMENT/2) + p->nValue));
+  aDict = sqlite3_malloc(p->nDict);
+  if( aCount==0 || aHeap==0 || aDict==0 ){
+    sqlite3_result_error_nomem(context);
+    goto dictionary_done;
+  }
+  memset(aCount, 0, sizeof(unsigned int) << GRAM_BITS);
+
+  /* the strings counted over all samples */
+  iStart = 0;
+  for(iValue=0; iValue<p->nValue; iValue++){
+    int iEnd = p->aEnd[iValue];
+    for(i=iStart; i+GRAM<=iEnd; i++){
+      aCount[gramHash(&p->aBuf[i])]++;
+    }
+    iStart = iEnd;
+  }
+
+  /* the segments of the samples, scored */
+  iStart = 0;
+  for(iValue=0; iValue<p->nValue; iValue++){
+    int iEnd = p->aEnd[iValue];
+    for(i=iStart; i+GRAM<=iEnd; i+=SEGMENT/2){
+      aHeap[nHeap].iStart = i;
+      aHeap[nHeap].score = segmentScore(p->aBuf, i, iEnd, aCount);
+      nHeap++;
+    }
+    iStart = iEnd;
+  }
+  for(i=nHeap/2-1; i>=0; i--){
+    heapDown(aHeap, nHeap, i);
+  }
+
+  /*
+  ** Greedily take the best segment. The scores only decrease when the
+  ** strings of a taken segment are not counted anymore, so the score of
+  ** the top is computed again and it is taken only when it still beats
+  ** the next one.
+  */
+  nDict = p->nDict;
+  while( nHeap>0 && nDict>0 ){
+    DictSegment top = aHeap[0];
+    int iEnd, iSeg, n;
+    iSeg = top.iStart;
+    /* the end of the value of the segment, by binary search */
+    {
+      int lo = 0, hi = p->nValue-1;
+      while( lo<hi ){
+        int mid = (lo+hi)/2;
+        if( p->aEnd[mid]<=iSeg ) lo = mid+1; else hi = mid;
+      }
+      iEnd = p->aEnd[lo];
+    }
+    top.score = segmentScore(p->aBuf, iSeg, iEnd, aCount);
+    if( top.score==0 ){
+      aHeap[0] = aHeap[--nHeap];
+      heapDown(aHeap, nHeap, 0);
+      continue;
+    }
+    if( nHeap>1 && (top.score<aHeap[1].score
+                    || (nHeap>2 && top.score<aHeap[2].score)) ){
+      aHeap[0] = top;
+      heapDown(aHeap, nHeap, 0);
+      continue;
+    }
+    aHeap[0] = aHeap[--nHeap];
+    heapDown(aHeap, nHeap, 0);
+
+    /* the best segments at the end of the dictionary */
+    n = SEGMENT;
+    if( iSeg+n>iEnd ) n = iEnd-iSeg;
+    if( n>nDict ) n = nDict;
+    nDict -= n;
+    memcpy(&aDict[nDict], &p->aBuf[iSeg], n);
+    for(i=iSeg; i+GRAM<=iSeg+n; i++){
+      aCount[gramHash(&p->aBuf[i])] = 0;
+    }
+  }
+  sqlite3_result_blob(context, &aDict[nDict], p->nDict-nDict, SQLITE_TRANSIENT);
+
+dictionary_done:
+  sqlite3_free(aCount);
+  sqlite3_free(aHeap);
+  sqlite3_free(aDict);
+  sqlite3_free(p->aBuf);
+  sqlite3_free(p->aEnd);
 }
 
 
@@ -86,29 +460,42 @@ int sqlite3CompressInit(sqlite3 *db){
   static const struct {
      char *zName;
      signed char nArg;
-     int argType;           /* 1: 0, 2: 1, 3: 2,...  N:  N-1. */
      int eTextRep;          /* 1: UTF-16.  0: UTF-8 */
      void (*xFunc)(sqlite3_context*,int,sqlite3_value **);
   } aFuncs[] = {
-    { "compress",           1, 0, SQLITE_UTF8,    compressFunc },
-    { "uncompress",         1, 0, SQLITE_UTF8,    uncompressFunc },
+    { "compress",           1, SQLITE_UTF8,    compressFunc },
+    { "compress",           2, SQLITE_UTF8,    compressFunc },
+    { "compress",           3, SQLITE_UTF8,    compressFunc },
+    { "uncompress",         1, SQLITE_UTF8,    uncompressFunc },
+    { "uncompress",         2, SQLITE_UTF8,    uncompressFunc },
+  };
+  static const struct {
+     char *zName;
+     signed char nArg;
+     void (*xStep)(sqlite3_context*,int,sqlite3_value**);
+     void (*xFinal)(sqlite3_context*);
+  } aAggs[] = {
+    { "compress_dictionary", 1, dictionaryStep, dictionaryFinal },
+    { "compress_dictionary", 2, dictionaryStep, dictionaryFinal },
   };
 
   int i;
-  for(i=0; i<sizeof(aFuncs)/sizeof(aFuncs[0]); i++){
-    void *pArg;
-    int argType = aFuncs[i].argType;
-    pArg = (void*)(int)argType;
-    sqlite3_create_function(db, aFuncs[i].zName, aFuncs[i].nArg,
-        aFuncs[i].eTextRep, pArg, aFuncs[i].xFunc, 0, 0);
+  int rc = SQLITE_OK;
+  for(i=0; rc==SQLITE_OK && i<sizeof(aFuncs)/sizeof(aFuncs[0]); i++){
+    rc = sqlite3_create_function(db, aFuncs[i].zName, aFuncs[i].nArg,
+        aFuncs[i].eTextRep, 0, aFuncs[i].xFunc, 0, 0);
+  }
+  for(i=0; rc==SQLITE_OK && i<sizeof(aAggs)/sizeof(aAggs[0]); i++){
+    rc = sqlite3_create_function(db, aAggs[i].zName, aAggs[i].nArg,
+        SQLITE_UTF8, 0, 0, aAggs[i].xStep, aAggs[i].xFinal);
   }
 
-  return 0;
+  return rc;
 }
 
 #if !SQLITE_CORE
 int sqlite3_extension_init(
-  sqlite3 *db, 
+  sqlite3 *db,
   char **pzErrMsg,
   const sqlite3_api_routines *pApi
 ){
@@ -0,0 +1,210 @@
+/*
+Checks of the zlib functions of compress.c, see compresstest.pro. The
+extension is compiled in.
+
+The SQL cases cover the format shared with qCompress(), the levels, the
+preset dictionaries and the values uncompress() refuses. The C functions
+used by the Compress Column dialog are checked for the zlib status codes
+they promise.
+*/
+
+#include <sqlite3.h>
+#include <zlib.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int sqlite3CompressInit(sqlite3 *db);
+int sqlite3CompressData(const unsigned char *in, int nIn, int level,
+                        const unsigned char *dict, int nDict,
+                        unsigned char **out, int *nOut);
+int sqlite3UncompressData(const unsigned char *in, int nIn,
+                          const unsigned char *dict, int nDict,
+                          unsigned char **out, int *nOut);
+
+typedef struct CompressCase CompressCase;
+struct CompressCase {
+  const char *zSql;
+  const char *zExpected;
+};
+
+static const CompressCase aCase[] = {
+  /* the size in 4 bytes and the zlib stream, as qCompress() writes it */
+  { "SELECT hex(compress('abc'))", "00000003789C4B4C4A0600024D0127" },
+  { "SELECT hex(compress(''))", "00000000789C030000000001" },
+  { "SELECT hex(substr(compress(zeroblob(70000)), 1, 4))", "00011170" },
+  { "SELECT CAST(uncompress(X'00000003789C4B4C4A0600024D0127') AS TEXT)", "abc" },
+  { "SELECT quote(compress(NULL))", "NULL" },
+
+  /* values of every type come back as the bytes of the value */
+  { "SELECT CAST(uncompress(compress('Příliš žluťoučký kůň')) AS TEXT)", "Příliš žluťoučký kůň" },
+  { "SELECT typeof(uncompress(compress('abc')))", "blob" },
+  { "SELECT uncompress(compress(X'00FF00')) = X'00FF00'", "1" },
+  { "SELECT CAST(uncompress(compress(12.5)) AS TEXT)", "12.5" },
+  { "SELECT uncompress(compress(b)) = CAST(b AS BLOB) FROM t", "1" },
+  { "SELECT length(uncompress(compress(''))) ", "0" },
+
+  /* levels: 0 stores, 9 is not worse than 1, NULL is the default */
+  { "SELECT length(compress(b, 0)) > length(b) FROM t", "1" },
+  { "SELECT length(compress(b, 9)) <= length(compress(b, 1)) FROM t", "1" },
+  { "SELECT length(compress(b, 9)) * 5 < length(b) FROM t", "1" },
+  { "SELECT compress(b, NULL) = compress(b) FROM t", "1" },
+  { "SELECT uncompress(compress(b, 0)) = CAST(b AS BLOB) FROM t", "1" },
+  { "SELECT compress('abc', 10)", "compress() level must be 0 to 9" },
+  { "SELECT compress('abc', -1)", "compress() level must be 0 to 9" },
+
+  /* a preset dictionary is needed to restore the value, and helps it */
+  { "SELECT CAST(uncompress(compress('abcabc', 6, 'xabcx'), 'xabcx') AS TEXT)", "abcabc" },
+  { "SELECT quote(uncompress(compress('abcabc', 6, 'xabcx')))", "NULL" },
+  { "SELECT quote(uncompress(compress('abcabc', 6, 'xabcx'), 'yabcy'))", "NULL" },
+  { "SELECT length(compress(s, 9, d)) < length(compress(s, 9)) FROM t", "1" },
+  { "SELECT uncompress(compress(s, 9, d), d) = CAST(s AS BLOB) FROM t", "1" },
+  /* an empty dictionary is none */
+  { "SELECT compress('abc', 6, '') = compress('abc', 6)", "1" },
+
+  /* values which are not compressed give NULL */
+  { "SELECT quote(uncompress('abc'))", "NULL" },
+  { "SELECT quote(uncompress(X'00000003'))", "NULL" },
+  { "SELECT quote(uncompress('plain text, not compressed'))", "NULL" },
+  { "SELECT quote(uncompress(X'FFFFFFFF789C4B4C4A0600024D0127'))", "NULL" },
+  { "SELECT quote(uncompress(X'00000004789C4B4C4A0600024D0127'))", "NULL" },
+  { "SELECT quote(uncompress(X'00000003789C4B4C4A0600024D01'))", "NULL" },
+  { "SELECT quote(uncompress(NULL))", "NULL" },
+
+  /* compress_dictionary: the size, the shared strings, short values */
+  { "SELECT length(compress_dictionary(b)) <= 32768 FROM mail", "1" },
+  { "SELECT length(compress_dictionary(b, 200)) <= 200 FROM mail", "1" },
+  { "SELECT length(compress_dictionary(b, 0)) <= 32768 FROM mail", "1" },
+  { "SELECT instr(compress_dictionary(b), 'Subject: ') > 0 FROM mail", "1" },
+  /* a string is taken once, however many values repeat it */
+  { "SELECT length(compress_dictionary(b)) <= 128 FROM (SELECT s AS b FROM t, mail)", "1" },
+  { "SELECT quote(compress_dictionary(b)) FROM mail WHERE 0", "NULL" },
+  { "SELECT quote(compress_dictionary(b)) FROM (SELECT 'short' AS b UNION ALL SELECT NULL)",
+    "NULL" },
+  { "SELECT sum(length(compress(b, 9, d))) * 3 < sum(length(compress(b, 9))) * 2"
+    " FROM mail, (SELECT compress_dictionary(b) AS d FROM mail)", "1" },
+  { "SELECT count(*) FROM mail, (SELECT compress_dictionary(b, 1024) AS d FROM mail)"
+    " WHERE uncompress(compress(b, 9, d), d) = CAST(b AS BLOB)", "200" },
+
+  { 0, 0 }
+};
+
+static const char zFill[] =
+  "CREATE TABLE t(b, s, d);"
+  "INSERT INTO t SELECT"
+  " (WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM c WHERE i<500)"
+  "  SELECT group_concat('row ' || (i % 7) || ' of the table', ';') FROM c),"
+  " 'Dear customer, your order has been shipped.',"
+  " 'your order has been shipped. Dear customer,';"
+  /* short mails sharing their headers */
+  "CREATE TABLE mail(b);"
+  "WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM c WHERE i<200)"
+  " INSERT INTO mail SELECT 'From: user' || i || '@example.org' || char(10)"
+  " || 'Subject: Your invoice number ' || (i * 7919 % 10007) || char(10)"
+  " || 'Content-Type: text/plain; charset=UTF-8' || char(10) || char(10)"
+  " || 'Hello, please find the invoice for the month ' || (i % 12 + 1) || ' attached.'"
+  " FROM c;";
+
+static int nCheck = 0;
+static int nFail = 0;
+
+/* the first column of the first row of zSql as text, or the error */
+static void check(sqlite3 *db, const char *zSql, const char *zExpected){
+  sqlite3_stmt *pStmt = 0;
+  const char *zGot = 0;
+  int rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+  ++nCheck;
+  if( rc==SQLITE_OK ){
+    rc = sqlite3_step(pStmt);
+    if( rc==SQLITE_ROW )
+      zGot = (const char *)sqlite3_column_text(pStmt, 0);
+  }
+  if( rc!=SQLITE_ROW && rc!=SQLITE_DONE )
+    zGot = sqlite3_errmsg(db);
+  if( strcmp(zGot ? zGot : "NULL", zExpected)!=0 ){
+    printf("FAIL %s\n  got      %s\n  expected %s\n", zSql, zGot ? zGot : "NULL", zExpected);
+    ++nFail;
+  }
+  sqlite3_finalize(pStmt);
+}
+
+static void checkRc(const char *zWhat, int rc, int rcExpected){
+  ++nCheck;
+  if( rc!=rcExpected ){
+    printf("FAIL %s\n  got      %d\n  expected %d\n", zWhat, rc, rcExpected);
+    ++nFail;
+  }
+}
+
+/* the C functions of the Compress Column dialog */
+static void checkData(void){
+  static const unsigned char aDict[] = "a dictionary of the data";
+  static const unsigned char aOther[] = "another dictionary of it";
+  unsigned char aIn[4000];
+  unsigned char *aZip = 0;
+  unsigned char *aOut = 0;
+  int nZip = 0;
+  int nOut = 0;
+  int i;
+
+  for(i=0; i<(int)sizeof(aIn); i++)
+    aIn[i] = "the data of a dictionary"[i % 24];
+
+  checkRc("sqlite3CompressData()",
+          sqlite3CompressData(aIn, sizeof(aIn), 9, aDict, sizeof(aDict) - 1, &aZip, &nZip), Z_OK);
+  checkRc("sqlite3UncompressData() with the dictionary",
+          sqlite3UncompressData(aZip, nZip, aDict, sizeof(aDict) - 1, &aOut, &nOut), Z_OK);
+  ++nCheck;
+  if( nOut!=(int)sizeof(aIn) || memcmp(aOut, aIn, sizeof(aIn))!=0 ){
+    printf("FAIL sqlite3UncompressData() does not restore the data\n");
+    ++nFail;
+  }
+  free(aOut);
+  aOut = 0;
+  checkRc("sqlite3UncompressData() without the dictionary",
+          sqlite3UncompressData(aZip, nZip, 0, 0, &aOut, &nOut), Z_NEED_DICT);
+  checkRc("sqlite3UncompressData() with another dictionary",
+          sqlite3UncompressData(aZip, nZip, aOther, sizeof(aOther) - 1, &aOut, &nOut),
+          Z_DATA_ERROR);
+  ++nCheck;
+  if( aOut!=0 || nOut!=0 ){
+    printf("FAIL sqlite3UncompressData() returns data on an error\n");
+    ++nFail;
+  }
+  checkRc("sqlite3UncompressData() of 4 bytes",
+          sqlite3UncompressData(aZip, 4, 0, 0, &aOut, &nOut), Z_DATA_ERROR);
+  /* a size the stream cannot hold */
+  aZip[0] = 0x7f;
+  checkRc("sqlite3UncompressData() of a wrong size",
+          sqlite3UncompressData(aZip, nZip, aDict, sizeof(aDict) - 1, &aOut, &nOut),
+          Z_DATA_ERROR);
+  free(aZip);
+
+  checkRc("sqlite3CompressData() at level 10",
+          sqlite3CompressData(aIn, sizeof(aIn), 10, 0, 0, &aZip, &nZip), Z_STREAM_ERROR);
+  ++nCheck;
+  if( aZip!=0 || nZip!=0 ){
+    printf("FAIL sqlite3CompressData() returns data on an error\n");
+    ++nFail;
+  }
+}
+
+int main(void){
+  sqlite3 *db;
+  const CompressCase *p;
+
+  sqlite3_open(":memory:", &db);
+  sqlite3CompressInit(db);
+  if( sqlite3_exec(db, zFill, 0, 0, 0)!=SQLITE_OK ){
+    printf("%s\n", sqlite3_errmsg(db));
+    return 1;
+  }
+  for(p=aCase; p->zSql; p++)
+    check(db, p->zSql, p->zExpected);
+  sqlite3_close(db);
+  checkData();
+
+  printf("%d checks, %d failures\n", nCheck, nFail);
+  return nFail ? 1 : 0;
+}
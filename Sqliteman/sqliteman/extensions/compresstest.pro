@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = compresstest
+DEPENDPATH += .
+INCLUDEPATH += .
+CONFIG -= qt
+DEFINES += SQLITE_CORE SQLITE_ENABLE_COMPRESS
+LIBS += -lsqlite3 -lz
+
+CONFIG += console
+
+# Input
+SOURCES += compresstest.c compress.c
@@ -113,66 +113,8 @@ Original code 2006 June 05 by relicoder.
 #include <stdlib.h>
 #include <assert.h>
 
-#ifndef _MAP_H_
-#define _MAP_H_
-
 #include <stdint.h>
 
-/*
-** Simple binary tree implementation to use in median, mode and quartile calculations
-** Tree is not necessarily balanced. That would require something like red&black trees of AVL
-*/
-
-typedef int(*cmp_func)(const void *, const void *);
-typedef void(*map_iterator)(void*, int64_t, void*);
-
-typedef struct node{
-  struct node *l;
-  struct node *r;
-  void* data;
-  int64_t count;
-} node;
-
-typedef struct map{
-  node *base;
-  cmp_func cmp;
-  short free;
-} map;
-
-/*
-** creates a map given a comparison function
-*/
-map map_make(cmp_func cmp);
-
-/*
-** inserts the element e into map m
-*/
-void map_insert(map *m, void *e);
-
-/*
-** executes function iter over all elements in the map, in key increasing order
-*/
-void map_iterate(map *m, map_iterator iter, void* p);
-
-/*
-** frees all memory used by a map
-*/
-void map_destroy(map *m);
-
-/*
-** compares 2 integers
-** to use with map_make
-*/
-int int_cmp(const void *a, const void *b);
-
-/*
-** compares 2 doubles
-** to use with map_make
-*/
-int double_cmp(const void *a, const void *b);
-
-#endif /* _MAP_H_ */
-
 #if !SQLITE_CORE
 typedef uint8_t         u8;
 typedef uint16_t        u16;
@@ -1131,25 +1073,92 @@ struct StdevCtx {
 
 /*
 ** An instance of the following structure holds the context of a
-** mode() or median() aggregate computation.
-** Depends on structures defined in map.c (see map & map)
+** mode(), median() or quartile aggregate computation.
+** The values are kept in a growable array in the order they came, so
+** a window function can drop the oldest one in xInverse. The order
+** statistics are found by selection (quickselect) in O(n), the mode
+** by sorting. Values are stored as integers until the first non-integer
+** arrives; then the array is converted to doubles.
 ** These aggregate functions only work for integers and floats although
 ** they could be made to work for strings. This is usually considered meaningless.
 ** Only usuall order (for median), no use of collation functions (would this even make sense?)
 */
+typedef union ModeVal ModeVal;
+union ModeVal {
+  i64 i;
+  double d;
+};
+
 typedef struct ModeCtx ModeCtx;
 struct ModeCtx {
-  i64 riM;            /* integer value found so far */
-  double rdM;         /* double value found so far */
-  i64 cnt;            /* number of elements so far */
-  double pcnt;        /* number of elements smaller than a percentile */
-  i64 mcnt;           /* maximum number of occurrences (for mode) */
-  i64 mn;             /* number of occurrences (for mode and percentiles) */
+  ModeVal *a;         /* values, a[first] is the oldest one */
+  i64 first;          /* index of the oldest value still in the window */
+  i64 cnt;            /* number of elements in a[] including removed ones */
+  i64 alloc;          /* allocated size of a[] */
+  ModeVal *tmp;       /* scratch copy for xValue */
+  i64 tmpAlloc;       /* allocated size of tmp[] */
   i64 is_double;      /* whether the computation is being done for doubles (>0) or integers (=0) */
-  map* m;             /* map structure used for the computation */
-  int done;           /* whether the answer has been found */
 };
 
+/*
+** compares two values of the given type
+*/
+static int modeCmp(const ModeVal *a, const ModeVal *b, int is_double){
+  if( is_double ){
+    return a->d<b->d ? -1 : (a->d>b->d ? 1 : 0);
+  }
+  return a->i<b->i ? -1 : (a->i>b->i ? 1 : 0);
+}
+
+/*
+** qsort callbacks
+*/
+static int int_cmp(const void *a, const void *b){
+  return modeCmp((const ModeVal*)a, (const ModeVal*)b, 0);
+}
+
+static int double_cmp(const void *a, const void *b){
+  return modeCmp((const ModeVal*)a, (const ModeVal*)b, 1);
+}
+
+/*
+** Rearranges a[0..n-1] so that a[k] is the value which would be there
+** if the array was sorted, nothing larger is before it and nothing
+** smaller after it (nth_element). Median of three pivots keep sorted
+** input, the usual case for timestamped data, linear.
+*/
+static void modeSelect(ModeVal *a, i64 n, i64 k, int is_double){
+  i64 lo = 0;
+  i64 hi = n-1;
+  while( lo<hi ){
+    i64 mid = lo + (hi-lo)/2;
+    i64 i, j;
+    ModeVal pivot, t;
+    if( modeCmp(&a[mid], &a[lo], is_double)<0 ){ t=a[mid]; a[mid]=a[lo]; a[lo]=t; }
+    if( modeCmp(&a[hi], &a[lo], is_double)<0 ){ t=a[hi]; a[hi]=a[lo]; a[lo]=t; }
+    if( modeCmp(&a[hi], &a[mid], is_double)<0 ){ t=a[hi]; a[hi]=a[mid]; a[mid]=t; }
+    pivot = a[mid];
+    i = lo;
+    j = hi;
+    while( i<=j ){
+      while( modeCmp(&a[i], &pivot, is_double)<0 ) ++i;
+      while( modeCmp(&pivot, &a[j], is_double)<0 ) --j;
+      if( i<=j ){
+        t=a[i]; a[i]=a[j]; a[j]=t;
+        ++i;
+        --j;
+      }
+    }
+    if( k<=j ){
+      hi = j;
+    }else if( k>=i ){
+      lo = i;
+    }else{
+      return;
+    }
+  }
+}
+
 /*
 ** called for each value received during a calculation of samplestde, stdev or variance
 */
@@ -1171,15 +1180,41 @@ static void varianceStep(sqlite3_context *context, int argc, sqlite3_value **arg
   }
 }
 
+/*
+** called for each value leaving the window of samplestdev, stdev or variance
+** reverses varianceStep
+*/
+static void varianceInverse(sqlite3_context *context, int argc, sqlite3_value **argv){
+  StdevCtx *p;
+
+  double x;
+  double rM;
+
+  assert( argc==1 );
+  p = sqlite3_aggregate_context(context, sizeof(*p));
+  if( SQLITE_NULL != sqlite3_value_numeric_type(argv[0]) && p->cnt>0 ){
+    if( 0==--p->cnt ){
+      p->rM = 0.0;
+      p->rS = 0.0;
+      return;
+    }
+    x = sqlite3_value_double(argv[0]);
+    rM = p->rM;
+    p->rM -= (x-rM)/p->cnt;
+    p->rS -= (x-rM)*(x-p->rM);
+    /* rounding errors must not make it negative */
+    if( p->rS<0.0 )
+      p->rS = 0.0;
+  }
+}
+
 /*
 ** called for each value received during a calculation of mode of median
 */
 static void modeStep(sqlite3_context *context, int argc, sqlite3_value **argv){
   ModeCtx *p;
-  i64 xi=0;
-  double xd=0.0;
-  i64 *iptr;
-  double *dptr;
+  ModeVal *a;
+  i64 i;
   int type;
 
   assert( argc==1 );
@@ -1187,184 +1222,244 @@ static void modeStep(sqlite3_context *context, int argc, sqlite3_value **argv){
 
   if( type == SQLITE_NULL)
     return;
-  
+
   p = sqlite3_aggregate_context(context, sizeof(*p));
+  if( p==0 )
+    return;
 
-  if( 0==(p->m) ){
-    p->m = calloc(1, sizeof(map));
-    if( type==SQLITE_INTEGER ){
-      /* map will be used for integers */
-      *(p->m) = map_make(int_cmp);
-      p->is_double = 0;
+  if( p->cnt==p->alloc ){
+    /* drop values removed by the window before growing */
+    if( p->first>0 && p->first>=p->cnt/2 ){
+      memmove(p->a, p->a+p->first, (p->cnt-p->first)*sizeof(ModeVal));
+      p->cnt -= p->first;
+      p->first = 0;
     }else{
-      p->is_double = 1;
-      /* map will be used for doubles */
-      *(p->m) = map_make(double_cmp);
+      i64 n = p->alloc ? p->alloc*2 : 64;
+      a = (ModeVal*)realloc(p->a, n*sizeof(ModeVal));
+      if( a==0 ){
+        sqlite3_result_error_nomem(context);
+        return;
+      }
+      p->a = a;
+      p->alloc = n;
     }
   }
 
-  ++(p->cnt);
-
-  if( 0==p->is_double ){
-    xi = sqlite3_value_int64(argv[0]);
-    iptr = (i64*)calloc(1,sizeof(i64));
-    *iptr = xi;
-    map_insert(p->m, iptr);
-  }else{
-    xd = sqlite3_value_double(argv[0]);
-    dptr = (double*)calloc(1,sizeof(double));
-    *dptr = xd;
-    map_insert(p->m, dptr);
+  if( 0==p->is_double && type!=SQLITE_INTEGER ){
+    /* from now on the computation is done for doubles */
+    for(i=p->first; i<p->cnt; ++i){
+      p->a[i].d = (double)p->a[i].i;
+    }
+    p->is_double = 1;
   }
+
+  if( 0==p->is_double )
+    p->a[p->cnt++].i = sqlite3_value_int64(argv[0]);
+  else
+    p->a[p->cnt++].d = sqlite3_value_double(argv[0]);
 }
 
 /*
-**  Auxiliary function that iterates all elements in a map and finds the mode
-**  (most frequent value)
+** called for each value leaving the window of mode, median or a quartile
+** SQLite always removes the oldest value still in the window
 */
-static void modeIterate(void* e, i64 c, void* pp){
-  i64 ei;
-  double ed;
-  ModeCtx *p = (ModeCtx*)pp;
-  
-  if( 0==p->is_double ){
-    ei = *(int*)(e);
-
-	if( p->mcnt==c ){
-      ++p->mn;
-    }else if( p->mcnt<c ){
-      p->riM = ei;
-      p->mcnt = c;
-	  p->mn=1;
+static void modeInverse(sqlite3_context *context, int argc, sqlite3_value **argv){
+  ModeCtx *p;
+
+  assert( argc==1 );
+  /* NULLs have not been stored by modeStep */
+  if( SQLITE_NULL == sqlite3_value_numeric_type(argv[0]) )
+    return;
+
+  p = sqlite3_aggregate_context(context, 0);
+  if( p && p->first<p->cnt ){
+    ++p->first;
+    if( p->first==p->cnt ){
+      p->first = 0;
+      p->cnt = 0;
+      p->is_double = 0;
     }
-  }else{
-    ed = *(double*)(e);
-
-	if( p->mcnt==c ){
-      ++p->mn;
-    }else if(p->mcnt<c){
-      p->rdM = ed;
-      p->mcnt = c;
-	  p->mn=1;
+  }
+}
+
+/*
+** Returns the values of the current window. xValue must not change the
+** order of the context, so the values are copied to the scratch array.
+** xFinalize gets the context array itself.
+*/
+static ModeVal *modeValues(sqlite3_context *context, ModeCtx *p, int copy){
+  i64 n = p->cnt - p->first;
+  if( !copy )
+    return p->a + p->first;
+  if( n>p->tmpAlloc ){
+    ModeVal *t = (ModeVal*)realloc(p->tmp, n*sizeof(ModeVal));
+    if( t==0 ){
+      sqlite3_result_error_nomem(context);
+      return 0;
     }
+    p->tmp = t;
+    p->tmpAlloc = n;
   }
+  memcpy(p->tmp, p->a + p->first, n*sizeof(ModeVal));
+  return p->tmp;
 }
 
 /*
-**  Auxiliary function that iterates all elements in a map and finds the median
-**  (the value such that the number of elements smaller is equal the the number of 
-**  elements larger)
+** frees the arrays of the context
 */
-static void medianIterate(void* e, i64 c, void* pp){
-  i64 ei;
-  double ed;
-  double iL;
-  double iR;
-  int il;
-  int ir;
-  ModeCtx *p = (ModeCtx*)pp;
-
-  if(p->done>0)
-    return;
+static void modeFree(ModeCtx *p){
+  free(p->a);
+  free(p->tmp);
+  p->a = 0;
+  p->tmp = 0;
+}
 
-  iL = p->pcnt;
-  iR = p->cnt - p->pcnt;
-  il = p->mcnt + c;
-  ir = p->cnt - p->mcnt;
-
-  if( il >= iL ){
-    if( ir >= iR ){
-    ++p->mn;
-      if( 0==p->is_double ){
-        ei = *(int*)(e);
-        p->riM += ei;
-      }else{
-        ed = *(double*)(e);
-        p->rdM += ed;
-      }
-    }else{
-      p->done=1;
+/*
+** Computes the mode value (the only most frequent value)
+*/
+static void _modeResult(sqlite3_context *context, int copy){
+  ModeCtx *p;
+  ModeVal *a;
+  i64 n, i, run, mcnt, mn, m;
+
+  p = sqlite3_aggregate_context(context, 0);
+  if( p==0 || p->cnt==p->first )
+    return;
+  n = p->cnt - p->first;
+  a = modeValues(context, p, copy);
+  if( a==0 )
+    return;
+  qsort(a, n, sizeof(ModeVal), p->is_double ? double_cmp : int_cmp);
+
+  mcnt = 0;
+  mn = 0;
+  m = 0;
+  for(i=0; i<n; i+=run){
+    run = 1;
+    while( i+run<n && 0==modeCmp(&a[i], &a[i+run], p->is_double) )
+      ++run;
+    if( mcnt==run ){
+      ++mn;
+    }else if( mcnt<run ){
+      m = i;
+      mcnt = run;
+      mn = 1;
     }
   }
-  p->mcnt+=c;
+
+  if( 1==mn ){
+    if( 0==p->is_double )
+      sqlite3_result_int64(context, a[m].i);
+    else
+      sqlite3_result_double(context, a[m].d);
+  }
 }
 
 /*
 ** Returns the mode value
 */
+static void modeValue(sqlite3_context *context){
+  _modeResult(context, 1);
+}
+
 static void modeFinalize(sqlite3_context *context){
   ModeCtx *p;
+  _modeResult(context, 0);
   p = sqlite3_aggregate_context(context, 0);
-  if( p && p->m ){
-    map_iterate(p->m, modeIterate, p);
-    map_destroy(p->m);
-    free(p->m);
-
-    if( 1==p->mn ){
-      if( 0==p->is_double )
-        sqlite3_result_int64(context, p->riM);
-      else
-        sqlite3_result_double(context, p->rdM);
-    }
-  }
+  if( p )
+    modeFree(p);
 }
 
 /*
 ** auxiliary function for percentiles
+** The result is the value having at least n*q elements smaller or equal
+** and at least n*(1-q) elements larger or equal, the mean of the two
+** neighbouring values when n*q is whole.
 */
-static void _medianFinalize(sqlite3_context *context){
+static void _percentileResult(sqlite3_context *context, double q, int copy){
   ModeCtx *p;
-  p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
-  if( p && p->m ){
-    p->done=0;
-    map_iterate(p->m, medianIterate, p);
-    map_destroy(p->m);
-    free(p->m);
+  ModeVal *a;
+  i64 n, lo, hi, i;
+  double k;
 
-    if( 0==p->is_double )
-      if( 1==p->mn )
-      	sqlite3_result_int64(context, p->riM);
-      else
-      	sqlite3_result_double(context, p->riM*1.0/p->mn);
+  p = sqlite3_aggregate_context(context, 0);
+  if( p==0 || p->cnt==p->first )
+    return;
+  n = p->cnt - p->first;
+  a = modeValues(context, p, copy);
+  if( a==0 )
+    return;
+
+  k = n*q;
+  lo = (i64)ceil(k) - 1;
+  hi = (i64)floor(k);
+  if( lo<0 )
+    lo = 0;
+  if( hi>n-1 )
+    hi = n-1;
+  modeSelect(a, n, lo, p->is_double);
+  if( hi>lo ){
+    /* the next value is the smallest one right of the selected */
+    for(i=hi+1; i<n; ++i){
+      if( modeCmp(&a[i], &a[hi], p->is_double)<0 ){
+        ModeVal t = a[i]; a[i] = a[hi]; a[hi] = t;
+      }
+    }
+  }
+
+  if( 0==p->is_double ){
+    if( hi==lo || a[lo].i==a[hi].i )
+      sqlite3_result_int64(context, a[lo].i);
     else
-      sqlite3_result_double(context, p->rdM/p->mn);
+      sqlite3_result_double(context, (a[lo].i + (double)a[hi].i)/2.0);
+  }else{
+    sqlite3_result_double(context, (a[lo].d + a[hi].d)/2.0);
   }
 }
 
 /*
 ** Returns the median value
 */
+static void medianValue(sqlite3_context *context){
+  _percentileResult(context, 0.5, 1);
+}
+
 static void medianFinalize(sqlite3_context *context){
   ModeCtx *p;
-  p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
-  if( p!=0 ){
-    p->pcnt = (p->cnt)/2.0;
-    _medianFinalize(context);
-  }
+  _percentileResult(context, 0.5, 0);
+  p = sqlite3_aggregate_context(context, 0);
+  if( p )
+    modeFree(p);
 }
 
 /*
 ** Returns the lower_quartile value
 */
+static void lower_quartileValue(sqlite3_context *context){
+  _percentileResult(context, 0.25, 1);
+}
+
 static void lower_quartileFinalize(sqlite3_context *context){
   ModeCtx *p;
-  p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
-  if( p!=0 ){
-    p->pcnt = (p->cnt)/4.0;
-    _medianFinalize(context);
-  }
+  _percentileResult(context, 0.25, 0);
+  p = sqlite3_aggregate_context(context, 0);
+  if( p )
+    modeFree(p);
 }
 
 /*
 ** Returns the upper_quartile value
 */
+static void upper_quartileValue(sqlite3_context *context){
+  _percentileResult(context, 0.75, 1);
+}
+
 static void upper_quartileFinalize(sqlite3_context *context){
   ModeCtx *p;
-  p = (ModeCtx*) sqlite3_aggregate_context(context, 0);
-  if( p!=0 ){
-    p->pcnt = (p->cnt)*3/4.0;
-    _medianFinalize(context);
-  }
+  _percentileResult(context, 0.75, 0);
+  p = sqlite3_aggregate_context(context, 0);
+  if( p )
+    modeFree(p);
 }
 
 /*
@@ -1555,14 +1650,23 @@ int sqlite3FunctionsInit(sqlite3 *db){
     u8 needCollSeq;
     void (*xStep)(sqlite3_context*,int,sqlite3_value**);
     void (*xFinalize)(sqlite3_context*);
+    void (*xValue)(sqlite3_context*);
+    void (*xInverse)(sqlite3_context*,int,sqlite3_value**);
   } aAggs[] = {
-    { "samplestdev",      1, 0, 0, varianceStep, samplestdevFinalize  },
-    { "stdev",            1, 0, 0, varianceStep, stdevFinalize  },
-    { "variance",         1, 0, 0, varianceStep, varianceFinalize  },
-    { "mode",             1, 0, 0, modeStep,     modeFinalize  },
-    { "median",           1, 0, 0, modeStep,     medianFinalize  },
-    { "lower_quartile",   1, 0, 0, modeStep,     lower_quartileFinalize  },
-    { "upper_quartile",   1, 0, 0, modeStep,     upper_quartileFinalize  },
+    { "samplestdev",      1, 0, 0, varianceStep, samplestdevFinalize,
+                                   samplestdevFinalize,    varianceInverse },
+    { "stdev",            1, 0, 0, varianceStep, stdevFinalize,
+                                   stdevFinalize,          varianceInverse },
+    { "variance",         1, 0, 0, varianceStep, varianceFinalize,
+                                   varianceFinalize,       varianceInverse },
+    { "mode",             1, 0, 0, modeStep,     modeFinalize,
+                                   modeValue,              modeInverse },
+    { "median",           1, 0, 0, modeStep,     medianFinalize,
+                                   medianValue,            modeInverse },
+    { "lower_quartile",   1, 0, 0, modeStep,     lower_quartileFinalize,
+                                   lower_quartileValue,    modeInverse },
+    { "upper_quartile",   1, 0, 0, modeStep,     upper_quartileFinalize,
+                                   upper_quartileValue,    modeInverse },
   };
   int i;
 
@@ -1595,6 +1699,16 @@ int sqlite3FunctionsInit(sqlite3 *db){
     }
     //sqlite3CreateFunc
     /* LMH no error checking */
+#if SQLITE_VERSION_NUMBER >= 3025000
+    /* window functions (OVER clause) need the xValue and xInverse of 3.25;
+    ** the library may be older than the headers of an extension */
+    if( sqlite3_libversion_number()>=3025000 ){
+      sqlite3_create_window_function(db, aAggs[i].zName, aAggs[i].nArg,
+          SQLITE_UTF8, pArg, aAggs[i].xStep, aAggs[i].xFinalize,
+          aAggs[i].xValue, aAggs[i].xInverse, 0);
+      continue;
+    }
+#endif
     sqlite3_create_function(db, aAggs[i].zName, aAggs[i].nArg, SQLITE_UTF8, 
         pArg, 0, aAggs[i].xStep, aAggs[i].xFinalize);
 #if 0
@@ -1619,106 +1733,4 @@ int sqlite3_extension_init(
 }
 #endif
 
-map map_make(cmp_func cmp){
-  map r;
-  r.cmp=cmp;
-  r.base = 0;
-
-  return r;
-}
-
-void* xcalloc(size_t nmemb, size_t size, char* s){
-  void* ret = calloc(nmemb, size);
-  return ret;
-}
-
-void xfree(void* p){
-  free(p);
-}
-
-void node_insert(node** n, cmp_func cmp, void *e){
-  int c;
-  node* nn;
-  if(*n==0){
-    nn = (node*)xcalloc(1,sizeof(node), "for node");
-    nn->data = e;
-    nn->count = 1;
-    *n=nn;
-  }else{
-    c=cmp((*n)->data,e);
-    if(0==c){
-      ++((*n)->count);
-      xfree(e);
-    }else if(c>0){
-      /* put it right here */
-      node_insert(&((*n)->l), cmp, e);
-    }else{
-      node_insert(&((*n)->r), cmp, e);
-    }
-  }
-}
-
-void map_insert(map *m, void *e){
-  node_insert(&(m->base), m->cmp, e);
-}
-
-void node_iterate(node *n, map_iterator iter, void* p){
-  if(n){
-    if(n->l)
-      node_iterate(n->l, iter, p);
-    iter(n->data, n->count, p);
-    if(n->r)
-      node_iterate(n->r, iter, p);
-  }
-}
-
-void map_iterate(map *m, map_iterator iter, void* p){
-  node_iterate(m->base, iter, p);
-}
-
-void node_destroy(node *n){
-  if(0!=n){
-    xfree(n->data);
-    if(n->l)
-      node_destroy(n->l);
-    if(n->r)
-      node_destroy(n->r);
-
-    xfree(n);
-  }
-}
-
-void map_destroy(map *m){
-  node_destroy(m->base);
-}
-
-int int_cmp(const void *a, const void *b){
-  int64_t aa = *(int64_t *)(a);
-  int64_t bb = *(int64_t *)(b);
-  /* printf("cmp %d <=> %d\n",aa,bb); */
-  if(aa==bb)
-    return 0;
-  else if(aa<bb)
-    return -1;
-  else
-    return 1;
-}
-
-int double_cmp(const void *a, const void *b){
-  double aa = *(double *)(a);
-  double bb = *(double *)(b);
-  /* printf("cmp %d <=> %d\n",aa,bb); */
-  if(aa==bb)
-    return 0;
-  else if(aa<bb)
-    return -1;
-  else
-    return 1;
-}
-
-void print_elem(void *e, int64_t c, void* p){
-  int ee = *(int*)(e);
-  printf("%d => %lld\n", ee,c);
-}
-
 #endif
@@ -297,6 +297,35 @@ The ISINNET function reimplemented by Alexey Pechnikov (pechnikov@mobigroup.ru).
 	192.168.1.19
 
 
+The ipnetwork virtual table indexes the networks stored in a column of
+another table, so an address is matched against all of them in O(log n)
+instead of calling ISINNET for every pair of rows:
+
+	CREATE TABLE nets(id INTEGER PRIMARY KEY, net TEXT, owner TEXT);
+	INSERT INTO nets(net, owner) VALUES('172.16.0.0/16', 'campus');
+	INSERT INTO nets(net, owner) VALUES('172.16.1.0/24', 'lab');
+	CREATE VIRTUAL TABLE netindex USING ipnetwork(nets, net);
+
+	SELECT network, source_rowid FROM netindex WHERE ip = '172.16.1.93';
+	SELECT network, source_rowid FROM netindex('172.16.1.93');
+	172.16.1.0/24|2
+	172.16.0.0/16|1
+
+	SELECT a.ip, n.owner FROM ip_add a
+		JOIN netindex i ON i.ip = a.ip
+		JOIN nets n ON n.id = i.source_rowid;
+
+Its columns are network (the source value), net_from and net_to (as IP2INT
+numbers), length, source_rowid and the hidden ip, which may be an address
+or its IP2INT number. The netindex('...') form needs SQLite 3.9.0. Matches
+come most specific (shortest) network first. The networks may be written
+as 'ip/bits', 'ip/mask', a single 'ip' or an intpool 'from-to'; other
+values are skipped. The index lives in memory: it is built when the table
+is read first and built again when a statement starts after the source
+table may have changed, i.e. after any change made by this connection or
+a commit of another one.
+
+
 programm template was taken from
 	http://sqlite.org/contrib/
 	http://sqlite.org/contrib/download/extension-functions.c?get=25
@@ -355,6 +384,7 @@ Liam Healy (with little modifications by Schplurtz le deboulonne)
 
 #include <stdlib.h>
 #include <sys/types.h>
+#include <stdint.h>
 #include <string.h>
 #include <arpa/inet.h>
 #include <stdio.h>
@@ -426,7 +456,7 @@ static void isinnet2Func(
 	u_int32_t ad, net, mask;
 
 	int rval, maskLen;
-	char *slashPos, *stringMask, *stringIP;
+	char *slashPos, *stringMask, *stringIP = NULL;
 
 	if( sqlite3_value_type(argv[0]) == SQLITE_NULL || sqlite3_value_type(argv[1]) == SQLITE_NULL ){
 		sqlite3_result_null(context);
@@ -441,8 +471,9 @@ static void isinnet2Func(
 	/*  split the ip address and mask */
 	slashPos = strchr((char*)sqlite3_value_text(argv[1]), (int) '/');
 	if (slashPos == NULL) {
-		/*  straight ip address without mask */
-		mask = (u_int32_t)1;
+		/*  straight ip address without mask, the same as /32 */
+		mask = ~(u_int32_t)0;
+		stringIP = sqlite3_mprintf("%s", (char*)sqlite3_value_text(argv[1]));
 	} else {
 		/* ipaddress has the mask, handle the mask and seperate out the  */
 		/*  ip address */
@@ -463,8 +494,14 @@ static void isinnet2Func(
 		int ipLen = (uintptr_t)slashPos  - (uintptr_t)(char*)sqlite3_value_text(argv[1]);
 		/* divide the string into ip and mask portion */
 		stringIP = sqlite3_malloc( ipLen +1 );
-		strncpy( stringIP, (char*)sqlite3_value_text(argv[1]), ipLen );
-		stringIP[ipLen] = '\0';
+		if (stringIP != NULL) {
+			strncpy( stringIP, (char*)sqlite3_value_text(argv[1]), ipLen );
+			stringIP[ipLen] = '\0';
+		}
+	}
+	if (stringIP == NULL) {
+		sqlite3_result_error_nomem(context);
+		return;
 	}
 
 	if ( (rval = inet_pton(AF_INET,(char*)stringIP,&net)) < 1) {
@@ -538,8 +575,8 @@ static void netfrom1Func(
 	/*  split the ip address and mask */
 	slashPos = strchr((char*)sqlite3_value_text(argv[0]), (int) '/');
 	if (slashPos == NULL) {
-		/*  straight ip address without mask */
-		mask = (u_int32_t)1;
+		/*  straight ip address without mask, the same as /32 */
+		mask = ~(u_int32_t)0;
 	} else {
 		/* ipaddress has the mask, handle the mask and seperate out the  */
 		/*  ip address */
@@ -558,9 +595,14 @@ static void netfrom1Func(
 			mask = htonl(mask);
 		}
 	}
-	int ipLen = slashPos  - (char*)sqlite3_value_text(argv[0]);
+	int ipLen = slashPos ? slashPos - (char*)sqlite3_value_text(argv[0])
+	                     : (int)strlen((char*)sqlite3_value_text(argv[0]));
 	/* divide the string into ip and mask portion */
 	stringIP = sqlite3_malloc( ipLen +1 );
+	if (stringIP == NULL) {
+		sqlite3_result_error_nomem(context);
+		return;
+	}
 	strncpy( stringIP, (char*)sqlite3_value_text(argv[0]), ipLen );
 	stringIP[ipLen] = '\0';
 
@@ -938,8 +980,8 @@ static void netto1Func(
 	/*  split the ip address and mask */
 	slashPos = strchr((char*)sqlite3_value_text(argv[0]), (int) '/');
 	if (slashPos == NULL) {
-		/*  straight ip address without mask */
-		mask = (u_int32_t)1;
+		/*  straight ip address without mask, the same as /32 */
+		mask = ~(u_int32_t)0;
 		mask_length = 1;
 	} else {
 		/* ipaddress has the mask, handle the mask and seperate out the  */
@@ -961,9 +1003,14 @@ static void netto1Func(
 			mask_length = (~(u_int32_t)mask) + 1; 
 		}
 	}
-	int ipLen = slashPos  - (char*)sqlite3_value_text(argv[0]);
+	int ipLen = slashPos ? slashPos - (char*)sqlite3_value_text(argv[0])
+	                     : (int)strlen((char*)sqlite3_value_text(argv[0]));
 	/* divide the string into ip and mask portion */
 	stringIP = sqlite3_malloc( ipLen +1 );
+	if (stringIP == NULL) {
+		sqlite3_result_error_nomem(context);
+		return;
+	}
 	strncpy( stringIP, (char*)sqlite3_value_text(argv[0]), ipLen );
 	stringIP[ipLen] = '\0';
 
@@ -1076,6 +1123,520 @@ static void intpool2table2Func(
 	sqlite3_result_null(context);
 }
 
+/*
+ * The ipnetwork virtual table: the networks of a source table sorted by
+ * their first address, with the largest last address of every subtree of
+ * the implicit binary tree over the sorted array (an augmented interval
+ * tree). An address is looked up in O(log n + matches).
+ */
+
+typedef struct IpRange {
+	u_int32_t from;
+	u_int32_t to;
+	u_int32_t maxTo;		/* the largest "to" of the subtree rooted here */
+	int iText;				/* offset of the network text in zText */
+	sqlite3_int64 rowid;	/* of the source row */
+} IpRange;
+
+typedef struct ipnet_vtab {
+	sqlite3_vtab base;
+	sqlite3 *db;
+	char *zSchema;
+	char *zTable;
+	char *zColumn;
+	IpRange *aRange;
+	int nRange;
+	char *zText;			/* the network texts, NUL terminated */
+	int valid;
+	int nCursor;			/* the index is not rebuilt under open cursors */
+	int totalChanges;		/* of the connection when the index was built */
+	int dataVersion;
+} ipnet_vtab;
+
+typedef struct ipnet_cursor {
+	sqlite3_vtab_cursor base;
+	int *aMatch;			/* the matching ranges of a lookup */
+	int nMatch;
+	int nAlloc;
+	int lookup;				/* aMatch is used, else all the ranges */
+	int i;
+	int ipIsText;
+	u_int32_t ip;
+} ipnet_cursor;
+
+#define IPNET_COLUMN_NETWORK	0
+#define IPNET_COLUMN_FROM		1
+#define IPNET_COLUMN_TO			2
+#define IPNET_COLUMN_LENGTH		3
+#define IPNET_COLUMN_ROWID		4
+#define IPNET_COLUMN_IP			5
+
+/* 'ip/bits', 'ip/mask', 'ip' or an intpool 'from-to' */
+static int ipParseNetwork(const char *z, u_int32_t *pFrom, u_int32_t *pTo) {
+	char zIp[16];
+	const char *zSlash;
+	u_int32_t ad, mask;
+	long long from, to;
+	char *zEnd;
+	int bits, n;
+	if (!z)
+		return 0;
+	zSlash = strchr(z, '/');
+	if (!zSlash && strchr(z, '-')) {
+		from = strtoll(z, &zEnd, 10);
+		if (zEnd == z || *zEnd != '-')
+			return 0;
+		z = zEnd + 1;
+		to = strtoll(z, &zEnd, 10);
+		if (zEnd == z || *zEnd || from < 0 || to > 0xffffffffLL || from > to)
+			return 0;
+		*pFrom = (u_int32_t)from;
+		*pTo = (u_int32_t)to;
+		return 1;
+	}
+	n = zSlash ? zSlash - z : strlen(z);
+	if (n >= sizeof(zIp))
+		return 0;
+	memcpy(zIp, z, n);
+	zIp[n] = '\0';
+	if (inet_pton(AF_INET, zIp, &ad) < 1)
+		return 0;
+	ad = htonl(ad);
+	mask = 0xffffffff;
+	if (zSlash) {
+		z = zSlash + 1;
+		if (strlen(z) < 3) {
+			bits = strtol(z, &zEnd, 10);
+			if (zEnd == z || *zEnd || bits < 0 || bits > 32)
+				return 0;
+			mask = bits ? ~((((u_int32_t)1) << (32 - bits)) - 1) : 0;
+		} else {
+			if (inet_pton(AF_INET, z, &mask) < 1)
+				return 0;
+			mask = htonl(mask);
+		}
+	}
+	*pFrom = ad & mask;
+	*pTo = (ad & mask) | ~mask;
+	return 1;
+}
+
+static int ipRangeCmp(const void *a, const void *b) {
+	const IpRange *x = a;
+	const IpRange *y = b;
+	if (x->from != y->from)
+		return x->from < y->from ? -1 : 1;
+	if (x->to != y->to)
+		return x->to < y->to ? -1 : 1;
+	return 0;
+}
+
+/* the subtree of [lo, hi) is rooted at its middle */
+static u_int32_t ipnetAugment(IpRange *a, int lo, int hi) {
+	int mid;
+	u_int32_t m, x;
+	if (lo >= hi)
+		return 0;
+	mid = lo + (hi - lo) / 2;
+	m = a[mid].to;
+	x = ipnetAugment(a, lo, mid);
+	if (x > m)
+		m = x;
+	x = ipnetAugment(a, mid + 1, hi);
+	if (x > m)
+		m = x;
+	a[mid].maxTo = m;
+	return m;
+}
+
+static int ipnetAddMatch(ipnet_cursor *pCur, int i) {
+	int *aNew;
+	if (pCur->nMatch == pCur->nAlloc) {
+		pCur->nAlloc = pCur->nAlloc ? pCur->nAlloc * 2 : 16;
+		aNew = sqlite3_realloc(pCur->aMatch, pCur->nAlloc * sizeof(int));
+		if (!aNew)
+			return SQLITE_NOMEM;
+		pCur->aMatch = aNew;
+	}
+	pCur->aMatch[pCur->nMatch++] = i;
+	return SQLITE_OK;
+}
+
+static int ipnetSearch(ipnet_vtab *p, ipnet_cursor *pCur, int lo, int hi, u_int32_t ip) {
+	int mid, rc;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		/* nothing in this subtree reaches up to ip */
+		if (p->aRange[mid].maxTo < ip)
+			return SQLITE_OK;
+		rc = ipnetSearch(p, pCur, lo, mid, ip);
+		if (rc != SQLITE_OK)
+			return rc;
+		/* everything right of mid starts after ip */
+		if (p->aRange[mid].from > ip)
+			return SQLITE_OK;
+		if (p->aRange[mid].to >= ip && (rc = ipnetAddMatch(pCur, mid)) != SQLITE_OK)
+			return rc;
+		lo = mid + 1;
+	}
+	return SQLITE_OK;
+}
+
+/* the most specific network first, by insertion sort: there are few */
+static void ipnetSortMatches(ipnet_vtab *p, ipnet_cursor *pCur) {
+	int i, j, x;
+	u_int32_t len;
+	for (i = 1; i < pCur->nMatch; i++) {
+		x = pCur->aMatch[i];
+		len = p->aRange[x].to - p->aRange[x].from;
+		for (j = i; j > 0; j--) {
+			const IpRange *y = p->aRange + pCur->aMatch[j - 1];
+			if (y->to - y->from <= len)
+				break;
+			pCur->aMatch[j] = pCur->aMatch[j - 1];
+		}
+		pCur->aMatch[j] = x;
+	}
+}
+
+static int ipnetDataVersion(ipnet_vtab *p) {
+	sqlite3_stmt *pStmt;
+	int version = 0;
+	char *zSql = sqlite3_mprintf("PRAGMA \"%w\".data_version", p->zSchema);
+	if (!zSql)
+		return 0;
+	/* older SQLite has no data_version, only local changes are noticed */
+	if (sqlite3_prepare_v2(p->db, zSql, -1, &pStmt, 0) == SQLITE_OK) {
+		if (sqlite3_step(pStmt) == SQLITE_ROW)
+			version = sqlite3_column_int(pStmt, 0);
+		sqlite3_finalize(pStmt);
+	}
+	sqlite3_free(zSql);
+	return version;
+}
+
+/* reading the source table into a new index */
+static int ipnetBuild(ipnet_vtab *p) {
+	sqlite3_stmt *pStmt;
+	IpRange *aRange = 0;
+	IpRange *aNew;
+	char *zText = 0;
+	char *zNew;
+	int nRange = 0, nRangeAlloc = 0;
+	int nText = 0, nTextAlloc = 0;
+	const char *z;
+	int n, rc;
+	u_int32_t from, to;
+	char *zSql = sqlite3_mprintf("SELECT rowid, \"%w\" FROM \"%w\".\"%w\"",
+		p->zColumn, p->zSchema, p->zTable);
+	if (!zSql)
+		return SQLITE_NOMEM;
+	rc = sqlite3_prepare_v2(p->db, zSql, -1, &pStmt, 0);
+	sqlite3_free(zSql);
+	if (rc != SQLITE_OK) {
+		sqlite3_free(p->base.zErrMsg);
+		p->base.zErrMsg = sqlite3_mprintf("ipnetwork: %s", sqlite3_errmsg(p->db));
+		return rc;
+	}
+	while ((rc = sqlite3_step(pStmt)) == SQLITE_ROW) {
+		z = (const char*)sqlite3_column_text(pStmt, 1);
+		if (!ipParseNetwork(z, &from, &to))
+			continue;
+		n = strlen(z) + 1;
+		if (nRange == nRangeAlloc) {
+			nRangeAlloc = nRangeAlloc ? nRangeAlloc * 2 : 1024;
+			aNew = sqlite3_realloc(aRange, nRangeAlloc * sizeof(IpRange));
+			if (!aNew)
+				break;
+			aRange = aNew;
+		}
+		if (nText + n > nTextAlloc) {
+			nTextAlloc = (nText + n) * 2;
+			zNew = sqlite3_realloc(zText, nTextAlloc);
+			if (!zNew)
+				break;
+			zText = zNew;
+		}
+		aRange[nRange].from = from;
+		aRange[nRange].to = to;
+		aRange[nRange].iText = nText;
+		aRange[nRange].rowid = sqlite3_column_int64(pStmt, 0);
+		memcpy(zText + nText, z, n);
+		nText += n;
+		nRange++;
+	}
+	if (rc == SQLITE_ROW)
+		rc = SQLITE_NOMEM;
+	else if (rc == SQLITE_DONE)
+		rc = SQLITE_OK;
+	sqlite3_finalize(pStmt);
+	if (rc != SQLITE_OK) {
+		sqlite3_free(aRange);
+		sqlite3_free(zText);
+		return rc;
+	}
+	qsort(aRange, nRange, sizeof(IpRange), ipRangeCmp);
+	ipnetAugment(aRange, 0, nRange);
+	sqlite3_free(p->aRange);
+	sqlite3_free(p->zText);
+	p->aRange = aRange;
+	p->nRange = nRange;
+	p->zText = zText;
+	return SQLITE_OK;
+}
+
+/* rebuilding the index when the source may have changed since */
+static int ipnetCheck(ipnet_vtab *p) {
+	int changes = sqlite3_total_changes(p->db);
+	int version = ipnetDataVersion(p);
+	int rc;
+	if (p->valid && (p->nCursor > 0
+		|| (changes == p->totalChanges && version == p->dataVersion)))
+		return SQLITE_OK;
+	rc = ipnetBuild(p);
+	p->valid = rc == SQLITE_OK;
+	p->totalChanges = changes;
+	p->dataVersion = version;
+	return rc;
+}
+
+/* an identifier argument without its quotes */
+static char *ipnetDequote(const char *z, int n) {
+	char q = z[0];
+	char *zOut;
+	int i, j;
+	if (q == '[')
+		q = ']';
+	if (n < 2 || (q != '"' && q != '\'' && q != '`' && q != ']') || z[n - 1] != q)
+		return sqlite3_mprintf("%.*s", n, z);
+	zOut = sqlite3_malloc(n);
+	if (!zOut)
+		return 0;
+	for (i = 1, j = 0; i < n - 1; i++) {
+		zOut[j++] = z[i];
+		/* a doubled quote stands for itself */
+		if (z[i] == q && q != ']' && i + 1 < n - 1 && z[i + 1] == q)
+			i++;
+	}
+	zOut[j] = '\0';
+	return zOut;
+}
+
+static void ipnetFree(ipnet_vtab *p) {
+	sqlite3_free(p->zSchema);
+	sqlite3_free(p->zTable);
+	sqlite3_free(p->zColumn);
+	sqlite3_free(p->aRange);
+	sqlite3_free(p->zText);
+	sqlite3_free(p);
+}
+
+/* ipnetwork(source_table, network_column); the source table may be
+   qualified by its schema, it is in the one of the virtual table else */
+static int ipnetConnect(
+	sqlite3 *db,
+	void *pAux,
+	int argc,
+	const char *const *argv,
+	sqlite3_vtab **ppVtab,
+	char **pzErr
+) {
+	ipnet_vtab *p;
+	const char *zDot;
+	int rc;
+	if (argc != 5) {
+		*pzErr = sqlite3_mprintf("ipnetwork: use ipnetwork(source_table, network_column)");
+		return SQLITE_ERROR;
+	}
+	rc = sqlite3_declare_vtab(db, "CREATE TABLE x(network TEXT, net_from INTEGER, "
+		"net_to INTEGER, length INTEGER, source_rowid INTEGER, ip HIDDEN)");
+	if (rc != SQLITE_OK)
+		return rc;
+	p = sqlite3_malloc(sizeof(*p));
+	if (!p)
+		return SQLITE_NOMEM;
+	memset(p, 0, sizeof(*p));
+	p->db = db;
+	zDot = strchr(argv[3], '.');
+	if (zDot) {
+		p->zSchema = ipnetDequote(argv[3], zDot - argv[3]);
+		p->zTable = ipnetDequote(zDot + 1, strlen(zDot + 1));
+	} else {
+		p->zSchema = sqlite3_mprintf("%s", argv[1]);
+		p->zTable = ipnetDequote(argv[3], strlen(argv[3]));
+	}
+	p->zColumn = ipnetDequote(argv[4], strlen(argv[4]));
+	if (!p->zSchema || !p->zTable || !p->zColumn) {
+		ipnetFree(p);
+		return SQLITE_NOMEM;
+	}
+	*ppVtab = &p->base;
+	return SQLITE_OK;
+}
+
+static int ipnetDisconnect(sqlite3_vtab *pVtab) {
+	ipnetFree((ipnet_vtab*)pVtab);
+	return SQLITE_OK;
+}
+
+static int ipnetOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+	ipnet_vtab *p = (ipnet_vtab*)pVtab;
+	ipnet_cursor *pCur;
+	int rc = ipnetCheck(p);
+	if (rc != SQLITE_OK)
+		return rc;
+	pCur = sqlite3_malloc(sizeof(*pCur));
+	if (!pCur)
+		return SQLITE_NOMEM;
+	memset(pCur, 0, sizeof(*pCur));
+	p->nCursor++;
+	*ppCursor = &pCur->base;
+	return SQLITE_OK;
+}
+
+static int ipnetClose(sqlite3_vtab_cursor *cur) {
+	ipnet_cursor *pCur = (ipnet_cursor*)cur;
+	((ipnet_vtab*)cur->pVtab)->nCursor--;
+	sqlite3_free(pCur->aMatch);
+	sqlite3_free(pCur);
+	return SQLITE_OK;
+}
+
+static int ipnetFilter(
+	sqlite3_vtab_cursor *cur,
+	int idxNum, const char *idxStr,
+	int argc, sqlite3_value **argv
+) {
+	ipnet_cursor *pCur = (ipnet_cursor*)cur;
+	ipnet_vtab *p = (ipnet_vtab*)cur->pVtab;
+	sqlite3_int64 ip;
+	u_int32_t ad;
+	pCur->i = 0;
+	pCur->nMatch = 0;
+	pCur->lookup = idxNum;
+	if (!idxNum)
+		return SQLITE_OK;
+	/* an address, or its IP2INT number */
+	switch (sqlite3_value_type(argv[0])) {
+		case SQLITE_INTEGER:
+			ip = sqlite3_value_int64(argv[0]);
+			if (ip < 0 || ip > 0xffffffffLL)
+				return SQLITE_OK;
+			pCur->ip = (u_int32_t)ip;
+			pCur->ipIsText = 0;
+			break;
+		case SQLITE_TEXT:
+			if (inet_pton(AF_INET, (const char*)sqlite3_value_text(argv[0]), &ad) < 1)
+				return SQLITE_OK;
+			pCur->ip = htonl(ad);
+			pCur->ipIsText = 1;
+			break;
+		default:
+			return SQLITE_OK;
+	}
+	if (ipnetSearch(p, pCur, 0, p->nRange, pCur->ip) != SQLITE_OK)
+		return SQLITE_NOMEM;
+	ipnetSortMatches(p, pCur);
+	return SQLITE_OK;
+}
+
+static int ipnetNext(sqlite3_vtab_cursor *cur) {
+	((ipnet_cursor*)cur)->i++;
+	return SQLITE_OK;
+}
+
+static int ipnetEof(sqlite3_vtab_cursor *cur) {
+	ipnet_cursor *pCur = (ipnet_cursor*)cur;
+	if (pCur->lookup)
+		return pCur->i >= pCur->nMatch;
+	return pCur->i >= ((ipnet_vtab*)cur->pVtab)->nRange;
+}
+
+static int ipnetColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) {
+	ipnet_cursor *pCur = (ipnet_cursor*)cur;
+	ipnet_vtab *p = (ipnet_vtab*)cur->pVtab;
+	const IpRange *r = p->aRange + (pCur->lookup ? pCur->aMatch[pCur->i] : pCur->i);
+	char zIp[INET_ADDRSTRLEN];
+	u_int32_t ad;
+	switch (i) {
+		case IPNET_COLUMN_NETWORK:
+			sqlite3_result_text(ctx, p->zText + r->iText, -1, SQLITE_TRANSIENT);
+			break;
+		case IPNET_COLUMN_FROM:
+			sqlite3_result_int64(ctx, r->from);
+			break;
+		case IPNET_COLUMN_TO:
+			sqlite3_result_int64(ctx, r->to);
+			break;
+		case IPNET_COLUMN_LENGTH:
+			sqlite3_result_int64(ctx, (sqlite3_int64)r->to - r->from + 1);
+			break;
+		case IPNET_COLUMN_ROWID:
+			sqlite3_result_int64(ctx, r->rowid);
+			break;
+		case IPNET_COLUMN_IP:
+			/* the looked up address as it was given */
+			if (!pCur->lookup)
+				break;
+			if (!pCur->ipIsText) {
+				sqlite3_result_int64(ctx, pCur->ip);
+				break;
+			}
+			ad = ntohl(pCur->ip);
+			if (inet_ntop(AF_INET, &ad, zIp, sizeof(zIp)))
+				sqlite3_result_text(ctx, zIp, -1, SQLITE_TRANSIENT);
+			break;
+	}
+	return SQLITE_OK;
+}
+
+static int ipnetRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid) {
+	ipnet_cursor *pCur = (ipnet_cursor*)cur;
+	*pRowid = (pCur->lookup ? pCur->aMatch[pCur->i] : pCur->i) + 1;
+	return SQLITE_OK;
+}
+
+/* an equality constraint on ip is a lookup */
+static int ipnetBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pIdxInfo) {
+	ipnet_vtab *p = (ipnet_vtab*)pVtab;
+	double n = p->valid && p->nRange > 0 ? p->nRange : 100000.0;
+	int i;
+	pIdxInfo->idxNum = 0;
+	for (i = 0; i < pIdxInfo->nConstraint; i++) {
+		if (pIdxInfo->aConstraint[i].usable
+			&& pIdxInfo->aConstraint[i].iColumn == IPNET_COLUMN_IP
+			&& pIdxInfo->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_EQ) {
+			pIdxInfo->idxNum = 1;
+			pIdxInfo->aConstraintUsage[i].argvIndex = 1;
+			pIdxInfo->aConstraintUsage[i].omit = 1;
+			break;
+		}
+	}
+	if (pIdxInfo->idxNum) {
+		/* log2(n) steps and a few matches */
+		for (pIdxInfo->estimatedCost = 2.0; n > 1.0; n /= 2.0)
+			pIdxInfo->estimatedCost += 1.0;
+	} else
+		pIdxInfo->estimatedCost = n + 10.0;
+	return SQLITE_OK;
+}
+
+static sqlite3_module ipnetModule = {
+	0,					/* iVersion */
+	ipnetConnect,		/* xCreate: nothing is stored */
+	ipnetConnect,		/* xConnect */
+	ipnetBestIndex,		/* xBestIndex */
+	ipnetDisconnect,	/* xDisconnect */
+	ipnetDisconnect,	/* xDestroy */
+	ipnetOpen,			/* xOpen */
+	ipnetClose,			/* xClose */
+	ipnetFilter,		/* xFilter */
+	ipnetNext,			/* xNext */
+	ipnetEof,			/* xEof */
+	ipnetColumn,		/* xColumn */
+	ipnetRowid,			/* xRowid */
+};
+
 /* SQLite invokes this routine once when it loads the extension.
 ** Create new functions, collating sequences, and virtual table
 ** modules here.  This is usually the only exported symbol in
@@ -1118,6 +1679,7 @@ int sqlite3InetInit(sqlite3 *db){
     sqlite3_create_function(db, aFuncs[i].zName, aFuncs[i].nArg,
         aFuncs[i].eTextRep, pArg, aFuncs[i].xFunc, 0, 0);
   }
+  sqlite3_create_module(db, "ipnetwork", &ipnetModule, 0);
 
   return 0;
 }
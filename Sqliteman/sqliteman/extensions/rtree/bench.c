@@ -0,0 +1,153 @@
+/*
+Load time and query node reads of an r-tree filled by INSERT and by
+rtree_bulkload(), see bench.pro. The r-tree module of rtree.c is
+compiled in; it replaces the one of the linked SQLite.
+
+	bench [rows [window]]
+
+The same random 2-D boxes (200000 by default, in a 10000 x 10000
+square) are loaded into two tables, one by INSERT ... SELECT and one by
+rtree_bulkload(). Then both run the same 1000 window queries of the
+given window size (100 by default). The node reads are the runs of the
+statement reading the %_node shadow table, counted by a trace callback.
+*/
+
+#include <sqlite3.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define QUERIES 1000
+
+int sqlite3RtreeInit(sqlite3 *db);
+
+static int nNodeRead = 0;
+
+
+static double now(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec/1e9;
+}
+
+static int traceCallback(unsigned eType, void *pCtx, void *p, void *x){
+  const char *zSql = sqlite3_sql((sqlite3_stmt *)p);
+  (void)eType; (void)pCtx; (void)x;
+  if( zSql && strncmp(zSql, "SELECT data FROM", 16)==0 && strstr(zSql, "_node") )
+    ++nNodeRead;
+  return 0;
+}
+
+static void execOrDie(sqlite3 *db, const char *zSql){
+  if( sqlite3_exec(db, zSql, 0, 0, 0)!=SQLITE_OK ){
+    fprintf(stderr, "%s\n%s\n", zSql, sqlite3_errmsg(db));
+    exit(1);
+  }
+}
+
+static int count(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = 0;
+  int n = -1;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)==SQLITE_OK
+   && sqlite3_step(pStmt)==SQLITE_ROW ){
+    n = sqlite3_column_int(pStmt, 0);
+  }
+  sqlite3_finalize(pStmt);
+  return n;
+}
+
+/* runs the window queries on zTable, returns the rows found */
+static int windows(sqlite3 *db, const char *zTable, double window,
+                   int *pReads, double *pSeconds){
+  sqlite3_stmt *pStmt = 0;
+  unsigned int seed = 1;
+  int nFound = 0;
+  int i;
+  double start;
+  char *zSql = sqlite3_mprintf("SELECT count(*) FROM \"%w\" "
+                               "WHERE x1>=?1 AND x0<=?2 AND y1>=?3 AND y0<=?4", zTable);
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)!=SQLITE_OK ){
+    fprintf(stderr, "%s\n%s\n", zSql, sqlite3_errmsg(db));
+    exit(1);
+  }
+  sqlite3_free(zSql);
+  nNodeRead = 0;
+  start = now();
+  for(i=0; i<QUERIES; i++){
+    double x, y;
+    seed = seed*1103515245 + 12345;
+    x = (seed>>8)%(10000 - (int)window);
+    seed = seed*1103515245 + 12345;
+    y = (seed>>8)%(10000 - (int)window);
+    sqlite3_bind_double(pStmt, 1, x);
+    sqlite3_bind_double(pStmt, 2, x + window);
+    sqlite3_bind_double(pStmt, 3, y);
+    sqlite3_bind_double(pStmt, 4, y + window);
+    if( sqlite3_step(pStmt)==SQLITE_ROW )
+      nFound += sqlite3_column_int(pStmt, 0);
+    sqlite3_reset(pStmt);
+  }
+  *pSeconds = now() - start;
+  /* the statement of the query itself is not a node read */
+  *pReads = nNodeRead;
+  sqlite3_finalize(pStmt);
+  return nFound;
+}
+
+int main(int argc, char **argv){
+  sqlite3 *db;
+  char *zSql;
+  int nRow = argc>1 ? atoi(argv[1]) : 200000;
+  double window = argc>2 ? atof(argv[2]) : 100.0;
+  double start, incTime, bulkTime, incQuery, bulkQuery;
+  int incReads, bulkReads, incFound, bulkFound;
+
+  if( nRow<1 || window<=0.0 || window>=10000.0 ){
+    fprintf(stderr, "usage: %s [rows [window]]\n", argv[0]);
+    return 1;
+  }
+  sqlite3_open(":memory:", &db);
+  sqlite3RtreeInit(db);
+  zSql = sqlite3_mprintf(
+      "CREATE TABLE src(id INTEGER PRIMARY KEY, x0, x1, y0, y1);"
+      "WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM c WHERE i<%d)"
+      " INSERT INTO src SELECT i, abs(random() %% 1000000)/100.0, abs(random() %% 1000)/100.0,"
+      " abs(random() %% 1000000)/100.0, abs(random() %% 1000)/100.0 FROM c;"
+      /* x1 and y1 hold the size until here */
+      "UPDATE src SET x1 = x0 + x1, y1 = y0 + y1;"
+      "CREATE VIRTUAL TABLE inc USING rtree(id, x0, x1, y0, y1);"
+      "CREATE VIRTUAL TABLE bulk USING rtree(id, x0, x1, y0, y1);", nRow);
+  execOrDie(db, zSql);
+  sqlite3_free(zSql);
+
+  start = now();
+  execOrDie(db, "INSERT INTO inc SELECT * FROM src");
+  incTime = now() - start;
+  start = now();
+  execOrDie(db, "SELECT rtree_bulkload('bulk', 'SELECT * FROM src')");
+  bulkTime = now() - start;
+
+  sqlite3_trace_v2(db, SQLITE_TRACE_STMT, traceCallback, 0);
+  incFound = windows(db, "inc", window, &incReads, &incQuery);
+  bulkFound = windows(db, "bulk", window, &bulkReads, &bulkQuery);
+  sqlite3_trace_v2(db, 0, 0, 0);
+
+  printf("%d rows, %d windows of %g x %g\n", nRow, QUERIES, window, window);
+  printf("%-12s %10s %8s %6s %12s %10s %8s\n",
+         "", "load", "nodes", "depth", "node reads", "queries", "rows");
+  printf("%-12s %8.3f s %8d %6d %12d %8.3f s %8d\n", "INSERT", incTime,
+         count(db, "SELECT count(*) FROM inc_node"),
+         count(db, "SELECT rtreedepth(data) FROM inc_node WHERE nodeno=1"),
+         incReads, incQuery, incFound);
+  printf("%-12s %8.3f s %8d %6d %12d %8.3f s %8d\n", "bulk load", bulkTime,
+         count(db, "SELECT count(*) FROM bulk_node"),
+         count(db, "SELECT rtreedepth(data) FROM bulk_node WHERE nodeno=1"),
+         bulkReads, bulkQuery, bulkFound);
+  if( incFound!=bulkFound )
+    printf("the trees do not find the same rows\n");
+
+  sqlite3_close(db);
+  return incFound!=bulkFound;
+}
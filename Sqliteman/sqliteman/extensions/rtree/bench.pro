@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = bench
+DEPENDPATH += .
+INCLUDEPATH += .
+CONFIG -= qt
+DEFINES += SQLITE_CORE SQLITE_ENABLE_RTREE
+LIBS += -lsqlite3
+
+CONFIG += console
+
+# Input
+SOURCES += bench.c rtree.c
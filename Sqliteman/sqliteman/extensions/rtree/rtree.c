@@ -2816,10 +2816,521 @@ static void rtreedepth(sqlite3_context *ctx, int nArg, sqlite3_value **apArg){
   }
 }
 
+/*
+** Sort the cells in aCell[] by the center of dimension iDim, the
+** minimum value is used to break ties. Array aSpare is temporary
+** working space of nCell cells. This is a stable merge sort, as the
+** order of the cells within a slab of the previous dimension has to
+** be kept by rtreeStrOrder().
+*/
+static void SortByCenter(
+  Rtree *pRtree,
+  RtreeCell *aCell,
+  int nCell,
+  int iDim,
+  RtreeCell *aSpare
+){
+  if( nCell>1 ){
+    int iLeft = 0;
+    int iRight = 0;
+
+    int nLeft = nCell/2;
+    int nRight = nCell-nLeft;
+    RtreeCell *aLeft = aSpare;
+    RtreeCell *aRight = &aCell[nLeft];
+
+    SortByCenter(pRtree, aCell, nLeft, iDim, aSpare);
+    SortByCenter(pRtree, aRight, nRight, iDim, aSpare);
+
+    memcpy(aSpare, aCell, sizeof(RtreeCell)*nLeft);
+    while( iLeft<nLeft ){
+      if( iRight<nRight ){
+        RtreeCell *pL = &aLeft[iLeft];
+        RtreeCell *pR = &aRight[iRight];
+        double xleft = DCOORD(pL->aCoord[iDim*2])+DCOORD(pL->aCoord[iDim*2+1]);
+        double xright = DCOORD(pR->aCoord[iDim*2])+DCOORD(pR->aCoord[iDim*2+1]);
+        if( xright<xleft || (xright==xleft
+         && DCOORD(pR->aCoord[iDim*2])<DCOORD(pL->aCoord[iDim*2]))
+        ){
+          aCell[iLeft+iRight] = *pR;
+          iRight++;
+          continue;
+        }
+      }
+      aCell[iLeft+iRight] = aLeft[iLeft];
+      iLeft++;
+    }
+  }
+}
+
+/*
+** Order the nCell cells in aCell[] for Sort-Tile-Recursive packing [3]
+** into nodes of nMax cells. The cells are sorted by dimension iDim and
+** cut into S slabs of whole nodes, where S is the (nDim-iDim)th root of
+** the number of nodes. Each slab is ordered by the next dimension in the
+** same way. Consecutive runs of nMax cells of the result are then nodes
+** which cover small, nearly square areas.
+*/
+static void rtreeStrOrder(
+  Rtree *pRtree,
+  RtreeCell *aCell,
+  int nCell,
+  int iDim,
+  int nMax,
+  RtreeCell *aSpare
+){
+  SortByCenter(pRtree, aCell, nCell, iDim, aSpare);
+  if( iDim<pRtree->nDim-1 ){
+    int nNode = (nCell+nMax-1)/nMax;
+    int nSlab = 1;
+    int nSlabCell;
+    int ii;
+
+    for(;;){
+      i64 nPow = 1;
+      for(ii=iDim; ii<pRtree->nDim; ii++){
+        nPow *= nSlab;
+      }
+      if( nPow>=nNode ) break;
+      nSlab++;
+    }
+    nSlabCell = ((nNode+nSlab-1)/nSlab)*nMax;
+    for(ii=0; ii<nCell; ii+=nSlabCell){
+      int n = MIN(nSlabCell, nCell-ii);
+      rtreeStrOrder(pRtree, &aCell[ii], n, iDim+1, nMax, aSpare);
+    }
+  }
+}
+
+/*
+** Read the rows of statement pStmt, a rowid followed by the nDim*2
+** coordinates, into the array *paCell of *pnAlloc cells. The number of
+** cells read is added to *pnCell. The coordinates are converted in the
+** same way as by an INSERT. The index of a cell read with a NULL rowid
+** is added to the array *paNull of *pnNullAlloc entries, and *pnNull
+** is incremented. *piMax is set to the largest rowid read.
+*/
+static int rtreeBulkRead(
+  Rtree *pRtree,
+  sqlite3_stmt *pStmt,
+  RtreeCell **paCell, int *pnCell, int *pnAlloc,
+  int **paNull, int *pnNull, int *pnNullAlloc,
+  i64 *piMax
+){
+  int rc;
+  while( SQLITE_ROW==(rc = sqlite3_step(pStmt)) ){
+    RtreeCell *pCell;
+    int ii;
+
+    if( *pnCell==*pnAlloc ){
+      int nNew = *pnAlloc ? *pnAlloc*2 : 1024;
+      RtreeCell *aNew;
+      aNew = (RtreeCell *)sqlite3_realloc(*paCell, nNew*sizeof(RtreeCell));
+      if( !aNew ){
+        return SQLITE_NOMEM;
+      }
+      *paCell = aNew;
+      *pnAlloc = nNew;
+    }
+    pCell = &(*paCell)[*pnCell];
+
+    if( pRtree->eCoordType==RTREE_COORD_REAL32 ){
+      for(ii=0; ii<(pRtree->nDim*2); ii+=2){
+        pCell->aCoord[ii].f = (float)sqlite3_column_double(pStmt, ii+1);
+        pCell->aCoord[ii+1].f = (float)sqlite3_column_double(pStmt, ii+2);
+        if( pCell->aCoord[ii].f>pCell->aCoord[ii+1].f ){
+          return SQLITE_CONSTRAINT;
+        }
+      }
+    }else{
+      for(ii=0; ii<(pRtree->nDim*2); ii+=2){
+        pCell->aCoord[ii].i = sqlite3_column_int(pStmt, ii+1);
+        pCell->aCoord[ii+1].i = sqlite3_column_int(pStmt, ii+2);
+        if( pCell->aCoord[ii].i>pCell->aCoord[ii+1].i ){
+          return SQLITE_CONSTRAINT;
+        }
+      }
+    }
+
+    if( sqlite3_column_type(pStmt, 0)==SQLITE_NULL ){
+      if( *pnNull==*pnNullAlloc ){
+        int nNew = *pnNullAlloc ? *pnNullAlloc*2 : 256;
+        int *aNew = (int *)sqlite3_realloc(*paNull, nNew*sizeof(int));
+        if( !aNew ){
+          return SQLITE_NOMEM;
+        }
+        *paNull = aNew;
+        *pnNullAlloc = nNew;
+      }
+      (*paNull)[(*pnNull)++] = *pnCell;
+      pCell->iRowid = 0;
+    }else{
+      pCell->iRowid = sqlite3_column_int64(pStmt, 0);
+      *piMax = MAX(*piMax, pCell->iRowid);
+    }
+    (*pnCell)++;
+  }
+  return (rc==SQLITE_DONE ? SQLITE_OK : rc);
+}
+
+/*
+** Write the nCell cells of aCell[] to node iNode, using buffer zData of
+** pRtree->iNodeSize bytes. For the root node (iNode==1) iDepth is the
+** depth of the tree. The rowid of each cell of a leaf (iHeight==0) is
+** written to the <rtree>_rowid table with statement pRowid, the child
+** node of each cell of an internal node to the <rtree>_parent table
+** with pParent. The bounding box of the cells is written to *pBox.
+*/
+static int rtreeBulkNode(
+  Rtree *pRtree,
+  u8 *zData,
+  i64 iNode,
+  int iDepth,
+  int iHeight,
+  RtreeCell *aCell,
+  int nCell,
+  sqlite3_stmt *pNode,
+  sqlite3_stmt *pRowid,
+  sqlite3_stmt *pParent,
+  RtreeCell *pBox
+){
+  RtreeNode node;
+  sqlite3_stmt *pMap = (iHeight==0 ? pRowid : pParent);
+  int rc = SQLITE_OK;
+  int ii;
+
+  memset(&node, 0, sizeof(RtreeNode));
+  node.zData = zData;
+  memset(zData, 0, pRtree->iNodeSize);
+  writeInt16(zData, iDepth);
+  writeInt16(&zData[2], nCell);
+
+  *pBox = aCell[0];
+  for(ii=0; ii<nCell && rc==SQLITE_OK; ii++){
+    nodeOverwriteCell(pRtree, &node, &aCell[ii], ii);
+    cellUnion(pRtree, pBox, &aCell[ii]);
+    sqlite3_bind_int64(pMap, 1, aCell[ii].iRowid);
+    sqlite3_bind_int64(pMap, 2, iNode);
+    sqlite3_step(pMap);
+    rc = sqlite3_reset(pMap);
+  }
+  pBox->iRowid = iNode;
+
+  if( rc==SQLITE_OK ){
+    sqlite3_bind_int64(pNode, 1, iNode);
+    sqlite3_bind_blob(pNode, 2, zData, pRtree->iNodeSize, SQLITE_STATIC);
+    sqlite3_step(pNode);
+    rc = sqlite3_reset(pNode);
+  }
+  return rc;
+}
+
+/*
+** Write the nCell cells of aCell[] as a new tree. The cells are packed
+** into full leaf nodes in Sort-Tile-Recursive order, then the bounding
+** boxes of the nodes of each level into the nodes of the level above,
+** until they fit into the root node. Only the last node of a level is
+** not full. If it would be less than a third full, which is allowed for
+** the root node only, it shares the cells with the node before it.
+** The shadow tables have to be empty, the contents of aCell[] is
+** reordered.
+*/
+static int rtreeBulkWrite(
+  Rtree *pRtree,
+  RtreeCell *aCell,
+  int nCell,
+  sqlite3_stmt *pNode,
+  sqlite3_stmt *pRowid,
+  sqlite3_stmt *pParent
+){
+  int nMax = (pRtree->iNodeSize-4)/pRtree->nBytesPerCell;
+  int nMin = RTREE_MINCELLS(pRtree);
+  RtreeCell *aSpare = 0;
+  RtreeCell *aLevel = aCell;
+  int nLevel = nCell;
+  i64 iNext = 2;
+  int iHeight = 0;
+  RtreeCell box;
+  u8 *zData;
+  int rc = SQLITE_OK;
+
+  zData = (u8 *)sqlite3_malloc(pRtree->iNodeSize);
+  if( nCell>nMax ){
+    aSpare = (RtreeCell *)sqlite3_malloc(nCell*sizeof(RtreeCell));
+  }
+  if( !zData || (nCell>nMax && !aSpare) ){
+    sqlite3_free(zData);
+    sqlite3_free(aSpare);
+    return SQLITE_NOMEM;
+  }
+
+  while( rc==SQLITE_OK && nLevel>nMax ){
+    int nNode = (nLevel+nMax-1)/nMax;
+    RtreeCell *aUp;
+    int iCell = 0;
+    int ii;
+
+    rtreeStrOrder(pRtree, aLevel, nLevel, 0, nMax, aSpare);
+    aUp = (RtreeCell *)sqlite3_malloc(nNode*sizeof(RtreeCell));
+    if( !aUp ){
+      rc = SQLITE_NOMEM;
+      break;
+    }
+    for(ii=0; ii<nNode && rc==SQLITE_OK; ii++){
+      int n = MIN(nMax, nLevel-iCell);
+      int nRest = nLevel-iCell-n;
+      if( nRest>0 && nRest<nMin ){
+        n = (n+nRest)/2;
+      }
+      rc = rtreeBulkNode(pRtree, zData, iNext, 0, iHeight,
+          &aLevel[iCell], n, pNode, pRowid, pParent, &aUp[ii]);
+      iNext++;
+      iCell += n;
+    }
+    if( aLevel!=aCell ){
+      sqlite3_free(aLevel);
+    }
+    aLevel = aUp;
+    nLevel = nNode;
+    iHeight++;
+  }
+
+  if( rc==SQLITE_OK ){
+    if( nLevel>0 ){
+      rc = rtreeBulkNode(pRtree, zData, 1, iHeight, iHeight,
+          aLevel, nLevel, pNode, pRowid, pParent, &box);
+    }else{
+      memset(zData, 0, pRtree->iNodeSize);
+      sqlite3_bind_int64(pNode, 1, 1);
+      sqlite3_bind_blob(pNode, 2, zData, pRtree->iNodeSize, SQLITE_STATIC);
+      sqlite3_step(pNode);
+      rc = sqlite3_reset(pNode);
+    }
+  }
+
+  if( aLevel!=aCell ){
+    sqlite3_free(aLevel);
+  }
+  sqlite3_free(aSpare);
+  sqlite3_free(zData);
+  return rc;
+}
+
+/*
+** Implementation of the scalar function rtree_bulkload(). It loads the
+** rows returned by a query into an r-tree table much faster than an
+** INSERT statement, and the resulting tree is smaller and faster to
+** query. For an r-tree table "rt" with two dimensions:
+**
+**   SELECT rtree_bulkload('rt', 'SELECT id, x0, x1, y0, y1 FROM boxes');
+**
+** An optional third argument is the name of the database of the table.
+** The query returns the rowid and the coordinates of each entry, as
+** an INSERT into the table would take them. A NULL rowid is replaced
+** by a new one. The entries of the query and the entries already in
+** the table are packed into a new tree, which replaces the contents of
+** the shadow tables in a single savepoint. The function returns the
+** number of rows loaded from the query.
+**
+** All entries are held in memory while the tree is built, about 100
+** bytes per entry.
+*/
+static void rtreebulkload(
+  sqlite3_context *ctx,
+  int nArg,
+  sqlite3_value **apArg
+){
+  sqlite3 *db = sqlite3_context_db_handle(ctx);
+  const char *zName = (const char *)sqlite3_value_text(apArg[0]);
+  const char *zQuery = (const char *)sqlite3_value_text(apArg[1]);
+  const char *zDb = "main";
+  Rtree tree;
+  sqlite3_stmt *pStmt = 0;
+  sqlite3_stmt *pNode = 0;
+  sqlite3_stmt *pRowid = 0;
+  sqlite3_stmt *pParent = 0;
+  RtreeCell *aCell = 0;
+  int nCell = 0;
+  int nAlloc = 0;
+  int *aNull = 0;
+  int nNull = 0;
+  int nNullAlloc = 0;
+  int nExisting = 0;
+  i64 iMax = 0;
+  char *zSql;
+  char *zErr = 0;
+  int isSavepoint = 0;
+  int rc = SQLITE_OK;
+  int ii;
+
+  if( nArg>2 && sqlite3_value_type(apArg[2])!=SQLITE_NULL ){
+    zDb = (const char *)sqlite3_value_text(apArg[2]);
+  }
+  if( !zName || !zQuery || !zDb ){
+    sqlite3_result_error(ctx, "Invalid argument to rtree_bulkload()", -1);
+    return;
+  }
+
+  /* Find the coordinate type, the number of dimensions and the node
+  ** size of the table, as rtreeInit() has set them up.
+  */
+  memset(&tree, 0, sizeof(Rtree));
+  zSql = sqlite3_mprintf(
+    "SELECT sql LIKE '%%USING%%rtree!_i32%%' ESCAPE '!' "
+    "FROM \"%w\".sqlite_master WHERE type='table' AND name=%Q "
+    "AND sql LIKE '%%USING%%rtree%%'", zDb, zName
+  );
+  rc = zSql ? sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0) : SQLITE_NOMEM;
+  sqlite3_free(zSql);
+  if( rc==SQLITE_OK ){
+    if( SQLITE_ROW==sqlite3_step(pStmt) ){
+      tree.eCoordType = sqlite3_column_int(pStmt, 0) ?
+          RTREE_COORD_INT32 : RTREE_COORD_REAL32;
+    }else{
+      zErr = sqlite3_mprintf("no such rtree table: %s.%s", zDb, zName);
+    }
+    rc = sqlite3_finalize(pStmt);
+    pStmt = 0;
+  }
+  if( rc==SQLITE_OK && !zErr ){
+    zSql = sqlite3_mprintf(
+      "SELECT length(data) FROM \"%w\".\"%w_node\" WHERE nodeno=1",
+      zDb, zName
+    );
+    rc = zSql ? sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+    if( rc==SQLITE_OK ){
+      if( SQLITE_ROW==sqlite3_step(pStmt) ){
+        tree.iNodeSize = sqlite3_column_int(pStmt, 0);
+      }
+      rc = sqlite3_finalize(pStmt);
+      pStmt = 0;
+    }
+  }
+  if( rc==SQLITE_OK && !zErr ){
+    zSql = sqlite3_mprintf("SELECT * FROM \"%w\".\"%w\"", zDb, zName);
+    rc = zSql ? sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+    if( rc==SQLITE_OK ){
+      tree.nDim = (sqlite3_column_count(pStmt)-1)/2;
+      tree.nBytesPerCell = 8 + tree.nDim*4*2;
+      if( tree.iNodeSize<4+tree.nBytesPerCell*2 ){
+        zErr = sqlite3_mprintf("rtree table %s.%s is corrupt", zDb, zName);
+      }
+    }
+  }
+
+  /* Read the entries of the table before those of the query, so that a
+  ** NULL rowid of the query gets a rowid not used by either.
+  */
+  if( rc==SQLITE_OK && !zErr ){
+    rc = sqlite3_exec(db, "SAVEPOINT rtree_bulkload", 0, 0, 0);
+    isSavepoint = (rc==SQLITE_OK);
+  }
+  if( rc==SQLITE_OK && !zErr ){
+    rc = rtreeBulkRead(&tree, pStmt, &aCell, &nCell, &nAlloc,
+        &aNull, &nNull, &nNullAlloc, &iMax);
+    if( rc==SQLITE_CONSTRAINT ){
+      zErr = sqlite3_mprintf(
+          "rtree_bulkload(): a minimum is above its maximum"
+      );
+    }
+    nExisting = nCell;
+  }
+  sqlite3_finalize(pStmt);
+  pStmt = 0;
+  if( rc==SQLITE_OK && !zErr ){
+    rc = sqlite3_prepare_v2(db, zQuery, -1, &pStmt, 0);
+    if( rc==SQLITE_OK && (!pStmt || !sqlite3_stmt_readonly(pStmt)) ){
+      zErr = sqlite3_mprintf("rtree_bulkload() needs a SELECT statement");
+    }else if( rc==SQLITE_OK && sqlite3_column_count(pStmt)!=tree.nDim*2+1 ){
+      zErr = sqlite3_mprintf(
+          "the query of rtree_bulkload() has to return %d columns",
+          tree.nDim*2+1
+      );
+    }
+  }
+  if( rc==SQLITE_OK && !zErr ){
+    rc = rtreeBulkRead(&tree, pStmt, &aCell, &nCell, &nAlloc,
+        &aNull, &nNull, &nNullAlloc, &iMax);
+    if( rc==SQLITE_CONSTRAINT ){
+      zErr = sqlite3_mprintf(
+          "rtree_bulkload(): a minimum is above its maximum"
+      );
+    }
+  }
+  sqlite3_finalize(pStmt);
+  pStmt = 0;
+  for(ii=0; ii<nNull; ii++){
+    aCell[aNull[ii]].iRowid = ++iMax;
+  }
+
+  /* Replace the contents of the shadow tables by the new tree. A
+  ** duplicate rowid is caught by the primary key of <rtree>_rowid.
+  */
+  if( rc==SQLITE_OK && !zErr ){
+    zSql = sqlite3_mprintf(
+      "DELETE FROM \"%w\".\"%w_node\";"
+      "DELETE FROM \"%w\".\"%w_rowid\";"
+      "DELETE FROM \"%w\".\"%w_parent\";",
+      zDb, zName, zDb, zName, zDb, zName
+    );
+    rc = zSql ? sqlite3_exec(db, zSql, 0, 0, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+  }
+  if( rc==SQLITE_OK && !zErr ){
+    zSql = sqlite3_mprintf(
+      "INSERT INTO \"%w\".\"%w_node\" VALUES(?1, ?2)", zDb, zName
+    );
+    rc = zSql ? sqlite3_prepare_v2(db, zSql, -1, &pNode, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+  }
+  if( rc==SQLITE_OK && !zErr ){
+    zSql = sqlite3_mprintf(
+      "INSERT INTO \"%w\".\"%w_rowid\" VALUES(?1, ?2)", zDb, zName
+    );
+    rc = zSql ? sqlite3_prepare_v2(db, zSql, -1, &pRowid, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+  }
+  if( rc==SQLITE_OK && !zErr ){
+    zSql = sqlite3_mprintf(
+      "INSERT INTO \"%w\".\"%w_parent\" VALUES(?1, ?2)", zDb, zName
+    );
+    rc = zSql ? sqlite3_prepare_v2(db, zSql, -1, &pParent, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+  }
+  if( rc==SQLITE_OK && !zErr ){
+    rc = rtreeBulkWrite(&tree, aCell, nCell, pNode, pRowid, pParent);
+  }
+  sqlite3_finalize(pNode);
+  sqlite3_finalize(pParent);
+  sqlite3_finalize(pRowid);
+
+  if( rc!=SQLITE_OK && !zErr ){
+    zErr = sqlite3_mprintf("%s", sqlite3_errmsg(db));
+  }
+  if( isSavepoint ){
+    if( zErr ){
+      sqlite3_exec(db, "ROLLBACK TO rtree_bulkload", 0, 0, 0);
+    }
+    sqlite3_exec(db, "RELEASE rtree_bulkload", 0, 0, 0);
+  }
+  if( zErr ){
+    sqlite3_result_error(ctx, zErr, -1);
+  }else if( rc==SQLITE_NOMEM ){
+    sqlite3_result_error_nomem(ctx);
+  }else{
+    sqlite3_result_int64(ctx, nCell-nExisting);
+  }
+  sqlite3_free(zErr);
+  sqlite3_free(aNull);
+  sqlite3_free(aCell);
+}
+
 /*
 ** Register the r-tree module with database handle db. This creates the
-** virtual table module "rtree" and the debugging/analysis scalar 
-** function "rtreenode".
+** virtual table module "rtree", the debugging/analysis scalar 
+** function "rtreenode" and the bulk loading function "rtree_bulkload".
 */
 int sqlite3RtreeInit(sqlite3 *db){
   int rc = SQLITE_OK;
@@ -2832,6 +3343,16 @@ int sqlite3RtreeInit(sqlite3 *db){
     int utf8 = SQLITE_UTF8;
     rc = sqlite3_create_function(db, "rtreedepth", 1, utf8, 0,rtreedepth, 0, 0);
   }
+  if( rc==SQLITE_OK ){
+    int utf8 = SQLITE_UTF8;
+    rc = sqlite3_create_function(db, "rtree_bulkload", 2, utf8, 0,
+        rtreebulkload, 0, 0);
+  }
+  if( rc==SQLITE_OK ){
+    int utf8 = SQLITE_UTF8;
+    rc = sqlite3_create_function(db, "rtree_bulkload", 3, utf8, 0,
+        rtreebulkload, 0, 0);
+  }
   if( rc==SQLITE_OK ){
     void *c = (void *)RTREE_COORD_REAL32;
     rc = sqlite3_create_module_v2(db, "rtree", &rtreeModule, c, 0);
@@ -270,6 +270,452 @@ static void args2tableFunc(
 	return;
 }
 
+#if SQLITE_VERSION_NUMBER >= 3009000
+/*
+Table-valued functions producing a series on the fly instead of storing it
+with intrange2table() first. They need SQLite 3.9.0 or later.
+
+select value from generate_series(1, 10, 3);
+1
+4
+7
+10
+
+select value from generate_series(10, 1, -4);
+10
+6
+2
+
+select value from date_series('2009-01-30', '2009-05-01', '1 month');
+2009-01-30
+2009-03-02
+2009-03-30
+2009-04-30
+
+select value from datetime_series('2009-01-01', '2009-01-01 03:00', '90 minutes');
+2009-01-01 00:00:00
+2009-01-01 01:30:00
+2009-01-01 03:00:00
+
+The step of generate_series defaults to 1, the one of date_series to
+'1 day' and the one of datetime_series to '1 hour'. Step units are second,
+minute, hour, day, week, month and year; without a unit date_series counts
+days and datetime_series seconds. A negative step counts down. Month and
+year steps are added to the start like the date() modifiers do, so the
+days past the end of a month roll over into the next one.
+
+Finding the gaps of an id column without writing anything:
+select value from generate_series(1, (select max(id) from t))
+	where value not in (select id from t);
+*/
+
+#define SERIES_INTEGER		0
+#define SERIES_DATE			1
+#define SERIES_DATETIME		2
+
+#define SERIES_COLUMN_VALUE	0
+#define SERIES_COLUMN_START	1
+#define SERIES_COLUMN_STOP	2
+#define SERIES_COLUMN_STEP	3
+
+/* idxNum flags; the arguments of xFilter follow in this order */
+#define SERIES_START	1
+#define SERIES_STOP		2
+#define SERIES_STEP		4
+
+/* the largest step count, far from overflowing as seconds */
+#define SERIES_MAX_STEP	100000000
+
+static int seriesKinds[] = { SERIES_INTEGER, SERIES_DATE, SERIES_DATETIME };
+static const char *seriesNames[] = { "generate_series", "date_series", "datetime_series" };
+
+typedef struct series_vtab {
+	sqlite3_vtab base;
+	int kind;
+} series_vtab;
+
+typedef struct series_cursor {
+	sqlite3_vtab_cursor base;
+	int kind;
+	sqlite3_int64 start;	/* integers, or seconds since 1970-01-01 of dates */
+	sqlite3_int64 stop;
+	sqlite3_int64 step;		/* seconds, or months when months is set */
+	int months;
+	char *zStep;			/* the step argument of the date series */
+	sqlite3_int64 index;	/* of the current value, from 0 */
+	sqlite3_int64 value;
+	int eof;
+} series_cursor;
+
+/* days since 1970-01-01 of a proleptic Gregorian date; days past the end
+   of the month roll over into the next one */
+static sqlite3_int64 seriesDays(sqlite3_int64 y, int m, int d) {
+	sqlite3_int64 era;
+	int yoe, doy, doe;
+	y -= m <= 2;
+	era = (y >= 0 ? y : y - 399) / 400;
+	yoe = (int)(y - era * 400);
+	doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+/* the date of days since 1970-01-01 */
+static void seriesCivil(sqlite3_int64 z, int *y, int *m, int *d) {
+	sqlite3_int64 era;
+	int doe, yoe, doy, mp;
+	z += 719468;
+	era = (z >= 0 ? z : z - 146096) / 146097;
+	doe = (int)(z - era * 146097);
+	yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = (int)(yoe + era * 400 + (*m <= 2));
+}
+
+/* the range of date(): 0000-01-01 00:00:00 to 9999-12-31 23:59:59 */
+static int seriesDateInRange(sqlite3_int64 seconds) {
+	return seconds >= seriesDays(0, 1, 1) * 86400
+		&& seconds < seriesDays(10000, 1, 1) * 86400;
+}
+
+/* 'YYYY-MM-DD', optionally followed by ' HH:MM' or ' HH:MM:SS[.SSS]'
+   (or a 'T' instead of the space) */
+static int seriesParseDate(const unsigned char *z, sqlite3_int64 *pSeconds) {
+	int y, m, d, n;
+	int hh = 0, mm = 0, ss = 0;
+	const char *p = (const char*)z;
+	if (!p || sscanf(p, "%4d-%2d-%2d%n", &y, &m, &d, &n) != 3)
+		return 0;
+	p += n;
+	if (*p == ' ' || *p == 'T') {
+		if (sscanf(p + 1, "%2d:%2d%n", &hh, &mm, &n) != 2)
+			return 0;
+		p += 1 + n;
+		if (*p == ':') {
+			if (sscanf(p + 1, "%2d%n", &ss, &n) != 1)
+				return 0;
+			p += 1 + n;
+			if (*p == '.')
+				for (p++; *p >= '0' && *p <= '9'; p++)
+					;
+		}
+	}
+	while (*p == ' ')
+		p++;
+	if (*p || y < 0 || m < 1 || m > 12 || d < 1 || d > 31
+		|| hh < 0 || hh > 23 || mm < 0 || mm > 59 || ss < 0 || ss > 59)
+		return 0;
+	*pSeconds = seriesDays(y, m, d) * 86400 + hh * 3600 + mm * 60 + ss;
+	return 1;
+}
+
+/* '[+-]N [unit]'; a step without a unit counts days or seconds */
+static int seriesParseStep(const unsigned char *z, int kind, sqlite3_int64 *pStep, int *pMonths) {
+	static const struct {
+		const char *zName;
+		sqlite3_int64 size;
+		int months;
+	} aUnits[] = {
+		{ "second", 1, 0 },
+		{ "minute", 60, 0 },
+		{ "hour", 3600, 0 },
+		{ "day", 86400, 0 },
+		{ "week", 604800, 0 },
+		{ "month", 1, 1 },
+		{ "year", 12, 1 },
+	};
+	const char *p = (const char*)z;
+	char *zEnd;
+	sqlite3_int64 n;
+	int len, i;
+	if (!p)
+		return 0;
+	n = strtoll(p, &zEnd, 10);
+	if (zEnd == p || n < -SERIES_MAX_STEP || n > SERIES_MAX_STEP)
+		return 0;
+	for (p = zEnd; *p == ' '; p++)
+		;
+	len = strlen(p);
+	while (len && p[len - 1] == ' ')
+		len--;
+	if (len == 0) {
+		*pStep = kind == SERIES_DATE ? n * 86400 : n;
+		*pMonths = 0;
+		return n != 0;
+	}
+	if (p[len - 1] == 's' || p[len - 1] == 'S')
+		len--;
+	for (i = 0; i < sizeof(aUnits) / sizeof(aUnits[0]); i++) {
+		if (strlen(aUnits[i].zName) == len && sqlite3_strnicmp(p, aUnits[i].zName, len) == 0) {
+			*pStep = n * aUnits[i].size;
+			*pMonths = aUnits[i].months;
+			return n != 0;
+		}
+	}
+	return 0;
+}
+
+/* the index-th value of a date series */
+static int seriesDateValue(series_cursor *pCur, sqlite3_int64 index, sqlite3_int64 *pValue) {
+	sqlite3_int64 days, seconds, months;
+	int y, m, d;
+	if (!pCur->months) {
+		*pValue = pCur->start + index * pCur->step;
+		return seriesDateInRange(*pValue);
+	}
+	days = pCur->start / 86400;
+	seconds = pCur->start - days * 86400;
+	if (seconds < 0) {
+		days--;
+		seconds += 86400;
+	}
+	seriesCivil(days, &y, &m, &d);
+	months = (sqlite3_int64)y * 12 + (m - 1) + index * pCur->step;
+	if (months < 0 || months >= 10000 * 12)
+		return 0;
+	*pValue = seriesDays(months / 12, (int)(months % 12) + 1, d) * 86400 + seconds;
+	return seriesDateInRange(*pValue);
+}
+
+static int seriesPastStop(series_cursor *pCur) {
+	return pCur->step > 0 ? pCur->value > pCur->stop : pCur->value < pCur->stop;
+}
+
+static int seriesConnect(
+	sqlite3 *db,
+	void *pAux,
+	int argc,
+	const char *const *argv,
+	sqlite3_vtab **ppVtab,
+	char **pzErr
+) {
+	series_vtab *pNew;
+	int kind = *(int*)pAux;
+	int rc = sqlite3_declare_vtab(db, kind == SERIES_INTEGER
+		? "CREATE TABLE x(value INTEGER, start HIDDEN, stop HIDDEN, step HIDDEN)"
+		: "CREATE TABLE x(value TEXT, start HIDDEN, stop HIDDEN, step HIDDEN)");
+	if (rc != SQLITE_OK)
+		return rc;
+	pNew = sqlite3_malloc(sizeof(*pNew));
+	if (!pNew)
+		return SQLITE_NOMEM;
+	memset(pNew, 0, sizeof(*pNew));
+	pNew->kind = kind;
+	*ppVtab = &pNew->base;
+	return SQLITE_OK;
+}
+
+static int seriesDisconnect(sqlite3_vtab *pVtab) {
+	sqlite3_free(pVtab);
+	return SQLITE_OK;
+}
+
+static int seriesOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+	series_cursor *pCur = sqlite3_malloc(sizeof(*pCur));
+	if (!pCur)
+		return SQLITE_NOMEM;
+	memset(pCur, 0, sizeof(*pCur));
+	pCur->kind = ((series_vtab*)pVtab)->kind;
+	pCur->eof = 1;
+	*ppCursor = &pCur->base;
+	return SQLITE_OK;
+}
+
+static int seriesClose(sqlite3_vtab_cursor *cur) {
+	series_cursor *pCur = (series_cursor*)cur;
+	sqlite3_free(pCur->zStep);
+	sqlite3_free(pCur);
+	return SQLITE_OK;
+}
+
+static int seriesNext(sqlite3_vtab_cursor *cur) {
+	series_cursor *pCur = (series_cursor*)cur;
+	sqlite3_uint64 left;
+	if (pCur->eof)
+		return SQLITE_OK;
+	pCur->index++;
+	if (pCur->kind == SERIES_INTEGER) {
+		/* the value is between start and stop, the distance to stop cannot overflow */
+		if (pCur->step > 0) {
+			left = (sqlite3_uint64)pCur->stop - (sqlite3_uint64)pCur->value;
+			pCur->eof = left < (sqlite3_uint64)pCur->step;
+		} else {
+			left = (sqlite3_uint64)pCur->value - (sqlite3_uint64)pCur->stop;
+			pCur->eof = left < (sqlite3_uint64)0 - (sqlite3_uint64)pCur->step;
+		}
+		if (!pCur->eof)
+			pCur->value += pCur->step;
+		return SQLITE_OK;
+	}
+	pCur->eof = !seriesDateValue(pCur, pCur->index, &pCur->value) || seriesPastStop(pCur);
+	return SQLITE_OK;
+}
+
+static void seriesResultDate(sqlite3_context *ctx, int kind, sqlite3_int64 seconds) {
+	char zBuf[32];
+	sqlite3_int64 days = seconds / 86400;
+	int y, m, d;
+	seconds -= days * 86400;
+	if (seconds < 0) {
+		days--;
+		seconds += 86400;
+	}
+	seriesCivil(days, &y, &m, &d);
+	if (kind == SERIES_DATE)
+		sqlite3_snprintf(sizeof(zBuf), zBuf, "%04d-%02d-%02d", y, m, d);
+	else
+		sqlite3_snprintf(sizeof(zBuf), zBuf, "%04d-%02d-%02d %02d:%02d:%02d", y, m, d,
+			(int)(seconds / 3600), (int)(seconds / 60 % 60), (int)(seconds % 60));
+	sqlite3_result_text(ctx, zBuf, -1, SQLITE_TRANSIENT);
+}
+
+static int seriesColumn(sqlite3_vtab_cursor *cur, sqlite3_context *ctx, int i) {
+	series_cursor *pCur = (series_cursor*)cur;
+	sqlite3_int64 x;
+	switch (i) {
+		case SERIES_COLUMN_START:
+			x = pCur->start;
+			break;
+		case SERIES_COLUMN_STOP:
+			x = pCur->stop;
+			break;
+		case SERIES_COLUMN_STEP:
+			if (pCur->kind == SERIES_INTEGER)
+				sqlite3_result_int64(ctx, pCur->step);
+			else
+				sqlite3_result_text(ctx, pCur->zStep, -1, SQLITE_TRANSIENT);
+			return SQLITE_OK;
+		default:
+			x = pCur->value;
+			break;
+	}
+	if (pCur->kind == SERIES_INTEGER)
+		sqlite3_result_int64(ctx, x);
+	else
+		seriesResultDate(ctx, pCur->kind, x);
+	return SQLITE_OK;
+}
+
+static int seriesRowid(sqlite3_vtab_cursor *cur, sqlite_int64 *pRowid) {
+	*pRowid = ((series_cursor*)cur)->index + 1;
+	return SQLITE_OK;
+}
+
+static int seriesEof(sqlite3_vtab_cursor *cur) {
+	return ((series_cursor*)cur)->eof;
+}
+
+static int seriesError(sqlite3_vtab_cursor *cur, char *zMsg) {
+	sqlite3_vtab *pVtab = cur->pVtab;
+	sqlite3_free(pVtab->zErrMsg);
+	pVtab->zErrMsg = zMsg;
+	return zMsg ? SQLITE_ERROR : SQLITE_NOMEM;
+}
+
+static int seriesFilter(
+	sqlite3_vtab_cursor *cur,
+	int idxNum, const char *idxStr,
+	int argc, sqlite3_value **argv
+) {
+	series_cursor *pCur = (series_cursor*)cur;
+	const char *zName = seriesNames[pCur->kind];
+	const unsigned char *zStep;
+	int i;
+	pCur->eof = 1;
+	pCur->index = 0;
+	if ((idxNum & (SERIES_START | SERIES_STOP)) != (SERIES_START | SERIES_STOP))
+		return seriesError(cur, sqlite3_mprintf("%s: start and stop are required", zName));
+	/* nothing is between NULLs */
+	for (i = 0; i < argc; i++)
+		if (sqlite3_value_type(argv[i]) == SQLITE_NULL)
+			return SQLITE_OK;
+	if (pCur->kind == SERIES_INTEGER) {
+		pCur->start = sqlite3_value_int64(argv[0]);
+		pCur->stop = sqlite3_value_int64(argv[1]);
+		pCur->step = (idxNum & SERIES_STEP) ? sqlite3_value_int64(argv[2]) : 1;
+		if (pCur->step == 0)
+			return seriesError(cur, sqlite3_mprintf("%s: the step must not be zero", zName));
+	} else {
+		if (!seriesParseDate(sqlite3_value_text(argv[0]), &pCur->start))
+			return seriesError(cur, sqlite3_mprintf("%s: invalid start date '%s'",
+				zName, sqlite3_value_text(argv[0])));
+		if (!seriesParseDate(sqlite3_value_text(argv[1]), &pCur->stop))
+			return seriesError(cur, sqlite3_mprintf("%s: invalid stop date '%s'",
+				zName, sqlite3_value_text(argv[1])));
+		zStep = (idxNum & SERIES_STEP) ? sqlite3_value_text(argv[2])
+			: (const unsigned char*)(pCur->kind == SERIES_DATE ? "1 day" : "1 hour");
+		if (!seriesParseStep(zStep, pCur->kind, &pCur->step, &pCur->months))
+			return seriesError(cur, sqlite3_mprintf("%s: invalid step '%s'", zName, zStep));
+		sqlite3_free(pCur->zStep);
+		pCur->zStep = sqlite3_mprintf("%s", zStep);
+		if (!pCur->zStep)
+			return SQLITE_NOMEM;
+	}
+	pCur->value = pCur->start;
+	pCur->eof = seriesPastStop(pCur);
+	return SQLITE_OK;
+}
+
+/* start, stop and step are equality constraints on the hidden columns */
+static int seriesBestIndex(sqlite3_vtab *tab, sqlite3_index_info *pIdxInfo) {
+	int aArg[3] = { -1, -1, -1 };
+	int idxNum = 0;
+	int nArg = 0;
+	int i, iArg;
+	const struct sqlite3_index_constraint *pConstraint = pIdxInfo->aConstraint;
+	for (i = 0; i < pIdxInfo->nConstraint; i++, pConstraint++) {
+		if (!pConstraint->usable || pConstraint->op != SQLITE_INDEX_CONSTRAINT_EQ)
+			continue;
+		switch (pConstraint->iColumn) {
+			case SERIES_COLUMN_START: aArg[0] = i; break;
+			case SERIES_COLUMN_STOP: aArg[1] = i; break;
+			case SERIES_COLUMN_STEP: aArg[2] = i; break;
+		}
+	}
+	for (iArg = 0; iArg < 3; iArg++) {
+		if (aArg[iArg] < 0)
+			continue;
+		idxNum |= 1 << iArg;
+		pIdxInfo->aConstraintUsage[aArg[iArg]].argvIndex = ++nArg;
+		pIdxInfo->aConstraintUsage[aArg[iArg]].omit = 1;
+	}
+	pIdxInfo->idxNum = idxNum;
+	if ((idxNum & (SERIES_START | SERIES_STOP)) == (SERIES_START | SERIES_STOP)) {
+		pIdxInfo->estimatedCost = 1000.0;
+		pIdxInfo->estimatedRows = 1000;
+		/* only the default step is known to count up */
+		if (!(idxNum & SERIES_STEP) && pIdxInfo->nOrderBy == 1
+			&& pIdxInfo->aOrderBy[0].iColumn == SERIES_COLUMN_VALUE
+			&& !pIdxInfo->aOrderBy[0].desc)
+			pIdxInfo->orderByConsumed = 1;
+	} else {
+		/* a plan without the arguments fails in xFilter */
+		pIdxInfo->estimatedCost = 2147483647.0;
+		pIdxInfo->estimatedRows = 2147483647;
+	}
+	return SQLITE_OK;
+}
+
+static sqlite3_module seriesModule = {
+	0,					/* iVersion */
+	0,					/* xCreate: eponymous only */
+	seriesConnect,		/* xConnect */
+	seriesBestIndex,	/* xBestIndex */
+	seriesDisconnect,	/* xDisconnect */
+	0,					/* xDestroy */
+	seriesOpen,			/* xOpen */
+	seriesClose,		/* xClose */
+	seriesFilter,		/* xFilter */
+	seriesNext,			/* xNext */
+	seriesEof,			/* xEof */
+	seriesColumn,		/* xColumn */
+	seriesRowid,		/* xRowid */
+};
+#endif
+
 /* SQLite invokes this routine once when it loads the extension.
 ** Create new functions, collating sequences, and virtual table
 ** modules here.  This is usually the only exported symbol in
@@ -299,6 +745,15 @@ int sqlite3TablefuncInit(sqlite3 *db){
         aFuncs[i].eTextRep, pArg, aFuncs[i].xFunc, 0, 0);
   }
 
+#if SQLITE_VERSION_NUMBER >= 3009000
+  /* table-valued functions need SQLite 3.9.0 */
+  if( sqlite3_libversion_number()>=3009000 ){
+    for(i=0; i<sizeof(seriesKinds)/sizeof(seriesKinds[0]); i++){
+      sqlite3_create_module(db, seriesNames[i], &seriesModule, &seriesKinds[i]);
+    }
+  }
+#endif
+
   return 0;
 }
 
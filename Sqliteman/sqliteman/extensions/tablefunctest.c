@@ -0,0 +1,126 @@
+/*
+Checks of the series table-valued functions of tablefunc.c, see
+tablefunctest.pro. The extension is compiled in. Every case is a query
+returning one text value, mostly group_concat() of a whole series, or
+the error message of the query.
+*/
+
+#include <sqlite3.h>
+
+#include <stdio.h>
+#include <string.h>
+
+int sqlite3TablefuncInit(sqlite3 *db);
+
+typedef struct SeriesCase SeriesCase;
+struct SeriesCase {
+  const char *zSql;
+  const char *zExpected;
+};
+
+static const SeriesCase aCase[] = {
+  /* generate_series: up, down, the default step, empty series */
+  { "SELECT group_concat(value) FROM generate_series(1, 10, 3)", "1,4,7,10" },
+  { "SELECT group_concat(value) FROM generate_series(10, 1, -4)", "10,6,2" },
+  { "SELECT group_concat(value) FROM generate_series(-2, 2)", "-2,-1,0,1,2" },
+  { "SELECT group_concat(value) FROM generate_series(5, 5)", "5" },
+  { "SELECT count(*) FROM generate_series(5, 1)", "0" },
+  { "SELECT count(*) FROM generate_series(1, 5, -1)", "0" },
+  { "SELECT count(*) FROM generate_series(1, 1000000)", "1000000" },
+  { "SELECT sum(value) FROM generate_series(1, 100)", "5050" },
+  /* the series stops before it overflows */
+  { "SELECT group_concat(value) FROM generate_series(9223372036854775806, 9223372036854775807)",
+    "9223372036854775806,9223372036854775807" },
+  { "SELECT count(*) FROM generate_series(9223372036854775800, 9223372036854775807, 5)", "2" },
+  { "SELECT group_concat(value) FROM generate_series(-9223372036854775807, -9223372036854775808, -1)",
+    "-9223372036854775807,-9223372036854775808" },
+  { "SELECT count(*) FROM generate_series(-9223372036854775808, 9223372036854775807, 9223372036854775807)",
+    "3" },
+  /* hidden columns, rowid and a join */
+  { "SELECT group_concat(start || '-' || stop || '-' || step) FROM generate_series(1, 2)",
+    "1-2-1,1-2-1" },
+  { "SELECT group_concat(rowid) FROM generate_series(10, 30, 10)", "1,2,3" },
+  { "SELECT group_concat(value) FROM generate_series WHERE start = 3 AND stop = 5", "3,4,5" },
+  { "SELECT group_concat(a.value * b.value) FROM generate_series(1, 2) a, generate_series(a.value, 2) b",
+    "1,2,4" },
+  { "SELECT group_concat(value) FROM (SELECT value FROM generate_series(1, 3) ORDER BY value DESC)",
+    "3,2,1" },
+  /* NULL arguments give an empty series, a missing one or a zero step fail */
+  { "SELECT count(*) FROM generate_series(NULL, 3)", "0" },
+  { "SELECT count(*) FROM generate_series(1, 3, NULL)", "0" },
+  { "SELECT count(*) FROM generate_series(1, 3, 0)", "generate_series: the step must not be zero" },
+  { "SELECT count(*) FROM generate_series(1)", "generate_series: start and stop are required" },
+
+  /* date_series: days, weeks, the roll-over of months and years */
+  { "SELECT group_concat(value) FROM date_series('2009-02-26', '2009-03-02')",
+    "2009-02-26,2009-02-27,2009-02-28,2009-03-01,2009-03-02" },
+  { "SELECT group_concat(value) FROM date_series('2008-02-27', '2008-03-01')",
+    "2008-02-27,2008-02-28,2008-02-29,2008-03-01" },
+  { "SELECT group_concat(value) FROM date_series('2009-01-30', '2009-05-01', '1 month')",
+    "2009-01-30,2009-03-02,2009-03-30,2009-04-30" },
+  { "SELECT group_concat(value) FROM date_series('2008-02-29', '2011-03-01', '1 year')",
+    "2008-02-29,2009-03-01,2010-03-01,2011-03-01" },
+  { "SELECT group_concat(value) FROM date_series('2009-01-01', '2009-01-29', '2 weeks')",
+    "2009-01-01,2009-01-15,2009-01-29" },
+  { "SELECT group_concat(value) FROM date_series('2009-01-10', '2009-01-01', '-3 days')",
+    "2009-01-10,2009-01-07,2009-01-04,2009-01-01" },
+  { "SELECT group_concat(value) FROM date_series('2009-12-31', '2010-01-02', '1')",
+    "2009-12-31,2010-01-01,2010-01-02" },
+  { "SELECT group_concat(value) FROM date_series('2009-05-31', '2009-01-01', '-1 month')",
+    "2009-05-31,2009-05-01,2009-03-31,2009-03-03,2009-01-31" },
+  { "SELECT count(*) FROM date_series('2000-01-01', '2099-12-31')", "36525" },
+  { "SELECT count(*) FROM date_series('2009-01-02', '2009-01-01')", "0" },
+  { "SELECT count(*) FROM date_series('2009-13-01', '2009-01-01')",
+    "date_series: invalid start date '2009-13-01'" },
+  { "SELECT count(*) FROM date_series('2009-01-01', '2009-01-05', '1 fortnight')",
+    "date_series: invalid step '1 fortnight'" },
+  { "SELECT count(*) FROM date_series('2009-01-01', '2009-01-05', '0 days')",
+    "date_series: invalid step '0 days'" },
+
+  /* datetime_series: the default hour, minutes, seconds and the date part */
+  { "SELECT group_concat(value) FROM datetime_series('2009-01-01', '2009-01-01 03:00', '90 minutes')",
+    "2009-01-01 00:00:00,2009-01-01 01:30:00,2009-01-01 03:00:00" },
+  { "SELECT group_concat(value) FROM datetime_series('2009-01-01 22:00', '2009-01-02 01:00')",
+    "2009-01-01 22:00:00,2009-01-01 23:00:00,2009-01-02 00:00:00,2009-01-02 01:00:00" },
+  { "SELECT group_concat(value) FROM datetime_series('2009-01-01 00:00:58', '2009-01-01 00:01:01', '1')",
+    "2009-01-01 00:00:58,2009-01-01 00:00:59,2009-01-01 00:01:00,2009-01-01 00:01:01" },
+  { "SELECT group_concat(value) FROM datetime_series('2009-01-31 12:00', '2009-04-01', '1 month')",
+    "2009-01-31 12:00:00,2009-03-03 12:00:00,2009-03-31 12:00:00" },
+  { "SELECT group_concat(step) FROM datetime_series('2009-01-01', '2009-01-01 01:00', '30 minutes')",
+    "30 minutes,30 minutes,30 minutes" },
+
+  { 0, 0 }
+};
+
+
+int main(void){
+  sqlite3 *db;
+  const SeriesCase *p;
+  int nCase = 0;
+  int nFail = 0;
+
+  sqlite3_open(":memory:", &db);
+  sqlite3TablefuncInit(db);
+  for(p=aCase; p->zSql; p++, nCase++){
+    sqlite3_stmt *pStmt = 0;
+    const char *zGot = 0;
+    int rc = sqlite3_prepare_v2(db, p->zSql, -1, &pStmt, 0);
+    if( rc==SQLITE_OK ){
+      rc = sqlite3_step(pStmt);
+      if( rc==SQLITE_ROW )
+        zGot = (const char *)sqlite3_column_text(pStmt, 0);
+    }
+    if( rc!=SQLITE_ROW && rc!=SQLITE_DONE )
+      zGot = sqlite3_errmsg(db);
+    if( strcmp(zGot ? zGot : "NULL", p->zExpected)!=0 ){
+      printf("FAIL %s\n  got      %s\n  expected %s\n", p->zSql, zGot ? zGot : "NULL",
+             p->zExpected);
+      ++nFail;
+    }
+    sqlite3_finalize(pStmt);
+  }
+  sqlite3_close(db);
+
+  printf("%d cases, %d failures\n", nCase, nFail);
+  return nFail ? 1 : 0;
+}
@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = tablefunctest
+DEPENDPATH += .
+INCLUDEPATH += .
+CONFIG -= qt
+DEFINES += SQLITE_CORE SQLITE_ENABLE_TABLEFUNC
+LIBS += -lsqlite3
+
+CONFIG += console
+
+# Input
+SOURCES += tablefunctest.c tablefunc.c
@@ -2,7 +2,8 @@
 
  virtualtext.c -- SQLite3 extension [VIRTUAL TABLE accessing CSV/TXT]
 
- version 2.3, 2008 October 13
+ version 3.0, memory-mapped and lazily parsed
+ (based on version 2.3, 2008 October 13)
 
  Author: Sandro Furieri a-furieri@lqt.it
 
@@ -43,12 +44,43 @@ the terms of any one of the MPL, the GPL or the LGPL.
  
 */
 
+/*
+ Usage:
+   CREATE VIRTUAL TABLE x USING VirtualText(text_path, encoding
+       [, titles [, decimal_separator [, text_separator [, field_separator ] ] ] ]);
+
+ The file is memory-mapped, never copied into memory. When a table is
+ opened first the file is scanned once to count the rows, to infer the
+ column types and to remember the offset of every VRTTXT_INDEX_STEP-th
+ row. This sparse row index is saved as <text_path>.vtidx and reused as
+ long as the size and the modification time of the file do not change.
+ The cells of a row are located and converted only when their column
+ is read. Constraints on ROWNO (which is the ROWID too) seek through the
+ row index, so reading the tail of a huge file does not parse the rest.
+ The file is kept open and its size is checked before every row is
+ read: a file truncated while the table is open makes the query fail
+ with SQLITE_IOERR instead of touching the lost pages of the mapping.
+
+ Compile as
+   gcc -fPIC -shared virtualtext.c -o libsqlitevirtualtext.so
+*/
+
 #if !defined(SQLITE_CORE) || defined(SQLITE_ENABLE_VIRTUALTEXT)
 
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <locale.h>
 #include <iconv.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #ifndef SQLITE_CORE
   #include "sqlite3ext.h"
@@ -57,29 +89,68 @@ the terms of any one of the MPL, the GPL or the LGPL.
   #include "sqlite3.h"
 #endif
 
-#define VRTTXT_TEXT		1
-#define VRTTXT_INTEGER	2
-#define VRTTXT_DOUBLE	3
+/* column types, ordered: a column gets the widest type of its values */
+#define VRTTXT_NONE		0
+#define VRTTXT_INTEGER	1
+#define VRTTXT_DOUBLE	2
+#define VRTTXT_TEXT		3
 
-static struct sqlite3_module virtualtext_module;
+#define VRTTXT_INDEX_STEP	1024	/* rows between two offsets of the row index */
+#define VRTTXT_INDEX_SUFFIX	".vtidx"
+#define VRTTXT_INDEX_VERSION	1
 
-struct row_buffer
-{
-/* a complete row */
-    int n_cells;		/* how many cells are stored into this line */
-    char **cells;		/* the cells array */
-    struct row_buffer *next;	/* pointer for linked list */
-};
+/* xBestIndex idxNum flags; the arguments follow in this order */
+#define VRTTXT_EQ	1
+#define VRTTXT_GT	2
+#define VRTTXT_GE	4
+#define VRTTXT_LT	8
+#define VRTTXT_LE	16
+
+/* row numbers stay far within this range, bounds are clamped to it */
+#define VRTTXT_MAX_ROWNO	(((sqlite3_int64) 1) << 60)
+
+static struct sqlite3_module virtualtext_module;
 
 struct text_buffer
 {
-    int max_n_cells;		/* the maximun cell index */
+/* the memory-mapped text file and its sparse row index */
+    const char *map;		/* the file contents */
+    size_t size;		/* the file size */
+    int fd;			/* the file, to notice a truncation */
+    size_t data_start;		/* the offset of the first data row */
+    char field_separator;
+    char text_separator;
+    char decimal_separator;
+    int max_n_cells;		/* the number of columns, ROWNO excluded */
     char **titles;		/* the column titles array */
     char *types;		/* the column types array */
-    int n_rows;			/* the number of rows */
-    struct row_buffer **rows;	/* the rows array */
-    struct row_buffer *first;	/* pointers to build a linked list of rows */
-    struct row_buffer *last;
+    sqlite3_int64 n_rows;	/* the number of rows */
+    sqlite3_int64 *offsets;	/* the offset of every VRTTXT_INDEX_STEP-th row */
+    iconv_t toUtf8;		/* (iconv_t) -1 for UTF-8 files */
+};
+
+struct text_index_header
+{
+/* the header of a row index file */
+    char magic[8];
+    int version;
+    int step;
+    sqlite3_int64 file_size;
+    sqlite3_int64 file_mtime;
+    sqlite3_int64 data_start;
+    sqlite3_int64 n_rows;
+    int max_n_cells;
+    char field_separator;
+    char text_separator;
+    char decimal_separator;
+    char first_line_titles;
+};
+
+struct text_field
+{
+/* a cell of the current row as a range of the file */
+    size_t start;
+    size_t end;
 };
 
 typedef struct VirtualTextStruct
@@ -89,7 +160,7 @@ typedef struct VirtualTextStruct
     int nRef;			/* # references: USED INTERNALLY BY SQLITE */
     char *zErrMsg;		/* error message: USED INTERNALLY BY SQLITE */
     sqlite3 *db;		/* the sqlite db holding the virtual table */
-    struct text_buffer *buffer;	/* the in-memory buffer storing text */
+    struct text_buffer *buffer;	/* the mapped text file */
 } VirtualText;
 typedef VirtualText *VirtualTextPtr;
 
@@ -97,536 +168,665 @@ typedef struct VirtualTextCursortStruct
 {
 /* extends the sqlite3_vtab_cursor struct */
     VirtualTextPtr pVtab;	/* Virtual table of this cursor */
-    long current_row;		/* the current row ID */
+    sqlite3_int64 current_row;	/* the current row index (ROWNO - 1) */
+    sqlite3_int64 last_row;	/* the last row index wanted by the filter */
+    size_t parse_offset;	/* where the next cell of the row starts */
+    int row_parsed;		/* all the cells of the row are located */
+    int n_fields;		/* how many cells of the row are located */
+    struct text_field *fields;	/* the located cells */
+    char *value;		/* buffer of unquoted values */
+    size_t value_size;
+    char *utf8;			/* buffer of converted values */
+    size_t utf8_size;
     int eof;			/* the EOF marker */
 } VirtualTextCursor;
 typedef VirtualTextCursor *VirtualTextCursorPtr;
 
-static void
-text_insert_row (struct text_buffer *text, char **fields, int max_cell)
+static int
+text_grow (char **buffer, size_t * size, size_t needed)
 {
-/* inserting a row into the text buffer struct */
-    int i;
-    struct row_buffer *row = malloc (sizeof (struct row_buffer));
-    row->n_cells = max_cell + 1;
-    if (max_cell < 0)
-	row->cells = NULL;
-    else
+/* making a buffer large enough; 0 when out of memory */
+    char *p;
+    if (*size >= needed)
+	return 1;
+    p = realloc (*buffer, needed);
+    if (!p)
+	return 0;
+    *buffer = p;
+    *size = needed;
+    return 1;
+}
+
+static size_t
+text_field_end (struct text_buffer *text, size_t pos, int *row_end)
+{
+/* locating the end of the cell starting at pos: the offset of the field
+   separator or of the newline ending it, or the file size */
+    const char *p = text->map + pos;
+    const char *end = text->map + text->size;
+    int is_string = 0;
+    char c;
+    while (p < end)
       {
-	  row->cells = malloc (sizeof (char *) * (max_cell + 1));
-	  for (i = 0; i < row->n_cells; i++)
+	  c = *p;
+	  if (c == text->text_separator)
+	      is_string = !is_string;
+	  else if (!is_string)
 	    {
-		/* setting cell values */
-		*(row->cells + i) = *(fields + i);
+		if (c == text->field_separator)
+		  {
+		      *row_end = 0;
+		      return p - text->map;
+		  }
+		if (c == '\n')
+		  {
+		      *row_end = 1;
+		      return p - text->map;
+		  }
 	    }
+	  p++;
       }
-    row->next = NULL;
-/* inserting the row into the linked list */
-    if (!(text->first))
-	text->first = row;
-    if (text->last)
-	text->last->next = row;
-    text->last = row;
+    *row_end = 1;
+    return text->size;
 }
 
-static struct text_buffer *
-text_buffer_alloc ()
+static size_t
+text_row_end (struct text_buffer *text, size_t pos)
 {
-/* allocating and initializing the text buffer struct */
-    struct text_buffer *text = malloc (sizeof (struct text_buffer));
-    text->max_n_cells = 0;
-    text->titles = NULL;
-    text->types = NULL;
-    text->n_rows = 0;
-    text->rows = NULL;
-    text->first = NULL;
-    text->last = NULL;
-    return text;
-}
-
-static void
-text_buffer_free (struct text_buffer *text)
-{
-/* memory cleanup - freeing the text buffer */
-    int i;
-    struct row_buffer *row;
-    if (!text)
-	return;
-    row = text->first;
-    while (row)
+/* the offset following the row starting at pos; an odd count of text
+   separators before a newline leaves it inside a string */
+    const char *p = text->map + pos;
+    const char *end = text->map + text->size;
+    const char *nl;
+    const char *q;
+    int is_string = 0;
+    while (p < end)
       {
-	  for (i = 0; i < row->n_cells; i++)
+	  nl = memchr (p, '\n', end - p);
+	  if (!nl)
+	      return text->size;
+	  q = p;
+	  while ((q = memchr (q, text->text_separator, nl - q)) != NULL)
 	    {
-		if (*(row->cells + i))
-		    free (*(row->cells + i));
+		is_string = !is_string;
+		q++;
 	    }
-	  row = row->next;
+	  if (!is_string)
+	      return nl + 1 - text->map;
+	  p = nl + 1;
       }
-    if (text->types)
-	free (text->types);
-    free (text);
+    return text->size;
 }
 
 static int
-text_is_integer (char *value)
+text_unquote (struct text_buffer *text, struct text_field *field,
+	      char **buffer, size_t * size, const char **value, size_t * len)
 {
-/* checking if this value can be an INTEGER */
-    int invalids = 0;
-    int digits = 0;
-    int signs = 0;
+/* the value of a cell without text separators and carriage returns;
+   *len is 0 for an empty (NULL) cell. Returns 0 when out of memory */
+    const char *start = text->map + field->start;
+    size_t n = field->end - field->start;
+    size_t i;
+    int is_string = 0;
     char last = '\0';
-    char *p = value;
-    while (*p != '\0')
+    char c;
+    char *p;
+    if (!memchr (start, text->text_separator, n) && !memchr (start, '\r', n))
       {
-	  last = *p;
-	  if (*p >= '0' && *p <= '9')
-	      digits++;
-	  else if (*p == '+' || *p == '-')
-	      signs++;
-	  else
-	      signs++;
-	  p++;
+	  /* the common case: the value is right in the file */
+	  *value = start;
+	  *len = n;
+	  return 1;
       }
-    if (invalids)
-	return 0;
-    if (signs > 1)
+    if (!text_grow (buffer, size, n + 1))
 	return 0;
-    if (signs)
-      {
-	  if (*value == '+' || *value == '-' || last == '+' || last == '-')
-	      ;
-	  else
-	      return 0;
-      }
-    return 1;
-}
-
-static int
-text_is_double (char *value, char decimal_separator)
-{
-/* checking if this value can be a DOUBLE */
-    int invalids = 0;
-    int digits = 0;
-    int signs = 0;
-    int points = 0;
-    char last = '\0';
-    char *p = value;
-    while (*p != '\0')
+    p = *buffer;
+    for (i = 0; i < n; i++)
       {
-	  last = *p;
-	  if (*p >= '0' && *p <= '9')
-	      digits++;
-	  else if (*p == '+' || *p == '-')
-	      points++;
-	  else
+	  c = start[i];
+	  if (c == '\r' && !is_string)
+	    {
+		last = c;
+		continue;
+	    }
+	  if (c == text->text_separator)
 	    {
-		if (decimal_separator == ',')
+		if (is_string)
 		  {
-		      if (*p == ',')
-			  points++;
-		      else
-			  invalids++;
+		      is_string = 0;
+		      last = c;
 		  }
 		else
 		  {
-		      if (*p == '.')
-			  points++;
-		      else
-			  invalids++;
+		      /* a doubled text separator stands for itself */
+		      if (last == text->text_separator)
+			  *p++ = c;
+		      is_string = 1;
 		  }
+		continue;
 	    }
-	  p++;
+	  last = c;
+	  *p++ = c;
       }
-    if (invalids)
-	return 0;
-    if (points > 1)
-	return 0;
-    if (signs > 1)
-	return 0;
-    if (signs)
+    *value = *buffer;
+    *len = p - *buffer;
+    return 1;
+}
+
+static int
+text_to_utf8 (struct text_buffer *text, const char *value, size_t len,
+	      char **buffer, size_t * size, const char **out, size_t * out_len)
+{
+/* converting a value to UTF-8: 0 on success, 1 for an invalid
+   character, 2 when out of memory */
+    char *in = (char *) value;
+    char *p;
+    size_t in_left = len;
+    size_t out_left;
+    if (text->toUtf8 == (iconv_t) - 1)
       {
-	  if (*value == '+' || *value == '-' || last == '+' || last == '-')
-	      ;
-	  else
-	      return 0;
+	  *out = value;
+	  *out_len = len;
+	  return 0;
       }
-    return 1;
+    /* no single or double byte character takes more than 4 bytes in UTF-8 */
+    if (!text_grow (buffer, size, len * 4 + 4))
+	return 2;
+    p = *buffer;
+    out_left = *size;
+    iconv (text->toUtf8, NULL, NULL, NULL, NULL);
+    if (iconv (text->toUtf8, &in, &in_left, &p, &out_left) == (size_t) - 1)
+	return 1;
+    *out = *buffer;
+    *out_len = p - *buffer;
+    return 0;
 }
 
-static void
-text_clean_integer (char *value)
+static int
+text_value_type (const char *value, size_t len, char decimal_separator)
 {
-/* cleaning an integer value */
-    char last;
-    char buffer[35536];
-    int len = strlen (value);
-    last = value[len - 1];
-    if (last == '-' || last == '+')
+/* checking if this value can be an INTEGER or a DOUBLE; a sign may lead
+   or trail the digits */
+    size_t i = 0;
+    int digits = 0;
+    int points = 0;
+    if (len && (value[0] == '+' || value[0] == '-'))
+	i++;
+    else if (len && (value[len - 1] == '+' || value[len - 1] == '-'))
+	len--;
+    for (; i < len; i++)
       {
-	  /* trailing sign; transforming into a leading sign */
-	  *buffer = last;
-	  strcpy (buffer + 1, value);
-	  buffer[len - 1] = '\0';
-	  strcpy (value, buffer);
+	  if (value[i] >= '0' && value[i] <= '9')
+	      digits++;
+	  else if (value[i] == decimal_separator)
+	      points++;
+	  else
+	      return VRTTXT_TEXT;
       }
+    if (!digits || points > 1)
+	return VRTTXT_TEXT;
+    /* longer integers would overflow */
+    if (points || digits > 18)
+	return VRTTXT_DOUBLE;
+    return VRTTXT_INTEGER;
 }
 
 static void
-text_clean_double (char *value)
+text_result_number (sqlite3_context * pContext, const char *value,
+		    size_t len, int type, char decimal_separator)
 {
-/* cleaning an integer value */
-    char *p;
-    char last;
-    char buffer[35536];
-    int len = strlen (value);
-    last = value[len - 1];
-    if (last == '-' || last == '+')
+/* returning an INTEGER or DOUBLE value; a trailing sign becomes a leading
+   one and the decimal separator the one strtod() expects */
+    char buffer[128];
+    char point = *(localeconv ()->decimal_point);
+    sqlite3_int64 n = 0;
+    int negative = 0;
+    size_t i = 0;
+    char *p = buffer;
+    if (value[0] == '+' || value[0] == '-')
       {
-	  /* trailing sign; transforming into a leading sign */
-	  *buffer = last;
-	  strcpy (buffer + 1, value);
-	  buffer[len - 1] = '\0';
-	  strcpy (value, buffer);
+	  negative = value[0] == '-';
+	  i++;
       }
-    p = value;
-    while (*p != '\0')
+    else if (value[len - 1] == '+' || value[len - 1] == '-')
       {
-	  /* transforming COMMAs into POINTs */
-	  if (*p == ',')
-	      *p = '.';
-	  p++;
+	  negative = value[len - 1] == '-';
+	  len--;
       }
-}
-
-static int
-text_clean_text (char **value, void *toUtf8)
-{
-/* cleaning a TEXT value and converting to UTF-8 */
-    char *text = *value;
-    char *utf8text;
-    int err;
-    int i;
-    int oldlen = strlen (text);
-    int newlen;
-    for (i = oldlen - 1; i > 0; i++)
+    if (type == VRTTXT_INTEGER)
       {
-	  /* cleaning up trailing spaces */
-	  if (text[i] == ' ')
-	      text[i] = '\0';
-	  else
-	      break;
+	  for (; i < len; i++)
+	      n = n * 10 + (value[i] - '0');
+	  sqlite3_result_int64 (pContext, negative ? -n : n);
+	  return;
       }
-    utf8text = iconvConvertToUTF8 (toUtf8, text, oldlen, &err);
-    if (err)
-	return 1;
-    newlen = strlen (utf8text);
-    if (newlen <= oldlen)
-	strcpy (*value, utf8text);
-    else
+    if (len - i + 2 > sizeof (buffer))
       {
-	  free (*value);
-	  *value = malloc (newlen + 1);
-	  strcpy (*value, utf8text);
+	  sqlite3_result_text (pContext, value, len, SQLITE_TRANSIENT);
+	  return;
       }
-    return 0;
+    if (negative)
+	*p++ = '-';
+    for (; i < len; i++)
+	*p++ = value[i] == decimal_separator ? point : value[i];
+    *p = '\0';
+    sqlite3_result_double (pContext, strtod (buffer, NULL));
 }
 
-static struct text_buffer *
-text_parse (char *path, char *encoding, char first_line_titles,
-	    char field_separator, char text_separator, char decimal_separator)
+static void
+text_buffer_free (struct text_buffer *text)
 {
-/* trying to open and parse the text file */
-    int c;
-    int fld;
-    int len;
-    int max_cell;
-    int is_string = 0;
-    char last = '\0';
-    char *fields[4096];
-    char buffer[35536];
-    char *p = buffer;
-    struct text_buffer *text;
-    int nrows;
-    int ncols;
-    int errs;
-    struct row_buffer *row;
-    void *toUtf8;
-    int encoding_errors;
-    int ir;
-    char title[64];
-    char *first_valid_row;
+/* memory cleanup - unmapping the file and freeing the text buffer */
     int i;
-    char *name;
-    for (fld = 0; fld < 4096; fld++)
+    if (!text)
+	return;
+    if (text->map)
+	munmap ((void *) text->map, text->size);
+    if (text->fd >= 0)
+	close (text->fd);
+    if (text->titles)
       {
-	  /* preparing an empty row */
-	  fields[fld] = NULL;
+	  for (i = 0; i < text->max_n_cells; i++)
+	      free (*(text->titles + i));
+	  free (text->titles);
       }
-/* trying to open the text file */
-    FILE *in = fopen (path, "rb");
-    if (!in)
-	return NULL;
-    text = text_buffer_alloc ();
-    fld = 0;
-    while ((c = getc (in)) != EOF)
+    if (text->types)
+	free (text->types);
+    if (text->offsets)
+	free (text->offsets);
+    if (text->toUtf8 != (iconv_t) - 1)
+	iconv_close (text->toUtf8);
+    free (text);
+}
+
+static char **
+text_parse_titles (struct text_buffer *text, size_t * pos, int *n_titles)
+{
+/* reading the column names from the first line */
+    struct text_field field;
+    char **titles = NULL;
+    char *buffer = NULL;
+    size_t size = 0;
+    char *utf8 = NULL;
+    size_t utf8_size = 0;
+    const char *value;
+    size_t len;
+    int row_end = 0;
+    int n = 0;
+    size_t i;
+    char **p;
+    *n_titles = 0;
+    while (*pos < text->size && !row_end)
       {
-	  /* parsing the file, one char at each time */
-	  if (c == '\r' && !is_string)
-	    {
-		last = c;
-		continue;
-	    }
-	  if (c == field_separator && !is_string)
+	  field.start = *pos;
+	  field.end = text_field_end (text, *pos, &row_end);
+	  *pos = field.end < text->size ? field.end + 1 : text->size;
+	  p = realloc (titles, sizeof (char *) * (n + 1));
+	  if (!p)
+	      break;
+	  titles = p;
+	  titles[n] = NULL;
+	  if (text_unquote (text, &field, &buffer, &size, &value, &len)
+	      && text_to_utf8 (text, value, len, &utf8, &utf8_size, &value,
+			       &len) == 0)
 	    {
-		/* insering a field into the fields tmp array */
-		last = c;
-		*p = '\0';
-		len = strlen (buffer);
+		while (len && value[len - 1] == ' ')
+		    len--;
 		if (len)
 		  {
-		      fields[fld] = malloc (len + 1);
-		      strcpy (fields[fld], buffer);
+		      titles[n] = malloc (len + 1);
+		      if (titles[n])
+			{
+			    memcpy (titles[n], value, len);
+			    titles[n][len] = '\0';
+			    for (i = 0; i < len; i++)
+			      {
+				  /* masking any space in the column name */
+				  if (titles[n][i] == ' ')
+				      titles[n][i] = '_';
+			      }
+			}
 		  }
-		fld++;
-		p = buffer;
-		*p = '\0';
-		continue;
 	    }
-	  if (c == text_separator)
+	  n++;
+      }
+    free (buffer);
+    free (utf8);
+    *n_titles = n;
+    return titles;
+}
+
+static int
+text_build_index (struct text_buffer *text, int min_cells)
+{
+/* scanning the whole file once: counting the rows and cells, inferring
+   the column types and recording the row offsets; there are min_cells
+   columns at least */
+    struct text_field field;
+    size_t pos = text->data_start;
+    sqlite3_int64 n_offsets = 0;
+    sqlite3_int64 alloc_offsets = 0;
+    sqlite3_int64 *offsets;
+    int n_types = 0;
+    char *types;
+    char *buffer = NULL;
+    size_t size = 0;
+    const char *value;
+    size_t len;
+    int row_end;
+    int fld;
+    int last;
+    int type;
+#ifdef MADV_SEQUENTIAL
+    madvise ((void *) text->map, text->size, MADV_SEQUENTIAL);
+#endif
+    while (pos < text->size)
+      {
+	  if (text->n_rows % VRTTXT_INDEX_STEP == 0)
 	    {
-		/* found a text separator */
-		if (is_string)
-		  {
-		      is_string = 0;
-		      last = c;
-		  }
-		else
+		if (n_offsets == alloc_offsets)
 		  {
-		      if (last == text_separator)
-			  *p++ = text_separator;
-		      is_string = 1;
+		      alloc_offsets = alloc_offsets ? alloc_offsets * 2 : 256;
+		      offsets =
+			  realloc (text->offsets,
+				   sizeof (sqlite3_int64) * alloc_offsets);
+		      if (!offsets)
+			  goto nomem;
+		      text->offsets = offsets;
 		  }
-		continue;
+		text->offsets[n_offsets++] = pos;
 	    }
-	  last = c;
-	  if (c == '\n' && !is_string)
+	  fld = 0;
+	  last = -1;
+	  row_end = 0;
+	  while (!row_end)
 	    {
-		/* inserting the row into the text buffer */
-		*p = '\0';
-		len = strlen (buffer);
-		if (len)
+		field.start = pos;
+		field.end = text_field_end (text, pos, &row_end);
+		pos = field.end < text->size ? field.end + 1 : text->size;
+		if (field.end > field.start)
 		  {
-		      fields[fld] = malloc (len + 1);
-		      strcpy (fields[fld], buffer);
+		      if (!text_unquote
+			  (text, &field, &buffer, &size, &value, &len))
+			  goto nomem;
+		      if (len)
+			{
+			    if (fld >= n_types)
+			      {
+				  types = realloc (text->types, fld + 64);
+				  if (!types)
+				      goto nomem;
+				  memset (types + n_types, VRTTXT_NONE,
+					  fld + 64 - n_types);
+				  text->types = types;
+				  n_types = fld + 64;
+			      }
+			    if (text->types[fld] != VRTTXT_TEXT)
+			      {
+				  type =
+				      text_value_type (value, len,
+						       text->decimal_separator);
+				  if (type > text->types[fld])
+				      text->types[fld] = type;
+			      }
+			    last = fld;
+			}
 		  }
 		fld++;
-		p = buffer;
-		*p = '\0';
-		max_cell = -1;
-		for (fld = 0; fld < 4096; fld++)
-		  {
-		      if (fields[fld])
-			  max_cell = fld;
-		  }
-		text_insert_row (text, fields, max_cell);
-		for (fld = 0; fld < 4096; fld++)
-		  {
-		      /* resetting an empty row */
-		      fields[fld] = NULL;
-		  }
-		fld = 0;
-		continue;
 	    }
-	  *p++ = c;
+	  if (last + 1 > text->max_n_cells)
+	      text->max_n_cells = last + 1;
+	  text->n_rows++;
       }
-    fclose (in);
-/* checking if the text file really seems to contain a table */
-    nrows = 0;
-    ncols = 0;
-    errs = 0;
-    row = text->first;
-    while (row)
+#ifdef MADV_NORMAL
+    madvise ((void *) text->map, text->size, MADV_NORMAL);
+#endif
+    free (buffer);
+    if (min_cells > text->max_n_cells)
+	text->max_n_cells = min_cells;
+    if (text->max_n_cells > n_types)
       {
-	  if (first_line_titles && row == text->first)
-	    {
-		/* skipping first line */
-		row = row->next;
-		continue;
-	    }
-	  nrows++;
-	  if (row->n_cells > ncols)
-	      ncols = row->n_cells;
-	  row = row->next;
+	  types = realloc (text->types, text->max_n_cells);
+	  if (!types)
+	      return 0;
+	  memset (types + n_types, VRTTXT_NONE, text->max_n_cells - n_types);
+	  text->types = types;
       }
-    if (nrows == 0 && ncols == 0)
+    return 1;
+  nomem:
+    free (buffer);
+    return 0;
+}
+
+static int
+text_load_index (struct text_buffer *text, const char *path,
+		 const struct text_index_header *expected)
+{
+/* reading a row index saved by an earlier open of the same file */
+    struct text_index_header header;
+    sqlite3_int64 n_offsets;
+    int ok = 0;
+    FILE *in = fopen (path, "rb");
+    if (!in)
+	return 0;
+    if (fread (&header, sizeof (header), 1, in) != 1)
+	goto stop;
+    if (memcmp (header.magic, expected->magic, sizeof (header.magic)) != 0
+	|| header.version != expected->version
+	|| header.step != expected->step
+	|| header.file_size != expected->file_size
+	|| header.file_mtime != expected->file_mtime
+	|| header.data_start != expected->data_start
+	|| header.field_separator != expected->field_separator
+	|| header.text_separator != expected->text_separator
+	|| header.decimal_separator != expected->decimal_separator
+	|| header.first_line_titles != expected->first_line_titles
+	|| header.n_rows < 0 || header.max_n_cells < 0)
+	goto stop;
+    n_offsets = (header.n_rows + VRTTXT_INDEX_STEP - 1) / VRTTXT_INDEX_STEP;
+    text->types = malloc (header.max_n_cells + 1);
+    text->offsets = malloc (sizeof (sqlite3_int64) * (n_offsets + 1));
+    if (!text->types || !text->offsets)
+	goto stop;
+    if (fread (text->types, 1, header.max_n_cells, in) !=
+	(size_t) header.max_n_cells
+	|| fread (text->offsets, sizeof (sqlite3_int64), n_offsets,
+		  in) != (size_t) n_offsets)
+	goto stop;
+    if (n_offsets && (size_t) text->offsets[n_offsets - 1] >= text->size)
+	goto stop;
+    text->n_rows = header.n_rows;
+    text->max_n_cells = header.max_n_cells;
+    ok = 1;
+  stop:
+    fclose (in);
+    if (!ok)
       {
-	  text_buffer_free (text);
-	  return NULL;
+	  free (text->types);
+	  free (text->offsets);
+	  text->types = NULL;
+	  text->offsets = NULL;
       }
-    text->n_rows = nrows;
-/* going to check the column types */
-    text->max_n_cells = ncols;
-    text->types = malloc (sizeof (char) * text->max_n_cells);
-    first_valid_row = malloc (sizeof (char) * text->max_n_cells);
-    for (fld = 0; fld < text->max_n_cells; fld++)
+    return ok;
+}
+
+static void
+text_save_index (struct text_buffer *text, const char *path,
+		 const struct text_index_header *header)
+{
+/* saving the row index next to the file; silently skipped when the
+   directory is not writable */
+    sqlite3_int64 n_offsets =
+	(text->n_rows + VRTTXT_INDEX_STEP - 1) / VRTTXT_INDEX_STEP;
+    int ok;
+    FILE *out;
+    char *tmp = sqlite3_mprintf ("%s.tmp", path);
+    if (!tmp)
+	return;
+    out = fopen (tmp, "wb");
+    if (!out)
       {
-	  /* initally assuming any cell contains TEXT */
-	  *(text->types + fld) = VRTTXT_TEXT;
-	  *(first_valid_row + fld) = 1;
+	  sqlite3_free (tmp);
+	  return;
       }
-    row = text->first;
-    while (row)
+    ok = fwrite (header, sizeof (*header), 1, out) == 1
+	&& fwrite (text->types, 1, text->max_n_cells,
+		   out) == (size_t) text->max_n_cells
+	&& fwrite (text->offsets, sizeof (sqlite3_int64), n_offsets,
+		   out) == (size_t) n_offsets;
+    if (fclose (out) != 0)
+	ok = 0;
+    /* renaming makes a concurrent reader see a complete index or none */
+    if (!ok || rename (tmp, path) != 0)
+	remove (tmp);
+    sqlite3_free (tmp);
+}
+
+static struct text_buffer *
+text_parse (const char *path, const char *encoding, char first_line_titles,
+	    char field_separator, char text_separator, char decimal_separator)
+{
+/* mapping the text file and loading (or building) its row index */
+    struct text_buffer *text;
+    struct text_index_header header;
+    struct stat st;
+    char **titles = NULL;
+    int n_titles = 0;
+    char title[64];
+    char *index_path;
+    int fd;
+    int fld;
+    int is_utf8 = strcasecmp (encoding, "UTF-8") == 0
+	|| strcasecmp (encoding, "UTF8") == 0;
+    text = malloc (sizeof (struct text_buffer));
+    if (!text)
+	return NULL;
+    memset (text, 0, sizeof (struct text_buffer));
+    text->field_separator = field_separator;
+    text->text_separator = text_separator;
+    text->decimal_separator = decimal_separator;
+    text->toUtf8 = (iconv_t) - 1;
+    text->fd = -1;
+    if (!is_utf8)
       {
-	  if (first_line_titles && row == text->first)
-	    {
-		/* skipping first line */
-		row = row->next;
-		continue;
-	    }
-	  for (fld = 0; fld < row->n_cells; fld++)
+	  text->toUtf8 = iconv_open ("UTF-8", encoding);
+	  if (text->toUtf8 == (iconv_t) - 1)
 	    {
-		if (*(row->cells + fld))
-		  {
-		      if (text_is_integer (*(row->cells + fld)))
-			{
-			    if (*(first_valid_row + fld))
-			      {
-				  *(text->types + fld) = VRTTXT_INTEGER;
-				  *(first_valid_row + fld) = 0;
-			      }
-			}
-		      else if (text_is_double
-			       (*(row->cells + fld), decimal_separator))
-			{
-			    if (*(first_valid_row + fld))
-			      {
-				  *(text->types + fld) = VRTTXT_DOUBLE;
-				  *(first_valid_row + fld) = 0;
-			      }
-			    else
-			      {
-				  /* promoting an INTEGER column to be of the DOUBLE type */
-				  if (*(text->types + fld) == VRTTXT_INTEGER)
-				      *(text->types + fld) = VRTTXT_DOUBLE;
-			      }
-			}
-		      else
-			{
-			    /* this column is anyway of the TEXT type */
-			    *(text->types + fld) = VRTTXT_TEXT;
-			    if (*(first_valid_row + fld))
-				*(first_valid_row + fld) = 0;
-			}
-		  }
+		free (text);
+		return NULL;
 	    }
-	  row = row->next;
       }
-    free (first_valid_row);
-/* preparing the column names */
-    text->titles = malloc (sizeof (char *) * text->max_n_cells);
-    if (first_line_titles)
+/* trying to map the text file */
+    fd = open (path, O_RDONLY);
+    if (fd < 0)
       {
-	  for (fld = 0; fld < text->max_n_cells; fld++)
-	    {
-		if (fld >= text->first->n_cells)
-		  {
-		      /* this column name is NULL; setting a default name */
-		      sprintf (title, "COL%03d", fld + 1);
-		      len = strlen (title);
-		      *(text->titles + fld) = malloc (len + 1);
-		      strcpy (*(text->titles + fld), title);
-		  }
-		else
-		  {
-		      if (*(text->first->cells + fld))
-			{
-			    len = strlen (*(text->first->cells + fld));
-			    *(text->titles + fld) = malloc (len + 1);
-			    strcpy (*(text->titles + fld),
-				    *(text->first->cells + fld));
-			    name = *(text->titles + fld);
-			    for (i = 0; i < len; i++)
-			      {
-				  /* masking any space in the column name */
-				  if (*(name + i) == ' ')
-				      *(name + i) = '_';
-			      }
-			}
-		      else
-			{
-			    /* this column name is NULL; setting a default name */
-			    sprintf (title, "COL%03d", fld + 1);
-			    len = strlen (title);
-			    *(text->titles + fld) = malloc (len + 1);
-			    strcpy (*(text->titles + fld), title);
-			}
-		  }
-	    }
+	  text_buffer_free (text);
+	  return NULL;
       }
-    else
+    text->fd = fd;
+    if (fstat (fd, &st) != 0 || st.st_size == 0
+	|| (sqlite3_uint64) st.st_size > (size_t) - 1)
       {
-	  for (fld = 0; fld < text->max_n_cells; fld++)
-	    {
-		sprintf (title, "COL%03d", fld + 1);
-		len = strlen (title);
-		*(text->titles + fld) = malloc (len + 1);
-		strcpy (*(text->titles + fld), title);
-	    }
+	  text_buffer_free (text);
+	  return NULL;
       }
-/* cleaning cell values when needed */
-    toUtf8 = iconvCreateUTF8Converter (encoding);
-    if (!toUtf8)
+    text->map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (text->map == MAP_FAILED)
       {
+	  text->map = NULL;
 	  text_buffer_free (text);
 	  return NULL;
       }
-    encoding_errors = 0;
-    row = text->first;
-    while (row)
+    text->size = st.st_size;
+/* skipping a byte order mark */
+    if (is_utf8 && text->size >= 3 && memcmp (text->map, "\xEF\xBB\xBF", 3) == 0)
+	text->data_start = 3;
+    if (first_line_titles)
+	titles = text_parse_titles (text, &text->data_start, &n_titles);
+/* reusing the saved row index when the file has not been changed */
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, "VTXTIDX", 8);
+    header.version = VRTTXT_INDEX_VERSION;
+    header.step = VRTTXT_INDEX_STEP;
+    header.file_size = st.st_size;
+    header.file_mtime = st.st_mtime;
+    header.data_start = text->data_start;
+    header.field_separator = field_separator;
+    header.text_separator = text_separator;
+    header.decimal_separator = decimal_separator;
+    header.first_line_titles = first_line_titles;
+    index_path = sqlite3_mprintf ("%s%s", path, VRTTXT_INDEX_SUFFIX);
+    if (!index_path || !text_load_index (text, index_path, &header))
       {
-	  if (first_line_titles && row == text->first)
+	  if (!text_build_index (text, n_titles))
 	    {
-		/* skipping first line */
-		row = row->next;
-		continue;
+		sqlite3_free (index_path);
+		text->max_n_cells = 0;
+		goto error;
 	    }
-	  for (fld = 0; fld < row->n_cells; fld++)
+	  if (index_path)
 	    {
-		if (*(row->cells + fld))
-		  {
-		      if (*(text->types + fld) == VRTTXT_INTEGER)
-			  text_clean_integer (*(row->cells + fld));
-		      else if (*(text->types + fld) == VRTTXT_DOUBLE)
-			  text_clean_double (*(row->cells + fld));
-		      else
-			  encoding_errors +=
-			      text_clean_text (row->cells + fld, toUtf8);
-		  }
+		header.n_rows = text->n_rows;
+		header.max_n_cells = text->max_n_cells;
+		text_save_index (text, index_path, &header);
 	    }
-	  row = row->next;
       }
-    iconvFreeUTF8Converter (toUtf8);
-    if (encoding_errors)
+    sqlite3_free (index_path);
+/* checking if the text file really seems to contain a table */
+    if (text->max_n_cells == 0)
+	goto error;
+/* any column without values is TEXT */
+    for (fld = 0; fld < text->max_n_cells; fld++)
       {
-	  text_buffer_free (text);
-	  return NULL;
+	  if (*(text->types + fld) == VRTTXT_NONE)
+	      *(text->types + fld) = VRTTXT_TEXT;
       }
-/* ok, we can now go to prepare the rows array */
-    text->rows = malloc (sizeof (struct text_row *) * text->n_rows);
-    ir = 0;
-    row = text->first;
-    while (row)
+/* preparing the column names */
+    text->titles = malloc (sizeof (char *) * text->max_n_cells);
+    if (!text->titles)
+	goto error;
+    for (fld = 0; fld < text->max_n_cells; fld++)
       {
-	  if (first_line_titles && row == text->first)
+	  if (fld < n_titles && titles[fld])
 	    {
-		/* skipping first line */
-		row = row->next;
-		continue;
+		*(text->titles + fld) = titles[fld];
+		titles[fld] = NULL;
+	    }
+	  else
+	    {
+		/* this column name is NULL; setting a default name */
+		sprintf (title, "COL%03d", fld + 1);
+		*(text->titles + fld) = malloc (strlen (title) + 1);
+		if (*(text->titles + fld))
+		    strcpy (*(text->titles + fld), title);
 	    }
-	  *(text->rows + ir++) = row;
-	  row = row->next;
       }
+    for (fld = 0; fld < n_titles; fld++)
+	free (titles[fld]);
+    free (titles);
     return text;
+  error:
+    for (fld = 0; fld < n_titles; fld++)
+	free (titles[fld]);
+    free (titles);
+    text_buffer_free (text);
+    return NULL;
+}
+
+static void
+vtxt_dequote (const char *in, char *out, size_t size)
+{
+/* copying an argument, removing enclosing quotes */
+    size_t len = strlen (in);
+    if (len >= 2 && (in[0] == '\'' || in[0] == '"') && in[len - 1] == in[0])
+      {
+	  in++;
+	  len -= 2;
+      }
+    if (len >= size)
+	len = size - 1;
+    memcpy (out, in, len);
+    out[len] = '\0';
 }
 
 static int
@@ -637,50 +837,24 @@ vtxt_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     char path[2048];
     char encoding[128];
     const char *vtable;
-    const char *pEncoding = NULL;
-    int len;
     struct text_buffer *text = NULL;
-    const char *pPath = NULL;
     char field_separator = '\t';
     char text_separator = '"';
     char decimal_separator = '.';
     char first_line_titles = 1;
     int i;
-    char sql[4096];
+    char *sql;
     int seed;
     int dup;
     int idup;
-    char dummyName[4096];
-    char **col_name = NULL;
+    const char *name;
     VirtualTextPtr p_vt;
 /* checking for TEXTfile PATH */
     if (argc >= 5 && argc <= 9)
       {
-	  vtable = argv[1];
-	  pPath = argv[3];
-	  len = strlen (pPath);
-	  if (*(pPath + 0) == '\'' || *(pPath + 0) == '"' &&
-	      *(pPath + len - 1) == '\'' || *(pPath + len - 1) == '"')
-	    {
-		/* the path is enclosed between quotes - we need to dequote it */
-		strcpy (path, pPath + 1);
-		len = strlen (path);
-		*(path + len - 1) = '\0';
-	    }
-	  else
-	      strcpy (path, pPath);
-	  pEncoding = argv[4];
-	  len = strlen (pEncoding);
-	  if (*(pEncoding + 0) == '\'' || *(pEncoding + 0) == '"' &&
-	      *(pEncoding + len - 1) == '\'' || *(pEncoding + len - 1) == '"')
-	    {
-		/* the charset-name is enclosed between quotes - we need to dequote it */
-		strcpy (encoding, pEncoding + 1);
-		len = strlen (encoding);
-		*(encoding + len - 1) = '\0';
-	    }
-	  else
-	      strcpy (encoding, pEncoding);
+	  vtable = argv[2];
+	  vtxt_dequote (argv[3], path, sizeof (path));
+	  vtxt_dequote (argv[4], encoding, sizeof (encoding));
 	  if (argc >= 6)
 	    {
 		if (*(argv[5]) == '0' || *(argv[5]) == 'n' || *(argv[5]) == 'N')
@@ -728,75 +902,62 @@ vtxt_create (sqlite3 * db, void *pAux, int argc, const char *const *argv,
     if (!text)
       {
 	  /* something is going the wrong way; creating a stupid default table */
-	  sprintf (sql, "CREATE TABLE %s (ROWNO INTEGER)", vtable);
-	  if (sqlite3_declare_vtab (db, sql) != SQLITE_OK)
+	  sql = sqlite3_mprintf ("CREATE TABLE \"%w\" (ROWNO INTEGER)", vtable);
+	  if (!sql || sqlite3_declare_vtab (db, sql) != SQLITE_OK)
 	    {
+		sqlite3_free (sql);
+		sqlite3_free (p_vt);
 		*pzErr =
 		    sqlite3_mprintf
 		    ("[VirtualText module] cannot build a table from TEXT file\n");
 		return SQLITE_ERROR;
 	    }
+	  sqlite3_free (sql);
 	  p_vt->buffer = NULL;
 	  *ppVTab = (sqlite3_vtab *) p_vt;
 	  return SQLITE_OK;
       }
     p_vt->buffer = text;
 /* preparing the COLUMNs for this VIRTUAL TABLE */
-    sprintf (sql, "CREATE TABLE %s (ROWNO INTEGER", vtable);
-    col_name = malloc (sizeof (char *) * text->max_n_cells);
+    sql = sqlite3_mprintf ("CREATE TABLE \"%w\" (ROWNO INTEGER", vtable);
     seed = 0;
-    for (i = 0; i < text->max_n_cells; i++)
+    for (i = 0; sql && i < text->max_n_cells; i++)
       {
-	  strcat (sql, ", ");
-/*
-	  if (illegalSqlName (*(text->titles + i))
-	      || isReservedSqlName (*(text->titles + i))
-	      || isReservedSqliteName (*(text->titles + i)))
-	      sprintf (dummyName, "COL_%d", seed++);
-	  else
-	      strcpy (dummyName, *(text->titles + i));
-*/
-		sprintf (dummyName, "\"%s\"", *(text->titles + i));
-
-	  dup = 0;
-	  for (idup = 0; idup < i; idup++)
+	  name = *(text->titles + i);
+	  dup = name == NULL || strcasecmp (name, "ROWNO") == 0;
+	  for (idup = 0; !dup && idup < i; idup++)
 	    {
-		if (strcasecmp (dummyName, *(col_name + idup)) == 0)
+		if (*(text->titles + idup)
+		    && strcasecmp (name, *(text->titles + idup)) == 0)
 		    dup = 1;
 	    }
-	  if (strcasecmp (dummyName, "PKUID") == 0)
-	      dup = 1;
-	  if (strcasecmp (dummyName, "Geometry") == 0)
-	      dup = 1;
 	  if (dup)
-	      sprintf (dummyName, "COL_%d", seed++);
-	  len = strlen (dummyName);
-	  *(col_name + i) = malloc (len + 1);
-	  strcpy (*(col_name + i), dummyName);
-	  strcat (sql, dummyName);
+	      sql = sqlite3_mprintf ("%z, COL_%d", sql, seed++);
+	  else
+	      sql = sqlite3_mprintf ("%z, \"%w\"", sql, name);
+	  if (!sql)
+	      break;
 	  if (*(text->types + i) == VRTTXT_INTEGER)
-	      strcat (sql, " INTEGER");
+	      sql = sqlite3_mprintf ("%z INTEGER", sql);
 	  else if (*(text->types + i) == VRTTXT_DOUBLE)
-	      strcat (sql, " DOUBLE");
+	      sql = sqlite3_mprintf ("%z DOUBLE", sql);
 	  else
-	      strcat (sql, " TEXT");
-      }
-    strcat (sql, ")");
-    if (col_name)
-      {
-	  /* releasing memory allocation for column names */
-	  for (i = 0; i < text->max_n_cells; i++)
-	      free (*(col_name + i));
-	  free (col_name);
+	      sql = sqlite3_mprintf ("%z TEXT", sql);
       }
-    if (sqlite3_declare_vtab (db, sql) != SQLITE_OK)
+    if (sql)
+	sql = sqlite3_mprintf ("%z)", sql);
+    if (!sql || sqlite3_declare_vtab (db, sql) != SQLITE_OK)
       {
 	  *pzErr =
 	      sqlite3_mprintf
 	      ("[VirtualText module] CREATE VIRTUAL: invalid SQL statement \"%s\"",
-	       sql);
+	       sql ? sql : "");
+	  sqlite3_free (sql);
+	  text_buffer_free (text);
+	  sqlite3_free (p_vt);
 	  return SQLITE_ERROR;
       }
+    sqlite3_free (sql);
     *ppVTab = (sqlite3_vtab *) p_vt;
     return SQLITE_OK;
 }
@@ -805,14 +966,89 @@ static int
 vtxt_connect (sqlite3 * db, void *pAux, int argc, const char *const *argv,
 	      sqlite3_vtab ** ppVTab, char **pzErr)
 {
-/* connects the virtual table to some shapefile - simply aliases vshp_create() */
+/* connects the virtual table to some TEXT file - simply aliases vtxt_create() */
     return vtxt_create (db, pAux, argc, argv, ppVTab, pzErr);
 }
 
 static int
 vtxt_best_index (sqlite3_vtab * pVTab, sqlite3_index_info * pIndex)
 {
-/* best index selection */
+/* best index selection: equality and range constraints on ROWNO (or
+   ROWID) seek through the row index */
+    VirtualTextPtr p_vt = (VirtualTextPtr) pVTab;
+    const struct sqlite3_index_constraint *constraint;
+    double n_rows = p_vt->buffer ? (double) p_vt->buffer->n_rows : 0.0;
+    double rows = n_rows;
+    int eq = -1;
+    int lower = -1;
+    int upper = -1;
+    int arg = 1;
+    int i;
+    pIndex->idxNum = 0;
+    for (i = 0; i < pIndex->nConstraint; i++)
+      {
+	  constraint = pIndex->aConstraint + i;
+	  if (!constraint->usable
+	      || (constraint->iColumn != 0 && constraint->iColumn != -1))
+	      continue;
+	  switch (constraint->op)
+	    {
+	    case SQLITE_INDEX_CONSTRAINT_EQ:
+		if (eq < 0)
+		    eq = i;
+		break;
+	    case SQLITE_INDEX_CONSTRAINT_GT:
+	    case SQLITE_INDEX_CONSTRAINT_GE:
+		if (lower < 0)
+		    lower = i;
+		break;
+	    case SQLITE_INDEX_CONSTRAINT_LT:
+	    case SQLITE_INDEX_CONSTRAINT_LE:
+		if (upper < 0)
+		    upper = i;
+		break;
+	    }
+      }
+    if (eq >= 0)
+      {
+	  pIndex->idxNum |= VRTTXT_EQ;
+	  pIndex->aConstraintUsage[eq].argvIndex = arg++;
+	  pIndex->aConstraintUsage[eq].omit = 1;
+	  rows = 1.0;
+      }
+    if (lower >= 0)
+      {
+	  pIndex->idxNum |=
+	      pIndex->aConstraint[lower].op ==
+	      SQLITE_INDEX_CONSTRAINT_GT ? VRTTXT_GT : VRTTXT_GE;
+	  pIndex->aConstraintUsage[lower].argvIndex = arg++;
+	  pIndex->aConstraintUsage[lower].omit = 1;
+	  rows /= 3.0;
+      }
+    if (upper >= 0)
+      {
+	  pIndex->idxNum |=
+	      pIndex->aConstraint[upper].op ==
+	      SQLITE_INDEX_CONSTRAINT_LT ? VRTTXT_LT : VRTTXT_LE;
+	  pIndex->aConstraintUsage[upper].argvIndex = arg++;
+	  pIndex->aConstraintUsage[upper].omit = 1;
+	  rows /= 3.0;
+      }
+    /* a seek skips up to VRTTXT_INDEX_STEP rows */
+    if (pIndex->idxNum)
+	pIndex->estimatedCost = rows + VRTTXT_INDEX_STEP / 2;
+    else
+	pIndex->estimatedCost = n_rows + VRTTXT_INDEX_STEP;
+#if SQLITE_VERSION_NUMBER >= 3008002
+    if (sqlite3_libversion_number () >= 3008002)
+	pIndex->estimatedRows = (sqlite3_int64) rows + 1;
+#endif
+    /* the rows come in ROWNO order */
+    if (pIndex->nOrderBy == 1
+	&& (pIndex->aOrderBy[0].iColumn == 0
+	    || pIndex->aOrderBy[0].iColumn == -1)
+	&& !pIndex->aOrderBy[0].desc)
+	pIndex->orderByConsumed = 1;
     return SQLITE_OK;
 }
 
@@ -838,16 +1074,26 @@ static int
 vtxt_open (sqlite3_vtab * pVTab, sqlite3_vtab_cursor ** ppCursor)
 {
 /* opening a new cursor */
+    VirtualTextPtr p_vt = (VirtualTextPtr) pVTab;
     VirtualTextCursorPtr cursor =
 	(VirtualTextCursorPtr) sqlite3_malloc (sizeof (VirtualTextCursor));
     if (cursor == NULL)
 	return SQLITE_NOMEM;
-    cursor->pVtab = (VirtualTextPtr) pVTab;
-    cursor->current_row = 0;
-    cursor->eof = 0;
+    memset (cursor, 0, sizeof (VirtualTextCursor));
+    cursor->pVtab = p_vt;
+    cursor->eof = 1;
+    if (p_vt->buffer)
+      {
+	  cursor->fields =
+	      malloc (sizeof (struct text_field) *
+		      p_vt->buffer->max_n_cells);
+	  if (!cursor->fields)
+	    {
+		sqlite3_free (cursor);
+		return SQLITE_NOMEM;
+	    }
+      }
     *ppCursor = (sqlite3_vtab_cursor *) cursor;
-    if (!(cursor->pVtab->buffer))
-	cursor->eof = 1;
     return SQLITE_OK;
 }
 
@@ -856,15 +1102,155 @@ vtxt_close (sqlite3_vtab_cursor * pCursor)
 {
 /* closing the cursor */
     VirtualTextCursorPtr cursor = (VirtualTextCursorPtr) pCursor;
+    free (cursor->fields);
+    free (cursor->value);
+    free (cursor->utf8);
     sqlite3_free (pCursor);
     return SQLITE_OK;
 }
 
+static void
+vtxt_row_start (VirtualTextCursorPtr cursor, size_t pos)
+{
+/* positioning the cursor at a row, no cell located yet */
+    cursor->parse_offset = pos;
+    cursor->row_parsed = 0;
+    cursor->n_fields = 0;
+    cursor->eof = pos >= cursor->pVtab->buffer->size;
+}
+
+static void
+vtxt_bound (sqlite3_value * value, int op, sqlite3_int64 * first,
+	    sqlite3_int64 * last)
+{
+/* narrowing the ROWNO range [first, last] by a constraint */
+    sqlite3_int64 lo;
+    sqlite3_int64 hi;
+    double d;
+    switch (sqlite3_value_numeric_type (value))
+      {
+      case SQLITE_INTEGER:
+	  lo = hi = sqlite3_value_int64 (value);
+	  break;
+      case SQLITE_FLOAT:
+	  d = sqlite3_value_double (value);
+	  if (d < -(double) VRTTXT_MAX_ROWNO)
+	      d = -(double) VRTTXT_MAX_ROWNO;
+	  if (d > (double) VRTTXT_MAX_ROWNO)
+	      d = (double) VRTTXT_MAX_ROWNO;
+	  /* ceil() and floor() */
+	  lo = hi = (sqlite3_int64) d;
+	  if (d > (double) lo)
+	      lo++;
+	  if (d < (double) hi)
+	      hi--;
+	  break;
+      case SQLITE_NULL:
+	  /* nothing compares to NULL */
+	  *last = 0;
+	  return;
+      default:
+	  /* TEXT and BLOB values sort after any number */
+	  if (op != SQLITE_INDEX_CONSTRAINT_LT
+	      && op != SQLITE_INDEX_CONSTRAINT_LE)
+	      *last = 0;
+	  return;
+      }
+    if (lo < -VRTTXT_MAX_ROWNO)
+	lo = -VRTTXT_MAX_ROWNO;
+    if (lo > VRTTXT_MAX_ROWNO)
+	lo = VRTTXT_MAX_ROWNO;
+    if (hi < -VRTTXT_MAX_ROWNO)
+	hi = -VRTTXT_MAX_ROWNO;
+    if (hi > VRTTXT_MAX_ROWNO)
+	hi = VRTTXT_MAX_ROWNO;
+    switch (op)
+      {
+      case SQLITE_INDEX_CONSTRAINT_EQ:
+	  if (lo != hi)
+	      *last = 0;
+	  if (lo > *first)
+	      *first = lo;
+	  if (hi < *last)
+	      *last = hi;
+	  break;
+      case SQLITE_INDEX_CONSTRAINT_GT:
+	  if (hi + 1 > *first)
+	      *first = hi + 1;
+	  break;
+      case SQLITE_INDEX_CONSTRAINT_GE:
+	  if (lo > *first)
+	      *first = lo;
+	  break;
+      case SQLITE_INDEX_CONSTRAINT_LT:
+	  if (lo - 1 < *last)
+	      *last = lo - 1;
+	  break;
+      case SQLITE_INDEX_CONSTRAINT_LE:
+	  if (hi < *last)
+	      *last = hi;
+	  break;
+      }
+}
+
+static int
+vtxt_check_size (VirtualTextCursorPtr cursor)
+{
+/* checking that the mapped file is not truncated; reading a page of the
+   map beyond the end of the file would raise SIGBUS */
+    struct text_buffer *text = cursor->pVtab->buffer;
+    struct stat st;
+    if (fstat (text->fd, &st) == 0
+	&& (sqlite3_uint64) st.st_size >= (sqlite3_uint64) text->size)
+	return SQLITE_OK;
+    cursor->eof = 1;
+    sqlite3_free (cursor->pVtab->zErrMsg);
+    cursor->pVtab->zErrMsg =
+	sqlite3_mprintf ("[VirtualText module] the file has been truncated");
+    return SQLITE_IOERR;
+}
+
 static int
 vtxt_filter (sqlite3_vtab_cursor * pCursor, int idxNum, const char *idxStr,
 	     int argc, sqlite3_value ** argv)
 {
-/* setting up a cursor filter */
+/* setting up a cursor filter: seeking to the first wanted row */
+    VirtualTextCursorPtr cursor = (VirtualTextCursorPtr) pCursor;
+    struct text_buffer *text = cursor->pVtab->buffer;
+    sqlite3_int64 first = 1;
+    sqlite3_int64 last;
+    sqlite3_int64 row;
+    size_t pos;
+    int i = 0;
+    cursor->eof = 1;
+    if (!text)
+	return SQLITE_OK;
+    last = text->n_rows;
+    if (idxNum & VRTTXT_EQ)
+	vtxt_bound (argv[i++], SQLITE_INDEX_CONSTRAINT_EQ, &first, &last);
+    if (idxNum & VRTTXT_GT)
+	vtxt_bound (argv[i++], SQLITE_INDEX_CONSTRAINT_GT, &first, &last);
+    if (idxNum & VRTTXT_GE)
+	vtxt_bound (argv[i++], SQLITE_INDEX_CONSTRAINT_GE, &first, &last);
+    if (idxNum & VRTTXT_LT)
+	vtxt_bound (argv[i++], SQLITE_INDEX_CONSTRAINT_LT, &first, &last);
+    if (idxNum & VRTTXT_LE)
+	vtxt_bound (argv[i++], SQLITE_INDEX_CONSTRAINT_LE, &first, &last);
+    if (first > last)
+	return SQLITE_OK;
+    if (vtxt_check_size (cursor) != SQLITE_OK)
+	return SQLITE_IOERR;
+    /* the nearest indexed row, then skipping the rest */
+    row = (first - 1) / VRTTXT_INDEX_STEP * VRTTXT_INDEX_STEP;
+    pos = *(text->offsets + (first - 1) / VRTTXT_INDEX_STEP);
+    while (row < first - 1 && pos < text->size)
+      {
+	  pos = text_row_end (text, pos);
+	  row++;
+      }
+    cursor->current_row = row;
+    cursor->last_row = last - 1;
+    vtxt_row_start (cursor, pos);
     return SQLITE_OK;
 }
 
@@ -873,14 +1259,22 @@ vtxt_next (sqlite3_vtab_cursor * pCursor)
 {
 /* fetching next row from cursor */
     VirtualTextCursorPtr cursor = (VirtualTextCursorPtr) pCursor;
-    if (!(cursor->pVtab->buffer))
+    struct text_buffer *text = cursor->pVtab->buffer;
+    size_t pos;
+    if (!text || cursor->current_row >= cursor->last_row)
       {
 	  cursor->eof = 1;
 	  return SQLITE_OK;
       }
+    if (vtxt_check_size (cursor) != SQLITE_OK)
+	return SQLITE_IOERR;
+    /* the unparsed rest of the row is only searched for its end */
+    if (cursor->row_parsed)
+	pos = cursor->parse_offset;
+    else
+	pos = text_row_end (text, cursor->parse_offset);
     cursor->current_row++;
-    if (cursor->current_row >= cursor->pVtab->buffer->n_rows)
-	cursor->eof = 1;
+    vtxt_row_start (cursor, pos);
     return SQLITE_OK;
 }
 
@@ -896,57 +1290,77 @@ static int
 vtxt_column (sqlite3_vtab_cursor * pCursor, sqlite3_context * pContext,
 	     int column)
 {
-/* fetching value for the Nth column */
-    struct row_buffer *row;
-    int nCol = 1;
-    int i;
+/* fetching value for the Nth column, locating the cells up to it */
     VirtualTextCursorPtr cursor = (VirtualTextCursorPtr) pCursor;
     struct text_buffer *text = cursor->pVtab->buffer;
+    struct text_field *field;
+    const char *value;
+    size_t len;
+    int fld = column - 1;
+    int type;
+    int row_end;
     if (column == 0)
       {
 	  /* the ROWNO column */
-	  sqlite3_result_int (pContext, cursor->current_row + 1);
+	  sqlite3_result_int64 (pContext, cursor->current_row + 1);
 	  return SQLITE_OK;
       }
-    row = *(text->rows + cursor->current_row);
-    for (i = 0; i < text->max_n_cells; i++)
+    while (cursor->n_fields <= fld && !cursor->row_parsed)
       {
-	  if (nCol == column)
-	    {
-		if (i >= row->n_cells)
-		    sqlite3_result_null (pContext);
-		else
-		  {
-		      if (*(row->cells + i))
-			{
-			    if (*(text->types + i) == VRTTXT_INTEGER)
-				sqlite3_result_int (pContext,
-						    atoi (*(row->cells + i)));
-			    else if (*(text->types + i) == VRTTXT_DOUBLE)
-				sqlite3_result_double (pContext,
-						       atof (*
-							     (row->cells + i)));
-			    else
-				sqlite3_result_text (pContext,
-						     *(row->cells + i),
-						     strlen (*(row->cells + i)),
-						     SQLITE_STATIC);
-			}
-		      else
-			  sqlite3_result_null (pContext);
-		  }
-	    }
-	  nCol++;
+	  field = cursor->fields + cursor->n_fields++;
+	  field->start = cursor->parse_offset;
+	  field->end = text_field_end (text, field->start, &row_end);
+	  cursor->parse_offset =
+	      field->end < text->size ? field->end + 1 : text->size;
+	  cursor->row_parsed = row_end;
+      }
+    if (fld >= cursor->n_fields)
+      {
+	  sqlite3_result_null (pContext);
+	  return SQLITE_OK;
+      }
+    if (!text_unquote
+	(text, cursor->fields + fld, &cursor->value, &cursor->value_size,
+	 &value, &len))
+	return SQLITE_NOMEM;
+    if (!len)
+      {
+	  sqlite3_result_null (pContext);
+	  return SQLITE_OK;
+      }
+    type = *(text->types + fld);
+    /* a file changed behind the saved index may not fit the column type */
+    if (type != VRTTXT_TEXT
+	&& text_value_type (value, len, text->decimal_separator) <= type)
+      {
+	  text_result_number (pContext, value, len, type,
+			      text->decimal_separator);
+	  return SQLITE_OK;
+      }
+    while (len && value[len - 1] == ' ')
+	len--;
+    switch (text_to_utf8
+	    (text, value, len, &cursor->utf8, &cursor->utf8_size, &value,
+	     &len))
+      {
+      case 1:
+	  sqlite3_result_error (pContext,
+				"[VirtualText module] invalid character for the file encoding",
+				-1);
+	  return SQLITE_OK;
+      case 2:
+	  return SQLITE_NOMEM;
       }
+    sqlite3_result_text (pContext, value, len, SQLITE_TRANSIENT);
     return SQLITE_OK;
 }
 
 static int
 vtxt_rowid (sqlite3_vtab_cursor * pCursor, sqlite_int64 * pRowid)
 {
-/* fetching the ROWID */
+/* fetching the ROWID, the same as ROWNO */
     VirtualTextCursorPtr cursor = (VirtualTextCursorPtr) pCursor;
-    *pRowid = cursor->current_row;
+    *pRowid = cursor->current_row + 1;
     return SQLITE_OK;
 }
 
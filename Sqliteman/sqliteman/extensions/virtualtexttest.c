@@ -0,0 +1,185 @@
+/*
+Checks of the VirtualText module of virtualtext.c, see
+virtualtexttest.pro. The module is compiled in. The text files are
+written to the current directory and removed at the end.
+
+The cases cover quoting and separators, seeking by ROWNO through the
+sparse row index, the reuse and the rebuild of the saved index, and a
+file truncated while a query reads it.
+*/
+
+#include <sqlite3.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SMALL "virtualtexttest-small.csv"
+#define BIG "virtualtexttest-big.csv"
+#define BIG_ROWS 5000
+
+int sqlite3VirtualTextInit(sqlite3 *db);
+
+static int nFail = 0;
+static int nCheck = 0;
+
+
+static void writeFile(const char *zPath, const char *zText, int n){
+  FILE *f = fopen(zPath, "wb");
+  if( !f ){
+    perror(zPath);
+    exit(1);
+  }
+  fwrite(zText, 1, n, f);
+  fclose(f);
+}
+
+static void writeBig(int nRow){
+  FILE *f = fopen(BIG, "wb");
+  int i;
+  if( !f ){
+    perror(BIG);
+    exit(1);
+  }
+  fprintf(f, "id;name;val\n");
+  for(i=0; i<nRow; i++)
+    fprintf(f, "%d;\"n;%d\";%d,5\n", i, i, i);
+  fclose(f);
+}
+
+/* the first column of the first row of zSql as text, or the error */
+static void check(sqlite3 *db, const char *zSql, const char *zExpected){
+  sqlite3_stmt *pStmt = 0;
+  const char *zGot = 0;
+  int rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+  ++nCheck;
+  if( rc==SQLITE_OK ){
+    rc = sqlite3_step(pStmt);
+    if( rc==SQLITE_ROW )
+      zGot = (const char *)sqlite3_column_text(pStmt, 0);
+  }
+  if( rc!=SQLITE_ROW && rc!=SQLITE_DONE )
+    zGot = sqlite3_errmsg(db);
+  if( strcmp(zGot ? zGot : "NULL", zExpected)!=0 ){
+    printf("FAIL %s\n  got      %s\n  expected %s\n", zSql, zGot ? zGot : "NULL", zExpected);
+    ++nFail;
+  }
+  sqlite3_finalize(pStmt);
+}
+
+static void exec(sqlite3 *db, const char *zSql){
+  if( sqlite3_exec(db, zSql, 0, 0, 0)!=SQLITE_OK ){
+    printf("FAIL %s\n  %s\n", zSql, sqlite3_errmsg(db));
+    ++nFail;
+  }
+}
+
+static sqlite3 *openDb(void){
+  sqlite3 *db;
+  sqlite3_open(":memory:", &db);
+  sqlite3VirtualTextInit(db);
+  return db;
+}
+
+static void checkParsing(void){
+  static const char zText[] =
+    "a,b,c\r\n"
+    "1,\"x\r\ny\",3\r\n"
+    "2,,\r\n"
+    "\"q\"\"uote\",5\r\n"
+    "4,5,6,7\r\n"
+    "last,1.5,2";
+  sqlite3 *db = openDb();
+  writeFile(SMALL, zText, sizeof(zText) - 1);
+  exec(db, "CREATE VIRTUAL TABLE t USING VirtualText('" SMALL "', 'UTF-8', 1, POINT, DOUBLEQUOTE, ',')");
+  check(db, "SELECT group_concat(name, '|') FROM pragma_table_info('t')", "ROWNO|a|b|c|COL004");
+  check(db, "SELECT count(*) FROM t", "5");
+  /* a quoted separator and line break, empty and missing cells */
+  check(db, "SELECT b FROM t WHERE rowno = 1", "x\r\ny");
+  check(db, "SELECT quote(b) || quote(c) FROM t WHERE rowno = 2", "NULLNULL");
+  check(db, "SELECT a FROM t WHERE rowno = 3", "q\"uote");
+  /* a surplus cell makes a column of its own, the last line needs no
+  ** line break */
+  check(db, "SELECT a || b || c || COL004 FROM t WHERE rowno = 4", "4567");
+  check(db, "SELECT count(COL004) FROM t", "1");
+  check(db, "SELECT b + c FROM t WHERE rowno = 5", "3.5");
+  check(db, "SELECT group_concat(rowid) FROM t WHERE rowno BETWEEN 2 AND 4", "2,3,4");
+  sqlite3_close(db);
+}
+
+static void checkIndex(void){
+  sqlite3 *db = openDb();
+  char zExpected[64];
+  writeBig(BIG_ROWS);
+  unlink(BIG ".vtidx");
+  exec(db, "CREATE VIRTUAL TABLE t USING VirtualText('" BIG "', 'UTF-8', 1, COMMA, DOUBLEQUOTE, ';')");
+  sqlite3_snprintf(sizeof(zExpected), zExpected, "%d", BIG_ROWS);
+  check(db, "SELECT count(*) FROM t", zExpected);
+  check(db, "SELECT typeof(id) || typeof(name) || typeof(val) FROM t WHERE rowno = 1",
+        "integertextreal");
+  /* rows on both sides of the offsets kept every 1024 rows */
+  check(db, "SELECT group_concat(id) FROM t WHERE rowno IN (1, 1024, 1025, 2048, 2049)",
+        "0,1023,1024,2047,2048");
+  check(db, "SELECT name FROM t WHERE rowno = 4990", "n;4989");
+  check(db, "SELECT group_concat(rowno) FROM t WHERE rowno > 4997", "4998,4999,5000");
+  check(db, "SELECT group_concat(rowno) FROM (SELECT rowno FROM t WHERE rowno >= 3 AND rowno < 5 ORDER BY rowno DESC)", "4,3");
+  check(db, "SELECT count(*) FROM t WHERE rowno < 1 OR rowno > 5000", "0");
+  check(db, "SELECT count(*) FROM t WHERE rowno = 1.5", "0");
+  check(db, "SELECT id FROM t WHERE rowno = '3'", "2");
+  check(db, "SELECT sum(val) FROM t", "12500000.0");
+  check(db, "SELECT count(*) FROM t WHERE name = 'n;' || id", zExpected);
+  sqlite3_close(db);
+
+  /* the saved index is reused */
+  if( access(BIG ".vtidx", F_OK)!=0 ){
+    printf("FAIL the row index is not saved\n");
+    ++nFail;
+  }
+  db = openDb();
+  exec(db, "CREATE VIRTUAL TABLE t USING VirtualText('" BIG "', 'UTF-8', 1, COMMA, DOUBLEQUOTE, ';')");
+  check(db, "SELECT id FROM t WHERE rowno = 3000", "2999");
+  sqlite3_close(db);
+
+  /* a changed file is scanned again */
+  writeBig(BIG_ROWS + 10);
+  db = openDb();
+  exec(db, "CREATE VIRTUAL TABLE t USING VirtualText('" BIG "', 'UTF-8', 1, COMMA, DOUBLEQUOTE, ';')");
+  check(db, "SELECT count(*) FROM t", "5010");
+  check(db, "SELECT id FROM t WHERE rowno = 5010", "5009");
+  sqlite3_close(db);
+}
+
+static void checkTruncated(void){
+  sqlite3 *db = openDb();
+  sqlite3_stmt *pStmt = 0;
+  int rc;
+  int n = 0;
+  writeBig(BIG_ROWS);
+  exec(db, "CREATE VIRTUAL TABLE t USING VirtualText('" BIG "', 'UTF-8', 1, COMMA, DOUBLEQUOTE, ';')");
+  sqlite3_prepare_v2(db, "SELECT name FROM t", -1, &pStmt, 0);
+  while( (rc = sqlite3_step(pStmt))==SQLITE_ROW ){
+    if( ++n==10 && truncate(BIG, 100)!=0 )
+      perror(BIG);
+  }
+  ++nCheck;
+  if( rc!=SQLITE_IOERR || n!=10 ){
+    printf("FAIL a truncated file: rc %d after %d rows, expected %d after 10 rows\n",
+           rc, n, SQLITE_IOERR);
+    ++nFail;
+  }
+  sqlite3_finalize(pStmt);
+  sqlite3_close(db);
+}
+
+int main(void){
+  checkParsing();
+  checkIndex();
+  checkTruncated();
+  unlink(SMALL);
+  unlink(SMALL ".vtidx");
+  unlink(BIG);
+  unlink(BIG ".vtidx");
+  printf("%d checks, %d failures\n", nCheck, nFail);
+  return nFail ? 1 : 0;
+}
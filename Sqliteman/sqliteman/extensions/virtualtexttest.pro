@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = virtualtexttest
+DEPENDPATH += .
+INCLUDEPATH += .
+CONFIG -= qt
+DEFINES += SQLITE_CORE SQLITE_ENABLE_VIRTUALTEXT
+LIBS += -lsqlite3
+
+CONFIG += console
+
+# Input
+SOURCES += virtualtexttest.c virtualtext.c
@@ -0,0 +1,462 @@
+/*
+This library provides fast non-cryptographic hashes for fingerprinting
+data, e.g. to verify that a copy of a table is equal to its original.
+The hash is XXH64 (xxHash, 64 bits), several times faster than md5()
+of md5.c. It is not a protection against deliberate collisions.
+
+Functions:
+	xxh64(x)
+	xxh64(x, seed)
+		XXH64 of a text or blob as an integer. Numbers are hashed
+		as their text, NULL gives NULL
+	row_hash(x1, x2, ...)
+		hash of the types and values of all arguments in order.
+		Text is hashed as UTF-8 in any database encoding; 1 and 1.0
+		have different hashes
+	table_hash(x1, x2, ...)
+		aggregate: hash of the set of rows, not depending on the order
+		of the rows. The row_hash() of every row are added (modulo 2^64)
+		and the sum is hashed with the count of rows. Empty sets have
+		a hash too
+	table_hash_range(table, from, to)
+	table_hash_range(table, from, to, schema)
+		table_hash(rowid, <all columns>) of the rows of table with
+		rowid between from and to (both included); NULL from or to
+		is not limited. The same as
+			SELECT table_hash(rowid, c1, c2, ...) FROM table
+				WHERE rowid BETWEEN from AND to;
+		so the ranges of two copies of a large table can be compared
+		one by one
+
+For example a table in two attached databases:
+	SELECT (SELECT table_hash(rowid, a, b) FROM main.t)
+		== (SELECT table_hash(rowid, a, b) FROM copy.t);
+
+Compile with
+	gcc -O2 -fPIC -shared xxhash.c -o libsqlitexxhash.so
+*/
+
+#if !defined(SQLITE_CORE) || defined(SQLITE_ENABLE_XXHASH)
+
+#ifndef SQLITE_CORE
+  #include "sqlite3ext.h"
+  SQLITE_EXTENSION_INIT1
+#else
+  #include "sqlite3.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uint8_t u8;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef sqlite3_int64 i64;
+
+#define LARGEST_ROWID  ((i64)(((u64)1<<63)-1))
+#define SMALLEST_ROWID (-LARGEST_ROWID-1)
+
+#ifndef SQLITE_DETERMINISTIC
+  #define SQLITE_DETERMINISTIC 0
+#endif
+
+
+/*
+** XXH64, streaming. Written after the specification of xxHash by
+** Yann Collet (BSD license): four lanes of 8 byte words, a tail of
+** 8, 4 and 1 byte steps and the final avalanche.
+*/
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME3 0x165667B19E3779F9ULL
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME5 0x27D4EB2F165667C5ULL
+
+typedef struct Xxh64 Xxh64;
+struct Xxh64 {
+  u64 nTotal;          /* bytes hashed so far */
+  u64 v[4];            /* the lanes */
+  u64 seed;
+  u8 aBuf[32];         /* input not yet hashed by the lanes */
+  int nBuf;
+};
+
+static u64 xxhRotl(u64 x, int r){
+  return (x<<r) | (x>>(64-r));
+}
+
+/* Little endian loads. Compilers turn them into single loads. */
+static u64 xxhRead64(const u8 *p){
+  return (u64)p[0] | ((u64)p[1]<<8) | ((u64)p[2]<<16) | ((u64)p[3]<<24)
+      | ((u64)p[4]<<32) | ((u64)p[5]<<40) | ((u64)p[6]<<48) | ((u64)p[7]<<56);
+}
+static u32 xxhRead32(const u8 *p){
+  return (u32)p[0] | ((u32)p[1]<<8) | ((u32)p[2]<<16) | ((u32)p[3]<<24);
+}
+
+static u64 xxhRound(u64 acc, u64 input){
+  acc += input * XXH_PRIME2;
+  acc = xxhRotl(acc, 31);
+  return acc * XXH_PRIME1;
+}
+
+static u64 xxhMerge(u64 acc, u64 v){
+  acc ^= xxhRound(0, v);
+  return acc * XXH_PRIME1 + XXH_PRIME4;
+}
+
+static void xxhInit(Xxh64 *h, u64 seed){
+  h->nTotal = 0;
+  h->seed = seed;
+  h->v[0] = seed + XXH_PRIME1 + XXH_PRIME2;
+  h->v[1] = seed + XXH_PRIME2;
+  h->v[2] = seed;
+  h->v[3] = seed - XXH_PRIME1;
+  h->nBuf = 0;
+}
+
+/* Hash full 32 byte stripes of p, return the number of bytes used. */
+static int xxhStripes(Xxh64 *h, const u8 *p, int n){
+  const u8 *pStart = p;
+  u64 v0 = h->v[0], v1 = h->v[1], v2 = h->v[2], v3 = h->v[3];
+  while( n>=32 ){
+    v0 = xxhRound(v0, xxhRead64(p));
+    v1 = xxhRound(v1, xxhRead64(p+8));
+    v2 = xxhRound(v2, xxhRead64(p+16));
+    v3 = xxhRound(v3, xxhRead64(p+24));
+    p += 32;
+    n -= 32;
+  }
+  h->v[0] = v0; h->v[1] = v1; h->v[2] = v2; h->v[3] = v3;
+  return (int)(p - pStart);
+}
+
+static void xxhUpdate(Xxh64 *h, const void *pData, int n){
+  const u8 *p = (const u8*)pData;
+  int k;
+  if( n<=0 ) return;
+  h->nTotal += (u64)n;
+  if( h->nBuf+n<32 ){
+    memcpy(h->aBuf+h->nBuf, p, n);
+    h->nBuf += n;
+    return;
+  }
+  if( h->nBuf ){
+    k = 32 - h->nBuf;
+    memcpy(h->aBuf+h->nBuf, p, k);
+    xxhStripes(h, h->aBuf, 32);
+    p += k;
+    n -= k;
+    h->nBuf = 0;
+  }
+  k = xxhStripes(h, p, n);
+  p += k;
+  n -= k;
+  if( n ){
+    memcpy(h->aBuf, p, n);
+    h->nBuf = n;
+  }
+}
+
+static u64 xxhDigest(const Xxh64 *h){
+  const u8 *p = h->aBuf;
+  int n = h->nBuf;
+  u64 acc;
+  if( h->nTotal>=32 ){
+    acc = xxhRotl(h->v[0], 1) + xxhRotl(h->v[1], 7)
+        + xxhRotl(h->v[2], 12) + xxhRotl(h->v[3], 18);
+    acc = xxhMerge(acc, h->v[0]);
+    acc = xxhMerge(acc, h->v[1]);
+    acc = xxhMerge(acc, h->v[2]);
+    acc = xxhMerge(acc, h->v[3]);
+  }else{
+    acc = h->seed + XXH_PRIME5;
+  }
+  acc += h->nTotal;
+  while( n>=8 ){
+    acc ^= xxhRound(0, xxhRead64(p));
+    acc = xxhRotl(acc, 27) * XXH_PRIME1 + XXH_PRIME4;
+    p += 8;
+    n -= 8;
+  }
+  if( n>=4 ){
+    acc ^= (u64)xxhRead32(p) * XXH_PRIME1;
+    acc = xxhRotl(acc, 23) * XXH_PRIME2 + XXH_PRIME3;
+    p += 4;
+    n -= 4;
+  }
+  while( n>0 ){
+    acc ^= (*p) * XXH_PRIME5;
+    acc = xxhRotl(acc, 11) * XXH_PRIME1;
+    p++;
+    n--;
+  }
+  acc ^= acc >> 33;
+  acc *= XXH_PRIME2;
+  acc ^= acc >> 29;
+  acc *= XXH_PRIME3;
+  acc ^= acc >> 32;
+  return acc;
+}
+
+
+/*
+** Row hashes. Every value is hashed as a type tag followed by the value:
+** integers and reals as 8 bytes little endian, text and blobs as their
+** length and bytes, so the concatenation of the values is unambiguous.
+*/
+
+#define HASH_NULL    0
+#define HASH_INTEGER 1
+#define HASH_FLOAT   2
+#define HASH_TEXT    3
+#define HASH_BLOB    4
+
+static void hashWord(Xxh64 *h, u8 tag, u64 x){
+  u8 a[9];
+  int i;
+  a[0] = tag;
+  for(i=1; i<9; i++){
+    a[i] = (u8)x;
+    x >>= 8;
+  }
+  xxhUpdate(h, a, 9);
+}
+
+static void hashBytes(Xxh64 *h, u8 tag, const void *p, int n){
+  hashWord(h, tag, (u64)n);
+  xxhUpdate(h, p, n);
+}
+
+static void hashValue(Xxh64 *h, sqlite3_value *pVal){
+  u8 tag;
+  double r;
+  u64 x;
+  switch( sqlite3_value_type(pVal) ){
+    case SQLITE_INTEGER:
+      hashWord(h, HASH_INTEGER, (u64)sqlite3_value_int64(pVal));
+      break;
+    case SQLITE_FLOAT:
+      r = sqlite3_value_double(pVal);
+      memcpy(&x, &r, 8);
+      hashWord(h, HASH_FLOAT, x);
+      break;
+    case SQLITE_TEXT:
+      tag = HASH_TEXT;
+      hashBytes(h, tag, sqlite3_value_text(pVal), sqlite3_value_bytes(pVal));
+      break;
+    case SQLITE_BLOB:
+      tag = HASH_BLOB;
+      hashBytes(h, tag, sqlite3_value_blob(pVal), sqlite3_value_bytes(pVal));
+      break;
+    default:
+      tag = HASH_NULL;
+      xxhUpdate(h, &tag, 1);
+      break;
+  }
+}
+
+/* The same as hashValue() for a column of a statement. The values of
+** sqlite3_column_value() are unprotected and not for general use.
+*/
+static void hashColumn(Xxh64 *h, sqlite3_stmt *pStmt, int i){
+  u8 tag;
+  double r;
+  u64 x;
+  switch( sqlite3_column_type(pStmt, i) ){
+    case SQLITE_INTEGER:
+      hashWord(h, HASH_INTEGER, (u64)sqlite3_column_int64(pStmt, i));
+      break;
+    case SQLITE_FLOAT:
+      r = sqlite3_column_double(pStmt, i);
+      memcpy(&x, &r, 8);
+      hashWord(h, HASH_FLOAT, x);
+      break;
+    case SQLITE_TEXT:
+      tag = HASH_TEXT;
+      hashBytes(h, tag, sqlite3_column_text(pStmt, i), sqlite3_column_bytes(pStmt, i));
+      break;
+    case SQLITE_BLOB:
+      tag = HASH_BLOB;
+      hashBytes(h, tag, sqlite3_column_blob(pStmt, i), sqlite3_column_bytes(pStmt, i));
+      break;
+    default:
+      tag = HASH_NULL;
+      xxhUpdate(h, &tag, 1);
+      break;
+  }
+}
+
+static u64 rowHash(int argc, sqlite3_value **argv){
+  Xxh64 h;
+  int i;
+  xxhInit(&h, 0);
+  for(i=0; i<argc; i++){
+    hashValue(&h, argv[i]);
+  }
+  return xxhDigest(&h);
+}
+
+
+/*
+** The order independent set hash: the sum of the row hashes is
+** commutative, and hashing it with the count makes the result change
+** when a row is duplicated in a way that sums to the same value.
+*/
+
+typedef struct SetHash SetHash;
+struct SetHash {
+  u64 sum;
+  i64 nRow;
+};
+
+static void setHashAdd(SetHash *p, u64 rowHash){
+  p->sum += rowHash;
+  p->nRow++;
+}
+
+static i64 setHashResult(const SetHash *p){
+  Xxh64 h;
+  xxhInit(&h, 0);
+  hashWord(&h, HASH_INTEGER, p->sum);
+  hashWord(&h, HASH_INTEGER, (u64)p->nRow);
+  return (i64)xxhDigest(&h);
+}
+
+
+static void xxh64Func(sqlite3_context *context, int argc, sqlite3_value **argv){
+  Xxh64 h;
+  u64 seed = 0;
+  int n;
+  const void *p;
+  if( sqlite3_value_type(argv[0])==SQLITE_NULL ) return;
+  if( argc>1 ) seed = (u64)sqlite3_value_int64(argv[1]);
+  if( sqlite3_value_type(argv[0])==SQLITE_BLOB ){
+    p = sqlite3_value_blob(argv[0]);
+  }else{
+    p = sqlite3_value_text(argv[0]);
+  }
+  n = sqlite3_value_bytes(argv[0]);
+  xxhInit(&h, seed);
+  xxhUpdate(&h, p, n);
+  sqlite3_result_int64(context, (i64)xxhDigest(&h));
+}
+
+static void rowHashFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  sqlite3_result_int64(context, (i64)rowHash(argc, argv));
+}
+
+static void tableHashStep(sqlite3_context *context, int argc, sqlite3_value **argv){
+  SetHash *p = (SetHash*)sqlite3_aggregate_context(context, sizeof(SetHash));
+  if( p==0 ) return;
+  setHashAdd(p, rowHash(argc, argv));
+}
+
+static void tableHashFinalize(sqlite3_context *context){
+  SetHash empty = { 0, 0 };
+  SetHash *p = (SetHash*)sqlite3_aggregate_context(context, 0);
+  sqlite3_result_int64(context, setHashResult(p ? p : &empty));
+}
+
+static void tableHashRangeFunc(sqlite3_context *context, int argc, sqlite3_value **argv){
+  sqlite3 *db = sqlite3_context_db_handle(context);
+  const char *zTable = (const char*)sqlite3_value_text(argv[0]);
+  const char *zSchema = argc>3 ? (const char*)sqlite3_value_text(argv[3]) : 0;
+  SetHash set = { 0, 0 };
+  sqlite3_stmt *pStmt = 0;
+  char *zSql;
+  Xxh64 h;
+  int nCol, i, rc;
+
+  if( zTable==0 ){
+    sqlite3_result_error(context, "table_hash_range(): no table name", -1);
+    return;
+  }
+  if( zSchema ){
+    zSql = sqlite3_mprintf("SELECT rowid, * FROM \"%w\".\"%w\""
+                           " WHERE rowid BETWEEN ?1 AND ?2", zSchema, zTable);
+  }else{
+    zSql = sqlite3_mprintf("SELECT rowid, * FROM \"%w\""
+                           " WHERE rowid BETWEEN ?1 AND ?2", zTable);
+  }
+  if( zSql==0 ){
+    sqlite3_result_error_nomem(context);
+    return;
+  }
+  rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  if( rc==SQLITE_OK ){
+    /* the limits of the rowids for NULL, so the range is searched in the b-tree */
+    if( sqlite3_value_type(argv[1])==SQLITE_NULL ){
+      sqlite3_bind_int64(pStmt, 1, SMALLEST_ROWID);
+    }else{
+      sqlite3_bind_value(pStmt, 1, argv[1]);
+    }
+    if( sqlite3_value_type(argv[2])==SQLITE_NULL ){
+      sqlite3_bind_int64(pStmt, 2, LARGEST_ROWID);
+    }else{
+      sqlite3_bind_value(pStmt, 2, argv[2]);
+    }
+    nCol = sqlite3_column_count(pStmt);
+    while( (rc = sqlite3_step(pStmt))==SQLITE_ROW ){
+      xxhInit(&h, 0);
+      for(i=0; i<nCol; i++){
+        hashColumn(&h, pStmt, i);
+      }
+      setHashAdd(&set, xxhDigest(&h));
+    }
+    if( rc==SQLITE_DONE ) rc = SQLITE_OK;
+  }
+  if( rc==SQLITE_OK ){
+    sqlite3_result_int64(context, setHashResult(&set));
+  }else{
+    sqlite3_result_error(context, sqlite3_errmsg(db), -1);
+  }
+  sqlite3_finalize(pStmt);
+}
+
+
+/* SQLite invokes this routine once when it loads the extension.
+** Create new functions, collating sequences, and virtual table
+** modules here.  This is usually the only exported symbol in
+** the shared library.
+*/
+
+int sqlite3XxhashInit(sqlite3 *db){
+  static const struct {
+    const char *zName;
+    int nArg;
+    int eTextRep;
+    void (*xFunc)(sqlite3_context*,int,sqlite3_value**);
+  } aFuncs[] = {
+    { "xxh64",            1, SQLITE_UTF8|SQLITE_DETERMINISTIC, xxh64Func },
+    { "xxh64",            2, SQLITE_UTF8|SQLITE_DETERMINISTIC, xxh64Func },
+    { "row_hash",        -1, SQLITE_UTF8|SQLITE_DETERMINISTIC, rowHashFunc },
+    { "table_hash_range", 3, SQLITE_UTF8,                      tableHashRangeFunc },
+    { "table_hash_range", 4, SQLITE_UTF8,                      tableHashRangeFunc },
+  };
+  int i;
+  int rc = SQLITE_OK;
+  for(i=0; rc==SQLITE_OK && i<(int)(sizeof(aFuncs)/sizeof(aFuncs[0])); i++){
+    rc = sqlite3_create_function(db, aFuncs[i].zName, aFuncs[i].nArg, aFuncs[i].eTextRep,
+                                 0, aFuncs[i].xFunc, 0, 0);
+  }
+  if( rc==SQLITE_OK )
+    rc = sqlite3_create_function(db, "table_hash", -1, SQLITE_UTF8, 0,
+                                 0, tableHashStep, tableHashFinalize);
+  return rc;
+}
+
+#if !SQLITE_CORE
+int sqlite3_extension_init(
+  sqlite3 *db,
+  char **pzErrMsg,
+  const sqlite3_api_routines *pApi
+){
+  SQLITE_EXTENSION_INIT2(pApi)
+  return sqlite3XxhashInit(db);
+}
+#endif
+
+#endif
@@ -0,0 +1,191 @@
+/*
+Checks of the hash functions of xxhash.c, see xxhashtest.pro. The
+extension is compiled in.
+
+xxh64() is compared with reference values of the xxHash library, on
+inputs shorter and longer than one 32 byte stripe. The row and table
+hashes are checked for the properties they promise: the type and the
+order of the values count, the order of the rows does not, and
+table_hash_range() equals table_hash() of the same rows. The hashes of
+a UTF-16 database must equal the ones of a UTF-8 database.
+*/
+
+#include <sqlite3.h>
+
+#include <stdio.h>
+#include <string.h>
+
+int sqlite3XxhashInit(sqlite3 *db);
+
+typedef struct HashCase HashCase;
+struct HashCase {
+  const char *zSql;
+  const char *zExpected;
+};
+
+static const HashCase aCase[] = {
+  /* reference values of XXH64, as signed integers */
+  { "SELECT xxh64('')", "-1205034819632174695" },
+  { "SELECT xxh64('a')", "-3292477735350538661" },
+  { "SELECT xxh64('abc')", "4952883123889572249" },
+  { "SELECT xxh64('abc', 1)", "-4708009277469325048" },
+  { "SELECT xxh64('0123456789abcdef0123456789abcdef')", "7217744722875508421" },
+  { "SELECT xxh64('Nobody inspects the spammish repetition')", "-302119147016844303" },
+  { "SELECT xxh64('Příliš žluťoučký kůň')", "2584759120314280894" },
+  /* blobs are their bytes, numbers their text */
+  { "SELECT xxh64(X'616263') = xxh64('abc')", "1" },
+  { "SELECT xxh64(12345)", "-4110991663024418890" },
+  { "SELECT xxh64(1.5)", "8474032230287774941" },
+  { "SELECT quote(xxh64(NULL))", "NULL" },
+
+  /* row_hash: types, order and the borders of the values count */
+  { "SELECT typeof(row_hash(NULL))", "integer" },
+  { "SELECT row_hash(1, 'a', X'00', 2.5, NULL) = row_hash(1, 'a', X'00', 2.5, NULL)", "1" },
+  { "SELECT row_hash(1) = row_hash(1.0)", "0" },
+  { "SELECT row_hash(1) = row_hash('1')", "0" },
+  { "SELECT row_hash('a') = row_hash(X'61')", "0" },
+  { "SELECT row_hash(NULL) = row_hash('')", "0" },
+  { "SELECT row_hash(1, 2) = row_hash(2, 1)", "0" },
+  { "SELECT row_hash('a', 'bc') = row_hash('ab', 'c')", "0" },
+  { "SELECT row_hash(1, NULL) = row_hash(1)", "0" },
+  { "SELECT row_hash(-0.0) = row_hash(0.0)", "0" },
+  { "SELECT row_hash(zeroblob(100000)) = row_hash(zeroblob(100001))", "0" },
+
+  /* table_hash: the set of rows */
+  { "SELECT (SELECT table_hash(rowid, a, b) FROM (SELECT rowid, a, b FROM t ORDER BY a))"
+    " = (SELECT table_hash(rowid, a, b) FROM (SELECT rowid, a, b FROM t ORDER BY a DESC))", "1" },
+  { "SELECT (SELECT table_hash(a, b) FROM t) = (SELECT table_hash(a, b) FROM t WHERE rowid < 1000)",
+    "0" },
+  { "SELECT (SELECT table_hash(a) FROM t WHERE rowid IN (1, 2))"
+    " = (SELECT table_hash(a) FROM t WHERE rowid IN (2, 1))", "1" },
+  { "SELECT (SELECT table_hash(a) FROM (SELECT 1 AS a UNION ALL SELECT 1))"
+    " = (SELECT table_hash(a) FROM (SELECT 1 AS a))", "0" },
+  { "SELECT typeof(table_hash(a)) FROM t WHERE 0", "integer" },
+  { "SELECT (SELECT table_hash(a) FROM t WHERE 0) = (SELECT table_hash(a, b) FROM t WHERE 0)",
+    "1" },
+
+  /* table_hash_range: the same as table_hash() of the range */
+  { "SELECT table_hash_range('t', NULL, NULL) = (SELECT table_hash(rowid, a, b) FROM t)", "1" },
+  { "SELECT table_hash_range('t', 100, 199)"
+    " = (SELECT table_hash(rowid, a, b) FROM t WHERE rowid BETWEEN 100 AND 199)", "1" },
+  { "SELECT table_hash_range('t', NULL, 10)"
+    " = (SELECT table_hash(rowid, a, b) FROM t WHERE rowid <= 10)", "1" },
+  { "SELECT table_hash_range('t', 1001, NULL) = (SELECT table_hash(rowid) FROM t WHERE 0)", "1" },
+  { "SELECT table_hash_range('t', NULL, NULL, 'main') = table_hash_range('t', NULL, NULL)", "1" },
+  { "SELECT table_hash_range('t', NULL, NULL, 'other') = table_hash_range('t', NULL, NULL)", "1" },
+  { "SELECT table_hash_range('u', NULL, NULL, 'other')", "no such table: other.u" },
+  { "SELECT table_hash_range('t', 5, 5) = table_hash_range('t', 5, 5, 'changed')", "1" },
+  { "SELECT table_hash_range('t', 6, 6) = table_hash_range('t', 6, 6, 'changed')", "0" },
+  { "SELECT table_hash_range(NULL, 1, 2)", "table_hash_range(): no table name" },
+
+  { 0, 0 }
+};
+
+/* the first column of the first row of zSql as text, or the error */
+static int check(sqlite3 *db, const char *zSql, const char *zExpected){
+  sqlite3_stmt *pStmt = 0;
+  const char *zGot = 0;
+  int rc = sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0);
+  int ok;
+  if( rc==SQLITE_OK ){
+    rc = sqlite3_step(pStmt);
+    if( rc==SQLITE_ROW )
+      zGot = (const char *)sqlite3_column_text(pStmt, 0);
+  }
+  if( rc!=SQLITE_ROW && rc!=SQLITE_DONE )
+    zGot = sqlite3_errmsg(db);
+  ok = strcmp(zGot ? zGot : "NULL", zExpected)==0;
+  if( !ok )
+    printf("FAIL %s\n  got      %s\n  expected %s\n", zSql, zGot ? zGot : "NULL", zExpected);
+  sqlite3_finalize(pStmt);
+  return ok;
+}
+
+static sqlite3_int64 queryInt(sqlite3 *db, const char *zSql){
+  sqlite3_stmt *pStmt = 0;
+  sqlite3_int64 r = 0;
+  if( sqlite3_prepare_v2(db, zSql, -1, &pStmt, 0)==SQLITE_OK
+   && sqlite3_step(pStmt)==SQLITE_ROW ){
+    r = sqlite3_column_int64(pStmt, 0);
+  }
+  sqlite3_finalize(pStmt);
+  return r;
+}
+
+static const char zFill[] =
+  "CREATE TABLE t(a, b);"
+  "WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i+1 FROM c WHERE i<1000)"
+  " INSERT INTO t SELECT i, CASE i % 4 WHEN 0 THEN 'Příliš ' || i WHEN 1 THEN i * 0.5"
+  " WHEN 2 THEN randomblob(i % 50) ELSE NULL END FROM c;";
+
+int main(void){
+  sqlite3 *db;
+  sqlite3 *db16;
+  sqlite3_stmt *pStmt = 0;
+  const HashCase *p;
+  unsigned char aBlob[1027];
+  int nCase = 0;
+  int nFail = 0;
+  int i;
+
+  sqlite3_open(":memory:", &db);
+  sqlite3XxhashInit(db);
+  sqlite3_exec(db, zFill, 0, 0, 0);
+  sqlite3_exec(db, "ATTACH ':memory:' AS other;"
+                   "CREATE TABLE other.t AS SELECT * FROM main.t;"
+                   "ATTACH ':memory:' AS changed;"
+                   "CREATE TABLE changed.t AS SELECT * FROM main.t;"
+                   "UPDATE changed.t SET a = a + 1 WHERE rowid = 6;", 0, 0, 0);
+  for(p=aCase; p->zSql; p++, nCase++){
+    if( !check(db, p->zSql, p->zExpected) )
+      ++nFail;
+  }
+
+  /* a blob of many stripes and a tail of 3 bytes */
+  for(i=0; i<(int)sizeof(aBlob); i++)
+    aBlob[i] = i<1024 ? (unsigned char)i : (unsigned char)("xyz"[i - 1024]);
+  sqlite3_prepare_v2(db, "SELECT xxh64(?1)", -1, &pStmt, 0);
+  sqlite3_bind_blob(pStmt, 1, aBlob, sizeof(aBlob), SQLITE_STATIC);
+  ++nCase;
+  if( sqlite3_step(pStmt)!=SQLITE_ROW
+   || sqlite3_column_int64(pStmt, 0)!=(sqlite3_int64)0xe146cb31b65bc21aULL ){
+    printf("FAIL xxh64 of a blob of 1027 bytes\n");
+    ++nFail;
+  }
+  sqlite3_finalize(pStmt);
+
+  /* the text of a UTF-16 database is hashed as UTF-8 */
+  sqlite3_open(":memory:", &db16);
+  sqlite3XxhashInit(db16);
+  sqlite3_exec(db16, "PRAGMA encoding = 'UTF-16le'", 0, 0, 0);
+  sqlite3_exec(db16, "CREATE TABLE t(a, b)", 0, 0, 0);
+  pStmt = 0;
+  sqlite3_prepare_v2(db, "SELECT a, b FROM t", -1, &pStmt, 0);
+  while( sqlite3_step(pStmt)==SQLITE_ROW ){
+    sqlite3_stmt *pInsert = 0;
+    sqlite3_prepare_v2(db16, "INSERT INTO t VALUES(?1, ?2)", -1, &pInsert, 0);
+    sqlite3_bind_value(pInsert, 1, sqlite3_column_value(pStmt, 0));
+    sqlite3_bind_value(pInsert, 2, sqlite3_column_value(pStmt, 1));
+    sqlite3_step(pInsert);
+    sqlite3_finalize(pInsert);
+  }
+  sqlite3_finalize(pStmt);
+  nCase += 3;
+  if( !check(db16, "PRAGMA encoding", "UTF-16le") )
+    ++nFail;
+  if( queryInt(db, "SELECT table_hash(rowid, a, b) FROM t")
+      !=queryInt(db16, "SELECT table_hash(rowid, a, b) FROM t") ){
+    printf("FAIL table_hash() of a UTF-16 database\n");
+    ++nFail;
+  }
+  if( queryInt(db, "SELECT table_hash_range('t', NULL, NULL)")
+      !=queryInt(db16, "SELECT table_hash_range('t', NULL, NULL)") ){
+    printf("FAIL table_hash_range() of a UTF-16 database\n");
+    ++nFail;
+  }
+  sqlite3_close(db16);
+  sqlite3_close(db);
+
+  printf("%d cases, %d failures\n", nCase, nFail);
+  return nFail ? 1 : 0;
+}
@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = xxhashtest
+DEPENDPATH += .
+INCLUDEPATH += .
+CONFIG -= qt
+DEFINES += SQLITE_CORE SQLITE_ENABLE_XXHASH
+LIBS += -lsqlite3
+
+CONFIG += console
+
+# Input
+SOURCES += xxhashtest.c xxhash.c
@@ -0,0 +1,318 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QApplication>
+#include <QRegExp>
+#include <QSettings>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QSqlRecord>
+
+#include "foreignkeyauditdialog.h"
+#include "database.h"
+#include "utils.h"
+
+// auditTree columns
+#define COL_DATABASE 0
+#define COL_TABLE 1
+#define COL_COLUMNS 2
+#define COL_PARENT 3
+#define COL_ROWS 4
+#define COL_INDEX 5
+
+
+//! \brief Lower case and sorted; the order of the key columns in an index does not matter.
+static QStringList normalized(const QStringList & columns)
+{
+	QStringList ret;
+	foreach (QString column, columns)
+		ret.append(column.toLower());
+	ret.sort();
+	return ret;
+}
+
+
+ForeignKeyAuditDialog::ForeignKeyAuditDialog(QWidget * parent)
+	: QDialog(parent),
+	  update(false)
+{
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("fkaudit/height", QVariant(400)).toInt();
+	int ww = settings.value("fkaudit/width", QVariant(650)).toInt();
+	resize(ww, hh);
+	ui.showCoveredCheckBox->setChecked(settings.value("fkaudit/showCovered",
+										QVariant(false)).toBool());
+
+	audit();
+
+	connect(ui.createButton, SIGNAL(clicked()), this, SLOT(createButton_clicked()));
+	connect(ui.showCoveredCheckBox, SIGNAL(toggled(bool)),
+			this, SLOT(showCoveredCheckBox_toggled(bool)));
+	connect(ui.auditTree, SIGNAL(itemChanged(QTreeWidgetItem *, int)),
+			this, SLOT(auditTree_itemChanged(QTreeWidgetItem *, int)));
+}
+
+ForeignKeyAuditDialog::~ForeignKeyAuditDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+    settings.setValue("fkaudit/height", QVariant(height()));
+    settings.setValue("fkaudit/width", QVariant(width()));
+	settings.setValue("fkaudit/showCovered", QVariant(ui.showCoveredCheckBox->isChecked()));
+}
+
+QList<QStringList> ForeignKeyAuditDialog::tableIndexes(const QString & schema,
+													   const QString & table,
+													   QStringList & names)
+{
+	QList<QStringList> indexes;
+	QStringList candidates;
+	ForwardQuery query(QString("PRAGMA %1.index_list(%2);")
+					   .arg(Utils::quote(schema))
+					   .arg(Utils::quote(table)));
+	while (query.next())
+	{
+		// a partial index does not hold all rows (reported since sqlite 3.8.9)
+		if (query.record().count() > 4 && query.value(4).toInt())
+			continue;
+		candidates.append(query.value(1).toString());
+	}
+
+	names.clear();
+	foreach (QString index, candidates)
+	{
+		QStringList columns(Database::indexFields(index, schema));
+		// only the columns before an expression are usable for a lookup
+		int expression = columns.indexOf(QString());
+		if (expression >= 0)
+			columns = columns.mid(0, expression);
+		if (columns.isEmpty())
+			continue;
+		indexes.append(columns);
+		names.append(index);
+	}
+
+	// an INTEGER PRIMARY KEY is the rowid; the table itself is its index
+	QStringList primaryKey;
+	QString type;
+	ForwardQuery info(QString("PRAGMA %1.table_info(%2);")
+					  .arg(Utils::quote(schema))
+					  .arg(Utils::quote(table)));
+	while (info.next())
+	{
+		if (info.value(5).toInt() == 0)
+			continue;
+		primaryKey.append(info.value(1).toString());
+		type = info.value(2).toString();
+	}
+	if (primaryKey.count() == 1 && type.toUpper() == "INTEGER")
+	{
+		indexes.append(primaryKey);
+		names.append(tr("(rowid)"));
+	}
+	return indexes;
+}
+
+QVariant ForeignKeyAuditDialog::estimateRows(const QString & schema, const QString & table,
+											 bool hasStat, QString & source)
+{
+	if (hasStat)
+	{
+		// stat starts with the row count of the table
+		ForwardQuery query(
+					QString("SELECT max(cast(stat as integer)) FROM %1.sqlite_stat1 "
+							"WHERE tbl = %2;")
+					.arg(Utils::quote(schema)).arg(Utils::literal(table)));
+		if (query.next() && !query.value(0).isNull())
+		{
+			source = tr("sqlite_stat1");
+			return query.value(0).toLongLong();
+		}
+	}
+	// the largest rowid is read from the b-tree without a scan
+	ForwardQuery query(QString("SELECT max(rowid) FROM %1.%2;")
+					   .arg(Utils::quote(schema))
+					   .arg(Utils::quote(table)));
+	if (!query.lastError().isValid() && query.next() && !query.value(0).isNull())
+	{
+		source = tr("the largest rowid");
+		return query.value(0).toLongLong();
+	}
+	return QVariant();
+}
+
+void ForeignKeyAuditDialog::audit()
+{
+	disconnect(ui.auditTree, SIGNAL(itemChanged(QTreeWidgetItem *, int)),
+			   this, SLOT(auditTree_itemChanged(QTreeWidgetItem *, int)));
+	ui.auditTree->setSortingEnabled(false);
+	ui.auditTree->clear();
+	int keys = 0;
+	int missing = 0;
+
+	QStringList databases(Database::getDatabases().keys());
+	foreach (QString schema, databases)
+	{
+		ForwardQuery query(
+				QString("SELECT 1 FROM %1 WHERE type = 'table' AND name = 'sqlite_stat1';")
+				.arg(Database::getMaster(schema)));
+		bool hasStat = query.next();
+
+		QStringList tables(Database::getObjects("table", schema).keys());
+		foreach (QString table, tables)
+		{
+			// id -> child columns in key order, id -> parent table
+			QMap<int,QStringList> columns;
+			QMap<int,QString> parents;
+			ForwardQuery keys(QString("PRAGMA %1.foreign_key_list(%2);")
+							  .arg(Utils::quote(schema))
+							  .arg(Utils::quote(table)));
+			while (keys.next())
+			{
+				int id = keys.value(0).toInt();
+				parents[id] = keys.value(2).toString();
+				columns[id].append(keys.value(3).toString());
+			}
+			if (columns.isEmpty())
+				continue;
+
+			QStringList names;
+			QList<QStringList> indexes(tableIndexes(schema, table, names));
+			QString source;
+			QVariant rows(estimateRows(schema, table, hasStat, source));
+
+			QMapIterator<int,QStringList> it(columns);
+			while (it.hasNext())
+			{
+				it.next();
+				QStringList key(normalized(it.value()));
+				// the key columns have to be the leading columns of an index
+				int covering = -1;
+				for (int i = 0; i < indexes.count() && covering < 0; ++i)
+				{
+					if (normalized(indexes.at(i).mid(0, key.count())) == key)
+						covering = i;
+				}
+
+				QTreeWidgetItem * item = new QTreeWidgetItem(ui.auditTree);
+				item->setText(COL_DATABASE, schema);
+				item->setText(COL_TABLE, table);
+				item->setText(COL_COLUMNS, it.value().join(", "));
+				item->setText(COL_PARENT, parents.value(it.key()));
+				item->setData(COL_ROWS, Qt::DisplayRole, rows);
+				if (rows.isValid())
+					item->setToolTip(COL_ROWS, tr("Estimated from %1").arg(source));
+				++keys;
+				if (covering >= 0)
+				{
+					item->setText(COL_INDEX, names.at(covering));
+					item->setDisabled(true);
+					continue;
+				}
+				++missing;
+				QStringList data(schema);
+				data << table << it.value();
+				item->setData(COL_DATABASE, Qt::UserRole, data);
+				item->setCheckState(COL_DATABASE, Qt::Checked);
+				item->setText(COL_INDEX, tr("missing"));
+				item->setForeground(COL_INDEX, Qt::red);
+				item->setToolTip(COL_INDEX,
+								 tr("Deleting or updating a row of %1 scans the whole %2 table")
+								 .arg(parents.value(it.key())).arg(table));
+			}
+		}
+	}
+
+	ui.auditTree->setSortingEnabled(true);
+	ui.auditTree->sortByColumn(COL_ROWS, Qt::DescendingOrder);
+	for (int i = 0; i < ui.auditTree->columnCount(); ++i)
+		ui.auditTree->resizeColumnToContents(i);
+	showCoveredCheckBox_toggled(ui.showCoveredCheckBox->isChecked());
+	ui.createButton->setEnabled(missing > 0);
+
+	if (keys == 0)
+		ui.statusLabel->setText(tr("There are no foreign keys in the databases."));
+	else if (missing == 0)
+		ui.statusLabel->setText(tr("All %1 foreign keys are covered by an index.").arg(keys));
+	else
+		ui.statusLabel->setText(tr("%1 of %2 foreign keys have no index on their child columns.")
+								.arg(missing).arg(keys));
+
+	connect(ui.auditTree, SIGNAL(itemChanged(QTreeWidgetItem *, int)),
+			this, SLOT(auditTree_itemChanged(QTreeWidgetItem *, int)));
+}
+
+QString ForeignKeyAuditDialog::indexName(const QString & schema, const QString & table,
+										 const QStringList & columns)
+{
+	QString base(QString("idx_%1_%2").arg(table).arg(columns.join("_")));
+	base.replace(QRegExp("\\W"), "_");
+	QStringList used;
+	foreach (QString name, Database::getObjects(QString(), schema).keys())
+		used.append(name.toLower());
+
+	QString name(base);
+	for (int i = 2; used.contains(name.toLower()); ++i)
+		name = QString("%1_%2").arg(base).arg(i);
+	return name;
+}
+
+void ForeignKeyAuditDialog::createButton_clicked()
+{
+	int created = 0;
+	for (int i = 0; i < ui.auditTree->topLevelItemCount(); ++i)
+	{
+		QTreeWidgetItem * item = ui.auditTree->topLevelItem(i);
+		if (item->isDisabled() || item->checkState(COL_DATABASE) != Qt::Checked)
+			continue;
+
+		QStringList columns(item->data(COL_DATABASE, Qt::UserRole).toStringList());
+		QString schema(columns.takeFirst());
+		QString table(columns.takeFirst());
+		QString sql(QString("CREATE INDEX %1.%2 ON %3 (%4);")
+					.arg(Utils::quote(schema))
+					.arg(Utils::quote(indexName(schema, table, columns)))
+					.arg(Utils::quote(table))
+					.arg(Utils::quote(columns)));
+		ui.statusLabel->setText(tr("Creating an index on %1 (%2)...")
+								.arg(table).arg(columns.join(", ")));
+		qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+		if (!Database::execSql(sql))
+			break;
+		++created;
+	}
+	if (created == 0)
+		return;
+
+	update = true;
+	audit();
+	ui.statusLabel->setText(tr("%1 indexes created.").arg(created) + " "
+							+ ui.statusLabel->text());
+}
+
+void ForeignKeyAuditDialog::showCoveredCheckBox_toggled(bool checked)
+{
+	for (int i = 0; i < ui.auditTree->topLevelItemCount(); ++i)
+	{
+		QTreeWidgetItem * item = ui.auditTree->topLevelItem(i);
+		if (item->isDisabled())
+			item->setHidden(!checked);
+	}
+}
+
+void ForeignKeyAuditDialog::auditTree_itemChanged(QTreeWidgetItem * /*item*/, int column)
+{
+	if (column != COL_DATABASE)
+		return;
+	bool checked = false;
+	for (int i = 0; i < ui.auditTree->topLevelItemCount() && !checked; ++i)
+	{
+		QTreeWidgetItem * item = ui.auditTree->topLevelItem(i);
+		checked = !item->isDisabled() && item->checkState(COL_DATABASE) == Qt::Checked;
+	}
+	ui.createButton->setEnabled(checked);
+}
@@ -0,0 +1,59 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef FOREIGNKEYAUDITDIALOG_H
+#define FOREIGNKEYAUDITDIALOG_H
+
+#include <qdialog.h>
+#include <QStringList>
+#include <QVariant>
+
+#include "ui_foreignkeyauditdialog.h"
+
+
+/*! \brief Find foreign keys without an index on their child columns.
+Every DELETE or UPDATE of a parent row looks up the child rows. Without
+an index starting with the child key columns it is a full scan of the
+child table. The dialog lists the foreign keys of all tables
+(PRAGMA foreign_key_list) with the index covering them
+(PRAGMA index_list and index_info) and creates the missing ones.
+*/
+class ForeignKeyAuditDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		ForeignKeyAuditDialog(QWidget * parent = 0);
+		~ForeignKeyAuditDialog();
+
+		//! \brief True when an index has been created.
+		bool update;
+
+	private:
+		Ui::ForeignKeyAuditDialog ui;
+
+		void audit();
+		/*! \brief Column lists of the indexes usable for lookups in table.
+		\param names the names of the indexes, same order
+		*/
+		QList<QStringList> tableIndexes(const QString & schema, const QString & table,
+										QStringList & names);
+		/*! \brief Row count of table from sqlite_stat1, or max(rowid) when
+		it has not been analyzed. Invalid for unknown.
+		*/
+		QVariant estimateRows(const QString & schema, const QString & table,
+							  bool hasStat, QString & source);
+		QString indexName(const QString & schema, const QString & table,
+						  const QStringList & columns);
+
+	private slots:
+		void createButton_clicked();
+		void showCoveredCheckBox_toggled(bool checked);
+		void auditTree_itemChanged(QTreeWidgetItem * item, int column);
+};
+
+#endif
@@ -0,0 +1,490 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMessageBox>
+#include <QSettings>
+
+#include "healthcheckdialog.h"
+#include "database.h"
+#include "regexp.h"
+#include "utils.h"
+
+// targetTree columns
+#define COL_TARGET 0
+#define COL_STATUS 1
+
+// resultsTree columns
+#define COL_DATABASE 0
+#define COL_TABLE 1
+#define COL_MESSAGE 2
+
+
+HealthCheckThread::HealthCheckThread(const QString & fileName, sqlite3 * connection,
+									 const QList<Target> & targets, Check check,
+									 int maxErrors, QObject * parent)
+	: QThread(parent),
+	  m_fileName(fileName),
+	  m_connection(connection),
+	  m_targets(targets),
+	  m_check(check),
+	  m_maxErrors(maxErrors),
+	  m_cancelled(false)
+{
+}
+
+bool HealthCheckThread::hasTableCheck()
+{
+	return sqlite3_libversion_number() >= 3033000;
+}
+
+void HealthCheckThread::cancel()
+{
+	m_cancelled = true;
+}
+
+int HealthCheckThread::progressHandler(void * thread)
+{
+	HealthCheckThread * self = static_cast<HealthCheckThread*>(thread);
+	if (self->m_lastProgress.elapsed() >= 200)
+	{
+		self->m_lastProgress.restart();
+		emit self->progress(self->m_database, self->m_time.elapsed());
+	}
+	// non-zero interrupts the statement
+	return self->m_cancelled ? 1 : 0;
+}
+
+void HealthCheckThread::run()
+{
+	sqlite3 * db = m_connection;
+	if (!db)
+	{
+		QByteArray name(QDir::toNativeSeparators(m_fileName).toUtf8());
+		if (sqlite3_open_v2(name.constData(), &db, SQLITE_OPEN_READONLY, 0) != SQLITE_OK)
+		{
+			m_error = QString::fromUtf8(sqlite3_errmsg(db));
+			sqlite3_close(db);
+			return;
+		}
+		sqlite3_busy_timeout(db, 5000);
+		// CHECK constraints and index expressions may use REGEXP
+		Regexp::install(db);
+	}
+	sqlite3_progress_handler(db, 1000, HealthCheckThread::progressHandler, this);
+	m_lastProgress.start();
+
+	foreach (Target target, m_targets)
+	{
+		if (target.database != m_database)
+		{
+			m_database = target.database;
+			m_time.start();
+		}
+		if (m_cancelled || !process(db, target))
+			break;
+	}
+
+	sqlite3_progress_handler(db, 0, 0, 0);
+	if (db != m_connection)
+		sqlite3_close(db);
+}
+
+QString HealthCheckThread::statement(const Target & target, const QString & schema)
+{
+	if (m_check == ForeignKeyCheck)
+	{
+		if (target.table.isEmpty())
+			return QString("PRAGMA %1.foreign_key_check;").arg(Utils::quote(schema));
+		return QString("PRAGMA %1.foreign_key_check(%2);")
+			   .arg(Utils::quote(schema)).arg(Utils::quote(target.table));
+	}
+
+	QString pragma(m_check == QuickCheck ? "quick_check" : "integrity_check");
+	if (target.table.isEmpty())
+		return QString("PRAGMA %1.%2(%3);")
+			   .arg(Utils::quote(schema)).arg(pragma).arg(m_maxErrors);
+	// the limit of the findings cannot be given with a table
+	return QString("PRAGMA %1.%2(%3);")
+		   .arg(Utils::quote(schema)).arg(pragma).arg(Utils::quote(target.table));
+}
+
+bool HealthCheckThread::process(sqlite3 * db, const Target & target)
+{
+	// an own connection has the database as main
+	QString schema(m_connection ? target.database : QString("main"));
+	QByteArray sql(statement(target, schema).toUtf8());
+	int problems = 0;
+
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(db, sql.constData(), -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		{
+			if (problems >= m_maxErrors)
+			{
+				emit finding(target.database, target.table,
+							 tr("Stopped after %1 problems.").arg(problems));
+				rc = SQLITE_DONE;
+				break;
+			}
+			if (m_check == ForeignKeyCheck)
+			{
+				// table, rowid (NULL without rowid), parent, fkid
+				QString table(QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0)));
+				QString parent(QString::fromUtf8((const char*)sqlite3_column_text(stmt, 2)));
+				QString message;
+				if (sqlite3_column_type(stmt, 1) == SQLITE_NULL)
+					message = tr("A row refers to a missing row of %1 (foreign key %2).")
+							  .arg(parent).arg(sqlite3_column_int(stmt, 3));
+				else
+					message = tr("Row %1 refers to a missing row of %2 (foreign key %3).")
+							  .arg(sqlite3_column_int64(stmt, 1)).arg(parent)
+							  .arg(sqlite3_column_int(stmt, 3));
+				emit finding(target.database, table, message);
+			}
+			else
+			{
+				QString message(QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0)));
+				// the only row of a healthy database
+				if (message == "ok")
+					continue;
+				emit finding(target.database, target.table, message);
+			}
+			++problems;
+		}
+	}
+	if (rc != SQLITE_DONE && !m_cancelled)
+		m_error = QString("%1: %2").arg(target.database)
+				  .arg(QString::fromUtf8(sqlite3_errmsg(db)));
+	sqlite3_finalize(stmt);
+	if (rc != SQLITE_DONE)
+		return false;
+
+	emit targetDone(target.database, target.table, problems);
+	return true;
+}
+
+
+HealthCheckDialog::HealthCheckDialog(QWidget * parent)
+	: QDialog(parent),
+	  m_targetCount(0),
+	  m_targetsDone(0),
+	  m_findings(0),
+	  m_cancelled(false)
+{
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("healthcheck/height", QVariant(500)).toInt();
+	int ww = settings.value("healthcheck/width", QVariant(600)).toInt();
+	resize(ww, hh);
+	ui.checkComboBox->setCurrentIndex(settings.value("healthcheck/check",
+										QVariant(0)).toInt());
+	ui.maxErrorsSpinBox->setValue(settings.value("healthcheck/maxErrors",
+										QVariant(ui.maxErrorsSpinBox->value())).toInt());
+
+	QStringList databases(Database::getDatabases().keys());
+	databases.removeAll("main");
+	databases.prepend("main");
+	DbAttach files(Database::getDatabases());
+	foreach (QString database, databases)
+	{
+		QTreeWidgetItem * item = new QTreeWidgetItem(ui.targetTree);
+		item->setText(COL_TARGET, database);
+		item->setData(COL_TARGET, Qt::UserRole, files.value(database));
+		item->setToolTip(COL_TARGET, files.value(database));
+		item->setCheckState(COL_TARGET, Qt::Checked);
+		QStringList tables(Database::getObjects("table", database).keys());
+		tables.sort();
+		foreach (QString table, tables)
+		{
+			QTreeWidgetItem * child = new QTreeWidgetItem(item);
+			child->setText(COL_TARGET, table);
+			child->setCheckState(COL_TARGET, Qt::Unchecked);
+		}
+	}
+	ui.targetTree->resizeColumnToContents(COL_TARGET);
+	checkComboBox_currentIndexChanged(ui.checkComboBox->currentIndex());
+	setRunning(false);
+
+	connect(ui.checkButton, SIGNAL(clicked()), this, SLOT(checkButton_clicked()));
+	connect(ui.cancelButton, SIGNAL(clicked()), this, SLOT(cancelButton_clicked()));
+	connect(ui.checkComboBox, SIGNAL(currentIndexChanged(int)),
+			this, SLOT(checkComboBox_currentIndexChanged(int)));
+}
+
+HealthCheckDialog::~HealthCheckDialog()
+{
+	foreach (HealthCheckThread * thread, m_threads)
+		thread->cancel();
+	foreach (HealthCheckThread * thread, m_threads)
+		thread->wait();
+	QSettings settings("yarpen.cz", "sqliteman");
+    settings.setValue("healthcheck/height", QVariant(height()));
+    settings.setValue("healthcheck/width", QVariant(width()));
+	settings.setValue("healthcheck/check", QVariant(ui.checkComboBox->currentIndex()));
+	settings.setValue("healthcheck/maxErrors", QVariant(ui.maxErrorsSpinBox->value()));
+}
+
+QTreeWidgetItem * HealthCheckDialog::databaseItem(const QString & database)
+{
+	for (int i = 0; i < ui.targetTree->topLevelItemCount(); ++i)
+	{
+		if (ui.targetTree->topLevelItem(i)->text(COL_TARGET) == database)
+			return ui.targetTree->topLevelItem(i);
+	}
+	return 0;
+}
+
+void HealthCheckDialog::setStatus(const QString & database, const QString & status)
+{
+	QTreeWidgetItem * item = databaseItem(database);
+	if (item)
+		item->setText(COL_STATUS, status);
+}
+
+void HealthCheckDialog::setRunning(bool running)
+{
+	ui.targetTree->setEnabled(!running);
+	ui.checkComboBox->setEnabled(!running);
+	ui.maxErrorsSpinBox->setEnabled(!running);
+	ui.checkButton->setEnabled(!running);
+	ui.cancelButton->setEnabled(running);
+}
+
+void HealthCheckDialog::checkComboBox_currentIndexChanged(int index)
+{
+	// integrity_check(table) is not known to older libraries
+	bool tables = (index == HealthCheckThread::ForeignKeyCheck)
+				  || HealthCheckThread::hasTableCheck();
+	QString tip(tables ? QString()
+				: tr("Checking single tables needs sqlite 3.33 or newer"));
+	for (int i = 0; i < ui.targetTree->topLevelItemCount(); ++i)
+	{
+		QTreeWidgetItem * item = ui.targetTree->topLevelItem(i);
+		for (int j = 0; j < item->childCount(); ++j)
+		{
+			item->child(j)->setDisabled(!tables);
+			item->child(j)->setToolTip(COL_TARGET, tip);
+		}
+	}
+}
+
+void HealthCheckDialog::checkButton_clicked()
+{
+	HealthCheckThread::Check check
+		= (HealthCheckThread::Check)ui.checkComboBox->currentIndex();
+	bool tables = (check == HealthCheckThread::ForeignKeyCheck)
+				  || HealthCheckThread::hasTableCheck();
+
+	// a job for every database file, one for the rest
+	QList<QList<HealthCheckThread::Target> > jobs;
+	QStringList jobFiles;
+	QList<HealthCheckThread::Target> shared;
+	m_remaining.clear();
+	m_problems.clear();
+	for (int i = 0; i < ui.targetTree->topLevelItemCount(); ++i)
+	{
+		QTreeWidgetItem * item = ui.targetTree->topLevelItem(i);
+		item->setText(COL_STATUS, QString());
+		item->setForeground(COL_STATUS, palette().brush(QPalette::Text));
+
+		HealthCheckThread::Target target;
+		target.database = item->text(COL_TARGET);
+		QList<HealthCheckThread::Target> targets;
+		for (int j = 0; tables && j < item->childCount(); ++j)
+		{
+			if (item->child(j)->checkState(COL_TARGET) != Qt::Checked)
+				continue;
+			target.table = item->child(j)->text(COL_TARGET);
+			targets.append(target);
+		}
+		if (targets.isEmpty() && item->checkState(COL_TARGET) == Qt::Checked)
+			targets.append(target);
+		if (targets.isEmpty())
+			continue;
+
+		m_remaining[target.database] = targets.count();
+		m_problems[target.database] = 0;
+		item->setText(COL_STATUS, tr("Waiting"));
+		QString file(item->data(COL_TARGET, Qt::UserRole).toString());
+		if (QFileInfo(file).isFile())
+		{
+			jobs.append(targets);
+			jobFiles.append(file);
+		}
+		else
+			shared += targets;
+	}
+	if (m_remaining.isEmpty())
+	{
+		ui.statusLabel->setText(tr("Check a database or some of its tables."));
+		return;
+	}
+
+	sqlite3 * connection = 0;
+	if (!shared.isEmpty())
+	{
+		connection = Database::sqlite3handle();
+		if (!connection)
+			return;
+	}
+
+	ui.resultsTree->clear();
+	m_targetCount = 0;
+	m_targetsDone = 0;
+	m_findings = 0;
+	m_errors.clear();
+	m_cancelled = false;
+	for (int i = 0; i <= jobs.count(); ++i)
+	{
+		HealthCheckThread * thread;
+		if (i < jobs.count())
+			thread = new HealthCheckThread(jobFiles.at(i), 0, jobs.at(i), check,
+										   ui.maxErrorsSpinBox->value(), this);
+		else if (!shared.isEmpty())
+			thread = new HealthCheckThread(QString(), connection, shared, check,
+										   ui.maxErrorsSpinBox->value(), this);
+		else
+			break;
+		m_targetCount += thread->targets().count();
+		connect(thread, SIGNAL(finding(const QString &, const QString &, const QString &)),
+				this, SLOT(thread_finding(const QString &, const QString &, const QString &)));
+		connect(thread, SIGNAL(progress(const QString &, int)),
+				this, SLOT(thread_progress(const QString &, int)));
+		connect(thread, SIGNAL(targetDone(const QString &, const QString &, int)),
+				this, SLOT(thread_targetDone(const QString &, const QString &, int)));
+		connect(thread, SIGNAL(finished()), this, SLOT(thread_finished()));
+		m_threads.append(thread);
+	}
+
+	ui.progressBar->setMaximum(m_targetCount);
+	ui.progressBar->setValue(0);
+	ui.statusLabel->setText(tr("Checking..."));
+	setRunning(true);
+	m_time.start();
+	foreach (HealthCheckThread * thread, m_threads)
+		thread->start();
+}
+
+void HealthCheckDialog::cancelButton_clicked()
+{
+	foreach (HealthCheckThread * thread, m_threads)
+		thread->cancel();
+}
+
+void HealthCheckDialog::thread_finding(const QString & database, const QString & table,
+									   const QString & message)
+{
+	QTreeWidgetItem * item = new QTreeWidgetItem(ui.resultsTree);
+	item->setText(COL_DATABASE, database);
+	item->setText(COL_TABLE, table);
+	item->setText(COL_MESSAGE, message);
+	item->setToolTip(COL_MESSAGE, message);
+	++m_findings;
+	++m_problems[database];
+}
+
+void HealthCheckDialog::thread_progress(const QString & database, int msecs)
+{
+	if (m_threads.isEmpty())
+		return;
+	setStatus(database, tr("Running, %1 s").arg(msecs / 1000.0, 0, 'f', 1));
+	ui.statusLabel->setText(tr("%1 of %2 checks done, %3 problems found, %4 s")
+							.arg(m_targetsDone).arg(m_targetCount).arg(m_findings)
+							.arg(m_time.elapsed() / 1000.0, 0, 'f', 1));
+}
+
+void HealthCheckDialog::thread_targetDone(const QString & database,
+										  const QString & /*table*/, int /*problems*/)
+{
+	if (m_threads.isEmpty())
+		return;
+	++m_targetsDone;
+	ui.progressBar->setValue(m_targetsDone);
+	if (--m_remaining[database] > 0)
+		return;
+
+	m_remaining.remove(database);
+	int problems = m_problems.value(database);
+	if (problems == 0)
+	{
+		setStatus(database, tr("OK"));
+		return;
+	}
+	setStatus(database, tr("%1 problems").arg(problems));
+	QTreeWidgetItem * item = databaseItem(database);
+	if (item)
+		item->setForeground(COL_STATUS, Qt::red);
+}
+
+void HealthCheckDialog::thread_finished()
+{
+	HealthCheckThread * thread = qobject_cast<HealthCheckThread*>(sender());
+	// already handled by reject()
+	if (!thread || !m_threads.contains(thread))
+		return;
+	finishThread(thread);
+}
+
+void HealthCheckDialog::finishThread(HealthCheckThread * thread)
+{
+	QString error(thread->error());
+	m_cancelled |= thread->isCancelled();
+	foreach (HealthCheckThread::Target target, thread->targets())
+	{
+		if (!m_remaining.contains(target.database))
+			continue;
+		m_remaining.remove(target.database);
+		setStatus(target.database, error.isEmpty() ? tr("Stopped") : tr("Error"));
+	}
+	if (!error.isEmpty())
+		m_errors += error + "<br/>";
+	m_threads.removeAll(thread);
+	thread->deleteLater();
+	if (!m_threads.isEmpty())
+		return;
+
+	setRunning(false);
+	ui.resultsTree->resizeColumnToContents(COL_DATABASE);
+	ui.resultsTree->resizeColumnToContents(COL_TABLE);
+	QString seconds(QString::number(m_time.elapsed() / 1000.0, 'f', 1));
+	if (!m_errors.isEmpty())
+		ui.statusLabel->setText(tr("Error while checking")
+								+ ":<br/><span style=\" color:#ff0000;\">"
+								+ m_errors + "</span>");
+	else if (m_cancelled)
+		ui.statusLabel->setText(tr("Stopped. %1 of %2 checks done, %3 problems found.")
+								.arg(m_targetsDone).arg(m_targetCount).arg(m_findings));
+	else if (m_findings == 0)
+		ui.statusLabel->setText(tr("No problems found in %1 s.").arg(seconds));
+	else
+		ui.statusLabel->setText(tr("%1 problems found in %2 s.")
+								.arg(m_findings).arg(seconds));
+}
+
+void HealthCheckDialog::reject()
+{
+	if (!m_threads.isEmpty())
+	{
+		int ret = QMessageBox::question(this, windowTitle(),
+						tr("The databases are still checked. Do you want to stop it?"),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+		foreach (HealthCheckThread * thread, m_threads)
+			thread->cancel();
+		foreach (HealthCheckThread * thread, m_threads)
+		{
+			thread->wait();
+			finishThread(thread);
+		}
+	}
+	QDialog::reject();
+}
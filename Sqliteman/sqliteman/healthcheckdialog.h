@@ -0,0 +1,144 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef HEALTHCHECKDIALOG_H
+#define HEALTHCHECKDIALOG_H
+
+#include <qdialog.h>
+#include <QMap>
+#include <QThread>
+#include <QTime>
+
+#include "sqlite3.h"
+#include "ui_healthcheckdialog.h"
+
+
+/*! \brief Run one of the checking pragmas out of the GUI thread.
+Every thread checks the tables of one database file on its own read-only
+connection, so the databases are checked in parallel. Databases without
+a file (in-memory and temp) share the connection of the application;
+they are checked by one thread one after another.
+*/
+class HealthCheckThread : public QThread
+{
+	Q_OBJECT
+
+	public:
+		enum Check
+		{
+			IntegrityCheck,
+			QuickCheck,
+			ForeignKeyCheck
+		};
+
+		//! \brief A database and its table to check; an empty table is the whole database.
+		struct Target
+		{
+			QString database;
+			QString table;
+		};
+
+		/*!
+		\param fileName the database file of all targets
+		\param connection an open connection to use when fileName is not
+		       a file; the targets are addressed by their schema names then
+		\param targets the databases or tables to check
+		\param check the pragma to run
+		\param maxErrors stop a target after this many findings
+		\param parent standard Qt parent
+		*/
+		HealthCheckThread(const QString & fileName, sqlite3 * connection,
+						  const QList<Target> & targets, Check check,
+						  int maxErrors, QObject * parent = 0);
+
+		//! \brief An error message, empty on success or when cancelled.
+		QString error() const { return m_error; };
+		bool isCancelled() const { return m_cancelled; };
+		QList<Target> targets() const { return m_targets; };
+
+		//! \brief integrity_check(table) and quick_check(table) need sqlite 3.33
+		static bool hasTableCheck();
+
+	public slots:
+		void cancel();
+
+	signals:
+		//! \brief A problem found in database. table is empty when it is not known.
+		void finding(const QString & database, const QString & table,
+					 const QString & message);
+		//! \brief The check of database has been running for msecs.
+		void progress(const QString & database, int msecs);
+		void targetDone(const QString & database, const QString & table,
+						int problems);
+
+	protected:
+		void run();
+
+	private:
+		QString m_fileName;
+		sqlite3 * m_connection;
+		QList<Target> m_targets;
+		Check m_check;
+		int m_maxErrors;
+		QString m_error;
+		volatile bool m_cancelled;
+		//! \brief The database checked now; read by progressHandler
+		QString m_database;
+		QTime m_time;
+		QTime m_lastProgress;
+
+		static int progressHandler(void * thread);
+		QString statement(const Target & target, const QString & schema);
+		bool process(sqlite3 * db, const Target & target);
+};
+
+
+/*! \brief Check the integrity and the foreign keys of the databases.
+Whole attached databases or their chosen tables are checked by
+HealthCheckThread jobs. The problems are listed as they are found.
+*/
+class HealthCheckDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		HealthCheckDialog(QWidget * parent = 0);
+		~HealthCheckDialog();
+
+	private:
+		Ui::HealthCheckDialog ui;
+		QList<HealthCheckThread*> m_threads;
+		//! \brief Database name -> its targets not done yet
+		QMap<QString,int> m_remaining;
+		//! \brief Database name -> its findings
+		QMap<QString,int> m_problems;
+		int m_targetCount;
+		int m_targetsDone;
+		int m_findings;
+		QString m_errors;
+		bool m_cancelled;
+		QTime m_time;
+
+		QTreeWidgetItem * databaseItem(const QString & database);
+		void setStatus(const QString & database, const QString & status);
+		void setRunning(bool running);
+		void finishThread(HealthCheckThread * thread);
+
+	private slots:
+		void checkButton_clicked();
+		void cancelButton_clicked();
+		void checkComboBox_currentIndexChanged(int index);
+		void thread_finding(const QString & database, const QString & table,
+							const QString & message);
+		void thread_progress(const QString & database, int msecs);
+		void thread_targetDone(const QString & database, const QString & table,
+							   int problems);
+		void thread_finished();
+		void reject();
+};
+
+#endif
@@ -154,7 +154,7 @@ void ImportTableDialog::slotAccepted()
 				  + binds.join(", ")
 				  + ");";
 		
-	QSqlQuery query(QSqlDatabase::database(SESSION_NAME));
+	ForwardQuery query;
 
 	if (   (m_tableName == tableComboBox->currentText())
 		&& (m_schema == schemaComboBox->currentText())
@@ -167,7 +167,20 @@ void ImportTableDialog::slotAccepted()
 		// FIXME emit some failure message here
 		return;
 	}
-	
+
+	// one statement for all rows; only the bound values change
+	if (!query.prepare(sql))
+	{
+		log.append(query.lastError().text());
+		result = false;
+		values.clear();
+	}
+
+	// well formed rows are bound column-wise and inserted in one batch
+	QList<QVariantList> columns;
+	for (int i = 0; i < cols; ++i)
+		columns.append(QVariantList());
+	QList<int> batchRows;
 	foreach (l, values)
 	{
 		++row;
@@ -178,19 +191,35 @@ void ImportTableDialog::slotAccepted()
 			result = false;
 			continue;
 		}
-
-		query.prepare(sql);
 		for (int i = 0; i < cols ; ++i)
-			query.addBindValue(l.at(i));
+			columns[i].append(l.at(i));
+		batchRows.append(row);
+	}
 
-		query.exec();
-		if (query.lastError().isValid())
+	if (!batchRows.isEmpty())
+	{
+		for (int i = 0; i < cols ; ++i)
+			query.bindValue(i, columns.at(i));
+		if (query.execBatch())
+			success += batchRows.count();
+		else
 		{
-			log.append(tr("Row = %1; %2").arg(row).arg(query.lastError().text()));
-			result = false;
+			// the batch is rolled back as a whole, so go row by row
+			// to tell which rows are wrong
+			for (int r = 0; r < batchRows.count(); ++r)
+			{
+				for (int i = 0; i < cols ; ++i)
+					query.bindValue(i, columns.at(i).at(r));
+				query.exec();
+				if (query.lastError().isValid())
+				{
+					log.append(tr("Row = %1; %2").arg(batchRows.at(r)).arg(query.lastError().text()));
+					result = false;
+				}
+				else
+					++success;
+			}
 		}
-		else
-			++success;
 	}
 
 	if (result)
@@ -0,0 +1,576 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QApplication>
+#include <QHeaderView>
+#include <QRegExp>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTreeWidgetItem>
+
+#include "indexadvisordialog.h"
+#include "createindexdialog.h"
+#include "database.h"
+#include "regexp.h"
+#include "sqlkeywords.h"
+#include "sqlparser.h"
+#include "utils.h"
+
+// the widest index proposed
+#define ADVISOR_MAX_COLUMNS 6
+
+
+typedef struct
+{
+	QStringList equality;
+	QStringList range;
+	QStringList order;
+} ColumnUsage;
+
+
+static bool isName(const Token & t)
+{
+	return (t.type == tokenIdentifier) || (t.type == tokenQuotedIdentifier);
+}
+
+// upper case keyword-like token, empty for anything quoted
+static QString word(const QList<Token> & tokens, int i)
+{
+	if ((i < 0) || (i >= tokens.count()))
+		return QString();
+	if (tokens.at(i).type == tokenQuotedIdentifier)
+		return QString();
+	return tokens.at(i).name.toUpper();
+}
+
+// words ending a table reference which sqlKeywords() does not know alone
+static bool isClauseWord(const QString & w)
+{
+	static QStringList words(QStringList() << "ORDER" << "GROUP" << "BY"
+							 << "IN" << "IS" << "WHEN" << "WITH" << "INDEXED");
+	return words.contains(w) || isKeyword(w);
+}
+
+static void appendUnique(QStringList & list, const QString & value)
+{
+	if (!list.contains(value))
+		list.append(value);
+}
+
+static bool selectColumn(sqlite3 * db, const QString & sql, int column,
+						 QStringList & values, QString & error)
+{
+	QByteArray utf8(sql.toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(db, utf8.constData(), -1, &stmt, 0) != SQLITE_OK)
+	{
+		error = QString::fromUtf8(sqlite3_errmsg(db));
+		sqlite3_finalize(stmt);
+		return false;
+	}
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+		values.append(QString::fromUtf8((const char*)sqlite3_column_text(stmt, column)));
+	if (sqlite3_finalize(stmt) != SQLITE_OK)
+	{
+		error = QString::fromUtf8(sqlite3_errmsg(db));
+		return false;
+	}
+	return true;
+}
+
+/* A rough cost of a plan for comparisons only: full scans are the most
+expensive, an index search is cheaper the more terms it uses. */
+static int planCost(const QStringList & plan)
+{
+	int cost = 0;
+	foreach (QString detail, plan)
+	{
+		if (detail.startsWith("SCAN") && !detail.contains("SUBQUERY")
+			&& !detail.contains("CONSTANT ROW"))
+			cost += detail.contains("COVERING INDEX") ? 50 : 100;
+		else if (detail.startsWith("SEARCH"))
+		{
+			if (detail.contains("PRIMARY KEY"))
+				cost += 1;
+			else
+				cost += qMax(2, 10 - 2 * detail.count("?"));
+		}
+		if (detail.contains("AUTOMATIC"))
+			cost += 50;
+		if (detail.contains("TEMP B-TREE"))
+			cost += 10;
+	}
+	return cost;
+}
+
+
+IndexAdvisorDialog::IndexAdvisorDialog(const QString & statement,
+									   const QStringList & history,
+									   LiteManWindow * creator,
+									   QWidget * parent)
+	: QDialog(parent),
+	  update(false),
+	  m_statement(statement),
+	  m_history(history),
+	  creator(creator),
+	  m_scratch(0)
+{
+	setupUi(this);
+
+	sourceComboBox->addItem(tr("Current statement"));
+	sourceComboBox->addItem(tr("Query history (%n statement(s))", "", history.count()));
+	if (statement.trimmed().isEmpty())
+		sourceComboBox->setCurrentIndex(1);
+	resultTree->header()->setStretchLastSection(false);
+	resultTree->header()->setResizeMode(0, QHeaderView::Stretch);
+	createButton->setEnabled(false);
+
+	connect(analyzeButton, SIGNAL(clicked()),
+			this, SLOT(analyzeButton_clicked()));
+	connect(createButton, SIGNAL(clicked()),
+			this, SLOT(createButton_clicked()));
+	connect(resultTree, SIGNAL(itemSelectionChanged()),
+			this, SLOT(resultTree_itemSelectionChanged()));
+}
+
+IndexAdvisorDialog::~IndexAdvisorDialog()
+{
+	if (m_scratch)
+		sqlite3_close(m_scratch);
+}
+
+bool IndexAdvisorDialog::scratchExec(const QString & sql)
+{
+	QByteArray utf8(sql.toUtf8());
+	return sqlite3_exec(m_scratch, utf8.constData(), 0, 0, 0) == SQLITE_OK;
+}
+
+bool IndexAdvisorDialog::createScratch(QString & error)
+{
+	if (m_scratch)
+		sqlite3_close(m_scratch);
+	m_tables.clear();
+	m_columns.clear();
+	if (sqlite3_open(":memory:", &m_scratch) != SQLITE_OK)
+	{
+		error = QString::fromUtf8(sqlite3_errmsg(m_scratch));
+		return false;
+	}
+	// the schema and the advised statements may use REGEXP
+	Regexp::install(m_scratch);
+
+	// tables first, the indexes, views and triggers depend on them
+	ForwardQuery query(
+		"SELECT name, sql FROM main.sqlite_master "
+		"WHERE sql NOT NULL AND name NOT LIKE 'sqlite_%' "
+		"ORDER BY type <> 'table';");
+	QStringList failed;
+	while (query.next())
+	{
+		if (scratchExec(query.value(1).toString()))
+			continue;
+		// shadow tables are created by their virtual table already
+		if (!QString::fromUtf8(sqlite3_errmsg(m_scratch)).contains("already exists"))
+			failed.append(query.value(0).toString());
+	}
+	if (query.lastError().isValid())
+	{
+		error = query.lastError().text();
+		return false;
+	}
+	if (!failed.isEmpty())
+	{
+		messageEdit->append(tr("Objects not copied into the scratch schema "
+							   "(statements using them are skipped): %1")
+							.arg(failed.join(", ")));
+	}
+
+	// the planner needs the real statistics to choose like it will
+	ForwardQuery stat("SELECT tbl, idx, stat FROM main.sqlite_stat1;");
+	if (!stat.lastError().isValid()
+		&& scratchExec("ANALYZE sqlite_master;")
+		&& scratchExec("DELETE FROM sqlite_stat1;"))
+	{
+		sqlite3_stmt * stmt = 0;
+		sqlite3_prepare_v2(m_scratch, "INSERT INTO sqlite_stat1 VALUES (?, ?, ?);",
+						   -1, &stmt, 0);
+		while (stmt && stat.next())
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				if (stat.value(i).isNull())
+					sqlite3_bind_null(stmt, i + 1);
+				else
+				{
+					QByteArray value(stat.value(i).toString().toUtf8());
+					sqlite3_bind_text(stmt, i + 1, value.constData(), value.size(),
+									  SQLITE_TRANSIENT);
+				}
+			}
+			sqlite3_step(stmt);
+			sqlite3_reset(stmt);
+		}
+		sqlite3_finalize(stmt);
+		// reloads the copied statistics
+		scratchExec("ANALYZE sqlite_master;");
+	}
+
+	QStringList tables;
+	if (!selectColumn(m_scratch,
+					  "SELECT name FROM sqlite_master WHERE type = 'table' "
+					  "AND name NOT LIKE 'sqlite_%';",
+					  0, tables, error))
+		return false;
+	foreach (QString table, tables)
+	{
+		QStringList columns;
+		if (!selectColumn(m_scratch,
+						  QString("PRAGMA table_info(%1);").arg(Utils::quote(table)),
+						  1, columns, error))
+			return false;
+		m_tables[table.toLower()] = table;
+		m_columns[table.toLower()] = columns;
+	}
+	return true;
+}
+
+QStringList IndexAdvisorDialog::workload()
+{
+	QStringList sources;
+	if (sourceComboBox->currentIndex() == 0)
+		sources.append(m_statement);
+	else
+		sources = m_history;
+
+	QRegExp explainRx("^EXPLAIN\\s+QUERY\\s+PLAN\\s+", Qt::CaseInsensitive);
+	QRegExp firstWordRx("^(\\w+)");
+	QStringList dml(QStringList() << "SELECT" << "WITH" << "UPDATE"
+					<< "DELETE" << "INSERT" << "REPLACE");
+	QStringList seen;
+	QStringList result;
+	foreach (QString sql, sources)
+	{
+		sql = sql.trimmed();
+		sql.remove(explainRx);
+		while (sql.endsWith(";"))
+		{
+			sql.chop(1);
+			sql = sql.trimmed();
+		}
+		if (firstWordRx.indexIn(sql) == -1
+			|| !dml.contains(firstWordRx.cap(1).toUpper()))
+			continue;
+		if (seen.contains(sql.simplified()))
+			continue;
+		seen.append(sql.simplified());
+		result.append(sql);
+	}
+	return result;
+}
+
+QList<QStringList> IndexAdvisorDialog::candidates(const QString & sql)
+{
+	QList<Token> tokens = SqlParser::tokenise(sql);
+	int n = tokens.count();
+
+	// table references: an alias or a table name -> the table
+	QMap<QString,QString> aliases;
+	for (int i = 0; i < n; ++i)
+	{
+		QString w(word(tokens, i));
+		if (w != "FROM" && w != "JOIN" && w != "UPDATE" && w != "INTO")
+			continue;
+		int j = i + 1;
+		while ((j < n) && isName(tokens.at(j)))
+		{
+			QString name(tokens.at(j).name);
+			QString schema;
+			++j;
+			if ((j + 1 < n) && (tokens.at(j).name == ".") && isName(tokens.at(j + 1)))
+			{
+				schema = name;
+				name = tokens.at(j + 1).name;
+				j += 2;
+			}
+			// only the main schema is copied
+			if ((!schema.isEmpty() && schema.toLower() != "main")
+				|| !m_tables.contains(name.toLower()))
+				break;
+			QString table(name.toLower());
+			aliases[table] = table;
+			if (word(tokens, j) == "AS")
+				++j;
+			if ((j < n) && isName(tokens.at(j)) && !isClauseWord(word(tokens, j)))
+			{
+				aliases[tokens.at(j).name.toLower()] = table;
+				++j;
+			}
+			if ((w != "FROM") || (j >= n) || (tokens.at(j).name != ","))
+				break;
+			++j;
+		}
+	}
+	QStringList usedTables(aliases.values());
+
+	// column usage in WHERE/ON and ORDER BY/GROUP BY
+	enum { NoClause, Predicate, Ordering } clause = NoClause;
+	QMap<QString,ColumnUsage> usage;
+	for (int i = 0; i < n; ++i)
+	{
+		QString w(word(tokens, i));
+		if (w == "WHERE" || w == "ON")
+		{
+			clause = Predicate;
+			continue;
+		}
+		if ((w == "ORDER" || w == "GROUP") && (word(tokens, i + 1) == "BY"))
+		{
+			clause = Ordering;
+			++i;
+			continue;
+		}
+		if (w == "SELECT" || w == "FROM" || w == "JOIN" || w == "HAVING"
+			|| w == "LIMIT" || w == "UNION" || w == "EXCEPT" || w == "INTERSECT"
+			|| w == "SET" || w == "VALUES" || w == "USING")
+		{
+			clause = NoClause;
+			continue;
+		}
+		if ((clause == NoClause) || !isName(tokens.at(i)))
+			continue;
+		// :name, @name and $name are parameters
+		if ((i > 0) && (tokens.at(i - 1).type == tokenSingle)
+			&& QString(":@$").contains(tokens.at(i - 1).name))
+			continue;
+
+		int first = i;
+		QString qualifier;
+		QString column(tokens.at(i).name);
+		while ((i + 2 < n) && (tokens.at(i + 1).name == ".") && isName(tokens.at(i + 2)))
+		{
+			qualifier = column;
+			column = tokens.at(i + 2).name;
+			i += 2;
+		}
+		// a function call
+		if ((i + 1 < n) && (tokens.at(i + 1).name == "("))
+			continue;
+
+		QString table;
+		if (!qualifier.isEmpty())
+			table = aliases.value(qualifier.toLower());
+		else
+		{
+			foreach (QString t, usedTables)
+			{
+				if (!m_columns.value(t).contains(column, Qt::CaseInsensitive))
+					continue;
+				if (!table.isEmpty() && table != t)
+				{
+					// ambiguous
+					table.clear();
+					break;
+				}
+				table = t;
+			}
+		}
+		if (table.isEmpty())
+			continue;
+		// the real column name
+		QStringList columns(m_columns.value(table));
+		int ix = -1;
+		for (int j = 0; j < columns.count(); ++j)
+		{
+			if (columns.at(j).compare(column, Qt::CaseInsensitive) == 0)
+			{
+				ix = j;
+				break;
+			}
+		}
+		if (ix == -1)
+			continue;
+		column = columns.at(ix);
+
+		if (clause == Ordering)
+		{
+			appendUnique(usage[table].order, column);
+			continue;
+		}
+		QString next(tokens.value(i + 1).name.toUpper());
+		QString prev(tokens.value(first - 1).name.toUpper());
+		if ((next == "IS") && (word(tokens, i + 2) == "NOT"))
+			continue;
+		if (next == "=" || next == "==" || next == "IS" || next == "IN"
+			|| prev == "=" || prev == "==")
+			appendUnique(usage[table].equality, column);
+		else if (next == "<" || next == "<=" || next == ">" || next == ">="
+				 || next == "BETWEEN"
+				 || prev == "<" || prev == "<=" || prev == ">" || prev == ">=")
+			appendUnique(usage[table].range, column);
+	}
+
+	// equality columns first, then a range or the ordering columns
+	QList<QStringList> result;
+	foreach (QString table, usage.keys())
+	{
+		ColumnUsage u(usage.value(table));
+		QStringList eq(u.equality.mid(0, ADVISOR_MAX_COLUMNS - 1));
+		QList<QStringList> columnSets;
+		if (!eq.isEmpty())
+			columnSets.append(eq);
+		foreach (QString range, u.range.mid(0, 2))
+		{
+			if (!eq.contains(range))
+				columnSets.append(QStringList(eq) << range);
+		}
+		if (!u.order.isEmpty())
+		{
+			QStringList cols(eq);
+			foreach (QString order, u.order)
+				appendUnique(cols, order);
+			columnSets.append(cols.mid(0, ADVISOR_MAX_COLUMNS));
+		}
+		foreach (QStringList cols, columnSets)
+		{
+			QStringList candidate(QStringList(m_tables.value(table)) + cols);
+			if (!result.contains(candidate))
+				result.append(candidate);
+		}
+	}
+	return result;
+}
+
+QStringList IndexAdvisorDialog::plan(const QString & sql, QString & error)
+{
+	QStringList details;
+	selectColumn(m_scratch, QString("EXPLAIN QUERY PLAN %1").arg(sql), 3, details, error);
+	return details;
+}
+
+void IndexAdvisorDialog::analyzeButton_clicked()
+{
+	resultTree->clear();
+	messageEdit->clear();
+	createButton->setEnabled(false);
+
+	QStringList statements(workload());
+	if (statements.isEmpty())
+	{
+		messageEdit->setHtml(tr("There is no SELECT, INSERT, UPDATE or DELETE statement to analyze."));
+		return;
+	}
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	QString error;
+	if (!createScratch(error))
+	{
+		QApplication::restoreOverrideCursor();
+		messageEdit->append(tr("Cannot create the scratch schema")
+							+ ":<br/><span style=\" color:#ff0000;\">"
+							+ error + "<br/></span>");
+		return;
+	}
+
+	// "table\ncolumns" -> the suggestion item
+	QMap<QString,QTreeWidgetItem*> suggestions;
+	int skipped = 0;
+	foreach (QString sql, statements)
+	{
+		QStringList before(plan(sql, error));
+		if (before.isEmpty())
+		{
+			++skipped;
+			messageEdit->append(tr("Skipped")
+								+ ":<br/><span style=\" color:#ff0000;\">"
+								+ error + "<br/></span>" + tr("using sql statement:")
+								+ "<br/><tt>" + sql + "</tt>");
+			continue;
+		}
+		int beforeCost = planCost(before);
+		QList<QStringList> list(candidates(sql));
+		for (int i = 0; i < list.count(); ++i)
+		{
+			QString table(list.at(i).first());
+			QStringList columns(list.at(i).mid(1));
+			QStringList quoted;
+			foreach (QString column, columns)
+				quoted.append(Utils::quote(column));
+			QString indexName(QString("sqliteman_advisor_%1").arg(i));
+			if (!scratchExec(QString("CREATE INDEX %1 ON %2 (%3);")
+							 .arg(Utils::quote(indexName))
+							 .arg(Utils::quote(table))
+							 .arg(quoted.join(", "))))
+				continue;
+			QStringList after(plan(sql, error));
+			scratchExec(QString("DROP INDEX %1;").arg(Utils::quote(indexName)));
+
+			int afterCost = planCost(after);
+			if (after.isEmpty() || (afterCost >= beforeCost)
+				|| !after.join("\n").contains(indexName))
+				continue;
+
+			QString key(table + "\n" + columns.join("\n"));
+			QTreeWidgetItem * item = suggestions.value(key);
+			if (!item)
+			{
+				item = new QTreeWidgetItem(resultTree);
+				item->setText(0, QString("%1 (%2)").arg(table).arg(columns.join(", ")));
+				item->setData(0, Qt::UserRole, QStringList(table) + columns);
+				item->setData(2, Qt::UserRole, 0);
+				suggestions[key] = item;
+			}
+			QTreeWidgetItem * child = new QTreeWidgetItem(item);
+			child->setText(0, sql.simplified());
+			child->setText(2, QString("%1 -> %2").arg(beforeCost).arg(afterCost));
+			child->setToolTip(0, sql);
+			child->setToolTip(2, tr("Before:\n%1\n\nWith the index:\n%2")
+								 .arg(before.join("\n"))
+								 .arg(after.join("\n").replace(indexName, tr("<new index>"))));
+			int gain = item->data(2, Qt::UserRole).toInt() + beforeCost - afterCost;
+			item->setData(2, Qt::UserRole, gain);
+			// numbers as data so the column sorts numerically
+			item->setData(1, Qt::DisplayRole, item->childCount());
+			item->setText(2, tr("-%1").arg(gain));
+		}
+	}
+	QApplication::restoreOverrideCursor();
+
+	resultTree->sortItems(1, Qt::DescendingOrder);
+	resultTree->resizeColumnToContents(1);
+	resultTree->resizeColumnToContents(2);
+	messageEdit->append(tr("%n statement(s) analyzed", "", statements.count() - skipped)
+						+ ", "
+						+ tr("%n index(es) suggested.", "", resultTree->topLevelItemCount()));
+}
+
+void IndexAdvisorDialog::resultTree_itemSelectionChanged()
+{
+	QTreeWidgetItem * item = resultTree->currentItem();
+	createButton->setEnabled(item && !item->parent() && !item->isDisabled());
+}
+
+void IndexAdvisorDialog::createButton_clicked()
+{
+	QTreeWidgetItem * item = resultTree->currentItem();
+	if (!item || item->parent())
+		return;
+
+	QStringList columns(item->data(0, Qt::UserRole).toStringList());
+	QString table(columns.takeFirst());
+	QString name(QString("idx_%1_%2").arg(table).arg(columns.join("_")));
+	name.replace(QRegExp("\\W"), "_");
+
+	CreateIndexDialog dia(table, "main", creator);
+	dia.suggest(name, columns);
+	dia.exec();
+	if (dia.update)
+	{
+		update = true;
+		item->setDisabled(true);
+		createButton->setEnabled(false);
+	}
+}
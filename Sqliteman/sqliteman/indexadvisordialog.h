@@ -0,0 +1,82 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef INDEXADVISORDIALOG_H
+#define INDEXADVISORDIALOG_H
+
+#include <QDialog>
+#include <QMap>
+#include <QStringList>
+
+#include "litemanwindow.h"
+#include "sqlite3.h"
+#include "ui_indexadvisordialog.h"
+
+
+/*! \brief Propose indexes for a workload of statements.
+The workload is the current editor statement or the query history.
+Columns used in WHERE and JOIN ... ON terms (equality and range) and in
+ORDER BY/GROUP BY are collected per table from every statement and
+combined into candidate indexes.
+Every candidate is created in a scratch in-memory copy of the main schema
+(with its sqlite_stat1 statistics) and kept when EXPLAIN QUERY PLAN
+of a statement gets cheaper with it - the sqlite3expert approach, so
+nothing is built on the real data.
+A suggestion is created with CreateIndexDialog prefilled.
+*/
+class IndexAdvisorDialog : public QDialog, public Ui::IndexAdvisorDialog
+{
+	Q_OBJECT
+
+	public:
+		/*! \brief Create a dialog
+		\param statement the current editor statement
+		\param history the query history statements
+		\param creator the main window for CreateIndexDialog
+		\param parent standard Qt parent
+		*/
+		IndexAdvisorDialog(const QString & statement,
+						   const QStringList & history,
+						   LiteManWindow * creator,
+						   QWidget * parent = 0);
+		~IndexAdvisorDialog();
+
+		//! \brief True when an index has been created.
+		bool update;
+
+	private:
+		QString m_statement;
+		QStringList m_history;
+		LiteManWindow * creator;
+
+		//! \brief The scratch schema connection
+		sqlite3 * m_scratch;
+		//! \brief Lower case table name -> its column names (scratch schema)
+		QMap<QString,QStringList> m_columns;
+		//! \brief Lower case table name -> its real name
+		QMap<QString,QString> m_tables;
+
+		//! \brief Copy the main schema and its statistics into m_scratch.
+		bool createScratch(QString & error);
+		//! \brief The statements to analyze, normalized and unique.
+		QStringList workload();
+		/*! \brief Candidate indexes for a statement.
+		\retval QList<QStringList> every item is a table name followed by
+		        the index columns.
+		*/
+		QList<QStringList> candidates(const QString & sql);
+		//! \brief EXPLAIN QUERY PLAN details in the scratch schema.
+		QStringList plan(const QString & sql, QString & error);
+		bool scratchExec(const QString & sql);
+
+	private slots:
+		void analyzeButton_clicked();
+		void createButton_clicked();
+		void resultTree_itemSelectionChanged();
+};
+
+#endif
@@ -13,10 +13,14 @@ for which a new license (GPL+exception) is in place.
 #include <QMenuBar>
 #include <QMenu>
 #include <QTime>
+#include <QTimer>
 
 #include <QInputDialog>
 #include <QMessageBox>
 #include <QFileDialog>
+#include <QComboBox>
+#include <QGridLayout>
+#include <QLabel>
 
 #include <QSqlDatabase>
 #include <QSqlError>
@@ -27,6 +31,7 @@ for which a new license (GPL+exception) is in place.
 #include <QSettings>
 #include <QFileInfo>
 #include <QAction>
+#include <QActionGroup>
 #include <QFile>
 #include <QDir>
 #include <QProcess>
@@ -51,15 +56,25 @@ for which a new license (GPL+exception) is in place.
 #include "constraintsdialog.h"
 #include "analyzedialog.h"
 #include "vacuumdialog.h"
+#include "backupdialog.h"
+#include "compresscolumndialog.h"
+#include "datacomparedialog.h"
+#include "busyhandler.h"
+#include "dumpdialog.h"
+#include "foreignkeyauditdialog.h"
+#include "healthcheckdialog.h"
 #include "helpbrowser.h"
 #include "importtabledialog.h"
+#include "lockmonitordialog.h"
 #include "sqliteprocess.h"
+#include "tablechecksumdialog.h"
 #include "populatordialog.h"
 #include "utils.h"
 #include "buildtime.h"
 
 #ifdef INTERNAL_SQLDRIVER
 #include "driver/qsql_sqlite.h"
+#include "profilerdock.h"
 #endif
 
 LiteManWindow::LiteManWindow(const QString & fileToOpen)
@@ -101,6 +116,11 @@ LiteManWindow::LiteManWindow(const QString & fileToOpen)
 	m_activeItem = 0;
 	statusBar()->addPermanentWidget(m_sqliteVersionLabel);
 
+	m_readTimer = new QTimer(this);
+	m_readTimer->setInterval(10000);
+	connect(m_readTimer, SIGNAL(timeout()), this, SLOT(checkLongReads()));
+	m_readTimer->start();
+
 	queryEditor =  new QueryEditorDialog(this);
 
 	readSettings();
@@ -165,6 +185,8 @@ void LiteManWindow::closeEvent(QCloseEvent * e)
 	}
 	
 	writeSettings();
+	schemaBrowser->storageWidget->cancel();
+	AnalyzeDialog::optimizeOnClose();
 
 	QMapIterator<QString, QString> i(attachedDb);
 	while (i.hasNext())
@@ -205,6 +227,12 @@ void LiteManWindow::initUI()
 
 	setCentralWidget(splitter);
 
+#ifdef INTERNAL_SQLDRIVER
+	profilerDock = new ProfilerDock(this);
+	addDockWidget(Qt::BottomDockWidgetArea, profilerDock);
+	profilerDock->hide();
+#endif
+
 	// Disable the UI, as long as there is no open database
 	schemaBrowser->setEnabled(false);
 	dataViewer->setEnabled(false);
@@ -251,6 +279,23 @@ void LiteManWindow::initActions()
 	recentFilesMenu = new QMenu(this);
 	recentAct->setMenu(recentFilesMenu);
 
+	profileAct = new QAction(tr("Connection &Profile"), this);
+	profileMenu = new QMenu(this);
+	profileAct->setMenu(profileMenu);
+	profileAct->setEnabled(false);
+	profileGroup = new QActionGroup(this);
+	foreach (QString name, ConnectionProfile::names())
+	{
+		ConnectionProfile p(ConnectionProfile::profile(name));
+		QAction * a = new QAction(p.title(), profileGroup);
+		a->setCheckable(true);
+		a->setData(name);
+		a->setStatusTip(p.description());
+		profileMenu->addAction(a);
+	}
+	connect(profileGroup, SIGNAL(triggered(QAction *)),
+			this, SLOT(changeProfile(QAction *)));
+
 	preferencesAct = new QAction(tr("&Preferences..."), this);
 	connect(preferencesAct, SIGNAL(triggered()), this, SLOT(preferences()));
 
@@ -368,12 +413,33 @@ void LiteManWindow::initActions()
 	vacuumAct = new QAction(tr("&Vacuum..."), this);
 	connect(vacuumAct, SIGNAL(triggered()), this, SLOT(vacuumDialog()));
 
+	healthCheckAct = new QAction(tr("&Check Integrity..."), this);
+	connect(healthCheckAct, SIGNAL(triggered()), this, SLOT(healthCheckDialog()));
+
+	foreignKeyAuditAct = new QAction(tr("&Foreign Key Indexes..."), this);
+	connect(foreignKeyAuditAct, SIGNAL(triggered()), this, SLOT(foreignKeyAuditDialog()));
+
+	lockMonitorAct = new QAction(tr("&Lock Monitor..."), this);
+	connect(lockMonitorAct, SIGNAL(triggered()), this, SLOT(lockMonitorDialog()));
+
+	backupAct = new QAction(tr("&Backup and Restore..."), this);
+	connect(backupAct, SIGNAL(triggered()), this, SLOT(backupDialog()));
+
 	attachAct = new QAction(tr("A&ttach Database..."), this);
 	connect(attachAct, SIGNAL(triggered()), this, SLOT(attachDatabase()));
 
 	detachAct = new QAction(tr("&Detach Database"), this);
 	connect(detachAct, SIGNAL(triggered()), this, SLOT(detachDatabase()));
 
+	tableChecksumAct = new QAction(tr("Compare &Table Checksums..."), this);
+	connect(tableChecksumAct, SIGNAL(triggered()), this, SLOT(tableChecksumDialog()));
+
+	dataCompareAct = new QAction(tr("Compare Table &Data..."), this);
+	connect(dataCompareAct, SIGNAL(triggered()), this, SLOT(dataCompareDialog()));
+
+	compressColumnAct = new QAction(tr("Com&press Column..."), this);
+	connect(compressColumnAct, SIGNAL(triggered()), this, SLOT(compressColumnDialog()));
+
 #ifdef ENABLE_EXTENSIONS
 	loadExtensionAct = new QAction(tr("&Load Extensions..."), this);
 	connect(loadExtensionAct, SIGNAL(triggered()), this, SLOT(loadExtension()));
@@ -392,6 +458,7 @@ void LiteManWindow::initMenus()
 	fileMenu->addAction(newAct);
 	fileMenu->addAction(openAct);
 	fileMenu->addAction(recentAct);
+	fileMenu->addAction(profileAct);
 	fileMenu->addSeparator();
 	fileMenu->addAction(preferencesAct);
 	fileMenu->addSeparator();
@@ -408,6 +475,9 @@ void LiteManWindow::initMenus()
 	databaseMenu->addAction(execSqlAct);
 	databaseMenu->addAction(objectBrowserAct);
 	databaseMenu->addAction(dataViewerAct);
+#ifdef INTERNAL_SQLDRIVER
+	databaseMenu->addAction(profilerDock->toggleViewAction());
+#endif
 	databaseMenu->addSeparator();
 	databaseMenu->addAction(exportSchemaAct);
 	databaseMenu->addAction(dumpDatabaseAct);
@@ -416,8 +486,15 @@ void LiteManWindow::initMenus()
 	adminMenu = menuBar()->addMenu(tr("&System"));
 	adminMenu->addAction(analyzeAct);
 	adminMenu->addAction(vacuumAct);
+	adminMenu->addAction(healthCheckAct);
+	adminMenu->addAction(foreignKeyAuditAct);
+	adminMenu->addAction(lockMonitorAct);
+	adminMenu->addAction(backupAct);
 	adminMenu->addSeparator();
 	adminMenu->addAction(attachAct);
+	adminMenu->addAction(tableChecksumAct);
+	adminMenu->addAction(dataCompareAct);
+	adminMenu->addAction(compressColumnAct);
 #ifdef ENABLE_EXTENSIONS
 	adminMenu->addSeparator();
 	adminMenu->addAction(loadExtensionAct);
@@ -466,10 +543,20 @@ void LiteManWindow::rebuildRecentFileMenu()
 		// &10 collides with &1
 		if (i > 8)
 			accel = "";
+		QString profile(ConnectionProfile::profileName(recentDocs.at(i)));
+		if (profile != ConnectionProfile::names().first())
+		{
+			profile = " ["
+					  + ConnectionProfile::profile(profile).title()
+					  + "]";
+		}
+		else
+			profile = "";
 		QAction *a = new QAction(accel
 								 + QString('1' + i)
 								 + " "
-								 + recentDocs.at(i),
+								 + recentDocs.at(i)
+								 + profile,
 								 this);
 		a->setData(QVariant(recentDocs.at(i)));
 		connect(a, SIGNAL(triggered()), this, SLOT(openRecent()));
@@ -538,6 +625,8 @@ void LiteManWindow::newDB()
 	if (QFile::exists(fileName))
 		QFile::remove(fileName);
 
+	// a new file cannot be created read-only
+	ConnectionProfile::setProfileName(fileName, ConnectionProfile::names().first());
 	openDatabase(fileName);
 }
 
@@ -549,10 +638,36 @@ void LiteManWindow::open(const QString & file)
 	if(!file.isNull())
 		fileName = file;
 	else
-		fileName = QFileDialog::getOpenFileName(this,
-								tr("Open Database"),
-								QDir::currentPath(),
-								tr("SQLite database (*)"));
+	{
+		// Qt's own dialog as the native ones cannot take the profile box
+		QFileDialog dialog(this, tr("Open Database"), QDir::currentPath(),
+						   tr("SQLite database (*)"));
+		dialog.setFileMode(QFileDialog::ExistingFile);
+		dialog.setOption(QFileDialog::DontUseNativeDialog);
+		QComboBox * profileBox = new QComboBox(&dialog);
+		profileBox->addItem(tr("Last used for the file"), QString());
+		foreach (QString name, ConnectionProfile::names())
+		{
+			ConnectionProfile p(ConnectionProfile::profile(name));
+			profileBox->addItem(p.title(), name);
+			profileBox->setItemData(profileBox->count() - 1,
+									p.description(), Qt::ToolTipRole);
+		}
+		QGridLayout * layout = qobject_cast<QGridLayout*>(dialog.layout());
+		if (layout)
+		{
+			int row = layout->rowCount();
+			layout->addWidget(new QLabel(tr("Connection profile:"), &dialog), row, 0);
+			layout->addWidget(profileBox, row, 1);
+		}
+		if (dialog.exec() && !dialog.selectedFiles().isEmpty())
+		{
+			fileName = dialog.selectedFiles().first();
+			QString profile(profileBox->itemData(profileBox->currentIndex()).toString());
+			if (!profile.isEmpty())
+				ConnectionProfile::setProfileName(fileName, profile);
+		}
+	}
 
 	if(fileName.isNull()) { return; }
 	if (QFile::exists(fileName))
@@ -578,6 +693,8 @@ void LiteManWindow::openDatabase(const QString & fileName)
 	QSqlDatabase db = QSqlDatabase::database(SESSION_NAME);
 	if (db.isValid())
 	{
+		schemaBrowser->storageWidget->cancel();
+		AnalyzeDialog::optimizeOnClose();
 		db.close();
 		QSqlDatabase::removeDatabase(SESSION_NAME);
 	}
@@ -587,7 +704,9 @@ void LiteManWindow::openDatabase(const QString & fileName)
 	db = QSqlDatabase::addDatabase("QSQLITE", SESSION_NAME);
 #endif
 
+	m_profile = ConnectionProfile::profile(ConnectionProfile::profileName(fileName));
 	db.setDatabaseName(fileName);
+	db.setConnectOptions(m_profile.connectOptions());
 
 	if (!db.open())
 	{
@@ -618,6 +737,24 @@ void LiteManWindow::openDatabase(const QString & fileName)
 		isOpened = true;
 		dataViewer->removeErrorMessage();
 
+#ifdef INTERNAL_SQLDRIVER
+		profilerDock->watch(db);
+#endif
+		// backoff instead of the fixed busy timeout of the driver
+		BusyHandler::install(Database::sqlite3handle());
+		QString err(m_profile.apply(db));
+		if (!err.isEmpty())
+		{
+			dataViewer->setStatusText(
+				tr("Cannot apply the connection profile %1")
+					.arg(m_profile.title())
+				+ ":<br/><span style=\" color:#ff0000;\">"
+				+ err
+				+ "<br/></span>");
+		}
+		foreach (QAction * a, profileGroup->actions())
+			a->setChecked(a->data().toString() == m_profile.name());
+
 		// check for sqlite library version
 		QString ver;
 		if (q.exec("select sqlite_version(*);"))
@@ -668,6 +805,7 @@ void LiteManWindow::openDatabase(const QString & fileName)
 	}
 
 	// Enable UI
+	profileAct->setEnabled(isOpened);
 	schemaBrowser->setEnabled(isOpened);
 	databaseMenu->setEnabled(isOpened);
 	adminMenu->setEnabled(isOpened);
@@ -677,7 +815,7 @@ void LiteManWindow::openDatabase(const QString & fileName)
 	if (n)
 	{
 		dataViewer->setStatusText(
-			tr("Cannot create user function exec")
+			tr("Cannot create user functions")
 			+ ":<br/><span style=\" color:#ff0000;\">"
 			+ sqlite3_errstr(n)
 			+ "<br/></span>");
@@ -737,6 +875,18 @@ void LiteManWindow::openRecent()
 		open(action->data().toString());
 }
 
+void LiteManWindow::changeProfile(QAction * action)
+{
+	QString fileName(QSqlDatabase::database(SESSION_NAME).databaseName());
+	if (fileName.isEmpty() || action->data().toString() == m_profile.name())
+		return;
+	ConnectionProfile::setProfileName(fileName, action->data().toString());
+	openDatabase(fileName);
+	// keep the check mark right if the reopening was cancelled
+	foreach (QAction * a, profileGroup->actions())
+		a->setChecked(a->data().toString() == m_profile.name());
+}
+
 void LiteManWindow::about()
 {
 
@@ -878,18 +1028,10 @@ void LiteManWindow::exportSchema()
 void LiteManWindow::dumpDatabase()
 {
 	dataViewer->removeErrorMessage();
-	QString fileName = QFileDialog::getSaveFileName(this, tr("Export Database"),
-                                                    QDir::currentPath(),
-                                                    tr("SQL File (*.sql)"));
-
-	if (fileName.isNull())
-		return;
-
-	if (Database::dumpDatabase(fileName))
-	{
-		QMessageBox::information(this, m_appName,
-								 tr("Dump written into: %1").arg(fileName));
-	}
+	if (!checkForPending()) { return; }
+	DumpDialog *dia = new DumpDialog(m_mainDbPath, this);
+	dia->exec();
+	delete dia;
 }
 
 void LiteManWindow::createTable()
@@ -1414,7 +1556,8 @@ void LiteManWindow::describeIndex() { describeObject("index"); }
 void LiteManWindow::analyzeDialog()
 {
 	dataViewer->removeErrorMessage();
-	AnalyzeDialog *dia = new AnalyzeDialog(this);
+	AnalyzeDialog *dia = new AnalyzeDialog(m_mainDbPath, this);
+	connect(dia, SIGNAL(aboutToAnalyze()), this, SLOT(releaseDataView()));
 	dia->exec();
 	delete dia;
 	foreach (QTreeWidgetItem* item, schemaBrowser->tableTree->searchMask(schemaBrowser->tableTree->trSys))
@@ -1428,10 +1571,123 @@ void LiteManWindow::vacuumDialog()
 {
 	dataViewer->removeErrorMessage();
 	VacuumDialog *dia = new VacuumDialog(this);
+	connect(dia, SIGNAL(aboutToRebuild()), this, SLOT(releaseDataView()));
+	dia->exec();
+	// auto_vacuum may have been changed
+	schemaBrowser->buildPragmasTree();
+	delete dia;
+}
+
+void LiteManWindow::healthCheckDialog()
+{
+	dataViewer->removeErrorMessage();
+	HealthCheckDialog *dia = new HealthCheckDialog(this);
 	dia->exec();
 	delete dia;
 }
 
+void LiteManWindow::foreignKeyAuditDialog()
+{
+	dataViewer->removeErrorMessage();
+	ForeignKeyAuditDialog *dia = new ForeignKeyAuditDialog(this);
+	dia->exec();
+	if (dia->update)
+	{
+		schemaBrowser->tableTree->buildTree();
+		queryEditor->treeChanged();
+		checkForCatalogue();
+	}
+	delete dia;
+}
+
+void LiteManWindow::tableChecksumDialog()
+{
+	dataViewer->removeErrorMessage();
+	TableChecksumDialog *dia = new TableChecksumDialog(this);
+	dia->exec();
+	delete dia;
+}
+
+void LiteManWindow::dataCompareDialog()
+{
+	dataViewer->removeErrorMessage();
+	DataCompareDialog *dia = new DataCompareDialog(this);
+	dia->exec();
+	delete dia;
+}
+
+void LiteManWindow::compressColumnDialog()
+{
+	dataViewer->removeErrorMessage();
+	if (!checkForPending()) { return; }
+	CompressColumnDialog *dia = new CompressColumnDialog(this);
+	connect(dia, SIGNAL(aboutToCompress()), this, SLOT(releaseDataView()));
+	dia->exec();
+	if (dia->update)
+	{
+		schemaBrowser->tableTree->buildTree();
+		queryEditor->treeChanged();
+	}
+	delete dia;
+}
+
+void LiteManWindow::lockMonitorDialog()
+{
+	LockMonitorDialog * dia = new LockMonitorDialog(this);
+	dia->setAttribute(Qt::WA_DeleteOnClose);
+	dia->show();
+}
+
+void LiteManWindow::checkLongReads()
+{
+	QDateTime oldest;
+	foreach (LockMonitorDialog::OpenStatement statement,
+			 LockMonitorDialog::openStatements())
+	{
+		if (!oldest.isValid() || statement.since < oldest)
+			oldest = statement.since;
+	}
+	if (!oldest.isValid() || oldest == m_readWarned)
+		return;
+	int seconds = oldest.secsTo(QDateTime::currentDateTime());
+	if (seconds < LockMonitorDialog::readWarning())
+		return;
+
+	m_readWarned = oldest;
+	SqlTableModel * table = qobject_cast<SqlTableModel*>(dataViewer->tableData());
+	if (table && table->pendingTransaction())
+		statusBar()->showMessage(tr("The data view has kept a read transaction open "
+									"for %1 s. It blocks checkpoints and writers; "
+									"commit or roll back its changes.").arg(seconds), 20000);
+	else
+		statusBar()->showMessage(tr("A query has kept a read transaction open for %1 s. "
+									"It blocks checkpoints and writers; fetch all "
+									"its rows or close it.").arg(seconds), 20000);
+}
+
+void LiteManWindow::backupDialog()
+{
+	dataViewer->removeErrorMessage();
+	if (!checkForPending()) { return; }
+	BackupDialog *dia = new BackupDialog(this);
+	connect(dia, SIGNAL(aboutToRestore()), this, SLOT(releaseDataView()));
+	dia->exec();
+	if (dia->update)
+	{
+		schemaBrowser->tableTree->buildTree();
+		schemaBrowser->buildPragmasTree();
+		queryEditor->treeChanged();
+	}
+	delete dia;
+}
+
+void LiteManWindow::releaseDataView()
+{
+	// the statements of the shown model would block the connection
+	dataViewer->setTableModel(new QSqlQueryModel(), false);
+	m_activeItem = 0;
+}
+
 void LiteManWindow::attachDatabase()
 {
 	dataViewer->removeErrorMessage();
@@ -1458,7 +1714,7 @@ void LiteManWindow::attachDatabase()
 	if (!ok || schema.isEmpty())
 		return;
 	QString sql = QString("ATTACH DATABASE ")
-				  + Utils::literal(fileName)
+				  + Utils::literal(m_profile.attachName(fileName))
 				  + " as "
 				  + Utils::quote(schema)
 				  + ";";
@@ -1476,10 +1732,17 @@ void LiteManWindow::attachDatabase()
 	}
 	else
 	{
+		QString err(m_profile.apply(QSqlDatabase::database(SESSION_NAME), schema));
 		attachedDb[schema] = Database::sessionName(schema);
+#ifdef INTERNAL_SQLDRIVER
+		QSqlDatabase db = QSqlDatabase::addDatabase(new QSQLiteDriver(this),
+													attachedDb[schema]);
+#else
 		QSqlDatabase db =
 			QSqlDatabase::addDatabase("QSQLITE", attachedDb[schema]);
+#endif
 		db.setDatabaseName(fileName);
+		db.setConnectOptions(m_profile.connectOptions());
 		if (!db.open())
 		{
 			dataViewer->setStatusText(
@@ -1514,6 +1777,19 @@ void LiteManWindow::attachDatabase()
 			}
 			else
 			{
+#ifdef INTERNAL_SQLDRIVER
+				profilerDock->watch(db);
+#endif
+				err += m_profile.apply(db);
+				if (!err.isEmpty())
+				{
+					dataViewer->setStatusText(
+						tr("Cannot apply the connection profile %1")
+							.arg(m_profile.title())
+						+ ":<br/><span style=\" color:#ff0000;\">"
+						+ err
+						+ "<br/></span>");
+				}
 				schemaBrowser->tableTree->buildDatabase(schema);
 				queryEditor->treeChanged();
 			}
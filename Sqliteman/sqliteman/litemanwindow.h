@@ -8,17 +8,23 @@ for which a new license (GPL+exception) is in place.
 #ifndef LITEMANWINDOW_H
 #define LITEMANWINDOW_H
 
+#include <QDateTime>
 #include <QMainWindow>
 #include <QPointer>
 #include <QMap>
 
+#include "connectionprofile.h"
+
 class QAction;
+class QActionGroup;
 class QLabel;
 class QMenu;
 class QSplitter;
+class QTimer;
 class QTreeWidgetItem;
 
 class DataViewer;
+class ProfilerDock;
 class HelpBrowser;
 class QueryEditorDialog;
 class SchemaBrowser;
@@ -108,6 +114,8 @@ class LiteManWindow : public QMainWindow
 		is present, the file dialog will not be shown. */
 		void open(const QString & file = QString());
 		void openRecent();
+		//! \brief Reopen the current database with another connection profile.
+		void changeProfile(QAction * action);
 		void about();
 		void aboutQt();
 		void help();
@@ -149,8 +157,19 @@ class LiteManWindow : public QMainWindow
 
 		void analyzeDialog();
 		void vacuumDialog();
+		void healthCheckDialog();
+		void foreignKeyAuditDialog();
+		void lockMonitorDialog();
+		//! \brief Warn about a read transaction held open by the data view.
+		void checkLongReads();
+		void backupDialog();
+		//! \brief Show an empty data view to free the open statements.
+		void releaseDataView();
 		void attachDatabase();
 		void detachDatabase();
+		void tableChecksumDialog();
+		void dataCompareDialog();
+		void compressColumnDialog();
 		void loadExtension();
 
 		void createTrigger();
@@ -167,8 +186,14 @@ class LiteManWindow : public QMainWindow
 		QString m_mainDbPath;
 		QString m_appName;
 		QString m_lang;
+		//! \brief The profile of the main connection, used for attached databases too
+		ConnectionProfile m_profile;
 		QTreeWidgetItem * m_activeItem;
 		QLabel * m_sqliteVersionLabel;
+		//! \brief Polls the open statements for checkLongReads()
+		QTimer * m_readTimer;
+		//! \brief The start of the read transaction warned about last
+		QDateTime m_readWarned;
 
 		// \brief True if is sqlite3 binary available in the path
 // 		bool m_sqliteBinAvailable;
@@ -184,15 +209,21 @@ class LiteManWindow : public QMainWindow
 		SqlEditor* sqlEditor;
 		QSplitter* splitterSql;
 		HelpBrowser * helpBrowser;
+#ifdef INTERNAL_SQLDRIVER
+		ProfilerDock * profilerDock;
+#endif
 		
 		QMenu * databaseMenu;
 		QMenu * adminMenu;
 		QMenu * recentFilesMenu;
+		QMenu * profileMenu;
+		QActionGroup * profileGroup;
 		QMenu * contextMenu;
 
 		QAction * newAct;
 		QAction * openAct;
 		QAction * recentAct;
+		QAction * profileAct;
 		QAction * exitAct;
 		QAction * aboutAct;
 		QAction * aboutQtAct;
@@ -232,8 +263,15 @@ class LiteManWindow : public QMainWindow
 
 		QAction * analyzeAct;
 		QAction * vacuumAct;
+		QAction * healthCheckAct;
+		QAction * foreignKeyAuditAct;
+		QAction * lockMonitorAct;
+		QAction * backupAct;
 		QAction * attachAct;
 		QAction * detachAct;
+		QAction * tableChecksumAct;
+		QAction * dataCompareAct;
+		QAction * compressColumnAct;
 #ifdef ENABLE_EXTENSIONS
 		QAction * loadExtensionAct;
 #endif
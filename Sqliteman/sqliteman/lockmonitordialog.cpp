@@ -0,0 +1,312 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSettings>
+#include <QSqlQuery>
+#include <QTimer>
+
+#include "lockmonitordialog.h"
+#include "busyhandler.h"
+#include "database.h"
+#include "utils.h"
+
+// databaseTree columns
+#define COL_DATABASE 0
+#define COL_TRANSACTION 1
+#define COL_JOURNAL 2
+#define COL_WAL_SIZE 3
+#define COL_WAL_FRAMES 4
+#define COL_WRITE_LOCK 5
+
+// statementTree columns
+#define COL_STATEMENT 0
+#define COL_AGE 1
+#define COL_WARNING 2
+
+// transaction levels of transactionState()
+#define TXN_UNKNOWN -1
+#define TXN_NONE 0
+#define TXN_READ 1
+#define TXN_WRITE 2
+
+
+//! \brief Statement -> when it has been seen running first
+static QMap<sqlite3_stmt*,LockMonitorDialog::OpenStatement> s_seen;
+
+
+LockMonitorDialog::LockMonitorDialog(QWidget * parent)
+	: QDialog(parent)
+{
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("lockmonitor/height", QVariant(500)).toInt();
+	int ww = settings.value("lockmonitor/width", QVariant(650)).toInt();
+	resize(ww, hh);
+	ui.probeCheckBox->setChecked(settings.value("lockmonitor/probe",
+										QVariant(false)).toBool());
+	setPolicyWidgets();
+
+	m_timer = new QTimer(this);
+	m_timer->setInterval(1000);
+	connect(m_timer, SIGNAL(timeout()), this, SLOT(refresh()));
+	connect(ui.checkpointButton, SIGNAL(clicked()), this, SLOT(checkpointButton_clicked()));
+	connect(ui.resetButton, SIGNAL(clicked()), this, SLOT(resetButton_clicked()));
+	connect(ui.applyButton, SIGNAL(clicked()), this, SLOT(applyButton_clicked()));
+
+	refresh();
+	for (int i = 0; i < ui.databaseTree->columnCount(); ++i)
+		ui.databaseTree->resizeColumnToContents(i);
+	m_timer->start();
+}
+
+LockMonitorDialog::~LockMonitorDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+    settings.setValue("lockmonitor/height", QVariant(height()));
+    settings.setValue("lockmonitor/width", QVariant(width()));
+	settings.setValue("lockmonitor/probe", QVariant(ui.probeCheckBox->isChecked()));
+}
+
+QList<LockMonitorDialog::OpenStatement> LockMonitorDialog::openStatements()
+{
+	QList<OpenStatement> ret;
+	sqlite3 * db = Database::sqlite3handle();
+	if (!db)
+	{
+		s_seen.clear();
+		return ret;
+	}
+
+	QMap<sqlite3_stmt*,OpenStatement> seen;
+	QDateTime now(QDateTime::currentDateTime());
+	for (sqlite3_stmt * stmt = sqlite3_next_stmt(db, 0); stmt; stmt = sqlite3_next_stmt(db, stmt))
+	{
+		// a stepped statement not reset yet keeps its read transaction
+		if (!sqlite3_stmt_busy(stmt))
+			continue;
+		OpenStatement statement;
+		statement.sql = QString::fromUtf8(sqlite3_sql(stmt)).simplified();
+		statement.since = now;
+		// a finalized statement may leave its address to a new one
+		if (s_seen.contains(stmt) && s_seen[stmt].sql == statement.sql)
+			statement.since = s_seen[stmt].since;
+		seen[stmt] = statement;
+		ret.append(statement);
+	}
+	s_seen = seen;
+	return ret;
+}
+
+int LockMonitorDialog::readWarning()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	return settings.value("busy/readWarning", QVariant(60)).toInt();
+}
+
+void LockMonitorDialog::setPolicyWidgets()
+{
+	BusyHandler::Policy policy(BusyHandler::policy());
+	ui.timeoutSpinBox->setValue(policy.timeout);
+	ui.initialDelaySpinBox->setValue(policy.initialDelay);
+	ui.maxDelaySpinBox->setValue(policy.maxDelay);
+	ui.warnSpinBox->setValue(readWarning());
+}
+
+QString LockMonitorDialog::transactionState(sqlite3 * db, const QString & schema,
+											bool openStatements, int & level)
+{
+#if SQLITE_VERSION_NUMBER >= 3034000
+	Q_UNUSED(openStatements);
+	switch (sqlite3_txn_state(db, schema.toUtf8().constData()))
+	{
+		case SQLITE_TXN_READ:
+			level = TXN_READ;
+			return tr("read");
+		case SQLITE_TXN_WRITE:
+			level = TXN_WRITE;
+			return tr("write");
+		default:
+			level = TXN_NONE;
+			return tr("none");
+	}
+#else
+	Q_UNUSED(schema);
+	// sqlite3_txn_state() needs sqlite 3.34; only the connection is known
+	if (!sqlite3_get_autocommit(db))
+	{
+		level = TXN_UNKNOWN;
+		return tr("open (BEGIN)");
+	}
+	level = openStatements ? TXN_READ : TXN_NONE;
+	return openStatements ? tr("read (open statements)") : tr("none");
+#endif
+}
+
+QString LockMonitorDialog::probeWriteLock(const QString & fileName, int transaction)
+{
+	sqlite3 * probe = 0;
+	QByteArray name(QDir::toNativeSeparators(fileName).toUtf8());
+	if (sqlite3_open_v2(name.constData(), &probe, SQLITE_OPEN_READWRITE, 0) != SQLITE_OK)
+	{
+		QString error(QString::fromUtf8(sqlite3_errmsg(probe)));
+		sqlite3_close(probe);
+		return error;
+	}
+
+	// the probe never waits, nobody is blocked by it for long
+	QString ret;
+	int rc = sqlite3_exec(probe, "SELECT count(*) FROM sqlite_master;", 0, 0, 0);
+	if (rc == SQLITE_BUSY)
+		ret = tr("exclusive, readers are blocked");
+	else if (rc != SQLITE_OK)
+		ret = QString::fromUtf8(sqlite3_errmsg(probe));
+	else
+	{
+		rc = sqlite3_exec(probe, "BEGIN IMMEDIATE;", 0, 0, 0);
+		if (rc == SQLITE_OK)
+		{
+			ret = tr("free");
+			sqlite3_exec(probe, "ROLLBACK;", 0, 0, 0);
+		}
+		else if (rc == SQLITE_BUSY)
+		{
+			if (transaction == TXN_WRITE)
+				ret = tr("held by Sqliteman");
+			else if (transaction == TXN_UNKNOWN)
+				ret = tr("held by Sqliteman or another connection");
+			else
+				ret = tr("held by another connection");
+		}
+		else
+			ret = QString::fromUtf8(sqlite3_errmsg(probe));
+	}
+	sqlite3_close(probe);
+	return ret;
+}
+
+void LockMonitorDialog::refresh()
+{
+	sqlite3 * db = Database::sqlite3handle();
+	if (!db)
+		return;
+	// before the queries of this method are open
+	QList<OpenStatement> statements(openStatements());
+
+	QString current(ui.databaseTree->currentItem()
+					? ui.databaseTree->currentItem()->text(COL_DATABASE)
+					: QString("main"));
+	bool mainWal = false;
+	ui.databaseTree->clear();
+	DbAttach databases(Database::getDatabases());
+	foreach (QString schema, databases.keys())
+	{
+		QString fileName(databases.value(schema));
+		QString journal;
+		int pageSize = 0;
+		ForwardQuery query(QString("PRAGMA %1.journal_mode;")
+						   .arg(Utils::quote(schema)));
+		if (query.next())
+			journal = query.value(0).toString().toLower();
+		ForwardQuery size(QString("PRAGMA %1.page_size;")
+						  .arg(Utils::quote(schema)));
+		if (size.next())
+			pageSize = size.value(0).toInt();
+		if (schema == "main")
+			mainWal = (journal == "wal");
+
+		QTreeWidgetItem * item = new QTreeWidgetItem(ui.databaseTree);
+		item->setText(COL_DATABASE, schema);
+		item->setToolTip(COL_DATABASE, fileName);
+		int level;
+		item->setText(COL_TRANSACTION,
+					  transactionState(db, schema, !statements.isEmpty(), level));
+		item->setText(COL_JOURNAL, journal);
+
+		QFileInfo wal(fileName + "-wal");
+		if (journal == "wal" && wal.exists())
+		{
+			// 32 bytes of the WAL header, 24 bytes of every frame header
+			qlonglong size = wal.size();
+			qlonglong frames = (size > 32 && pageSize > 0) ? (size - 32) / (pageSize + 24) : 0;
+			item->setText(COL_WAL_SIZE, Utils::formatSize(size));
+			item->setData(COL_WAL_FRAMES, Qt::DisplayRole, frames);
+		}
+		if (ui.probeCheckBox->isChecked() && QFileInfo(fileName).isFile())
+			item->setText(COL_WRITE_LOCK, probeWriteLock(fileName, level));
+		if (schema == current)
+			ui.databaseTree->setCurrentItem(item);
+	}
+
+	ui.statementTree->clear();
+	QDateTime now(QDateTime::currentDateTime());
+	int warning = readWarning();
+	foreach (OpenStatement statement, statements)
+	{
+		int age = statement.since.secsTo(now);
+		QTreeWidgetItem * item = new QTreeWidgetItem(ui.statementTree);
+		item->setText(COL_STATEMENT, statement.sql);
+		item->setToolTip(COL_STATEMENT, statement.sql);
+		item->setData(COL_AGE, Qt::DisplayRole, age);
+		if (age < warning)
+			continue;
+		item->setText(COL_WARNING, mainWal ? tr("Blocks checkpoints") : tr("Blocks writers"));
+		item->setForeground(COL_WARNING, Qt::red);
+	}
+
+	BusyHandler::Stats stats(BusyHandler::stats());
+	ui.contentionsValue->setText(QString::number(stats.contentions));
+	ui.waitsValue->setText(QString::number(stats.waits));
+	ui.timeoutsValue->setText(QString::number(stats.timeouts));
+	ui.waitTimeValue->setText(tr("%1 s").arg(stats.waitTime / 1000.0, 0, 'f', 1));
+	ui.longestValue->setText(tr("%1 ms").arg(stats.longestWait));
+}
+
+void LockMonitorDialog::checkpointButton_clicked()
+{
+	QTreeWidgetItem * item = ui.databaseTree->currentItem();
+	QString schema(item ? item->text(COL_DATABASE) : QString("main"));
+	// PASSIVE never waits for readers or writers
+	ForwardQuery query(QString("PRAGMA %1.wal_checkpoint(PASSIVE);")
+					   .arg(Utils::quote(schema)));
+	if (!query.next())
+		return;
+	int log = query.value(1).toInt();
+	int checkpointed = query.value(2).toInt();
+	if (log < 0)
+	{
+		ui.statusLabel->setText(tr("%1 is not in WAL mode.").arg(schema));
+		return;
+	}
+	QString text(tr("Checkpoint of %1: %2 of %3 frames copied into the database.")
+				 .arg(schema).arg(checkpointed).arg(log));
+	if (checkpointed < log)
+		text += " " + tr("The rest is still used by open read transactions "
+						 "or a writer; the WAL file cannot be restarted.");
+	ui.statusLabel->setText(text);
+	refresh();
+}
+
+void LockMonitorDialog::resetButton_clicked()
+{
+	BusyHandler::resetStats();
+	refresh();
+}
+
+void LockMonitorDialog::applyButton_clicked()
+{
+	BusyHandler::Policy policy;
+	policy.timeout = ui.timeoutSpinBox->value();
+	policy.initialDelay = ui.initialDelaySpinBox->value();
+	policy.maxDelay = qMax(ui.maxDelaySpinBox->value(), policy.initialDelay);
+	BusyHandler::setPolicy(policy);
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("busy/readWarning", QVariant(ui.warnSpinBox->value()));
+	setPolicyWidgets();
+	refresh();
+}
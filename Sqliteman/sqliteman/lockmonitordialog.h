@@ -0,0 +1,75 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef LOCKMONITORDIALOG_H
+#define LOCKMONITORDIALOG_H
+
+#include <qdialog.h>
+#include <QDateTime>
+
+#include "sqlite3.h"
+#include "ui_lockmonitordialog.h"
+
+class QTimer;
+
+
+/*! \brief Show the locks of the databases and the waits for them.
+For every attached database there is the transaction state of the
+main connection, the journal mode, the size of the WAL file and
+optionally a probe of the write lock from another connection.
+Statements of the main connection which hold a read transaction open
+(typically a partly fetched data view) are listed with a warning when
+they are open too long; they block WAL checkpoints and writers.
+The BusyHandler counters and its policy are shown too.
+It refreshes itself every second.
+*/
+class LockMonitorDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		//! \brief A statement of the main connection which has not finished.
+		struct OpenStatement
+		{
+			QString sql;
+			//! \brief When it has been seen running for the first time
+			QDateTime since;
+		};
+
+		LockMonitorDialog(QWidget * parent = 0);
+		~LockMonitorDialog();
+
+		/*! \brief Running statements of the main connection.
+		Every call updates the first-seen times, so it has to be polled.
+		*/
+		static QList<OpenStatement> openStatements();
+		//! \brief Warn about read transactions open longer than this (seconds).
+		static int readWarning();
+
+	private:
+		Ui::LockMonitorDialog ui;
+		QTimer * m_timer;
+
+		/*! \brief Transaction state of the main connection on schema.
+		\param level one of the TXN_ levels
+		*/
+		QString transactionState(sqlite3 * db, const QString & schema,
+								 bool openStatements, int & level);
+		/*! \brief Try to take the write lock from an own connection without waiting.
+		\param transaction the TXN_ level of the main connection
+		*/
+		QString probeWriteLock(const QString & fileName, int transaction);
+		void setPolicyWidgets();
+
+	private slots:
+		void refresh();
+		void checkpointButton_clicked();
+		void resetButton_clicked();
+		void applyButton_clicked();
+};
+
+#endif
@@ -112,12 +112,13 @@ qlonglong PopulatorDialog::tableRowCount()
 				  + "."
 				  + Utils::quote(m_table)
 				  + ";";
-	QSqlQuery query(sql, QSqlDatabase::database(SESSION_NAME));
-	if (!execSql(sql, tr("Cannot get statistics for table")))
+	ForwardQuery query(sql);
+	if (query.lastError().isValid())
 	{
+		queryError(query, sql, tr("Cannot get statistics for table"));
 		return -1;
 	}
-	while(query.next())
+	if (query.next())
 		return query.value(0).toLongLong();
 	return -1;
 }
@@ -135,8 +136,9 @@ QString PopulatorDialog::sqlColumns()
 
 void PopulatorDialog::populateButton_clicked()
 {
-	// Avoid QVariantList extension because it doesn't work for column names
-	// containing special characters
+	// The rows are bound column-wise (QVariantList) to positional
+	// placeholders; named ones made of the column names don't work for
+	// names containing special characters.
 	resultEdit->setHtml("");
 	m_columnList.clear();
 	for (int i = 0; i < columnTable->rowCount(); ++i)
@@ -188,38 +190,46 @@ void PopulatorDialog::populateButton_clicked()
 	resultEdit->clear();
 
 	cntPre = tableRowCount();
-	QSqlQuery query(QSqlDatabase::database(SESSION_NAME));
-	for (int i = 0; i < spinBox->value(); ++i)
+	QStringList binds;
+	for (int j = 0; j < values.count(); ++j)
+		binds.append("?");
+	QString sql = QString("INSERT ")
+				  + (constraintBox->isChecked() ? "OR IGNORE" : "")
+				  + " INTO "
+				  + Utils::quote(m_schema)
+				  + "."
+				  + Utils::quote(m_table)
+				  + " ("
+				  + sqlColumns()
+				  + ") VALUES ("
+				  + binds.join(",")
+				  + ");";
+
+	ForwardQuery query;
+	if (!query.prepare(sql))
+		queryError(query, sql, tr("Cannot insert values"));
+	else
 	{
-		QStringList slr;
 		for (int j = 0; j < values.count(); ++j)
+			query.bindValue(j, values.at(j));
+		if (query.execBatch())
+			updated = true;
+		else
 		{
-			slr.append(Utils::literal(values.at(j).at(i).toString()));
-		}
-		QString sql = QString("INSERT ")
-					  + (constraintBox->isChecked() ? "OR IGNORE" : "")
-					  + " INTO "
-					  + Utils::quote(m_schema)
-					  + "."
-					  + Utils::quote(m_table)
-					  + " ("
-					  + sqlColumns()
-					  + ") VALUES ("
-					  + slr.join(",")
-					  + ");";
-
-		query.prepare(sql);
-		if (!query.exec())
-		{
-			QString errtext = tr("Cannot insert values")
-							  + ":<br/><span style=\" color:#ff0000;\">"
-							  + query.lastError().text()
-							  + "<br/></span>" + tr("using sql statement:")
-							  + "<br/><tt>" + sql;
-			resultAppend(errtext);
-			if (!constraintBox->isChecked()) { break; }
+			// The batch is rolled back as a whole. Go row by row to keep
+			// the rows before the failing one, as it was without a batch.
+			for (int i = 0; i < spinBox->value(); ++i)
+			{
+				for (int j = 0; j < values.count(); ++j)
+					query.bindValue(j, values.at(j).at(i));
+				if (!query.exec())
+				{
+					queryError(query, sql, tr("Cannot insert values"));
+					if (!constraintBox->isChecked()) { break; }
+				}
+				else { updated = true; }
+			}
 		}
-		else { updated = true; }
 	}
 
 	if (!execSql("RELEASE POPULATOR;", tr("Cannot release savepoint")))
@@ -249,16 +259,10 @@ QVariantList PopulatorDialog::autoValues(Populator::PopColumn c)
 				  + Utils::quote(m_table)
 				  + ";";
 
-	QSqlQuery query(sql, QSqlDatabase::database(SESSION_NAME));
+	ForwardQuery query(sql);
 	if (query.lastError().isValid())
 	{
-		QString errtext = tr("Cannot get MAX() for column ")
-						  + c.name
-						  + ":<br/><span style=\" color:#ff0000;\">"
-						  + query.lastError().text()
-						  + "<br/></span>" + tr("using sql statement:")
-						  + "<br/><tt>" + sql;
-		resultAppend(errtext);
+		queryError(query, sql, tr("Cannot get MAX() for column ") + c.name);
 		return QVariantList();
 	}
 
@@ -383,20 +387,26 @@ QVariantList PopulatorDialog::dateValues(Populator::PopColumn c)
 
 bool PopulatorDialog::execSql(const QString & statement, const QString & message)
 {
-	QSqlQuery query(statement, QSqlDatabase::database(SESSION_NAME));
+	ForwardQuery query(statement);
 	if(query.lastError().isValid())
 	{
-		QString errtext = message
-						  + ":<br/><span style=\" color:#ff0000;\">"
-						  + query.lastError().text()
-						  + "<br/></span>" + tr("using sql statement:")
-						  + "<br/><tt>" + statement;
-		resultAppend(errtext);
+		queryError(query, statement, message);
 		return false;
 	}
 	return true;
 }
 
+void PopulatorDialog::queryError(const QSqlQuery & query, const QString & statement,
+								 const QString & message)
+{
+	QString errtext = message
+					  + ":<br/><span style=\" color:#ff0000;\">"
+					  + query.lastError().text()
+					  + "<br/></span>" + tr("using sql statement:")
+					  + "<br/><tt>" + statement;
+	resultAppend(errtext);
+}
+
 void PopulatorDialog::resultAppend(QString text)
 {
 	resultEdit->append(text);
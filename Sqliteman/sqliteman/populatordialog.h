@@ -82,6 +82,9 @@ class PopulatorDialog : public QDialog, public Ui::PopulatorDialog
 		qlonglong tableRowCount();
 
 		bool execSql(const QString & statement, const QString & message);
+		//! Report the error of query, which ran statement, after message.
+		void queryError(const QSqlQuery & query, const QString & statement,
+						const QString & message);
 
 		void resultAppend(QString text);
 
@@ -0,0 +1,182 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QDir>
+#include <QFile>
+#include <QFileDialog>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QTextStream>
+
+#include "profilerdock.h"
+
+// the oldest statements are dropped above this count
+#define PROFILER_MAX_ROWS 1000
+
+
+static QTableWidgetItem * numberItem(qlonglong value)
+{
+	QTableWidgetItem * item = new QTableWidgetItem();
+	// numbers as data so the columns sort numerically
+	item->setData(Qt::DisplayRole, value);
+	item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+	return item;
+}
+
+static QString csvField(QString value)
+{
+	return "\"" + value.replace("\"", "\"\"") + "\"";
+}
+
+
+ProfilerDock::ProfilerDock(QWidget * parent)
+	: QDockWidget(parent),
+	  m_counter(0)
+{
+	setupUi(this);
+
+	QStringList labels;
+	labels << tr("#")
+		   << tr("Statement")
+		   << tr("Prepare (us)")
+		   << tr("First Row (us)")
+		   << tr("Step (us)")
+		   << tr("Rows")
+		   << tr("Full Scan Steps")
+		   << tr("Sorts")
+		   << tr("Auto Indexes")
+		   << tr("VM Steps")
+		   << tr("Cache Hits")
+		   << tr("Cache Misses");
+	tableWidget->setColumnCount(labels.count());
+	tableWidget->setHorizontalHeaderLabels(labels);
+	tableWidget->verticalHeader()->hide();
+	tableWidget->sortByColumn(0, Qt::AscendingOrder);
+
+	connect(recordCheckBox, SIGNAL(toggled(bool)),
+			this, SLOT(recordCheckBox_toggled(bool)));
+	connect(clearButton, SIGNAL(clicked()),
+			this, SLOT(clearButton_clicked()));
+	connect(exportButton, SIGNAL(clicked()),
+			this, SLOT(exportButton_clicked()));
+}
+
+void ProfilerDock::watch(const QSqlDatabase & db)
+{
+	QSQLiteDriver * drv = qobject_cast<QSQLiteDriver*>(db.driver());
+	if (!drv)
+		return;
+
+	if (m_drivers.contains(drv))
+		return;
+	drv->setProfiling(recordCheckBox->isChecked());
+	connect(drv, SIGNAL(statementProfiled(const QSQLiteStatementProfile &)),
+			this, SLOT(statementProfiled(const QSQLiteStatementProfile &)));
+	m_drivers.append(drv);
+}
+
+void ProfilerDock::statementProfiled(const QSQLiteStatementProfile & profile)
+{
+	// sorting would move the row while it is being filled
+	tableWidget->setSortingEnabled(false);
+
+	if (tableWidget->rowCount() >= PROFILER_MAX_ROWS)
+	{
+		int oldest = 0;
+		for (int i = 1; i < tableWidget->rowCount(); ++i)
+		{
+			if (tableWidget->item(i, 0)->data(Qt::DisplayRole).toInt()
+				< tableWidget->item(oldest, 0)->data(Qt::DisplayRole).toInt())
+				oldest = i;
+		}
+		tableWidget->removeRow(oldest);
+	}
+
+	int row = tableWidget->rowCount();
+	tableWidget->insertRow(row);
+
+	QTableWidgetItem * sqlItem = new QTableWidgetItem(profile.sql.simplified());
+	sqlItem->setToolTip(profile.sql);
+
+	tableWidget->setItem(row, 0, numberItem(++m_counter));
+	tableWidget->setItem(row, 1, sqlItem);
+	tableWidget->setItem(row, 2, numberItem(profile.prepareTime));
+	if (profile.firstRowTime >= 0)
+		tableWidget->setItem(row, 3, numberItem(profile.firstRowTime));
+	else
+		tableWidget->setItem(row, 3, new QTableWidgetItem());
+	tableWidget->setItem(row, 4, numberItem(profile.stepTime));
+	tableWidget->setItem(row, 5, numberItem(profile.rows));
+	tableWidget->setItem(row, 6, numberItem(profile.fullscanSteps));
+	tableWidget->setItem(row, 7, numberItem(profile.sorts));
+	tableWidget->setItem(row, 8, numberItem(profile.autoindexes));
+	tableWidget->setItem(row, 9, numberItem(profile.vmSteps));
+	tableWidget->setItem(row, 10, numberItem(profile.cacheHits));
+	tableWidget->setItem(row, 11, numberItem(profile.cacheMisses));
+
+	tableWidget->setSortingEnabled(true);
+}
+
+void ProfilerDock::recordCheckBox_toggled(bool checked)
+{
+	for (int i = m_drivers.count() - 1; i >= 0; --i)
+	{
+		// the connection has been closed in the meantime
+		if (m_drivers.at(i).isNull())
+			m_drivers.removeAt(i);
+		else
+			m_drivers.at(i)->setProfiling(checked);
+	}
+}
+
+void ProfilerDock::clearButton_clicked()
+{
+	tableWidget->setRowCount(0);
+	m_counter = 0;
+}
+
+void ProfilerDock::exportButton_clicked()
+{
+	QString fileName = QFileDialog::getSaveFileName(this,
+							tr("Export Statement Profile"),
+							QDir::currentPath(),
+							tr("CSV file (*.csv)"));
+	if (fileName.isNull())
+		return;
+
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+	{
+		QMessageBox::critical(this, tr("Export Statement Profile"),
+							  tr("Unable to open file %1 for writing.").arg(fileName));
+		return;
+	}
+
+	QTextStream stream(&file);
+	stream.setCodec("UTF-8");
+
+	QStringList fields;
+	for (int j = 0; j < tableWidget->columnCount(); ++j)
+		fields.append(csvField(tableWidget->horizontalHeaderItem(j)->text()));
+	stream << fields.join(",") << "\n";
+
+	// in the order shown
+	for (int i = 0; i < tableWidget->rowCount(); ++i)
+	{
+		fields.clear();
+		for (int j = 0; j < tableWidget->columnCount(); ++j)
+		{
+			QTableWidgetItem * item = tableWidget->item(i, j);
+			QString value;
+			if (item)
+				value = (j == 1) ? item->toolTip() : item->text();
+			fields.append((j == 1) ? csvField(value) : value);
+		}
+		stream << fields.join(",") << "\n";
+	}
+	file.close();
+}
@@ -0,0 +1,54 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef PROFILERDOCK_H
+#define PROFILERDOCK_H
+
+#include <QDockWidget>
+#include <QPointer>
+#include <QSqlDatabase>
+
+#include "ui_profilerdock.h"
+#include "driver/qsql_sqlite.h"
+
+
+/*! \brief A dockable table of the executed statements.
+Every statement run on a watched connection is listed with its prepare,
+first row and step times, row count, the sqlite3_stmt_status() counters
+and the page cache hits/misses. It works with the internal driver only
+as it reports the numbers (see QSQLiteDriver::setProfiling()).
+Nothing is recorded (and nothing costs time) until Record is checked.
+*/
+class ProfilerDock : public QDockWidget, public Ui::ProfilerDock
+{
+	Q_OBJECT
+
+	public:
+		ProfilerDock(QWidget * parent = 0);
+
+		/*! \brief Record statements of the connection too.
+		Connections of other drivers are ignored.
+		\param db an open connection
+		*/
+		void watch(const QSqlDatabase & db);
+
+	public slots:
+		void statementProfiled(const QSQLiteStatementProfile & profile);
+
+	private:
+		//! \brief Live drivers of the watched connections
+		QList<QPointer<QSQLiteDriver> > m_drivers;
+		//! \brief A sequence number of the next recorded statement
+		int m_counter;
+
+	private slots:
+		void recordCheckBox_toggled(bool checked);
+		void clearButton_clicked();
+		void exportButton_clicked();
+};
+
+#endif
@@ -0,0 +1,307 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QApplication>
+#include <QMap>
+#include <QPair>
+#include <QPushButton>
+#include <QRegExp>
+#include <QTreeWidgetItemIterator>
+
+#include "queryplandialog.h"
+#include "database.h"
+
+// plan tree columns
+#define PLAN_DETAIL 0
+#define PLAN_LOOPS 1
+#define PLAN_ROWS 2
+#define PLAN_ESTIMATE 3
+
+
+QueryPlanDialog::QueryPlanDialog(const QString & sql, QWidget * parent)
+	: QDialog(parent),
+	  m_sql(sql),
+	  m_scans(0),
+	  m_tempTrees(0),
+	  m_autoIndexes(0)
+{
+	setupUi(this);
+
+	planTree->setHeaderLabels(QStringList() << tr("Plan")
+											<< tr("Loops")
+											<< tr("Rows Visited")
+											<< tr("Estimated Rows"));
+	// the counts are known after a measured run only
+	planTree->setColumnHidden(PLAN_LOOPS, true);
+	planTree->setColumnHidden(PLAN_ROWS, true);
+	planTree->setColumnHidden(PLAN_ESTIMATE, true);
+
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+	connect(measureButton, SIGNAL(clicked()),
+			this, SLOT(measureButton_clicked()));
+#else
+	measureButton->hide();
+#endif
+
+	if (!explain())
+		measureButton->setEnabled(false);
+}
+
+bool QueryPlanDialog::explain()
+{
+	sqlite3 * db = Database::sqlite3handle();
+	if (!db)
+		return false;
+
+	QByteArray sql(QString("EXPLAIN QUERY PLAN %1").arg(m_sql).toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(db, sql.constData(), -1, &stmt, 0) != SQLITE_OK)
+	{
+		showError(QString::fromUtf8(sqlite3_errmsg(db)));
+		sqlite3_finalize(stmt);
+		return false;
+	}
+
+	// sqlite 3.24+ gives (id, parent, notused, detail) rows forming
+	// a tree, older versions (selectid, order, from, detail)
+	bool hasParent = (QString(sqlite3_column_name(stmt, 1)) == "parent");
+	QMap<int,QTreeWidgetItem*> nodes;
+	QList<QPair<QTreeWidgetItem*,int> > subqueries;
+	QRegExp subqueryRx("SUBQUER(?:Y|IES) (\\d+)(?: AND (\\d+))?");
+
+	while (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		int id = sqlite3_column_int(stmt, 0);
+		QString detail(QString::fromUtf8((const char*)sqlite3_column_text(stmt, 3)));
+		QTreeWidgetItem * item;
+		if (hasParent)
+		{
+			QTreeWidgetItem * parentItem = nodes.value(sqlite3_column_int(stmt, 1));
+			if (parentItem)
+				item = new QTreeWidgetItem(parentItem);
+			else
+				item = new QTreeWidgetItem(planTree);
+			nodes[id] = item;
+		}
+		else
+		{
+			// loops are grouped under their SELECT
+			if (!nodes.contains(id))
+			{
+				QTreeWidgetItem * selectItem = new QTreeWidgetItem(planTree);
+				selectItem->setText(PLAN_DETAIL, id == 0 ? tr("QUERY") : tr("SELECT %1").arg(id));
+				nodes[id] = selectItem;
+			}
+			item = new QTreeWidgetItem(nodes[id]);
+			if (subqueryRx.indexIn(detail) != -1)
+			{
+				subqueries.append(qMakePair(item, subqueryRx.cap(1).toInt()));
+				if (!subqueryRx.cap(2).isEmpty())
+					subqueries.append(qMakePair(item, subqueryRx.cap(2).toInt()));
+			}
+		}
+		item->setText(PLAN_DETAIL, detail);
+		markItem(item);
+	}
+
+	if (sqlite3_finalize(stmt) != SQLITE_OK)
+	{
+		showError(QString::fromUtf8(sqlite3_errmsg(db)));
+		return false;
+	}
+
+	// hang the subquery SELECTs under the loops using them
+	for (int i = 0; i < subqueries.count(); ++i)
+	{
+		QTreeWidgetItem * selectItem = nodes.value(subqueries.at(i).second);
+		int index = planTree->indexOfTopLevelItem(selectItem);
+		if (!selectItem || index == -1)
+			continue;
+		// never move a SELECT under itself
+		bool ancestor = false;
+		for (QTreeWidgetItem * p = subqueries.at(i).first; p; p = p->parent())
+			ancestor |= (p == selectItem);
+		if (!ancestor)
+			subqueries.at(i).first->addChild(planTree->takeTopLevelItem(index));
+	}
+
+	planTree->expandAll();
+	planTree->resizeColumnToContents(PLAN_DETAIL);
+	updateSummary();
+	return true;
+}
+
+void QueryPlanDialog::markItem(QTreeWidgetItem * item)
+{
+	QString detail(item->text(PLAN_DETAIL));
+	QStringList notes;
+	QColor color;
+
+	if (detail.startsWith("SCAN") && !detail.contains("SUBQUERY")
+		&& !detail.contains("CONSTANT ROW"))
+	{
+		if (detail.contains("COVERING INDEX"))
+			notes.append(tr("A scan of a covering index: the table itself is not read."));
+		else
+		{
+			notes.append(tr("A full scan: every row is read. "
+							"An index on the filtered columns can turn it into a SEARCH."));
+			color = Qt::darkRed;
+			++m_scans;
+		}
+	}
+	else if (detail.startsWith("SEARCH"))
+	{
+		notes.append(tr("A search: only the matching rows are read using an index."));
+		color = Qt::darkGreen;
+	}
+
+	if (detail.contains("TEMP B-TREE"))
+	{
+		notes.append(tr("Rows are sorted or grouped in a temporary B-tree. "
+						"An index in the ORDER BY/GROUP BY order avoids it."));
+		color = Qt::darkYellow;
+		++m_tempTrees;
+	}
+	if (detail.contains("AUTOMATIC"))
+	{
+		notes.append(tr("An automatic index is built for every run of the statement. "
+						"Consider creating a permanent one."));
+		color = Qt::darkYellow;
+		++m_autoIndexes;
+	}
+
+	if (color.isValid())
+		item->setForeground(PLAN_DETAIL, color);
+	item->setToolTip(PLAN_DETAIL, notes.join("\n"));
+}
+
+void QueryPlanDialog::showError(const QString & message)
+{
+	summaryLabel->setText(tr("Cannot explain the statement")
+						  + ":<br/><span style=\" color:#ff0000;\">"
+						  + message + "<br/></span>");
+}
+
+void QueryPlanDialog::updateSummary()
+{
+	QStringList found;
+	if (m_scans)
+		found.append(tr("%n full table scan(s)", "", m_scans));
+	if (m_tempTrees)
+		found.append(tr("%n temporary B-tree(s)", "", m_tempTrees));
+	if (m_autoIndexes)
+		found.append(tr("%n automatic index(es)", "", m_autoIndexes));
+	if (found.isEmpty())
+		summaryLabel->setText(tr("Every table is read using an index."));
+	else
+		summaryLabel->setText(found.join(", "));
+}
+
+void QueryPlanDialog::measureButton_clicked()
+{
+#ifdef SQLITE_ENABLE_STMT_SCANSTATUS
+	sqlite3 * db = Database::sqlite3handle();
+	if (!db)
+		return;
+
+	QByteArray sql(m_sql.toUtf8());
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(db, sql.constData(), -1, &stmt, 0) != SQLITE_OK)
+	{
+		showError(QString::fromUtf8(sqlite3_errmsg(db)));
+		sqlite3_finalize(stmt);
+		return;
+	}
+	// the statement is really run so nothing can be changed by it
+	if (!sqlite3_stmt_readonly(stmt))
+	{
+		sqlite3_finalize(stmt);
+		summaryLabel->setText(tr("Only read-only statements can be measured."));
+		return;
+	}
+
+	// the counters are read from the finished statement, no reset
+	int rc;
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		;
+	QApplication::restoreOverrideCursor();
+	if (rc != SQLITE_DONE)
+	{
+		showError(QString::fromUtf8(sqlite3_errmsg(db)));
+		sqlite3_finalize(stmt);
+		return;
+	}
+
+	// the loops are reported with the same text as their plan rows
+	QList<QTreeWidgetItem*> items;
+	QTreeWidgetItemIterator it(planTree);
+	while (*it)
+	{
+		(*it)->setText(PLAN_LOOPS, QString());
+		(*it)->setText(PLAN_ROWS, QString());
+		(*it)->setText(PLAN_ESTIMATE, QString());
+		items.append(*it);
+		++it;
+	}
+
+	// the same walk as display_scanstats() in the sqlite3 shell:
+	// an estimate of a nested loop is the product of its outer loops
+	int maxSelect = 0;
+	for (int k = 0; k <= maxSelect; ++k)
+	{
+		double estLoop = 1.0;
+		int n = 0;
+		for (int i = 0; ; ++i)
+		{
+			sqlite3_int64 loops;
+			sqlite3_int64 visits;
+			double est;
+			int selectId;
+			const char * explainText;
+			if (sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_NLOOP, (void*)&loops))
+				break;
+			sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_SELECTID, (void*)&selectId);
+			if (selectId > maxSelect)
+				maxSelect = selectId;
+			if (selectId != k)
+				continue;
+			sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_NVISIT, (void*)&visits);
+			sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_EST, (void*)&est);
+			sqlite3_stmt_scanstatus(stmt, i, SQLITE_SCANSTAT_EXPLAIN, (void*)&explainText);
+			if (n++ == 0)
+				estLoop = loops;
+			estLoop *= est;
+
+			QString detail(QString::fromUtf8(explainText));
+			for (int j = 0; j < items.count(); ++j)
+			{
+				QTreeWidgetItem * item = items.at(j);
+				if (item->text(PLAN_DETAIL) != detail)
+					continue;
+				qlonglong estimate = (qlonglong)(estLoop + 0.5);
+				item->setText(PLAN_LOOPS, QString::number(loops));
+				item->setText(PLAN_ROWS, QString::number(visits));
+				item->setText(PLAN_ESTIMATE, QString::number(estimate));
+				// a bad estimate usually means stale or missing ANALYZE stats
+				if (visits > 100 && (visits > 10 * estimate || 10 * visits < estimate))
+					item->setForeground(PLAN_ROWS, Qt::red);
+				items.removeAt(j);
+				break;
+			}
+		}
+	}
+	sqlite3_finalize(stmt);
+
+	for (int i = PLAN_LOOPS; i <= PLAN_ESTIMATE; ++i)
+	{
+		planTree->setColumnHidden(i, false);
+		planTree->resizeColumnToContents(i);
+	}
+#endif
+}
@@ -0,0 +1,50 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef QUERYPLANDIALOG_H
+#define QUERYPLANDIALOG_H
+
+#include <QDialog>
+
+#include "ui_queryplandialog.h"
+
+class QTreeWidgetItem;
+
+
+/*! \brief EXPLAIN QUERY PLAN of a statement as a tree.
+Loops are nested under their SELECT, subqueries under the loop using them.
+Full table scans, temporary B-trees and automatic indexes are highlighted
+and counted.
+When sqlite is built with SQLITE_ENABLE_STMT_SCANSTATUS the statement
+can be run (read-only statements only) to show the real loop and row
+counts next to the planner estimates, like .scanstats in the sqlite3 shell.
+*/
+class QueryPlanDialog : public QDialog, public Ui::QueryPlanDialog
+{
+	Q_OBJECT
+
+	public:
+		QueryPlanDialog(const QString & sql, QWidget * parent = 0);
+
+	private:
+		QString m_sql;
+		int m_scans;
+		int m_tempTrees;
+		int m_autoIndexes;
+
+		//! \brief Build the tree from EXPLAIN QUERY PLAN rows.
+		bool explain();
+		//! \brief Highlight and count one plan row.
+		void markItem(QTreeWidgetItem * item);
+		void showError(const QString & message);
+		void updateSummary();
+
+	private slots:
+		void measureButton_clicked();
+};
+
+#endif
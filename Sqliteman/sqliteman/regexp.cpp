@@ -0,0 +1,1063 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <string.h>
+
+#include <QList>
+#include <QString>
+#include <QtAlgorithms>
+
+#include "regexp.h"
+
+// instructions of the NFA program
+#define OP_CHAR 0
+#define OP_CLASS 1
+// any character but a line end
+#define OP_ANY 2
+// any character, the unanchored search loop
+#define OP_ANYALL 3
+#define OP_SPLIT 4
+#define OP_JMP 5
+#define OP_BOL 6
+#define OP_EOL 7
+#define OP_WORDB 8
+#define OP_NOTWORDB 9
+#define OP_MATCH 10
+
+// nodes of the parsed pattern
+#define N_LIT 0
+#define N_CLASS 1
+#define N_ANY 2
+#define N_BOL 3
+#define N_EOL 4
+#define N_WORDB 5
+#define N_NOTWORDB 6
+#define N_CAT 7
+#define N_ALT 8
+#define N_REPEAT 9
+
+// limits; the DFA cache is dropped and rebuilt when it is full
+#define MAX_PROGRAM 20000
+#define MAX_REPEAT 1000
+#define MAX_DEPTH 200
+#define MAX_STATES 500
+#define CACHE_SIZE 16
+
+
+//! \brief Compiled patterns, the most recently used first
+static QList<Regexp*> s_cache;
+static QMutex s_cacheMutex;
+
+
+static bool isWord(uint c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+		   || (c >= '0' && c <= '9') || c == '_';
+}
+
+static uint foldCase(uint c)
+{
+	if (c < 128)
+		return (c >= 'A' && c <= 'Z') ? c + 32 : c;
+	return c < 0x10000 ? QChar((ushort)c).toLower().unicode() : c;
+}
+
+static uint upperCase(uint c)
+{
+	if (c < 128)
+		return (c >= 'a' && c <= 'z') ? c - 32 : c;
+	return c < 0x10000 ? QChar((ushort)c).toUpper().unicode() : c;
+}
+
+//! \brief Decode one character at i and move i behind it.
+static uint decodeUtf8(const unsigned char * text, int length, int & i)
+{
+	uint c = text[i++];
+	if (c < 0x80)
+		return c;
+	int extra = c >= 0xF0 ? 3 : (c >= 0xE0 ? 2 : (c >= 0xC0 ? 1 : 0));
+	if (!extra)
+		return 0xFFFD;
+	c &= 0x3F >> extra;
+	while (extra-- && i < length && (text[i] & 0xC0) == 0x80)
+		c = (c << 6) | (text[i++] & 0x3F);
+	return c;
+}
+
+//! \brief Position of needle in text from "from" or -1.
+static int findBytes(const unsigned char * text, int length,
+					 const QByteArray & needle, int from)
+{
+	const unsigned char * n = (const unsigned char *)needle.constData();
+	int size = needle.size();
+	const unsigned char * p = text + from;
+	const unsigned char * last = text + length - size;
+	while (p <= last)
+	{
+		p = (const unsigned char *)memchr(p, n[0], last - p + 1);
+		if (!p)
+			return -1;
+		if (memcmp(p, n, size) == 0)
+			return p - text;
+		++p;
+	}
+	return -1;
+}
+
+//! \brief Add the ranges of a character class escape (\\d, \\w, \\s).
+static bool escapeClass(uint e, QVector<uint> & ranges)
+{
+	QVector<uint> r;
+	switch (e)
+	{
+		case 'd': case 'D':
+			r << '0' << '9';
+			break;
+		case 'w': case 'W':
+			r << '0' << '9' << 'A' << 'Z' << '_' << '_' << 'a' << 'z';
+			break;
+		case 's': case 'S':
+			r << '\t' << '\r' << ' ' << ' ';
+			break;
+		default:
+			return false;
+	}
+	if (e == 'D' || e == 'W' || e == 'S')
+	{
+		// the complement of the sorted ranges
+		uint from = 0;
+		for (int i = 0; i < r.size(); i += 2)
+		{
+			if (r[i] > from)
+				ranges << from << r[i] - 1;
+			from = r[i + 1] + 1;
+		}
+		ranges << from << 0x10FFFF;
+	}
+	else
+		ranges += r;
+	return true;
+}
+
+
+/*! \brief Parse a pattern into a tree and compile it into the NFA program.
+The program is the one of Thompson's construction: SPLIT continues at
+two places, JMP at one, the others match a character or an assertion.
+*/
+class RegexpParser
+{
+	public:
+		RegexpParser(Regexp * re) : m_re(re), m_pos(0), m_depth(0) {}
+		bool parse(const QByteArray & pattern, QString & error);
+
+	private:
+		struct Node
+		{
+			int type;
+			uint c;
+			int cls;
+			int min;
+			int max;
+			QVector<int> kids;
+		};
+
+		Regexp * m_re;
+		QVector<uint> m_text;
+		int m_pos;
+		int m_depth;
+		QVector<Node> m_nodes;
+		QString m_error;
+
+		bool atEnd() const { return m_pos >= m_text.size(); }
+		uint peek() const { return m_text[m_pos]; }
+		int fail(const QString & error);
+		int newNode(int type, uint c = 0, int cls = -1);
+		int literal(uint c);
+		int parseAlternation();
+		int parseConcatenation();
+		int parseRepetition();
+		int parseAtom();
+		int parseClass();
+		bool parseNumber(int & n);
+		bool escapeChar(uint & c);
+		void literalPrefix(int root);
+		int emitInst(int op, uint c = 0, int cls = -1);
+		bool emit(int n);
+};
+
+int RegexpParser::fail(const QString & error)
+{
+	if (m_error.isEmpty())
+		m_error = error;
+	return -1;
+}
+
+int RegexpParser::newNode(int type, uint c, int cls)
+{
+	Node node;
+	node.type = type;
+	node.c = c;
+	node.cls = cls;
+	node.min = node.max = 1;
+	m_nodes.append(node);
+	return m_nodes.size() - 1;
+}
+
+int RegexpParser::literal(uint c)
+{
+	return newNode(N_LIT, m_re->m_caseInsensitive ? foldCase(c) : c);
+}
+
+bool RegexpParser::parse(const QByteArray & pattern, QString & error)
+{
+	m_text = QString::fromUtf8(pattern.constData(), pattern.size()).toUcs4();
+	if (m_text.size() >= 4 && m_text[0] == '(' && m_text[1] == '?'
+		&& m_text[2] == 'i' && m_text[3] == ')')
+	{
+		m_re->m_caseInsensitive = true;
+		m_pos = 4;
+	}
+
+	int root = parseAlternation();
+	if (root >= 0 && !atEnd())
+		root = fail("unmatched ) in the regular expression");
+	if (root >= 0)
+	{
+		literalPrefix(root);
+		// unanchored search: .*? in front of the pattern
+		if (!m_re->m_anchored)
+		{
+			int split = emitInst(OP_SPLIT);
+			m_re->m_program[split].x = 3;
+			m_re->m_program[split].y = 1;
+			emitInst(OP_ANYALL);
+			m_re->m_program[emitInst(OP_JMP)].x = split;
+		}
+		if (emit(root))
+			emitInst(OP_MATCH);
+	}
+	error = m_error;
+	return m_error.isEmpty();
+}
+
+int RegexpParser::parseAlternation()
+{
+	int left = parseConcatenation();
+	if (left < 0 || atEnd() || peek() != '|')
+		return left;
+	int alt = newNode(N_ALT);
+	m_nodes[alt].kids.append(left);
+	while (!atEnd() && peek() == '|')
+	{
+		++m_pos;
+		int right = parseConcatenation();
+		if (right < 0)
+			return -1;
+		m_nodes[alt].kids.append(right);
+	}
+	return alt;
+}
+
+int RegexpParser::parseConcatenation()
+{
+	int cat = newNode(N_CAT);
+	while (!atEnd() && peek() != '|' && peek() != ')')
+	{
+		int kid = parseRepetition();
+		if (kid < 0)
+			return -1;
+		m_nodes[cat].kids.append(kid);
+	}
+	return cat;
+}
+
+bool RegexpParser::parseNumber(int & n)
+{
+	n = 0;
+	int start = m_pos;
+	while (!atEnd() && peek() >= '0' && peek() <= '9' && m_pos - start < 6)
+		n = n * 10 + (m_text[m_pos++] - '0');
+	return m_pos > start;
+}
+
+int RegexpParser::parseRepetition()
+{
+	int atom = parseAtom();
+	while (atom >= 0 && !atEnd())
+	{
+		int min;
+		int max;
+		uint c = peek();
+		if (c == '*' || c == '+' || c == '?')
+		{
+			min = (c == '+') ? 1 : 0;
+			max = (c == '?') ? 1 : -1;
+			++m_pos;
+		}
+		else if (c == '{')
+		{
+			// not a valid repetition: the brace is a literal
+			int save = m_pos++;
+			if (!parseNumber(min))
+			{
+				m_pos = save;
+				break;
+			}
+			max = min;
+			if (!atEnd() && peek() == ',')
+			{
+				++m_pos;
+				if (!atEnd() && peek() == '}')
+					max = -1;
+				else if (!parseNumber(max))
+				{
+					m_pos = save;
+					break;
+				}
+			}
+			if (atEnd() || peek() != '}')
+			{
+				m_pos = save;
+				break;
+			}
+			++m_pos;
+			if (max != -1 && max < min)
+				return fail("bad repetition {m,n} in the regular expression");
+			if (min > MAX_REPEAT || max > MAX_REPEAT)
+				return fail(QString("repetition count over %1 in the regular expression")
+							.arg(MAX_REPEAT));
+		}
+		else
+			break;
+
+		// a lazy quantifier matches the same texts; REGEXP asks only if there is a match
+		if (!atEnd() && peek() == '?')
+			++m_pos;
+		else if (!atEnd() && peek() == '+')
+			return fail("possessive quantifiers are not supported in the regular expression");
+		int repeat = newNode(N_REPEAT);
+		m_nodes[repeat].min = min;
+		m_nodes[repeat].max = max;
+		m_nodes[repeat].kids.append(atom);
+		atom = repeat;
+	}
+	return atom;
+}
+
+bool RegexpParser::escapeChar(uint & c)
+{
+	switch (c)
+	{
+		case 'n': c = '\n'; return true;
+		case 'r': c = '\r'; return true;
+		case 't': c = '\t'; return true;
+		case 'f': c = '\f'; return true;
+		case 'v': c = '\v'; return true;
+		case 'a': c = 0x07; return true;
+		case 'e': c = 0x1B; return true;
+		case 'x':
+		case 'u':
+		{
+			bool braces = (c == 'x' && !atEnd() && peek() == '{');
+			int digits = braces ? 8 : (c == 'x' ? 2 : 4);
+			if (braces)
+				++m_pos;
+			c = 0;
+			int start = m_pos;
+			while (!atEnd() && m_pos - start < digits)
+			{
+				uint h = peek();
+				int v = (h >= '0' && h <= '9') ? h - '0'
+						: (h >= 'a' && h <= 'f') ? h - 'a' + 10
+						: (h >= 'A' && h <= 'F') ? h - 'A' + 10 : -1;
+				if (v < 0)
+					break;
+				c = c * 16 + v;
+				++m_pos;
+			}
+			if (m_pos == start || (!braces && m_pos - start < digits))
+			{
+				fail("bad hexadecimal escape in the regular expression");
+				return false;
+			}
+			if (braces)
+			{
+				if (atEnd() || peek() != '}')
+				{
+					fail("missing } in the regular expression");
+					return false;
+				}
+				++m_pos;
+			}
+			return true;
+		}
+	}
+	if (c < 128 && isWord(c))
+	{
+		fail(QString("unknown escape \\%1 in the regular expression").arg(QChar((ushort)c)));
+		return false;
+	}
+	// an escaped punctuation character stands for itself
+	return true;
+}
+
+int RegexpParser::parseAtom()
+{
+	uint c = peek();
+	++m_pos;
+	switch (c)
+	{
+		case '(':
+		{
+			if (++m_depth > MAX_DEPTH)
+				return fail("the regular expression is nested too deeply");
+			if (!atEnd() && peek() == '?')
+			{
+				if (m_pos + 1 < m_text.size() && m_text[m_pos + 1] == ':')
+					m_pos += 2;
+				else
+					return fail("only (?:...) groups and a leading (?i) are supported"
+								" in the regular expression");
+			}
+			int inner = parseAlternation();
+			if (inner < 0)
+				return -1;
+			if (atEnd() || peek() != ')')
+				return fail("missing ) in the regular expression");
+			++m_pos;
+			--m_depth;
+			return inner;
+		}
+		case '.':
+			return newNode(N_ANY);
+		case '^':
+			return newNode(N_BOL);
+		case '$':
+			return newNode(N_EOL);
+		case '[':
+			return parseClass();
+		case '*':
+		case '+':
+		case '?':
+			return fail("nothing to repeat in the regular expression");
+		case '\\':
+		{
+			if (atEnd())
+				return fail("trailing \\ in the regular expression");
+			uint e = peek();
+			++m_pos;
+			switch (e)
+			{
+				case 'b': return newNode(N_WORDB);
+				case 'B': return newNode(N_NOTWORDB);
+				case 'A': return newNode(N_BOL);
+				case 'z':
+				case 'Z': return newNode(N_EOL);
+			}
+			Regexp::CharClass cls;
+			cls.negated = false;
+			if (escapeClass(e, cls.ranges))
+			{
+				m_re->m_classes.append(cls);
+				return newNode(N_CLASS, 0, m_re->m_classes.size() - 1);
+			}
+			if (!escapeChar(e))
+				return -1;
+			return literal(e);
+		}
+	}
+	return literal(c);
+}
+
+int RegexpParser::parseClass()
+{
+	Regexp::CharClass cls;
+	cls.negated = false;
+	if (!atEnd() && peek() == '^')
+	{
+		cls.negated = true;
+		++m_pos;
+	}
+	bool first = true;
+	while (true)
+	{
+		if (atEnd())
+			return fail("missing ] in the regular expression");
+		uint c = peek();
+		++m_pos;
+		if (c == ']' && !first)
+			break;
+		first = false;
+
+		if (c == '[' && !atEnd() && peek() == ':')
+		{
+			int end = m_pos + 1;
+			while (end + 1 < m_text.size() && !(m_text[end] == ':' && m_text[end + 1] == ']'))
+				++end;
+			if (end + 1 >= m_text.size())
+				return fail("missing :] in the regular expression");
+			QString name(QString::fromUcs4(m_text.constData() + m_pos + 1, end - m_pos - 1));
+			QVector<uint> & r = cls.ranges;
+			if (name == "alpha")
+				r << 'A' << 'Z' << 'a' << 'z';
+			else if (name == "digit")
+				r << '0' << '9';
+			else if (name == "alnum")
+				r << '0' << '9' << 'A' << 'Z' << 'a' << 'z';
+			else if (name == "upper")
+				r << 'A' << 'Z';
+			else if (name == "lower")
+				r << 'a' << 'z';
+			else if (name == "space")
+				r << '\t' << '\r' << ' ' << ' ';
+			else if (name == "blank")
+				r << '\t' << '\t' << ' ' << ' ';
+			else if (name == "xdigit")
+				r << '0' << '9' << 'A' << 'F' << 'a' << 'f';
+			else if (name == "punct")
+				r << '!' << '/' << ':' << '@' << '[' << '`' << '{' << '~';
+			else if (name == "word")
+				r << '0' << '9' << 'A' << 'Z' << '_' << '_' << 'a' << 'z';
+			else if (name == "cntrl")
+				r << 0 << 0x1F << 0x7F << 0x7F;
+			else
+				return fail(QString("unknown class [:%1:] in the regular expression").arg(name));
+			m_pos = end + 2;
+			continue;
+		}
+
+		if (c == '\\')
+		{
+			if (atEnd())
+				return fail("trailing \\ in the regular expression");
+			c = peek();
+			++m_pos;
+			if (escapeClass(c, cls.ranges))
+				continue;
+			if (c == 'b')
+				c = 0x08;
+			else if (!escapeChar(c))
+				return -1;
+		}
+		uint hi = c;
+		if (m_pos + 1 < m_text.size() && peek() == '-' && m_text[m_pos + 1] != ']')
+		{
+			++m_pos;
+			hi = peek();
+			++m_pos;
+			if (hi == '\\')
+			{
+				if (atEnd())
+					return fail("trailing \\ in the regular expression");
+				hi = peek();
+				++m_pos;
+				if (!escapeChar(hi))
+					return -1;
+			}
+			if (hi < c)
+				return fail("bad range in a class of the regular expression");
+		}
+		cls.ranges << c << hi;
+	}
+	m_re->m_classes.append(cls);
+	return newNode(N_CLASS, 0, m_re->m_classes.size() - 1);
+}
+
+void RegexpParser::literalPrefix(int root)
+{
+	QVector<int> items;
+	if (m_nodes[root].type == N_CAT)
+		items = m_nodes[root].kids;
+	else
+		items.append(root);
+
+	QVector<uint> prefix;
+	int i = 0;
+	if (i < items.size() && m_nodes[items[i]].type == N_BOL)
+	{
+		m_re->m_anchored = true;
+		++i;
+	}
+	for ( ; i < items.size() && m_nodes[items[i]].type == N_LIT; ++i)
+		prefix.append(m_nodes[items[i]].c);
+	if (m_re->m_caseInsensitive || prefix.isEmpty())
+		return;
+	m_re->m_prefix = QString::fromUcs4(prefix.constData(), prefix.size()).toUtf8();
+	m_re->m_literal = (i == items.size());
+}
+
+int RegexpParser::emitInst(int op, uint c, int cls)
+{
+	Regexp::Inst inst;
+	inst.op = op;
+	inst.c = c;
+	inst.cls = cls;
+	inst.x = inst.y = 0;
+	m_re->m_program.append(inst);
+	if (m_re->m_program.size() > MAX_PROGRAM)
+		fail("the regular expression is too large");
+	return m_re->m_program.size() - 1;
+}
+
+bool RegexpParser::emit(int n)
+{
+	QVector<Regexp::Inst> & prog = m_re->m_program;
+	const Node node = m_nodes[n];
+	switch (node.type)
+	{
+		case N_LIT:
+			emitInst(OP_CHAR, node.c);
+			break;
+		case N_CLASS:
+			emitInst(OP_CLASS, 0, node.cls);
+			break;
+		case N_ANY:
+			emitInst(OP_ANY);
+			break;
+		case N_BOL:
+			emitInst(OP_BOL);
+			break;
+		case N_EOL:
+			emitInst(OP_EOL);
+			break;
+		case N_WORDB:
+			emitInst(OP_WORDB);
+			break;
+		case N_NOTWORDB:
+			emitInst(OP_NOTWORDB);
+			break;
+		case N_CAT:
+			for (int i = 0; i < node.kids.size() && m_error.isEmpty(); ++i)
+				emit(node.kids[i]);
+			break;
+		case N_ALT:
+		{
+			QVector<int> jumps;
+			for (int i = 0; i < node.kids.size() && m_error.isEmpty(); ++i)
+			{
+				if (i == node.kids.size() - 1)
+				{
+					emit(node.kids[i]);
+					break;
+				}
+				int split = emitInst(OP_SPLIT);
+				prog[split].x = split + 1;
+				emit(node.kids[i]);
+				jumps.append(emitInst(OP_JMP));
+				prog[split].y = prog.size();
+			}
+			foreach (int jump, jumps)
+				prog[jump].x = prog.size();
+			break;
+		}
+		case N_REPEAT:
+		{
+			for (int i = 0; i < node.min && m_error.isEmpty(); ++i)
+				emit(node.kids[0]);
+			if (node.max == -1)
+			{
+				int split = emitInst(OP_SPLIT);
+				prog[split].x = split + 1;
+				emit(node.kids[0]);
+				prog[emitInst(OP_JMP)].x = split;
+				prog[split].y = prog.size();
+				break;
+			}
+			QVector<int> splits;
+			for (int i = node.min; i < node.max && m_error.isEmpty(); ++i)
+			{
+				int split = emitInst(OP_SPLIT);
+				prog[split].x = split + 1;
+				splits.append(split);
+				emit(node.kids[0]);
+			}
+			foreach (int split, splits)
+				prog[split].y = prog.size();
+			break;
+		}
+	}
+	return m_error.isEmpty();
+}
+
+
+bool Regexp::CharClass::contains(uint c) const
+{
+	for (int i = 0; i < ranges.size(); i += 2)
+	{
+		if (c >= ranges[i] && c <= ranges[i + 1])
+			return true;
+	}
+	return false;
+}
+
+
+Regexp::Regexp()
+	: m_caseInsensitive(false),
+	  m_literal(false),
+	  m_anchored(false),
+	  m_generation(0),
+	  m_ref(1)
+{
+	clearStates();
+}
+
+Regexp::~Regexp()
+{
+	qDeleteAll(m_states);
+}
+
+void Regexp::ref()
+{
+	m_ref.ref();
+}
+
+void Regexp::release()
+{
+	if (!m_ref.deref())
+		delete this;
+}
+
+Regexp * Regexp::compile(const QByteArray & pattern, QString & error)
+{
+	Regexp * re = new Regexp();
+	re->m_pattern = pattern;
+	RegexpParser parser(re);
+	if (!parser.parse(pattern, error))
+	{
+		delete re;
+		return 0;
+	}
+	re->m_mark.fill(0, re->m_program.size());
+	return re;
+}
+
+void Regexp::clearStates()
+{
+	qDeleteAll(m_states);
+	m_states.clear();
+	m_index.clear();
+	m_start[0][0] = m_start[0][1] = m_start[1][0] = m_start[1][1] = -1;
+}
+
+bool Regexp::consumes(const Inst & inst, uint c) const
+{
+	switch (inst.op)
+	{
+		case OP_CHAR:
+			return inst.c == c;
+		case OP_CLASS:
+		{
+			// the text is folded to lower case already
+			const CharClass & cls = m_classes[inst.cls];
+			bool in = cls.contains(c) || (m_caseInsensitive && cls.contains(upperCase(c)));
+			return in != cls.negated;
+		}
+		case OP_ANY:
+			return c != '\n' && c != '\r';
+		case OP_ANYALL:
+			return true;
+	}
+	return false;
+}
+
+void Regexp::closure(int pc, QVector<int> & set, bool atStart)
+{
+	QVector<int> stack;
+	stack.append(pc);
+	while (!stack.isEmpty())
+	{
+		int p = stack.last();
+		stack.remove(stack.size() - 1);
+		if (m_mark[p] == m_generation)
+			continue;
+		m_mark[p] = m_generation;
+		const Inst & inst = m_program[p];
+		switch (inst.op)
+		{
+			case OP_JMP:
+				stack.append(inst.x);
+				break;
+			case OP_SPLIT:
+				stack.append(inst.y);
+				stack.append(inst.x);
+				break;
+			case OP_BOL:
+				if (atStart)
+					stack.append(p + 1);
+				break;
+			default:
+				// characters, MATCH and the assertions decided by the next character
+				set.append(p);
+		}
+	}
+}
+
+void Regexp::resolve(QVector<int> & set, bool prevWord, bool atEnd, bool nextWord)
+{
+	// the set grows while the assertions are followed
+	for (int i = 0; i < set.size(); ++i)
+	{
+		int op = m_program[set[i]].op;
+		bool passed;
+		if (op == OP_EOL)
+			passed = atEnd;
+		else if (op == OP_WORDB)
+			passed = (prevWord != nextWord);
+		else if (op == OP_NOTWORDB)
+			passed = (prevWord == nextWord);
+		else
+			continue;
+		if (passed)
+			closure(set[i] + 1, set, false);
+	}
+}
+
+int Regexp::state(QVector<int> & set, bool prevWord)
+{
+	qSort(set);
+	QByteArray key((const char *)set.constData(), set.size() * sizeof(int));
+	key.append(prevWord ? '1' : '0');
+	QHash<QByteArray,int>::const_iterator it = m_index.constFind(key);
+	if (it != m_index.constEnd())
+		return it.value();
+
+	if (m_states.size() >= MAX_STATES)
+		clearStates();
+	DState * d = new DState();
+	d->id = m_states.size();
+	d->pcs = set;
+	d->prevWord = prevWord;
+	d->match = false;
+	d->endMatch = -1;
+	for (int i = 0; i < set.size(); ++i)
+		d->match = d->match || m_program[set[i]].op == OP_MATCH;
+	for (int i = 0; i < 128; ++i)
+		d->next[i] = 0;
+	m_states.append(d);
+	m_index.insert(key, m_states.size() - 1);
+	return m_states.size() - 1;
+}
+
+int Regexp::startState(bool atStart, bool prevWord)
+{
+	int & s = m_start[atStart][prevWord];
+	if (s < 0)
+	{
+		QVector<int> set;
+		++m_generation;
+		closure(0, set, atStart);
+		int start = state(set, prevWord);
+		// state() may have dropped the cache with m_start
+		m_start[atStart][prevWord] = start;
+		return start;
+	}
+	return s;
+}
+
+int Regexp::step(int s, uint c)
+{
+	DState * d = m_states[s];
+	if (c < 128 && d->next[c])
+		return d->next[c]->id;
+	if (c >= 128)
+	{
+		QHash<uint,int>::const_iterator it = d->other.constFind(c);
+		if (it != d->other.constEnd())
+			return it.value();
+	}
+
+	bool nextWord = isWord(c);
+	QVector<int> current(d->pcs);
+	++m_generation;
+	for (int i = 0; i < current.size(); ++i)
+		m_mark[current[i]] = m_generation;
+	resolve(current, d->prevWord, false, nextWord);
+
+	QVector<int> next;
+	++m_generation;
+	for (int i = 0; i < current.size(); ++i)
+	{
+		int pc = current[i];
+		if (consumes(m_program[pc], c))
+			closure(pc + 1, next, false);
+		else if (m_program[pc].op == OP_MATCH && m_mark[pc] != m_generation)
+		{
+			// reached through an assertion decided by c; a match stays a match
+			m_mark[pc] = m_generation;
+			next.append(pc);
+		}
+	}
+	int count = m_states.size();
+	int n = state(next, nextWord);
+	// the transition is cached unless the states have been dropped
+	if (m_states.size() >= count)
+	{
+		if (c < 128)
+			d->next[c] = m_states[n];
+		else
+			d->other.insert(c, n);
+	}
+	return n;
+}
+
+bool Regexp::matchesAtEnd(int s)
+{
+	DState * d = m_states[s];
+	if (d->endMatch < 0)
+	{
+		QVector<int> current(d->pcs);
+		++m_generation;
+		for (int i = 0; i < current.size(); ++i)
+			m_mark[current[i]] = m_generation;
+		resolve(current, d->prevWord, true, false);
+		d->endMatch = 0;
+		for (int i = 0; i < current.size(); ++i)
+		{
+			if (m_program[current[i]].op == OP_MATCH)
+				d->endMatch = 1;
+		}
+	}
+	return d->endMatch == 1;
+}
+
+bool Regexp::run(const unsigned char * text, int length, int from)
+{
+	// only ASCII characters are word characters, a UTF-8 byte of
+	// another one is not
+	int s = startState(from == 0, from > 0 && isWord(text[from - 1]));
+	const DState * d = m_states[s];
+	int i = from;
+	while (!d->match)
+	{
+		if (i >= length)
+			return matchesAtEnd(d->id);
+		uint c = text[i];
+		if (c < 128)
+		{
+			// the fast path: a cached transition of an ASCII character,
+			// one load per character as the state points to the next one
+			if (m_caseInsensitive && c >= 'A' && c <= 'Z')
+				c += 32;
+			const DState * n = d->next[c];
+			++i;
+			if (n)
+			{
+				d = n;
+				continue;
+			}
+		}
+		else
+		{
+			c = decodeUtf8(text, length, i);
+			if (m_caseInsensitive)
+				c = foldCase(c);
+		}
+		s = step(d->id, c);
+		d = m_states[s];
+		// nothing can match any more
+		if (d->pcs.isEmpty())
+			return false;
+	}
+	return true;
+}
+
+bool Regexp::match(const char * text, int length)
+{
+	QMutexLocker locker(&m_mutex);
+	const unsigned char * t = (const unsigned char *)text;
+	if (m_prefix.isEmpty())
+		return run(t, length, 0);
+
+	int at;
+	if (m_anchored)
+	{
+		if (length < m_prefix.size() || memcmp(t, m_prefix.constData(), m_prefix.size()) != 0)
+			return false;
+		at = 0;
+	}
+	else
+	{
+		// every match starts with the prefix
+		at = findBytes(t, length, m_prefix, 0);
+		if (at < 0)
+			return false;
+	}
+	return m_literal ? true : run(t, length, at);
+}
+
+Regexp * Regexp::lookup(const QByteArray & pattern, QString & error)
+{
+	QMutexLocker locker(&s_cacheMutex);
+	for (int i = 0; i < s_cache.size(); ++i)
+	{
+		if (s_cache.at(i)->m_pattern == pattern)
+		{
+			Regexp * re = s_cache.takeAt(i);
+			s_cache.prepend(re);
+			re->ref();
+			return re;
+		}
+	}
+	locker.unlock();
+
+	Regexp * re = compile(pattern, error);
+	if (!re)
+		return 0;
+	locker.relock();
+	// the reference of the cache
+	re->ref();
+	s_cache.prepend(re);
+	if (s_cache.size() > CACHE_SIZE)
+		s_cache.takeLast()->release();
+	return re;
+}
+
+void Regexp::releaseData(void * data)
+{
+	static_cast<Regexp*>(data)->release();
+}
+
+void Regexp::function(sqlite3_context * context, int argc, sqlite3_value ** argv)
+{
+	Q_UNUSED(argc);
+	// X REGEXP Y calls regexp(Y, X)
+	if (sqlite3_value_type(argv[0]) == SQLITE_NULL
+		|| sqlite3_value_type(argv[1]) == SQLITE_NULL)
+	{
+		return;
+	}
+
+	Regexp * re = static_cast<Regexp*>(sqlite3_get_auxdata(context, 0));
+	bool own = (re == 0);
+	if (own)
+	{
+		QString error;
+		const char * pattern = (const char *)sqlite3_value_text(argv[0]);
+		re = lookup(QByteArray(pattern, sqlite3_value_bytes(argv[0])), error);
+		if (!re)
+		{
+			sqlite3_result_error(context, error.toUtf8().constData(), -1);
+			return;
+		}
+	}
+
+	const char * text = (const char *)sqlite3_value_text(argv[1]);
+	sqlite3_result_int(context, re->match(text, sqlite3_value_bytes(argv[1])) ? 1 : 0);
+	// the reference goes to the statement; a constant pattern is kept
+	// there for the next rows
+	if (own)
+		sqlite3_set_auxdata(context, 0, re, Regexp::releaseData);
+}
+
+int Regexp::install(sqlite3 * db)
+{
+	int flags = SQLITE_UTF8;
+#ifdef SQLITE_DETERMINISTIC
+	flags |= SQLITE_DETERMINISTIC;
+#endif
+	return sqlite3_create_function(db, "regexp", 2, flags, 0, Regexp::function, 0, 0);
+}
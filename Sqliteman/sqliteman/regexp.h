@@ -0,0 +1,129 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef REGEXP_H
+#define REGEXP_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+
+#include "sqlite3.h"
+
+
+/*! \brief The regexp(pattern, value) SQL function behind the REGEXP operator.
+SQLite knows the operator but has no function for it unless the ICU
+extension is loaded. Matching runs in time linear to the value: the
+pattern is compiled to an NFA which is turned into DFA states lazily,
+while the values are scanned, so there is no backtracking.
+The syntax is a subset of the ICU/Perl one: alternation, groups,
+greedy and lazy quantifiers including {m,n}, classes with ranges,
+\\d \\w \\s, anchors ^ $ \\b \\B and the (?i) flag at the start.
+Backreferences and lookaround are not supported.
+Compiled patterns are kept as the auxiliary data of the statement and
+in a small LRU cache shared by all statements. A literal prefix of the
+pattern is searched with memchr/memcmp before the DFA starts.
+*/
+class Regexp
+{
+	public:
+		//! \brief Create the regexp() function on db.
+		static int install(sqlite3 * db);
+
+		/*! \brief Compile a pattern.
+		\param error the reason when 0 is returned
+		\retval Regexp a pattern with one reference for the caller
+		*/
+		static Regexp * compile(const QByteArray & pattern, QString & error);
+
+		//! \brief Does the pattern match anywhere in the UTF-8 text?
+		bool match(const char * text, int length);
+
+		void ref();
+		//! \brief Delete when the last reference is released.
+		void release();
+
+	private:
+		struct Inst
+		{
+			int op;
+			uint c;
+			int cls;
+			int x;
+			int y;
+		};
+
+		struct CharClass
+		{
+			//! \brief lo, hi pairs
+			QVector<uint> ranges;
+			bool negated;
+			//! \brief Is c in the ranges (negated is not applied)?
+			bool contains(uint c) const;
+		};
+
+		struct DState
+		{
+			//! \brief Index in m_states
+			int id;
+			QVector<int> pcs;
+			bool prevWord;
+			bool match;
+			//! \brief Does the end of text match: -1 not known yet, 0, 1
+			int endMatch;
+			//! \brief Cached transitions of ASCII characters
+			DState * next[128];
+			QHash<uint,int> other;
+		};
+
+		QByteArray m_pattern;
+		QVector<Inst> m_program;
+		QVector<CharClass> m_classes;
+		bool m_caseInsensitive;
+		//! \brief Every match starts with it (when not case insensitive)
+		QByteArray m_prefix;
+		//! \brief The whole pattern is m_prefix
+		bool m_literal;
+		//! \brief The pattern starts with ^
+		bool m_anchored;
+
+		// the lazy DFA
+		QMutex m_mutex;
+		QVector<DState*> m_states;
+		QHash<QByteArray,int> m_index;
+		int m_start[2][2];
+		QVector<int> m_mark;
+		int m_generation;
+
+		QAtomicInt m_ref;
+
+		Regexp();
+		~Regexp();
+
+		//! \brief A compiled pattern from the LRU cache, compiled when missing.
+		static Regexp * lookup(const QByteArray & pattern, QString & error);
+		//! \brief The SQL function.
+		static void function(sqlite3_context * context, int argc, sqlite3_value ** argv);
+		//! \brief The auxdata destructor.
+		static void releaseData(void * data);
+
+		bool consumes(const Inst & inst, uint c) const;
+		void closure(int pc, QVector<int> & set, bool atStart);
+		void resolve(QVector<int> & set, bool prevWord, bool atEnd, bool nextWord);
+		int state(QVector<int> & set, bool prevWord);
+		int startState(bool atStart, bool prevWord);
+		int step(int s, uint c);
+		bool matchesAtEnd(int s);
+		void clearStates();
+		bool run(const unsigned char * text, int length, int from);
+
+		friend class RegexpParser;
+};
+
+#endif
@@ -0,0 +1,235 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+/*
+Checks of the regexp() engine, see regexptest.pro. Every case of the
+table is matched twice: on a cold DFA and on the cached transitions
+left by the first run. The generated cases below it need more DFA
+states than the cache keeps, so it is dropped while a value is scanned.
+*/
+
+#include <QtDebug>
+#include <QString>
+#include <QVector>
+
+#include "regexp.h"
+
+
+struct RegexpCase
+{
+	const char * pattern;
+	const char * text;
+	//! \brief 1 matches, 0 does not match, -1 the pattern is invalid
+	int expected;
+};
+
+static const RegexpCase cases[] = {
+	// literals, anchors and the literal prefix searched before the DFA
+	{ "abc", "xxabcxx", 1 },
+	{ "abc", "xxabxcx", 0 },
+	{ "^abc", "abcx", 1 },
+	{ "^abc", "xabc", 0 },
+	{ "^abc", "ab", 0 },
+	{ "^abc", "", 0 },
+	{ "abc$", "xabc", 1 },
+	{ "abc$", "abcx", 0 },
+	{ "abc$", "abcabc", 1 },
+	{ "ab[de]", "abcabd", 1 },
+	{ "ab[de]$", "abdabc", 0 },
+	{ "^ab[de]", "xabd", 0 },
+	{ "^ab[de]", "abe", 1 },
+	{ "^ab|cd", "xcd", 1 },
+	{ "^ab|cd", "xab", 0 },
+	{ "^(ab)c", "abc", 1 },
+	{ "ab\\b", "abc ab", 1 },
+	{ "ab\\b", "abc abx", 0 },
+	{ "^ab\\b", "abc", 0 },
+	{ "\\bab", "xab ab", 1 },
+	{ "é$", "café", 1 },
+	{ "^é", "é", 1 },
+	{ "(?i)^ABC", "abcd", 1 },
+	{ "(?i)^ABC", "xabc", 0 },
+	{ "(?i)ABC$", "xabc", 1 },
+	{ "^$", "", 1 },
+	{ "", "abc", 1 },
+	{ "ERROR.*timeout", "2024 ERROR: db timeout", 1 },
+	{ "ERROR.*timeout$", "2024 ERROR: db timeout!", 0 },
+
+	// alternation, groups and quantifiers
+	{ "a|b|c", "zzc", 1 },
+	{ "a(b|c)*d", "abcbcd", 1 },
+	{ "a(b|c)*d", "abcbxd", 0 },
+	{ "^(?:ab)+$", "ababab", 1 },
+	{ "^(?:ab)+$", "ababa", 0 },
+	{ "x{2,3}y", "axxy", 1 },
+	{ "^x{2,3}y", "xy", 0 },
+	{ "^x{2,3}$", "xxxx", 0 },
+	{ "^x{2,}$", "xxxxx", 1 },
+	{ "^x{3}$", "xxx", 1 },
+	{ "a{,3}", "a{,3}", 1 },
+	{ "a+?b", "aab", 1 },
+	{ "^a*?$", "aaa", 1 },
+	{ "^a??b$", "ab", 1 },
+	{ "a*", "", 1 },
+	{ "(a*)*b", "aaaaaaaaaaaaaaaaaaaaaaaaaaaac", 0 },
+
+	// classes and escapes
+	{ "[a-c]+z", "bbz", 1 },
+	{ "[^a-c]z", "az", 0 },
+	{ "[^a-c]z", "dz", 1 },
+	{ "\\d+\\.\\d+", "v1.25", 1 },
+	{ "\\s\\S", "a b", 1 },
+	{ "[\\w-]+@x", "a-b@x", 1 },
+	{ "[[:digit:]]{3}", "ab123", 1 },
+	{ "\\x41", "A", 1 },
+	{ "\\u00e9", "é", 1 },
+	{ "a.c", "abc", 1 },
+	{ "a.c", "a\nc", 0 },
+	{ "h.llo", "hällo", 1 },
+	{ "[é-ê]", "ë", 0 },
+	{ "[é-ê]", "ê", 1 },
+
+	// word boundaries; only ASCII characters are word characters
+	{ "\\bcat\\b", "a cat sat", 1 },
+	{ "\\bcat\\b", "concat", 0 },
+	{ "\\Bcat", "concat", 1 },
+	{ "\\Bcat", "cat", 0 },
+	{ "cat\\b", "cat", 1 },
+	{ "cat\\B", "cats", 1 },
+	{ "x\\b", "xé", 1 },
+
+	// case folding, of other than ASCII characters too
+	{ "(?i)HeLLo", "say hello", 1 },
+	{ "(?i)hello", "SAY HELLO", 1 },
+	{ "(?i)[A-Z]+!", "abc!", 1 },
+	{ "(?i)[^a]", "A", 0 },
+	{ "(?i)é", "É", 1 },
+	{ "(?i)É", "é", 1 },
+	{ "(?i)[à-þ]", "Ü", 1 },
+	{ "(?i)[À-Þ]", "ü", 1 },
+	{ "(?i)Ω", "ω", 1 },
+	{ "é", "É", 0 },
+
+	// ASCII transitions of the fast path next to the others of step()
+	{ "^a.b.c$", "aébçc", 1 },
+	{ "ab", "aéab", 1 },
+	{ "a[^b]c", "aéc", 1 },
+	{ "(?i)aÉb", "xAéB", 1 },
+
+	// invalid patterns
+	{ "(", "x", -1 },
+	{ "a)", "x", -1 },
+	{ "*a", "x", -1 },
+	{ "\\q", "x", -1 },
+	{ "a++", "x", -1 },
+	{ "[a", "x", -1 },
+
+	{ 0, 0, 0 }
+};
+
+
+//! \brief Random characters of alphabet, the same on every run.
+static QVector<uint> randomText(const QVector<uint> & alphabet, int length, uint & seed)
+{
+	QVector<uint> text;
+	for (int i = 0; i < length; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		text.append(alphabet[(seed >> 16) % alphabet.size()]);
+	}
+	return text;
+}
+
+/*! \brief Match texts with the tenth character from the end in first.
+The pattern "X[XY]{9}$" needs about 2^10 DFA states, more than the
+cache keeps.
+*/
+static int checkEviction(const char * pattern, const QVector<uint> & alphabet,
+						 const QVector<uint> & first)
+{
+	int failures = 0;
+	QString error;
+	Regexp * re = Regexp::compile(QByteArray(pattern), error);
+	if (!re)
+	{
+		qDebug() << "FAIL" << pattern << error;
+		return 1;
+	}
+	uint seed = 1;
+	for (int i = 0; i < 200; ++i)
+	{
+		QVector<uint> chars = randomText(alphabet, 2000, seed);
+		QByteArray text = QString::fromUcs4(chars.constData(), chars.size()).toUtf8();
+		bool expected = first.contains(chars[chars.size() - 10]);
+		// the second run follows the transitions cached by the first one
+		for (int run = 0; run < 2; ++run)
+		{
+			if (re->match(text.constData(), text.size()) != expected)
+			{
+				qDebug() << "FAIL" << pattern << "text" << i << "run" << run
+						 << "expected" << expected;
+				++failures;
+			}
+		}
+	}
+	re->release();
+	return failures;
+}
+
+
+int main(int argc, char ** argv)
+{
+	Q_UNUSED(argc);
+	Q_UNUSED(argv);
+
+	int failures = 0;
+	int count = 0;
+	for (const RegexpCase * c = cases; c->pattern; ++c, ++count)
+	{
+		QString error;
+		Regexp * re = Regexp::compile(QByteArray(c->pattern), error);
+		if (!re)
+		{
+			if (c->expected != -1)
+			{
+				qDebug() << "FAIL" << c->pattern << "does not compile:" << error;
+				++failures;
+			}
+			continue;
+		}
+		if (c->expected == -1)
+		{
+			qDebug() << "FAIL" << c->pattern << "compiles";
+			++failures;
+		}
+		for (int run = 0; run < 2; ++run)
+		{
+			int result = re->match(c->text, qstrlen(c->text)) ? 1 : 0;
+			if (c->expected != -1 && result != c->expected)
+			{
+				qDebug() << "FAIL" << c->pattern << c->text << "run" << run
+						 << "got" << result << "expected" << c->expected;
+				++failures;
+			}
+		}
+		re->release();
+	}
+
+	QVector<uint> ab, abCase, aE, a, aCase, aAcute;
+	ab << 'a' << 'b';
+	abCase << 'a' << 'b' << 'A' << 'B';
+	aE << 'a' << 0xE9;
+	a << 'a';
+	aCase << 'a' << 'A';
+	aAcute << 0xE9;
+	failures += checkEviction("a[ab]{9}$", ab, a);
+	failures += checkEviction("(?i)a[ab]{9}$", abCase, aCase);
+	failures += checkEviction("é[aé]{9}$", aE, aAcute);
+
+	qDebug() << count << "cases and 3 generated sets," << failures << "failures";
+	return failures ? 1 : 0;
+}
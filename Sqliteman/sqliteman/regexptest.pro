@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = regexptest
+DEPENDPATH += .
+INCLUDEPATH += . sqlite
+QT -= gui
+LIBS += -lsqlite3
+
+win32:CONFIG += console
+
+# Input
+HEADERS += regexp.h
+SOURCES += regexp.cpp regexptest.cpp
@@ -21,7 +21,7 @@ SchemaBrowser::SchemaBrowser(QWidget * parent, Qt::WindowFlags f)
 	extensionTableView->setModel(m_extensionModel);
 
 #ifndef ENABLE_EXTENSIONS
-	schemaTabWidget->setTabEnabled(2, false);
+	schemaTabWidget->setTabEnabled(schemaTabWidget->indexOf(extensionTab), false);
 #endif
 
 // 	connect(pragmaTable, SIGNAL(currentCellChanged(int, int, int, int)),
@@ -60,6 +60,8 @@ void SchemaBrowser::buildPragmasTree()
 	pragmaTable->setCurrentItem(pragmaTable->item(0, 0));
 	connect(pragmaTable, SIGNAL(currentCellChanged(int, int, int, int)),
 		    this, SLOT(pragmaTable_currentCellChanged(int, int, int, int)));
+
+	storageWidget->databaseChanged();
 }
 
 void SchemaBrowser::addPragma(const QString & name)
@@ -111,5 +113,5 @@ void SchemaBrowser::appendExtensions(const QStringList & list, bool switchToTab)
 	extensionTableView->resizeColumnsToContents();
 
 	if (switchToTab)
-		schemaTabWidget->setCurrentIndex(2);
+		schemaTabWidget->setCurrentWidget(extensionTab);
 }
@@ -21,8 +21,10 @@ for which a new license (GPL+exception) is in place.
 
 #include "createviewdialog.h"
 #include "database.h"
+#include "indexadvisordialog.h"
 #include "preferences.h"
 #include "queryeditordialog.h"
+#include "queryplandialog.h"
 #include "sqleditor.h"
 #include "sqlkeywords.h"
 #include "sqlmodels.h"
@@ -98,6 +100,8 @@ SqlEditor::SqlEditor(LiteManWindow * parent)
             this, SLOT(action_Run_SQL_triggered()));
 	connect(ui.actionRun_Explain, SIGNAL(triggered()),
 			this, SLOT(actionRun_Explain_triggered()));
+	connect(ui.actionIndex_Advisor, SIGNAL(triggered()),
+			this, SLOT(actionIndex_Advisor_triggered()));
 	connect(ui.actionRun_as_Script, SIGNAL(triggered()),
 			this, SLOT(actionRun_as_Script_triggered()));
 	connect(ui.action_Open, SIGNAL(triggered()),
@@ -262,10 +266,29 @@ void SqlEditor::action_Run_SQL_triggered()
 
 void SqlEditor::actionRun_Explain_triggered()
 {
-    QString s("explain query plan %1");
-    s = s.arg(query());
-	emit showSqlResult(s);
-    appendHistory(s);
+	QString sql(query());
+	if (sql.trimmed().isEmpty())
+		return;
+	QueryPlanDialog * dia = new QueryPlanDialog(sql, this);
+	dia->setAttribute(Qt::WA_DeleteOnClose);
+	dia->show();
+	appendHistory(QString("explain query plan %1").arg(sql));
+}
+
+void SqlEditor::actionIndex_Advisor_triggered()
+{
+	QStringList history;
+	for (int i = 0; i < ui.historyTreeWidget->topLevelItemCount(); ++i)
+		history.append(ui.historyTreeWidget->topLevelItem(i)->text(0));
+
+	IndexAdvisorDialog dia(query(), history, creator, this);
+	dia.exec();
+	if (dia.update)
+	{
+		emit buildTree();
+		if (creator)
+			creator->checkForCatalogue();
+	}
 }
 
 void SqlEditor::actionRun_as_Script_triggered()
@@ -288,8 +311,11 @@ void SqlEditor::actionRun_as_Script_triggered()
 	int pos;
 	bool ignore = true;
 
-	QSqlQuery query(QSqlDatabase::database(SESSION_NAME));
+	// statements without a result set are run through a forward-only
+	// query so nothing is cached for them
+	ForwardQuery query;
 	QString sql;
+	QSqlError err;
 	bool isError = false;
 
 	emit sqlScriptStart();
@@ -316,16 +342,29 @@ void SqlEditor::actionRun_as_Script_triggered()
 		{
 			sql = prepareExec(tokens, line, pos);
 			emit showSqlScriptResult(sql);
-			SqlQueryModel * mdl = new SqlQueryModel(creator);
-			mdl->setQuery(sql, QSqlDatabase::database(SESSION_NAME));
+			SqlQueryModel * mdl = 0;
+			if (query.prepare(sql) && !Database::hasResultColumns(query))
+			{
+				query.exec();
+				err = query.lastError();
+			}
+			else if (query.lastError().isValid())
+				err = query.lastError();
+			else
+			{
+				mdl = new SqlQueryModel(creator);
+				mdl->setQuery(sql, QSqlDatabase::database(SESSION_NAME));
+				err = mdl->lastError();
+			}
             appendHistory(sql);
-			if (mdl->lastError().isValid())
+			if (err.isValid())
 			{
+				delete mdl;
 				emit showSqlScriptResult(
-					"-- " + tr("Error: %1.").arg(mdl->lastError().text()));
+					"-- " + tr("Error: %1.").arg(err.text()));
 				int com = QMessageBox::question(this, tr("Run as Script"),
 						tr("This script contains the following error:\n")
-						+ mdl->lastError().text()
+						+ err.text()
 						+ tr("\nAt line: %1").arg(line),
 						QMessageBox::Ignore, QMessageBox::Abort);
 				if (com == QMessageBox::Abort)
@@ -340,7 +379,12 @@ void SqlEditor::actionRun_as_Script_triggered()
 				if (Utils::updateObjectTree(sql)) { rebuildTree = true; }
 				if (Utils::updateTables(sql)) { updateTable = true; }
 				emit showSqlScriptResult("-- " + tr("No error"));
-				if (mdl->rowCount() > 0) { model = mdl; }
+				if (mdl && mdl->rowCount() > 0)
+				{
+					// only the last result set is shown
+					delete model;
+					model = mdl;
+				}
 				else delete mdl;
 			}
 			emit showSqlScriptResult("--");
@@ -106,6 +106,7 @@ class SqlEditor : public QMainWindow
 	private slots:
 		void action_Run_SQL_triggered();
 		void actionRun_Explain_triggered();
+		void actionIndex_Advisor_triggered();
 		void actionRun_as_Script_triggered();
 		void action_Open_triggered();
 		void action_Save_triggered();
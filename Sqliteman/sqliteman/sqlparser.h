@@ -88,9 +88,10 @@ class SqlParser
 	
 		SqlParser(QString input);
 		static QString defaultToken(FieldInfo &f);
+		// also used to scan general statements (see IndexAdvisorDialog)
+		static QList<Token> tokenise(QString input);
 
 	private:
-		QList<Token> tokenise(QString input);
 		void clearField(FieldInfo &f);
 		void addToPrimaryKey(QString s);
 };
@@ -0,0 +1,196 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QHelpEvent>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QToolTip>
+
+#include "storagetreemap.h"
+
+
+StorageTreemap::StorageTreemap(QWidget * parent)
+	: QWidget(parent),
+	  m_current(-1)
+{
+}
+
+QSize StorageTreemap::sizeHint() const
+{
+	return QSize(200, 150);
+}
+
+void StorageTreemap::setItems(const QList<Item> & items)
+{
+	m_items = items;
+	m_current = -1;
+	layoutItems();
+	update();
+}
+
+void StorageTreemap::setCurrentItem(int index)
+{
+	m_current = index;
+	update();
+}
+
+double StorageTreemap::worstRatio(double sum, double smallest, double largest,
+								  double side)
+{
+	double side2 = side * side;
+	double sum2 = sum * sum;
+	return qMax(side2 * largest / sum2, sum2 / (side2 * smallest));
+}
+
+void StorageTreemap::layoutItems()
+{
+	m_rects.clear();
+	for (int i = 0; i < m_items.count(); ++i)
+		m_rects.append(QRectF());
+
+	// the largest items go first
+	QList<int> order;
+	double total = 0;
+	for (int i = 0; i < m_items.count(); ++i)
+	{
+		if (m_items.at(i).size <= 0)
+			continue;
+		int pos = 0;
+		while (pos < order.count()
+			   && m_items.at(order.at(pos)).size >= m_items.at(i).size)
+			++pos;
+		order.insert(pos, i);
+		total += m_items.at(i).size;
+	}
+
+	QRectF rect(contentsRect());
+	int next = 0;
+	while (next < order.count() && total > 0
+		   && rect.width() > 0 && rect.height() > 0)
+	{
+		double scale = rect.width() * rect.height() / total;
+		double side = qMin(rect.width(), rect.height());
+
+		// grow the row while its rectangles get closer to squares
+		int end = next;
+		double sum = 0;
+		double smallest = 0;
+		double largest = 0;
+		double worst = 0;
+		while (end < order.count())
+		{
+			double area = m_items.at(order.at(end)).size * scale;
+			double newSmallest = (end == next) ? area : qMin(smallest, area);
+			double newLargest = (end == next) ? area : qMax(largest, area);
+			double ratio = worstRatio(sum + area, newSmallest, newLargest, side);
+			if (end > next && ratio > worst)
+				break;
+			sum += area;
+			smallest = newSmallest;
+			largest = newLargest;
+			worst = ratio;
+			++end;
+		}
+
+		// lay the row along the shorter side and cut it off the rest
+		double thickness = sum / side;
+		double offset = 0;
+		bool vertical = rect.width() >= rect.height();
+		for (int i = next; i < end; ++i)
+		{
+			double length = m_items.at(order.at(i)).size * scale / thickness;
+			if (vertical)
+				m_rects[order.at(i)] = QRectF(rect.left(), rect.top() + offset,
+											  thickness, length);
+			else
+				m_rects[order.at(i)] = QRectF(rect.left() + offset, rect.top(),
+											  length, thickness);
+			offset += length;
+		}
+		if (vertical)
+			rect.setLeft(rect.left() + thickness);
+		else
+			rect.setTop(rect.top() + thickness);
+		total -= sum / scale;
+		next = end;
+	}
+}
+
+int StorageTreemap::itemAt(const QPoint & pos) const
+{
+	for (int i = 0; i < m_rects.count(); ++i)
+	{
+		if (m_rects.at(i).contains(pos))
+			return i;
+	}
+	return -1;
+}
+
+void StorageTreemap::paintEvent(QPaintEvent * /*event*/)
+{
+	QPainter painter(this);
+	painter.fillRect(contentsRect(), palette().color(QPalette::Base));
+	for (int i = 0; i < m_rects.count(); ++i)
+	{
+		QRectF r(m_rects.at(i));
+		if (r.isEmpty())
+			continue;
+		painter.setPen(palette().color(QPalette::Dark));
+		painter.setBrush(m_items.at(i).color);
+		painter.drawRect(r);
+
+		// a name only where it fits
+		QRectF textRect(r.adjusted(2, 1, -2, -1));
+		QFontMetrics fm(painter.font());
+		if (textRect.height() >= fm.height() && textRect.width() >= fm.width("..."))
+		{
+			painter.setPen(Qt::black);
+			painter.drawText(textRect, Qt::AlignLeft | Qt::AlignTop,
+							 fm.elidedText(m_items.at(i).name, Qt::ElideRight,
+										   (int)textRect.width()));
+		}
+	}
+	if (m_current >= 0 && m_current < m_rects.count()
+		&& !m_rects.at(m_current).isEmpty())
+	{
+		painter.setPen(QPen(palette().color(QPalette::Highlight), 3));
+		painter.setBrush(Qt::NoBrush);
+		painter.drawRect(m_rects.at(m_current).adjusted(1, 1, -1, -1));
+	}
+}
+
+void StorageTreemap::resizeEvent(QResizeEvent * event)
+{
+	layoutItems();
+	QWidget::resizeEvent(event);
+}
+
+void StorageTreemap::mousePressEvent(QMouseEvent * event)
+{
+	int index = itemAt(event->pos());
+	if (index >= 0)
+	{
+		setCurrentItem(index);
+		emit itemClicked(index);
+	}
+	QWidget::mousePressEvent(event);
+}
+
+bool StorageTreemap::event(QEvent * event)
+{
+	if (event->type() == QEvent::ToolTip)
+	{
+		QHelpEvent * help = static_cast<QHelpEvent*>(event);
+		int index = itemAt(help->pos());
+		if (index >= 0)
+			QToolTip::showText(help->globalPos(), m_items.at(index).toolTip, this);
+		else
+			QToolTip::hideText();
+		return true;
+	}
+	return QWidget::event(event);
+}
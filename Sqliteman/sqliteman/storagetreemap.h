@@ -0,0 +1,71 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef STORAGETREEMAP_H
+#define STORAGETREEMAP_H
+
+#include <QColor>
+#include <QList>
+#include <QRectF>
+#include <QWidget>
+
+
+/*! \brief A squarified treemap of sizes.
+Every item is drawn as a rectangle with an area proportional to its
+size. The layout keeps the rectangles close to squares so even small
+items stay visible.
+*/
+class StorageTreemap : public QWidget
+{
+	Q_OBJECT
+
+	public:
+		struct Item
+		{
+			QString name;
+			qlonglong size;
+			QColor color;
+			QString toolTip;
+		};
+
+		StorageTreemap(QWidget * parent = 0);
+
+		void setItems(const QList<Item> & items);
+		//! \brief Highlight an item, -1 for none.
+		void setCurrentItem(int index);
+
+		QSize sizeHint() const;
+
+	signals:
+		//! \brief An item has been clicked. index is its position in setItems().
+		void itemClicked(int index);
+
+	protected:
+		void paintEvent(QPaintEvent * event);
+		void resizeEvent(QResizeEvent * event);
+		void mousePressEvent(QMouseEvent * event);
+		bool event(QEvent * event);
+
+	private:
+		QList<Item> m_items;
+		//! \brief The rectangles of m_items; empty ones are not drawn.
+		QList<QRectF> m_rects;
+		int m_current;
+
+		void layoutItems();
+		int itemAt(const QPoint & pos) const;
+		/*! \brief The worst aspect ratio of a row of rectangles.
+		\param sum the area of the row
+		\param smallest the smallest area in the row
+		\param largest the largest area in the row
+		\param side the length of the side the row is laid along
+		*/
+		static double worstRatio(double sum, double smallest, double largest,
+								 double side);
+};
+
+#endif
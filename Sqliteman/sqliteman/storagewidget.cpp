@@ -0,0 +1,737 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSet>
+
+#include "storagewidget.h"
+#include "database.h"
+#include "regexp.h"
+#include "utils.h"
+
+// storageTree columns
+#define COL_NAME 0
+#define COL_PAGES 1
+#define COL_BYTES 2
+#define COL_PERCENT 3
+#define COL_PAYLOAD 4
+#define COL_UNUSED 5
+#define COL_FILL 6
+#define COL_OVERFLOW 7
+#define COL_FANOUT 8
+#define COL_ENTRIES 9
+#define COL_TABLE 10
+
+
+// big-endian integers and varints of the database file format
+static int get2byte(const QByteArray & data, int offset)
+{
+	return ((uchar)data.at(offset) << 8) | (uchar)data.at(offset + 1);
+}
+
+static quint32 get4byte(const QByteArray & data, int offset)
+{
+	return ((quint32)(uchar)data.at(offset) << 24)
+		   | ((quint32)(uchar)data.at(offset + 1) << 16)
+		   | ((quint32)(uchar)data.at(offset + 2) << 8)
+		   | (quint32)(uchar)data.at(offset + 3);
+}
+
+static int getVarint(const QByteArray & data, int offset, qlonglong & value)
+{
+	value = 0;
+	for (int i = 0; i < 9 && offset + i < data.size(); ++i)
+	{
+		uchar c = data.at(offset + i);
+		if (i == 8)
+		{
+			value = (value << 8) | c;
+			return 9;
+		}
+		value = (value << 7) | (c & 0x7f);
+		if (!(c & 0x80))
+			return i + 1;
+	}
+	return 9;
+}
+
+/* A private in-memory copy of the main database of source. In-memory
+databases cannot be opened by another connection and the shared one
+must not be used from the thread. */
+static sqlite3 * copyDatabase(sqlite3 * source, QString & error)
+{
+	sqlite3 * db = 0;
+	if (sqlite3_open(":memory:", &db) != SQLITE_OK)
+	{
+		error = QString::fromUtf8(sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return 0;
+	}
+	sqlite3_backup * backup = sqlite3_backup_init(db, "main", source, "main");
+	int rc = SQLITE_ERROR;
+	if (backup)
+	{
+		sqlite3_backup_step(backup, -1);
+		rc = sqlite3_backup_finish(backup);
+	}
+	if (rc != SQLITE_OK)
+	{
+		error = QString::fromUtf8(sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return 0;
+	}
+	Regexp::install(db);
+	return db;
+}
+
+static bool intPragma(sqlite3 * db, const char * sql, int & value)
+{
+	sqlite3_stmt * stmt = 0;
+	bool ok = sqlite3_prepare_v2(db, sql, -1, &stmt, 0) == SQLITE_OK
+			  && sqlite3_step(stmt) == SQLITE_ROW;
+	if (ok)
+		value = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+	return ok;
+}
+
+
+StorageInfo::StorageInfo()
+	: interiorPages(0),
+	  leafPages(0),
+	  overflowPages(0),
+	  entries(0),
+	  children(0),
+	  payload(0),
+	  unused(0),
+	  bytes(0)
+{
+}
+
+double StorageInfo::fanout() const
+{
+	return interiorPages ? (double)children / interiorPages : 0.0;
+}
+
+double StorageInfo::fill() const
+{
+	return bytes ? 100.0 * (bytes - unused) / bytes : 0.0;
+}
+
+
+StorageThread::StorageThread(const QString & fileName, sqlite3 * connection,
+							 QObject * parent)
+	: QThread(parent),
+	  m_fileName(fileName),
+	  m_connection(connection),
+	  m_cancelled(false),
+	  m_walker(false),
+	  m_pageCount(0),
+	  m_pagesDone(0),
+	  m_wal(false),
+	  m_pageSize(0),
+	  m_usableSize(0)
+{
+}
+
+void StorageThread::cancel()
+{
+	m_cancelled = true;
+}
+
+int StorageThread::progressHandler(void * thread)
+{
+	// non-zero interrupts the statement
+	return static_cast<StorageThread*>(thread)->m_cancelled ? 1 : 0;
+}
+
+void StorageThread::pageDone()
+{
+	++m_pagesDone;
+	if (m_lastProgress.elapsed() >= 200)
+	{
+		m_lastProgress.restart();
+		emit progress(m_pagesDone, m_pageCount);
+	}
+}
+
+void StorageThread::run()
+{
+	sqlite3 * db = m_connection;
+	if (!db)
+	{
+		QByteArray name(QDir::toNativeSeparators(m_fileName).toUtf8());
+		if (sqlite3_open_v2(name.constData(), &db, SQLITE_OPEN_READONLY, 0) != SQLITE_OK)
+		{
+			m_error = QString::fromUtf8(sqlite3_errmsg(db));
+			sqlite3_close(db);
+			return;
+		}
+		sqlite3_busy_timeout(db, 5000);
+		Regexp::install(db);
+	}
+	m_lastProgress.start();
+
+	// one read transaction; the page walker needs a file nobody commits to
+	bool began = (sqlite3_exec(db, "BEGIN;", 0, 0, 0) == SQLITE_OK);
+	QMap<QString,int> roots;
+	if (readSchema(db, roots))
+	{
+		sqlite3_progress_handler(db, 1000, StorageThread::progressHandler, this);
+		if (!readDbstat(db) && m_error.isEmpty() && !m_cancelled)
+		{
+			m_walker = true;
+			walk(roots);
+		}
+		sqlite3_progress_handler(db, 0, 0, 0);
+	}
+	if (began)
+		sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+
+	// the copy of an in-memory database is ours as well
+	sqlite3_close(db);
+	m_connection = 0;
+}
+
+bool StorageThread::readSchema(sqlite3 * db, QMap<QString,int> & roots)
+{
+	int freePages = 0;
+	if (!intPragma(db, "PRAGMA main.page_count;", m_pageCount)
+		|| !intPragma(db, "PRAGMA main.page_size;", m_pageSize)
+		|| !intPragma(db, "PRAGMA main.freelist_count;", freePages))
+	{
+		m_error = QString::fromUtf8(sqlite3_errmsg(db));
+		return false;
+	}
+
+	sqlite3_stmt * stmt = 0;
+	if (sqlite3_prepare_v2(db, "PRAGMA main.journal_mode;", -1, &stmt, 0) == SQLITE_OK
+		&& sqlite3_step(stmt) == SQLITE_ROW)
+		m_wal = qstricmp((const char*)sqlite3_column_text(stmt, 0), "wal") == 0;
+	sqlite3_finalize(stmt);
+
+	StorageInfo master;
+	master.name = "sqlite_master";
+	master.table = master.name;
+	master.type = "table";
+	m_index[master.name] = m_objects.count();
+	m_objects.append(master);
+	roots[master.name] = 1;
+
+	int rc = sqlite3_prepare_v2(db,
+					"SELECT name, tbl_name, type, rootpage FROM main.sqlite_master "
+					"WHERE rootpage > 0;", -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		{
+			StorageInfo info;
+			info.name = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0));
+			info.table = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 1));
+			info.type = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 2));
+			m_index[info.name] = m_objects.count();
+			m_objects.append(info);
+			roots[info.name] = sqlite3_column_int(stmt, 3);
+		}
+	}
+	if (rc != SQLITE_DONE)
+		m_error = QString::fromUtf8(sqlite3_errmsg(db));
+	sqlite3_finalize(stmt);
+
+	StorageInfo freelist;
+	freelist.name = tr("(free pages)");
+	freelist.leafPages = freePages;
+	freelist.bytes = (qlonglong)freePages * m_pageSize;
+	freelist.unused = freelist.bytes;
+	m_objects.append(freelist);
+
+	return rc == SQLITE_DONE;
+}
+
+bool StorageThread::readDbstat(sqlite3 * db)
+{
+	sqlite3_stmt * stmt = 0;
+	// sqlite built without SQLITE_ENABLE_DBSTAT_VTAB; not an error
+	if (sqlite3_prepare_v2(db, "SELECT name, pagetype, ncell, payload, unused, pgsize "
+							   "FROM dbstat;", -1, &stmt, 0) != SQLITE_OK)
+	{
+		sqlite3_finalize(stmt);
+		return false;
+	}
+
+	int rc;
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		QString name(QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0)));
+		if (!m_index.contains(name))
+		{
+			StorageInfo info;
+			info.name = name;
+			info.table = name;
+			m_index[name] = m_objects.count();
+			m_objects.append(info);
+		}
+		StorageInfo & info = m_objects[m_index[name]];
+
+		QByteArray type((const char*)sqlite3_column_text(stmt, 1));
+		int cells = sqlite3_column_int(stmt, 2);
+		if (type == "internal")
+		{
+			++info.interiorPages;
+			info.children += cells + 1;
+		}
+		else if (type == "leaf")
+		{
+			++info.leafPages;
+			info.entries += cells;
+		}
+		else
+			++info.overflowPages;
+		info.payload += sqlite3_column_int64(stmt, 3);
+		info.unused += sqlite3_column_int64(stmt, 4);
+		info.bytes += sqlite3_column_int64(stmt, 5);
+		pageDone();
+	}
+	if (rc != SQLITE_DONE && !m_cancelled)
+		m_error = QString::fromUtf8(sqlite3_errmsg(db));
+	sqlite3_finalize(stmt);
+	return rc == SQLITE_DONE;
+}
+
+bool StorageThread::walk(const QMap<QString,int> & roots)
+{
+	if (!QFileInfo(m_fileName).isFile())
+	{
+		m_error = tr("The dbstat virtual table is not available and the database is not a file.");
+		return false;
+	}
+	// committed pages can still be in the WAL file only
+	if (m_wal)
+	{
+		m_error = tr("The dbstat virtual table is not available and the pages "
+					 "of a database in WAL mode cannot be read from its file.");
+		return false;
+	}
+
+	m_file.setFileName(m_fileName);
+	if (!m_file.open(QIODevice::ReadOnly))
+	{
+		m_error = m_file.errorString();
+		return false;
+	}
+	QByteArray header(m_file.read(100));
+	if (header.size() < 100)
+	{
+		m_error = tr("Cannot read the database header.");
+		m_file.close();
+		return false;
+	}
+	m_pageSize = get2byte(header, 16);
+	if (m_pageSize == 1)
+		m_pageSize = 65536;
+	m_usableSize = m_pageSize - (uchar)header.at(20);
+
+	bool ok = true;
+	QMapIterator<QString,int> it(roots);
+	while (ok && it.hasNext() && !m_cancelled)
+	{
+		it.next();
+		ok = walkTree(it.value(), m_objects[m_index[it.key()]]);
+	}
+	m_file.close();
+	return ok;
+}
+
+bool StorageThread::readPage(quint32 pgno)
+{
+	if (pgno < 1 || pgno > (quint32)m_pageCount)
+	{
+		m_error = tr("Page %1 is out of the database. The database is corrupted.")
+				  .arg(pgno);
+		return false;
+	}
+	m_page.clear();
+	if (m_file.seek((qint64)(pgno - 1) * m_pageSize))
+		m_page = m_file.read(m_pageSize);
+	if (m_page.size() != m_pageSize)
+	{
+		m_error = tr("Cannot read page %1.").arg(pgno);
+		return false;
+	}
+	return true;
+}
+
+bool StorageThread::walkTree(quint32 root, StorageInfo & info)
+{
+	QList<quint32> stack;
+	QSet<quint32> visited;
+	stack.append(root);
+	while (!stack.isEmpty() && !m_cancelled)
+	{
+		quint32 pgno = stack.takeLast();
+		if (visited.contains(pgno))
+		{
+			m_error = tr("Page %1 is used twice. The database is corrupted.").arg(pgno);
+			return false;
+		}
+		visited.insert(pgno);
+		if (!readPage(pgno))
+			return false;
+		// overflow pages of the cells are read into m_page later
+		QByteArray page(m_page);
+
+		// the first page starts with the database header
+		int hdr = (pgno == 1) ? 100 : 0;
+		int type = (uchar)page.at(hdr);
+		if (type != 2 && type != 5 && type != 10 && type != 13)
+		{
+			m_error = tr("Page %1 is not a b-tree page. The database is corrupted.")
+					  .arg(pgno);
+			return false;
+		}
+		bool interior = (type == 2 || type == 5);
+		int cells = get2byte(page, hdr + 3);
+		int content = get2byte(page, hdr + 5);
+		if (content == 0)
+			content = 65536;
+		int cellArray = hdr + (interior ? 12 : 8);
+		if (cellArray + 2 * cells > m_usableSize || content < cellArray + 2 * cells)
+		{
+			m_error = tr("Page %1 has a broken header. The database is corrupted.")
+					  .arg(pgno);
+			return false;
+		}
+
+		// unused: the gap, the fragments and the freeblocks
+		qlonglong unused = content - (cellArray + 2 * cells) + (uchar)page.at(hdr + 7);
+		int freeblock = get2byte(page, hdr + 1);
+		for (int guard = 0; freeblock > 0 && freeblock + 4 <= m_usableSize
+							&& guard < m_usableSize / 4; ++guard)
+		{
+			unused += get2byte(page, freeblock + 2);
+			freeblock = get2byte(page, freeblock);
+		}
+		info.unused += unused;
+		info.bytes += m_pageSize;
+		if (interior)
+		{
+			++info.interiorPages;
+			info.children += cells + 1;
+			stack.append(get4byte(page, hdr + 8));
+		}
+		else
+		{
+			++info.leafPages;
+			info.entries += cells;
+		}
+		pageDone();
+
+		for (int i = 0; i < cells; ++i)
+		{
+			int cell = get2byte(page, cellArray + 2 * i);
+			if (cell < cellArray + 2 * cells || cell + 4 > m_usableSize)
+			{
+				m_error = tr("Page %1 has a broken cell. The database is corrupted.")
+						  .arg(pgno);
+				return false;
+			}
+			if (interior)
+			{
+				stack.append(get4byte(page, cell));
+				cell += 4;
+			}
+			// interior table cells hold a rowid only
+			if (type != 5 && !walkPayload(page, cell, type == 13, info))
+				return false;
+		}
+	}
+	return true;
+}
+
+bool StorageThread::walkPayload(const QByteArray & page, int cell, bool tableLeaf,
+								StorageInfo & info)
+{
+	qlonglong size;
+	cell += getVarint(page, cell, size);
+	if (tableLeaf)
+	{
+		qlonglong rowid;
+		cell += getVarint(page, cell, rowid);
+	}
+	info.payload += size;
+
+	// the part of the payload stored on the b-tree page itself
+	qlonglong usable = m_usableSize;
+	qlonglong maxLocal = tableLeaf ? usable - 35 : ((usable - 12) * 64 / 255) - 23;
+	qlonglong minLocal = ((usable - 12) * 32 / 255) - 23;
+	qlonglong local = size;
+	if (size > maxLocal)
+	{
+		local = minLocal + (size - minLocal) % (usable - 4);
+		if (local > maxLocal)
+			local = minLocal;
+	}
+	if (local == size)
+		return true;
+
+	if (cell + local + 4 > m_usableSize)
+	{
+		m_error = tr("A cell overflows its page. The database is corrupted.");
+		return false;
+	}
+	quint32 next = get4byte(page, cell + local);
+	qlonglong remaining = size - local;
+	while (next && remaining > 0 && !m_cancelled)
+	{
+		if (!readPage(next))
+			return false;
+		qlonglong onPage = qMin(remaining, usable - 4);
+		++info.overflowPages;
+		info.bytes += m_pageSize;
+		info.unused += usable - 4 - onPage;
+		remaining -= onPage;
+		next = get4byte(m_page, 0);
+		pageDone();
+	}
+	return true;
+}
+
+
+QMap<QString,StorageWidget::Report> StorageWidget::m_cache;
+
+StorageWidget::StorageWidget(QWidget * parent)
+	: QWidget(parent),
+	  m_thread(0)
+{
+	setupUi(this);
+	setRunning(false);
+
+	connect(analyzeButton, SIGNAL(clicked()),
+			this, SLOT(analyzeButton_clicked()));
+	connect(cancelButton, SIGNAL(clicked()),
+			this, SLOT(cancelButton_clicked()));
+	connect(storageTree, SIGNAL(itemSelectionChanged()),
+			this, SLOT(storageTree_itemSelectionChanged()));
+	connect(treemap, SIGNAL(itemClicked(int)),
+			this, SLOT(treemap_itemClicked(int)));
+}
+
+StorageWidget::~StorageWidget()
+{
+	cancel();
+}
+
+QString StorageWidget::fileStamp(const QString & fileName)
+{
+	QFileInfo db(fileName);
+	QFileInfo wal(fileName + "-wal");
+	return QString("%1 %2 %3 %4")
+			.arg(db.size()).arg(db.lastModified().toString(Qt::ISODate))
+			.arg(wal.exists() ? wal.size() : -1)
+			.arg(wal.exists() ? wal.lastModified().toString(Qt::ISODate) : QString());
+}
+
+void StorageWidget::databaseChanged()
+{
+	// the report of the running analysis is shown when it is done
+	if (m_thread)
+		return;
+	m_fileName = Database::getDatabases().value("main");
+	m_objects.clear();
+	storageTree->clear();
+	treemap->setItems(QList<StorageTreemap::Item>());
+
+	QFileInfo fi(m_fileName);
+	QString key(fi.absoluteFilePath());
+	if (fi.isFile() && m_cache.contains(key)
+		&& m_cache[key].stamp == fileStamp(m_fileName))
+		showReport(m_cache[key]);
+	else
+		statusLabel->setText(tr("Press Analyze to compute the storage report."));
+}
+
+void StorageWidget::cancel()
+{
+	if (!m_thread)
+		return;
+	m_thread->cancel();
+	m_thread->wait();
+	thread_finished();
+}
+
+void StorageWidget::setRunning(bool running)
+{
+	analyzeButton->setEnabled(!running);
+	cancelButton->setEnabled(running);
+	progressBar->setVisible(running);
+}
+
+void StorageWidget::analyzeButton_clicked()
+{
+	m_fileName = Database::getDatabases().value("main");
+	// in-memory databases have no file for the own connection
+	sqlite3 * connection = 0;
+	if (!QFileInfo(m_fileName).isFile())
+	{
+		sqlite3 * session = Database::sqlite3handle();
+		if (!session)
+			return;
+		QString error;
+		connection = copyDatabase(session, error);
+		if (!connection)
+		{
+			statusLabel->setText(tr("Error while analyzing the storage")
+								 + ":<br/><span style=\" color:#ff0000;\">"
+								 + error + "<br/></span>");
+			return;
+		}
+	}
+	m_stamp = fileStamp(m_fileName);
+
+	m_thread = new StorageThread(m_fileName, connection, this);
+	connect(m_thread, SIGNAL(progress(int, int)),
+			this, SLOT(thread_progress(int, int)));
+	connect(m_thread, SIGNAL(finished()),
+			this, SLOT(thread_finished()));
+
+	progressBar->setValue(0);
+	statusLabel->setText(tr("Analyzing..."));
+	setRunning(true);
+	m_thread->start();
+}
+
+void StorageWidget::cancelButton_clicked()
+{
+	if (m_thread)
+		m_thread->cancel();
+}
+
+void StorageWidget::thread_progress(int pages, int pageCount)
+{
+	if (!m_thread)
+		return;
+	progressBar->setMaximum(qMax(pageCount, 1));
+	progressBar->setValue(qMin(pages, pageCount));
+}
+
+void StorageWidget::thread_finished()
+{
+	// already handled by cancel()
+	if (!m_thread)
+		return;
+	QString error(m_thread->error());
+	bool cancelled = m_thread->isCancelled();
+	Report report;
+	report.stamp = m_stamp;
+	report.computed = QDateTime::currentDateTime();
+	report.walker = m_thread->usedPageWalker();
+	report.objects = m_thread->objects();
+	m_thread->deleteLater();
+	m_thread = 0;
+	setRunning(false);
+
+	if (!error.isEmpty())
+	{
+		statusLabel->setText(tr("Error while analyzing the storage")
+							 + ":<br/><span style=\" color:#ff0000;\">"
+							 + error + "<br/></span>");
+		return;
+	}
+	if (cancelled)
+	{
+		statusLabel->setText(tr("Stopped."));
+		return;
+	}
+
+	QFileInfo fi(m_fileName);
+	if (fi.isFile())
+		m_cache[fi.absoluteFilePath()] = report;
+	showReport(report);
+}
+
+void StorageWidget::showReport(const Report & report)
+{
+	m_objects = report.objects;
+	qlonglong total = 0;
+	foreach (StorageInfo info, m_objects)
+		total += info.bytes;
+
+	QList<StorageTreemap::Item> items;
+	storageTree->setSortingEnabled(false);
+	storageTree->clear();
+	for (int i = 0; i < m_objects.count(); ++i)
+	{
+		const StorageInfo & info = m_objects.at(i);
+		double percent = total ? 100.0 * info.bytes / total : 0.0;
+
+		QTreeWidgetItem * item = new QTreeWidgetItem(storageTree);
+		item->setText(COL_NAME, info.name);
+		item->setData(COL_NAME, Qt::UserRole, i);
+		item->setData(COL_PAGES, Qt::DisplayRole, info.pages());
+		item->setData(COL_BYTES, Qt::DisplayRole, info.bytes);
+		item->setData(COL_PERCENT, Qt::DisplayRole, qRound(percent * 10) / 10.0);
+		item->setData(COL_PAYLOAD, Qt::DisplayRole, info.payload);
+		item->setData(COL_UNUSED, Qt::DisplayRole, info.unused);
+		item->setData(COL_FILL, Qt::DisplayRole, qRound(info.fill() * 10) / 10.0);
+		item->setData(COL_OVERFLOW, Qt::DisplayRole, info.overflowPages);
+		item->setData(COL_FANOUT, Qt::DisplayRole, qRound(info.fanout() * 10) / 10.0);
+		item->setData(COL_ENTRIES, Qt::DisplayRole, info.entries);
+		item->setText(COL_TABLE, info.table);
+
+		// tables blue, indexes green, free pages grey; emptier is lighter
+		StorageTreemap::Item box;
+		box.name = info.name;
+		box.size = info.bytes;
+		if (info.type == "table")
+			box.color = QColor(120, 160, 220);
+		else if (info.type == "index")
+			box.color = QColor(130, 200, 130);
+		else
+			box.color = QColor(190, 190, 190);
+		box.color = box.color.lighter(100 + qRound((100.0 - info.fill()) * 0.6));
+		box.toolTip = tr("%1\n%2 pages, %3 (%4 % of the file)\n"
+						 "fill %5 %, %6 overflow pages")
+						.arg(info.name).arg(info.pages())
+						.arg(Utils::formatSize(info.bytes))
+						.arg(percent, 0, 'f', 1)
+						.arg(info.fill(), 0, 'f', 1)
+						.arg(info.overflowPages);
+		items.append(box);
+	}
+	storageTree->setSortingEnabled(true);
+	storageTree->sortByColumn(COL_BYTES, Qt::DescendingOrder);
+	for (int i = 0; i < storageTree->columnCount(); ++i)
+		storageTree->resizeColumnToContents(i);
+	treemap->setItems(items);
+
+	statusLabel->setText(tr("%1 in %2 objects. Computed %3 from %4.")
+						 .arg(Utils::formatSize(total))
+						 .arg(m_objects.count())
+						 .arg(report.computed.toString(Qt::DefaultLocaleShortDate))
+						 .arg(report.walker ? tr("the database file") : tr("dbstat")));
+}
+
+void StorageWidget::storageTree_itemSelectionChanged()
+{
+	QTreeWidgetItem * item = storageTree->currentItem();
+	treemap->setCurrentItem(item ? item->data(COL_NAME, Qt::UserRole).toInt() : -1);
+}
+
+void StorageWidget::treemap_itemClicked(int index)
+{
+	for (int i = 0; i < storageTree->topLevelItemCount(); ++i)
+	{
+		QTreeWidgetItem * item = storageTree->topLevelItem(i);
+		if (item->data(COL_NAME, Qt::UserRole).toInt() == index)
+		{
+			storageTree->setCurrentItem(item);
+			storageTree->scrollToItem(item);
+			break;
+		}
+	}
+}
@@ -0,0 +1,174 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef STORAGEWIDGET_H
+#define STORAGEWIDGET_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QMap>
+#include <QThread>
+#include <QTime>
+#include <QWidget>
+
+#include "sqlite3.h"
+#include "ui_storagewidget.h"
+
+
+//! \brief Space used by one table or index b-tree.
+struct StorageInfo
+{
+	StorageInfo();
+
+	QString name;
+	//! \brief The table of an index, the name of a table.
+	QString table;
+	//! \brief "table", "index" or empty for the free pages.
+	QString type;
+	qlonglong interiorPages;
+	qlonglong leafPages;
+	qlonglong overflowPages;
+	//! \brief Rows of a table, entries of an index.
+	qlonglong entries;
+	//! \brief Child pointers of the interior pages.
+	qlonglong children;
+	qlonglong payload;
+	qlonglong unused;
+	qlonglong bytes;
+
+	qlonglong pages() const { return interiorPages + leafPages + overflowPages; };
+	//! \brief Children per interior page, 0 for a b-tree of one page.
+	double fanout() const;
+	//! \brief Used bytes of the pages in percent.
+	double fill() const;
+};
+
+
+/*! \brief Collect StorageInfo of all b-trees of the main database.
+It reads the dbstat virtual table. When sqlite is built without it, the
+pages are read from the database file and the b-trees are walked here.
+*/
+class StorageThread : public QThread
+{
+	Q_OBJECT
+
+	public:
+		/*!
+		\param fileName the main database file
+		\param connection a private copy of the database, to use when
+		       fileName is not a file (in-memory databases). The thread
+		       closes it.
+		\param parent standard Qt parent
+		*/
+		StorageThread(const QString & fileName, sqlite3 * connection,
+					  QObject * parent = 0);
+
+		//! \brief An error message, empty on success or when cancelled.
+		QString error() const { return m_error; };
+		bool isCancelled() const { return m_cancelled; };
+		QList<StorageInfo> objects() const { return m_objects; };
+		//! \brief True when dbstat has not been available.
+		bool usedPageWalker() const { return m_walker; };
+
+	public slots:
+		void cancel();
+
+	signals:
+		void progress(int pages, int pageCount);
+
+	protected:
+		void run();
+
+	private:
+		QString m_fileName;
+		sqlite3 * m_connection;
+		QString m_error;
+		volatile bool m_cancelled;
+		bool m_walker;
+		QList<StorageInfo> m_objects;
+		//! \brief b-tree name -> its position in m_objects
+		QMap<QString,int> m_index;
+		int m_pageCount;
+		int m_pagesDone;
+		QTime m_lastProgress;
+
+		// the page walker
+		bool m_wal;
+		QFile m_file;
+		int m_pageSize;
+		int m_usableSize;
+		QByteArray m_page;
+
+		static int progressHandler(void * thread);
+		void pageDone();
+		bool readSchema(sqlite3 * db, QMap<QString,int> & roots);
+		bool readDbstat(sqlite3 * db);
+		bool walk(const QMap<QString,int> & roots);
+		bool readPage(quint32 pgno);
+		//! \brief Walk one b-tree; return false on I/O errors or corrupted pages.
+		bool walkTree(quint32 root, StorageInfo & info);
+		/*! \brief Account the payload of one cell and follow its overflow chain.
+		\param page the b-tree page
+		\param cell offset of the payload size in page
+		\param tableLeaf the cell is a table leaf cell (with a rowid)
+		*/
+		bool walkPayload(const QByteArray & page, int cell, bool tableLeaf,
+						 StorageInfo & info);
+};
+
+
+/*! \brief Storage report of the main database.
+It shows how the pages of the file are used by every table and index
+as a sortable list and as a treemap. Reports are computed by
+a StorageThread and cached for every file until the file changes.
+*/
+class StorageWidget : public QWidget, public Ui::StorageWidget
+{
+	Q_OBJECT
+
+	public:
+		StorageWidget(QWidget * parent = 0);
+		~StorageWidget();
+
+		//! \brief Show the cached report of the main database, if there is one.
+		void databaseChanged();
+		//! \brief Stop a running analysis. It is needed before the database is closed.
+		void cancel();
+
+	private:
+		struct Report
+		{
+			//! \brief File size and times when the report was computed.
+			QString stamp;
+			QDateTime computed;
+			bool walker;
+			QList<StorageInfo> objects;
+		};
+		//! \brief Absolute file name -> its last report
+		static QMap<QString,Report> m_cache;
+
+		QString m_fileName;
+		//! \brief fileStamp() of the file when the running analysis started
+		QString m_stamp;
+		StorageThread * m_thread;
+		QList<StorageInfo> m_objects;
+
+		//! \brief Size and modification time of the file and its WAL.
+		static QString fileStamp(const QString & fileName);
+		void showReport(const Report & report);
+		void setRunning(bool running);
+
+	private slots:
+		void analyzeButton_clicked();
+		void cancelButton_clicked();
+		void storageTree_itemSelectionChanged();
+		void treemap_itemClicked(int index);
+		void thread_progress(int pages, int pageCount);
+		void thread_finished();
+};
+
+#endif
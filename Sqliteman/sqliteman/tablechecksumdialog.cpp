@@ -0,0 +1,166 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#include <QApplication>
+#include <QSettings>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <QTime>
+
+#include "tablechecksumdialog.h"
+#include "datacomparedialog.h"
+#include "database.h"
+#include "utils.h"
+
+// resultTree columns
+#define COL_DATABASE 0
+#define COL_ROWS 1
+#define COL_CHECKSUM 2
+#define COL_TIME 3
+
+
+TableChecksumDialog::TableChecksumDialog(QWidget * parent)
+	: QDialog(parent)
+{
+	ui.setupUi(this);
+	QSettings settings("yarpen.cz", "sqliteman");
+	int hh = settings.value("tablechecksum/height", QVariant(320)).toInt();
+	int ww = settings.value("tablechecksum/width", QVariant(560)).toInt();
+	resize(ww, hh);
+	ui.rowidCheckBox->setChecked(settings.value("tablechecksum/rowid",
+								 QVariant(false)).toBool());
+
+	QStringList databases(Database::getDatabases().keys());
+	ui.databaseComboBox->addItems(databases);
+	ui.otherComboBox->addItems(databases);
+	ui.databaseComboBox->setCurrentIndex(databases.indexOf("main"));
+	// the first attached database is the most likely copy
+	foreach (QString schema, databases)
+	{
+		if (schema != "main" && schema != "temp")
+		{
+			ui.otherComboBox->setCurrentIndex(databases.indexOf(schema));
+			break;
+		}
+	}
+	databaseComboBox_activated(ui.databaseComboBox->currentText());
+
+	if (databases.count() < 2)
+		ui.statusLabel->setText(tr("Attach the database with the copy of the table first."));
+
+	connect(ui.databaseComboBox, SIGNAL(activated(const QString &)),
+			this, SLOT(databaseComboBox_activated(const QString &)));
+	connect(ui.compareButton, SIGNAL(clicked()), this, SLOT(compareButton_clicked()));
+}
+
+TableChecksumDialog::~TableChecksumDialog()
+{
+	QSettings settings("yarpen.cz", "sqliteman");
+	settings.setValue("tablechecksum/height", QVariant(height()));
+	settings.setValue("tablechecksum/width", QVariant(width()));
+	settings.setValue("tablechecksum/rowid", QVariant(ui.rowidCheckBox->isChecked()));
+}
+
+void TableChecksumDialog::databaseComboBox_activated(const QString & schema)
+{
+	QString current(ui.tableComboBox->currentText());
+	QStringList tables(Database::getObjects("table", schema).keys());
+	tables.sort();
+	ui.tableComboBox->clear();
+	ui.tableComboBox->addItems(tables);
+	if (tables.contains(current))
+		ui.tableComboBox->setCurrentIndex(tables.indexOf(current));
+}
+
+bool TableChecksumDialog::checksum(const QString & schema, const QString & table,
+								   const QStringList & columns, qint64 & rows,
+								   qint64 & hash, QString & error)
+{
+	ForwardQuery query(
+				QString("SELECT count(*), table_hash(%1) FROM %2.%3;")
+				.arg(columns.join(", "))
+				.arg(Utils::quote(schema))
+				.arg(Utils::quote(table)));
+	if (query.lastError().isValid() || !query.next())
+	{
+		error = query.lastError().text();
+		return false;
+	}
+	rows = query.value(0).toLongLong();
+	hash = query.value(1).toLongLong();
+	return true;
+}
+
+void TableChecksumDialog::compareButton_clicked()
+{
+	QString table(ui.tableComboBox->currentText());
+	QStringList schemas;
+	schemas << ui.databaseComboBox->currentText() << ui.otherComboBox->currentText();
+	ui.resultTree->clear();
+	if (table.isEmpty())
+		return;
+	if (schemas.at(0) == schemas.at(1))
+	{
+		ui.statusLabel->setText(tr("Choose two different databases."));
+		return;
+	}
+
+	QStringList names;
+	bool integerKey;
+	QString error;
+	if (!DataCompareDialog::commonColumns(schemas.at(0), schemas.at(1), table,
+										  names, integerKey, error))
+	{
+		ui.statusLabel->setText(error);
+		return;
+	}
+
+	QStringList hashed;
+	if (ui.rowidCheckBox->isChecked() && !integerKey)
+		hashed.append("rowid");
+	foreach (QString name, names)
+		hashed.append(Utils::quote(name));
+
+	QList<qint64> rows;
+	QList<qint64> hashes;
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	foreach (QString schema, schemas)
+	{
+		ui.statusLabel->setText(tr("Reading %1.%2...").arg(schema).arg(table));
+		qApp->processEvents(QEventLoop::ExcludeUserInputEvents);
+
+		qint64 count;
+		qint64 hash;
+		QTime time;
+		time.start();
+		if (!checksum(schema, table, hashed, count, hash, error))
+		{
+			QApplication::restoreOverrideCursor();
+			ui.statusLabel->setText(tr("Cannot read %1.%2: %3").arg(schema).arg(table).arg(error));
+			return;
+		}
+		QTreeWidgetItem * item = new QTreeWidgetItem(ui.resultTree);
+		item->setText(COL_DATABASE, schema);
+		item->setData(COL_ROWS, Qt::DisplayRole, count);
+		item->setText(COL_CHECKSUM, QString("%1").arg((quint64)hash, 16, 16, QChar('0')));
+		item->setText(COL_TIME, tr("%1 s").arg(time.elapsed() / 1000.0, 0, 'f', 3));
+		rows.append(count);
+		hashes.append(hash);
+	}
+	QApplication::restoreOverrideCursor();
+	for (int i = 0; i < ui.resultTree->columnCount(); ++i)
+		ui.resultTree->resizeColumnToContents(i);
+
+	if (hashes.at(0) == hashes.at(1))
+		ui.statusLabel->setText(tr("The tables are equal."));
+	else if (rows.at(0) != rows.at(1))
+		ui.statusLabel->setText(tr("The tables differ: %1 has %2 rows more.")
+								.arg(rows.at(0) > rows.at(1) ? schemas.at(0) : schemas.at(1))
+								.arg(qAbs(rows.at(0) - rows.at(1))));
+	else
+		ui.statusLabel->setText(tr("The tables differ in the values of some rows."));
+}
@@ -0,0 +1,46 @@
+/*
+For general Sqliteman copyright and licensing information please refer
+to the COPYING file provided with the program. Following this notice may exist
+a copyright and/or license notice that predates the release of Sqliteman
+for which a new license (GPL+exception) is in place.
+*/
+
+#ifndef TABLECHECKSUMDIALOG_H
+#define TABLECHECKSUMDIALOG_H
+
+#include <qdialog.h>
+#include <QStringList>
+
+#include "ui_tablechecksumdialog.h"
+
+
+/*! \brief Compare a table in two attached databases by checksums.
+Each side is read in one pass by the table_hash() aggregate of the built
+in xxhash extension (extensions/xxhash.c). It combines the hashes of the
+rows commutatively, so the checksums do not depend on the order of the
+rows in the files, and only the row count and the checksum are returned.
+*/
+class TableChecksumDialog : public QDialog
+{
+	Q_OBJECT
+
+	public:
+		TableChecksumDialog(QWidget * parent = 0);
+		~TableChecksumDialog();
+
+	private:
+		Ui::TableChecksumDialog ui;
+
+		/*! \brief Count and hash the rows of table in schema.
+		\retval false on an error, with the reason in error
+		*/
+		bool checksum(const QString & schema, const QString & table,
+					  const QStringList & columns, qint64 & rows,
+					  qint64 & hash, QString & error);
+
+	private slots:
+		void databaseComboBox_activated(const QString & schema);
+		void compareButton_clicked();
+};
+
+#endif
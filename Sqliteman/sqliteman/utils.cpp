@@ -114,6 +114,22 @@ QString Utils::like(QString s)
 		   + "%' ESCAPE '@'";
 }
 
+QString Utils::formatSize(qulonglong size)
+{
+	QString rval;
+
+	if(size < 1024)
+		rval = QString("%L1 B").arg(size);
+	else if(size < 1024*1024)
+		rval = QString("%L1 KB").arg(size/1024);
+	else if(size < 1024*1024*1024)
+		rval = QString("%L1 MB").arg(double(size)/1024.0/1024.0, 0, 'f', 1);
+	else
+		rval = QString("%L1 GB").arg(double(size)/1024.0/1024.0/1024.0, 0, 'f', 1);
+
+	return rval;
+}
+
 // debugging hacks
 void Utils::dump(QString s) { qDebug("%s", s.toUtf8().data()); }
 void Utils::dump(QItemSelection selection)
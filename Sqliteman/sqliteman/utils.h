@@ -49,6 +49,11 @@ QString unQuote(QString s);
 
 QString like(QString s);
 
+/*! \brief Format a size in bytes to the human readable form.
+It's taken from FatRat http://fatrat.dolezel.info/. Cheers!
+*/
+QString formatSize(qulonglong size);
+
 //debugging hacks
 void dump(QString s);
 void dump(QItemSelection selection);
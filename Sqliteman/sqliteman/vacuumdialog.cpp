@@ -5,14 +5,238 @@ a copyright and/or license notice that predates the release of Sqliteman
 for which a new license (GPL+exception) is in place.
 */
 
+#include <QDir>
+#include <QFile>
+#include <QFileDialog>
+#include <QMessageBox>
 #include <QSettings>
 
 #include "vacuumdialog.h"
 #include "database.h"
+#include "regexp.h"
 #include "utils.h"
 
+
+VacuumThread::VacuumThread(sqlite3 * connection, Mode mode,
+						   const QString & fileName, int stepTime, int pause,
+						   QObject * parent)
+	: QThread(parent),
+	  m_connection(connection),
+	  m_mode(mode),
+	  m_fileName(fileName),
+	  m_stepTime(stepTime),
+	  m_pause(pause),
+	  m_reclaimed(0),
+	  m_steps(0),
+	  m_cancelled(false)
+{
+}
+
+void VacuumThread::cancel()
+{
+	m_cancelled = true;
+}
+
+int VacuumThread::progressHandler(void * thread)
+{
+	VacuumThread * self = static_cast<VacuumThread*>(thread);
+	++self->m_steps;
+	if (self->m_lastProgress.elapsed() >= 250)
+	{
+		self->m_lastProgress.restart();
+		emit self->progress(self->m_steps, 0);
+	}
+	// non-zero interrupts the statement
+	return self->m_cancelled ? 1 : 0;
+}
+
+bool VacuumThread::exec(sqlite3 * db, const QString & sql)
+{
+	char * errmsg = 0;
+	if (sqlite3_exec(db, sql.toUtf8().constData(), 0, 0, &errmsg) != SQLITE_OK)
+	{
+		m_error = QString::fromUtf8(errmsg ? errmsg : sqlite3_errmsg(db));
+		sqlite3_free(errmsg);
+		return false;
+	}
+	return true;
+}
+
+bool VacuumThread::pragmaInt(sqlite3 * db, const char * sql, int & value)
+{
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+		rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW)
+		value = sqlite3_column_int(stmt, 0);
+	else
+		m_error = QString::fromUtf8(sqlite3_errmsg(db));
+	sqlite3_finalize(stmt);
+	return rc == SQLITE_ROW;
+}
+
+void VacuumThread::run()
+{
+	switch (m_mode)
+	{
+		case Reclaim:
+			reclaim();
+			break;
+		case EnableIncremental:
+		{
+			int mode;
+			if (!pragmaInt(m_connection, "PRAGMA main.auto_vacuum;", mode)
+				|| !exec(m_connection, "PRAGMA main.auto_vacuum = INCREMENTAL;"))
+				break;
+			// NONE -> INCREMENTAL takes effect with the next VACUUM only
+			if (mode == 0)
+				rebuild(m_connection, "VACUUM;");
+			break;
+		}
+		case Rebuild:
+			rebuild(m_connection, "VACUUM;");
+			break;
+		case RebuildInto:
+			rebuildInto();
+			break;
+	}
+}
+
+bool VacuumThread::reclaim()
+{
+	emit stageChanged(Reclaiming);
+	int mode;
+	if (!pragmaInt(m_connection, "PRAGMA main.auto_vacuum;", mode))
+		return false;
+	if (mode != 2)
+	{
+		m_error = tr("Auto vacuum of the database is not INCREMENTAL.");
+		return false;
+	}
+
+	int remaining;
+	if (!pragmaInt(m_connection, "PRAGMA main.freelist_count;", remaining))
+		return false;
+	int total = remaining;
+	emit progress(0, total);
+
+	// the pages released in one step (and one write transaction)
+	// follow the step time
+	int pages = 64;
+	QTime time;
+	while (remaining > 0 && !m_cancelled)
+	{
+		time.start();
+		if (!exec(m_connection, QString("PRAGMA main.incremental_vacuum(%1);")
+								.arg(pages)))
+			return false;
+		int elapsed = time.elapsed();
+
+		int left;
+		if (!pragmaInt(m_connection, "PRAGMA main.freelist_count;", left))
+			return false;
+		if (left < remaining)
+			m_reclaimed += remaining - left;
+		remaining = left;
+		// other connections may free pages in the meantime
+		total = qMax(total, m_reclaimed + remaining);
+		emit progress(m_reclaimed, total);
+
+		if (elapsed < m_stepTime / 2 && pages < (1 << 20))
+			pages *= 2;
+		else if (elapsed > m_stepTime && pages > 1)
+			pages /= 2;
+		if (remaining > 0)
+			msleep(m_pause);
+	}
+	return true;
+}
+
+bool VacuumThread::rebuild(sqlite3 * db, const char * sql,
+						   const QString & fileName)
+{
+	emit stageChanged(Rebuilding);
+	emit progress(0, 0);
+
+	sqlite3_stmt * stmt = 0;
+	int rc = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
+	if (rc == SQLITE_OK)
+	{
+		if (!fileName.isNull())
+		{
+			QByteArray name(QDir::toNativeSeparators(fileName).toUtf8());
+			sqlite3_bind_text(stmt, 1, name.constData(), -1, SQLITE_TRANSIENT);
+		}
+		m_steps = 0;
+		m_lastProgress.start();
+		sqlite3_progress_handler(db, 10000, VacuumThread::progressHandler, this);
+		rc = sqlite3_step(stmt);
+		sqlite3_progress_handler(db, 0, 0, 0);
+	}
+	if (rc == SQLITE_DONE)
+		// stopped too late, the statement is complete
+		m_cancelled = false;
+	else if (!m_cancelled)
+		m_error = QString::fromUtf8(sqlite3_errmsg(db));
+	sqlite3_finalize(stmt);
+	return rc == SQLITE_DONE;
+}
+
+bool VacuumThread::rebuildInto()
+{
+	if (sqlite3_libversion_number() >= 3027000)
+		return rebuild(m_connection, "VACUUM main INTO ?;", m_fileName);
+
+	// VACUUM INTO is not available. The database is copied by the backup
+	// API and the copy is vacuumed; the open database is only read.
+	emit stageChanged(Copying);
+	sqlite3 * file = 0;
+	QByteArray name(QDir::toNativeSeparators(m_fileName).toUtf8());
+	if (sqlite3_open_v2(name.constData(), &file,
+						SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, 0) != SQLITE_OK)
+	{
+		m_error = QString::fromUtf8(sqlite3_errmsg(file));
+		sqlite3_close(file);
+		return false;
+	}
+	// VACUUM computes the index expressions again
+	Regexp::install(file);
+	sqlite3_backup * backup = sqlite3_backup_init(file, "main", m_connection, "main");
+	if (!backup)
+	{
+		m_error = QString::fromUtf8(sqlite3_errmsg(file));
+		sqlite3_close(file);
+		return false;
+	}
+
+	int rc;
+	do
+	{
+		rc = sqlite3_backup_step(backup, 1024);
+		int pageCount = sqlite3_backup_pagecount(backup);
+		emit progress(pageCount - sqlite3_backup_remaining(backup), pageCount);
+		if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED)
+			msleep(m_pause);
+	}
+	while (!m_cancelled && (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED));
+	sqlite3_backup_finish(backup);
+
+	bool ok = (rc == SQLITE_DONE);
+	if (!ok && !m_cancelled)
+		m_error = QString::fromUtf8(sqlite3_errstr(rc));
+	if (ok)
+		ok = rebuild(file, "VACUUM;");
+	sqlite3_close(file);
+	return ok;
+}
+
+
 VacuumDialog::VacuumDialog(LiteManWindow * parent)
-	: QDialog(parent)
+	: QDialog(parent),
+	  m_thread(0),
+	  m_mode(VacuumThread::Rebuild),
+	  m_autoVacuum(0)
 {
 	creator = parent;
 	ui.setupUi(this);
@@ -20,40 +244,263 @@ VacuumDialog::VacuumDialog(LiteManWindow * parent)
 	int hh = settings.value("vacuum/height", QVariant(500)).toInt();
 	int ww = settings.value("vacuum/width", QVariant(600)).toInt();
 	resize(ww, hh);
+	ui.stepTimeSpinBox->setValue(settings.value("vacuum/steptime",
+									QVariant(ui.stepTimeSpinBox->value())).toInt());
+	ui.pauseSpinBox->setValue(settings.value("vacuum/pause",
+									QVariant(ui.pauseSpinBox->value())).toInt());
 
-	ui.tableList->addItems(Database::getObjects("table").values());
-	ui.tableList->addItems(Database::getObjects("index").values());
+	setRunning(false);
+	refresh();
 
+	connect(ui.refreshButton, SIGNAL(clicked()), this, SLOT(refreshButton_clicked()));
+	connect(ui.enableButton, SIGNAL(clicked()), this, SLOT(enableButton_clicked()));
+	connect(ui.reclaimButton, SIGNAL(clicked()), this, SLOT(reclaimButton_clicked()));
 	connect(ui.allButton, SIGNAL(clicked()), this, SLOT(allButton_clicked()));
-	connect(ui.tableButton, SIGNAL(clicked()), this, SLOT(tableButton_clicked()));
+	connect(ui.intoButton, SIGNAL(clicked()), this, SLOT(intoButton_clicked()));
+	connect(ui.cancelButton, SIGNAL(clicked()), this, SLOT(cancelButton_clicked()));
 }
 
 VacuumDialog::~VacuumDialog()
 {
+	if (m_thread)
+	{
+		m_thread->cancel();
+		m_thread->wait();
+	}
 	QSettings settings("yarpen.cz", "sqliteman");
     settings.setValue("vacuum/height", QVariant(height()));
     settings.setValue("vacuum/width", QVariant(width()));
+	settings.setValue("vacuum/steptime", QVariant(ui.stepTimeSpinBox->value()));
+	settings.setValue("vacuum/pause", QVariant(ui.pauseSpinBox->value()));
+}
+
+void VacuumDialog::refresh()
+{
+	qulonglong pageSize = Database::pragma("page_size").toULongLong();
+	qulonglong pageCount = Database::pragma("page_count").toULongLong();
+	qulonglong freePages = Database::pragma("freelist_count").toULongLong();
+	m_autoVacuum = Database::pragma("auto_vacuum").toInt();
+
+	ui.pageSizeValue->setText(Utils::formatSize(pageSize));
+	ui.pageCountValue->setText(QString("%L1 (%2)").arg(pageCount)
+							   .arg(Utils::formatSize(pageCount * pageSize)));
+	ui.freePagesValue->setText(QString("%L1").arg(freePages));
+	ui.reclaimableValue->setText(Utils::formatSize(freePages * pageSize));
+	switch (m_autoVacuum)
+	{
+		case 1:
+			ui.autoVacuumValue->setText(tr("Full"));
+			break;
+		case 2:
+			ui.autoVacuumValue->setText(tr("Incremental"));
+			break;
+		default:
+			ui.autoVacuumValue->setText(tr("None"));
+	}
+
+	ui.enableButton->setEnabled(m_autoVacuum != 2);
+	ui.reclaimButton->setEnabled(m_autoVacuum == 2 && freePages > 0);
+}
+
+void VacuumDialog::setRunning(bool running)
+{
+	ui.refreshButton->setEnabled(!running);
+	ui.incrementalGroupBox->setEnabled(!running);
+	ui.rebuildGroupBox->setEnabled(!running);
+	ui.cancelButton->setEnabled(running);
+}
+
+void VacuumDialog::start(VacuumThread::Mode mode)
+{
+	if (!creator || !creator->checkForPending())
+		return;
+	// the grid statements would stop VACUUM
+	if (mode != VacuumThread::Reclaim)
+		emit aboutToRebuild();
+
+	sqlite3 * connection = Database::sqlite3handle();
+	if (!connection)
+		return;
+
+	m_mode = mode;
+	m_thread = new VacuumThread(connection, mode, m_fileName,
+								ui.stepTimeSpinBox->value(),
+								ui.pauseSpinBox->value(), this);
+	connect(m_thread, SIGNAL(stageChanged(int)),
+			this, SLOT(thread_stageChanged(int)));
+	connect(m_thread, SIGNAL(progress(int, int)),
+			this, SLOT(thread_progress(int, int)));
+	connect(m_thread, SIGNAL(finished()),
+			this, SLOT(thread_finished()));
+
+	ui.progressBar->setRange(0, 100);
+	ui.progressBar->setValue(0);
+	ui.statusLabel->clear();
+	setRunning(true);
+	m_time.start();
+	m_thread->start();
+}
+
+void VacuumDialog::refreshButton_clicked()
+{
+	refresh();
+}
+
+void VacuumDialog::enableButton_clicked()
+{
+	if (m_autoVacuum == 0)
+	{
+		int ret = QMessageBox::question(this, tr("Enable Incremental Vacuum"),
+						tr("The database has to be rebuilt by VACUUM to enable "
+						   "the incremental vacuum.\n\nDo you want to continue?"),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+	}
+	start(VacuumThread::EnableIncremental);
+}
+
+void VacuumDialog::reclaimButton_clicked()
+{
+	start(VacuumThread::Reclaim);
 }
 
 void VacuumDialog::allButton_clicked()
 {
-	if (creator && creator->checkForPending())
+	start(VacuumThread::Rebuild);
+}
+
+void VacuumDialog::intoButton_clicked()
+{
+	QString fileName = QFileDialog::getSaveFileName(this, tr("Vacuum into"),
+													QDir::currentPath(),
+													tr("SQLite database (*)"));
+	if (fileName.isNull())
+		return;
+	// VACUUM INTO needs a new file; the dialog has asked to overwrite it
+	if (QFile::exists(fileName) && !QFile::remove(fileName))
 	{
-		Database::execSql("vacuum;");
+		ui.statusLabel->setText(tr("Cannot remove file %1.").arg(fileName));
+		return;
 	}
+	m_fileName = fileName;
+	start(VacuumThread::RebuildInto);
 }
 
-void VacuumDialog::tableButton_clicked()
+void VacuumDialog::cancelButton_clicked()
 {
-	QList<QListWidgetItem *> list(ui.tableList->selectedItems());
-	if (creator && creator->checkForPending())
+	if (m_thread)
+		m_thread->cancel();
+}
+
+void VacuumDialog::thread_stageChanged(int stage)
+{
+	switch (stage)
 	{
-		for (int i = 0; i < list.size(); ++i)
-		{
-			if (!Database::execSql(QString("vacuum %1;")
-								   .arg(Utils::quote(list.at(i)->text()))))
-				break;
-		}
+		case VacuumThread::Reclaiming:
+			m_stageText = tr("Releasing free pages...");
+			break;
+		case VacuumThread::Copying:
+			m_stageText = tr("Copying the database...");
+			break;
+		default:
+			m_stageText = tr("Rebuilding the database...");
+	}
+	ui.statusLabel->setText(m_stageText);
+}
+
+void VacuumDialog::thread_progress(int done, int total)
+{
+	if (!m_thread)
+		return;
+	QString elapsed(QString::number(m_time.elapsed() / 1000.0, 'f', 1));
+	if (total > 0)
+	{
+		ui.progressBar->setRange(0, total);
+		ui.progressBar->setValue(done);
+		ui.statusLabel->setText(tr("%1 %2 of %3 pages, %4 s")
+								.arg(m_stageText).arg(done).arg(total)
+								.arg(elapsed));
+	}
+	else
+	{
+		// a busy indicator; the length of a rebuild is not known
+		ui.progressBar->setRange(0, 0);
+		ui.statusLabel->setText(tr("%1 %2 s").arg(m_stageText).arg(elapsed));
+	}
+}
+
+void VacuumDialog::thread_finished()
+{
+	// already handled by reject()
+	if (!m_thread)
+		return;
+	QString error(m_thread->error());
+	bool cancelled = m_thread->isCancelled();
+	int reclaimed = m_thread->reclaimed();
+	m_thread->deleteLater();
+	m_thread = 0;
+
+	bool ok = error.isEmpty() && !cancelled;
+	ui.progressBar->setRange(0, 1);
+	ui.progressBar->setValue(ok ? 1 : 0);
+	setRunning(false);
+	refresh();
+
+	if (!ok && m_mode == VacuumThread::RebuildInto)
+		QFile::remove(m_fileName);
+
+	QString seconds(QString::number(m_time.elapsed() / 1000.0, 'f', 1));
+	if (!error.isEmpty())
+	{
+		ui.statusLabel->setText(tr("Error while vacuuming the database")
+								+ ":<br/><span style=\" color:#ff0000;\">"
+								+ error + "<br/></span>");
+		return;
+	}
+	if (cancelled)
+	{
+		// every incremental step is committed on its own
+		if (m_mode == VacuumThread::Reclaim)
+			ui.statusLabel->setText(tr("Stopped. %1 pages have been released.")
+									.arg(reclaimed));
+		else
+			ui.statusLabel->setText(tr("Cancelled. Nothing has been changed."));
+		return;
+	}
+
+	switch (m_mode)
+	{
+		case VacuumThread::Reclaim:
+			ui.statusLabel->setText(tr("%1 pages released in %2 s.")
+									.arg(reclaimed).arg(seconds));
+			break;
+		case VacuumThread::EnableIncremental:
+			ui.statusLabel->setText(tr("Incremental vacuum enabled in %1 s.")
+									.arg(seconds));
+			break;
+		case VacuumThread::Rebuild:
+			ui.statusLabel->setText(tr("Vacuumed in %1 s.").arg(seconds));
+			break;
+		case VacuumThread::RebuildInto:
+			ui.statusLabel->setText(tr("Written into %1 in %2 s.")
+									.arg(m_fileName).arg(seconds));
+			break;
 	}
 }
 
+void VacuumDialog::reject()
+{
+	if (m_thread)
+	{
+		int ret = QMessageBox::question(this, windowTitle(),
+						tr("The vacuum is still running. Do you want to stop it?"),
+						QMessageBox::Yes, QMessageBox::No);
+		if (ret != QMessageBox::Yes)
+			return;
+		m_thread->cancel();
+		m_thread->wait();
+		thread_finished();
+	}
+	QDialog::reject();
+}
@@ -9,12 +9,103 @@ for which a new license (GPL+exception) is in place.
 #define VACUUMDIALOG_H
 
 #include <qdialog.h>
+#include <QThread>
+#include <QTime>
 
 #include "litemanwindow.h"
+#include "sqlite3.h"
 #include "ui_vacuumdialog.h"
 
+
+/*! \brief VACUUM and incremental vacuum running out of the GUI thread.
+A rebuild (VACUUM, VACUUM INTO) is one long statement. It reports its
+progress and can be stopped through sqlite3_progress_handler().
+The incremental vacuum releases the free pages in short steps.
+*/
+class VacuumThread : public QThread
+{
+	Q_OBJECT
+
+	public:
+		enum Mode {
+			//! \brief PRAGMA incremental_vacuum until the freelist is empty
+			Reclaim,
+			//! \brief Set auto_vacuum to INCREMENTAL, rebuild when it is needed
+			EnableIncremental,
+			//! \brief VACUUM in place
+			Rebuild,
+			//! \brief Write a vacuumed copy into a new file
+			RebuildInto
+		};
+
+		enum Stage {
+			Reclaiming,
+			Copying,
+			Rebuilding
+		};
+
+		/*! \brief Prepare a job. It is started by start().
+		\param connection the open connection ("main" is vacuumed)
+		\param mode what to do
+		\param fileName the target file of RebuildInto
+		\param stepTime the time in ms one incremental step should take
+		\param pause ms to sleep between the incremental steps
+		\param parent standard Qt parent
+		*/
+		VacuumThread(sqlite3 * connection, Mode mode, const QString & fileName,
+					 int stepTime, int pause, QObject * parent = 0);
+
+		//! \brief An error message, empty on success or when cancelled.
+		QString error() const { return m_error; };
+		bool isCancelled() const { return m_cancelled; };
+		//! \brief Pages released by the incremental vacuum.
+		int reclaimed() const { return m_reclaimed; };
+
+	public slots:
+		//! \brief Stop as soon as possible. A rebuild is rolled back.
+		void cancel();
+
+	signals:
+		void stageChanged(int stage);
+		/*! \brief Progress of the current stage.
+		A rebuild does not know its total. It sends 0 as total.
+		*/
+		void progress(int done, int total);
+
+	protected:
+		void run();
+
+	private:
+		sqlite3 * m_connection;
+		Mode m_mode;
+		QString m_fileName;
+		int m_stepTime;
+		int m_pause;
+		int m_reclaimed;
+		int m_steps;
+		QTime m_lastProgress;
+		QString m_error;
+		volatile bool m_cancelled;
+
+		static int progressHandler(void * thread);
+		//! \brief Run a statement without results. Sets m_error when it fails.
+		bool exec(sqlite3 * db, const QString & sql);
+		//! \brief Read an integer PRAGMA. Sets m_error when it fails.
+		bool pragmaInt(sqlite3 * db, const char * sql, int & value);
+		bool reclaim();
+		/*! \brief Run one rebuilding statement under the progress handler.
+		\param fileName bound as its first parameter when it is not null
+		*/
+		bool rebuild(sqlite3 * db, const char * sql,
+					 const QString & fileName = QString());
+		bool rebuildInto();
+};
+
+
 /*! \brief Handle DB file (un)used space.
-Sqlite3 offers VACUUM option for its internal data structures.
+It shows the free pages of the main database. They are released
+step by step by an incremental vacuum or by a rebuild of the whole file
+with VACUUM. All of them run in a VacuumThread.
 \author Petr Vanek <petr@scribus.info>
  */
 class VacuumDialog : public QDialog
@@ -25,6 +116,10 @@ class VacuumDialog : public QDialog
 		VacuumDialog(LiteManWindow * parent = 0);
 		~VacuumDialog();
 
+	signals:
+		//! \brief Emitted before a rebuild. Open statements would block it.
+		void aboutToRebuild();
+
 	private:
 		Ui::VacuumDialog ui;
 
@@ -32,9 +127,29 @@ class VacuumDialog : public QDialog
 		// qobject_cast<LiteManWindow*>(parent()) doesn't work
 		LiteManWindow * creator;
 
+		VacuumThread * m_thread;
+		VacuumThread::Mode m_mode;
+		QTime m_time;
+		QString m_stageText;
+		QString m_fileName;
+		//! \brief The value of PRAGMA auto_vacuum (0 none, 1 full, 2 incremental)
+		int m_autoVacuum;
+
+		void refresh();
+		void setRunning(bool running);
+		void start(VacuumThread::Mode mode);
+
     private slots:
+		void refreshButton_clicked();
+		void enableButton_clicked();
+		void reclaimButton_clicked();
 		void allButton_clicked();
-		void tableButton_clicked();
+		void intoButton_clicked();
+		void cancelButton_clicked();
+		void thread_stageChanged(int stage);
+		void thread_progress(int done, int total);
+		void thread_finished();
+		void reject();
 };
 
 #endif